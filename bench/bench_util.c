@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2026 Moritz Grimm <mgrimm@mrsserver.net>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * bench_util: micro-benchmarks for the string functions that run on every
+ * track change and metadata update.
+ *
+ *     bench_util [-t msecs] [filter]
+ *
+ * Each case runs for about the given time (default: 200 ms), and its
+ * average time and number of xalloc allocations per call are reported.
+ * Only cases whose names contain the filter string are run.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "compat.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cfg.h"
+#include "log.h"
+#include "mdata.h"
+#include "util.h"
+#include "xalloc.h"
+
+struct bench_case {
+	const char	*name;
+	void		(*func)(const void *);
+	const void	*arg;
+};
+
+static const char	title_ja[] =
+    "\xe3\x81\x93\xe3\x82\x8c\xe3\x81\xaf\xe3\x83\x86\xe3\x82\xb9\xe3\x83\x88"
+    "\xe3\x81\xa7\xe3\x81\x99\xe3\x80\x82\xe6\x9d\xb1\xe4\xba\xac\xe3\x81\xae"
+    "\xe5\xa4\x9c\xe3\x81\xab\xe6\xad\x8c\xe3\x81\x86\xe3\x80\x81\xe9\x95\xb7"
+    "\xe3\x81\x84\xe9\x95\xb7\xe3\x81\x84\xe6\x9b\xb2\xe3\x81\xae\xe3\x82\xbf"
+    "\xe3\x82\xa4\xe3\x83\x88\xe3\x83\xab (Live at Budokan, Remastered 2026)";
+static const char	title_ar[] =
+    "\xd9\x87\xd8\xb0\xd8\xa7 \xd8\xa7\xd8\xae\xd8\xaa\xd8\xa8\xd8\xa7\xd8\xb1 "
+    "\xd9\x84\xd8\xb9\xd9\x86\xd9\x88\xd8\xa7\xd9\x86 \xd8\xb7\xd9\x88\xd9\x8a"
+    "\xd9\x84 \xd8\xac\xd8\xaf\xd8\xa7 \xd9\x85\xd9\x86 \xd8\xa3\xd8\xba\xd9\x86"
+    "\xd9\x8a\xd8\xa9 \xd8\xb9\xd8\xb1\xd8\xa8\xd9\x8a\xd8\xa9 - \xd8\xa7\xd9"
+    "\x84\xd9\x86\xd8\xb3\xd8\xae\xd8\xa9 \xd8\xa7\xd9\x84\xd9\x83\xd8\xa7\xd9"
+    "\x85\xd9\x84\xd8\xa9";
+static const char	title_ascii[] =
+    "Artist's Name - A Rather Long Track Title (Extended Club Mix) [2026]";
+static const char	long_path[] =
+    "/srv/media/music/library/Various Artists/The Greatest Hits Collection "
+    "Volume 12 (Deluxe Edition)/Disc 2/07 - Don't Stop 'Til You Get "
+    "Enough (Original 12'' Version).ogg";
+static const char	placeholders[] =
+    "encoder --artist @a@ --album @b@ --title @t@ --track @T@ "
+    "--comment @s@ --meta @M@ --artist-sort @a@ --title-sort @t@";
+static const char	mdata_format[] =
+    "@a@ - @t@ [@b@] (@s@) @T@";
+
+static unsigned int	run_msecs = 200;
+static mdata_t		md;
+static util_template_t	tmpl;
+static util_template_t	mdata_tmpl;
+static xarena_t 	arena;
+static volatile size_t	sink;
+
+static double	_now(void);
+static void	_run(const struct bench_case *);
+static void	_bench_expand_words(const void *);
+static void	_bench_template_expand(const void *);
+static void	_bench_shellquote(const void *);
+static void	_bench_shellquote_arena(const void *);
+static void	_bench_char2utf8(const void *);
+static void	_bench_utf82char(const void *);
+static void	_bench_strrcasecmp(const void *);
+static void	_bench_mdata_strformat(const void *);
+static void	_bench_mdata_strformat_template(const void *);
+
+static const struct bench_case	cases[] = {
+	{ "expand_words/placeholders", _bench_expand_words, placeholders },
+	{ "template_expand/placeholders", _bench_template_expand, NULL },
+	{ "shellquote/ascii", _bench_shellquote, title_ascii },
+	{ "shellquote/japanese", _bench_shellquote, title_ja },
+	{ "shellquote/path", _bench_shellquote, long_path },
+	{ "shellquote_arena/path", _bench_shellquote_arena, long_path },
+	{ "char2utf8/ascii", _bench_char2utf8, title_ascii },
+	{ "char2utf8/japanese", _bench_char2utf8, title_ja },
+	{ "char2utf8/arabic", _bench_char2utf8, title_ar },
+	{ "utf82char/ascii", _bench_utf82char, title_ascii },
+	{ "utf82char/japanese", _bench_utf82char, title_ja },
+	{ "utf82char/arabic", _bench_utf82char, title_ar },
+	{ "strrcasecmp/path", _bench_strrcasecmp, long_path },
+	{ "mdata_strformat/format", _bench_mdata_strformat, mdata_format },
+	{ "mdata_strformat/template", _bench_mdata_strformat_template, NULL },
+	{ NULL, NULL, NULL }
+};
+
+static double
+_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((double)ts.tv_sec * 1000000000.0 + (double)ts.tv_nsec);
+}
+
+static void
+_run(const struct bench_case *bc)
+{
+	unsigned long	iters, batch = 1, allocs;
+	double		start, elapsed;
+
+	/* Warm up caches, and anything that is initialized on first use: */
+	bc->func(bc->arg);
+
+	allocs = xalloc_get_allocs();
+	iters = 0;
+	start = _now();
+	do {
+		unsigned long	i;
+
+		for (i = 0; i < batch; i++)
+			bc->func(bc->arg);
+		iters += batch;
+		if (batch < 1024)
+			batch *= 2;
+		elapsed = _now() - start;
+	} while (elapsed < (double)run_msecs * 1000000.0);
+	allocs = xalloc_get_allocs() - allocs;
+
+	printf("%-28s %10lu ops %12.1f ns/op %8.2f allocs/op\n", bc->name,
+	    iters, elapsed / (double)iters, (double)allocs / (double)iters);
+}
+
+static void
+_bench_expand_words(const void *arg)
+{
+	struct util_dict	 dicts[] = {
+		{ PLACEHOLDER_ARTIST, title_ascii },
+		{ PLACEHOLDER_ALBUM, "Album" },
+		{ PLACEHOLDER_TITLE, title_ja },
+		{ PLACEHOLDER_TRACK, long_path },
+		{ PLACEHOLDER_STRING, title_ar },
+		{ PLACEHOLDER_METADATA, title_ascii },
+		{ NULL, NULL }
+	};
+	char			*out;
+
+	out = util_expand_words(arg, dicts);
+	sink += strlen(out);
+	xfree(out);
+}
+
+static void
+_bench_template_expand(const void *arg)
+{
+	const char	*values[CFG_PH_MAX];
+	char		*out;
+
+	(void)arg;
+	values[CFG_PH_METADATA] = title_ascii;
+	values[CFG_PH_ARTIST] = title_ascii;
+	values[CFG_PH_ALBUM] = "Album";
+	values[CFG_PH_TITLE] = title_ja;
+	values[CFG_PH_TRACK] = long_path;
+	values[CFG_PH_STRING] = title_ar;
+
+	out = util_template_expand(tmpl, values);
+	sink += strlen(out);
+	xfree(out);
+}
+
+static void
+_bench_shellquote(const void *arg)
+{
+	char	*out;
+
+	out = util_shellquote(arg, 0);
+	sink += strlen(out);
+	xfree(out);
+}
+
+static void
+_bench_shellquote_arena(const void *arg)
+{
+	xarena_reset(arena);
+	sink += strlen(util_shellquote_arena(arena, arg, 0));
+}
+
+static void
+_bench_char2utf8(const void *arg)
+{
+	char	*out;
+
+	out = util_char2utf8(arg);
+	sink += strlen(out);
+	xfree(out);
+}
+
+static void
+_bench_utf82char(const void *arg)
+{
+	char	*out;
+
+	out = util_utf82char(arg);
+	sink += strlen(out);
+	xfree(out);
+}
+
+static void
+_bench_strrcasecmp(const void *arg)
+{
+	sink += (size_t)util_strrcasecmp(arg, ".OGG");
+	sink += (size_t)util_strrcasecmp(arg, ".m3u");
+}
+
+static void
+_bench_mdata_strformat(const void *arg)
+{
+	char	buf[BUFSIZ];
+
+	sink += (size_t)mdata_strformat(md, buf, sizeof(buf), arg);
+}
+
+static void
+_bench_mdata_strformat_template(const void *arg)
+{
+	char	buf[BUFSIZ];
+
+	(void)arg;
+	sink += (size_t)mdata_strformat_template(md, buf, sizeof(buf),
+	    mdata_tmpl);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const struct bench_case *bc;
+	const char		*filter = NULL;
+	const char		*errstr;
+	char			 path[PATH_MAX];
+	int			 ch;
+
+	while (-1 != (ch = getopt(argc, argv, "t:"))) {
+		switch (ch) {
+		case 't':
+			run_msecs = (unsigned int)strtonum(optarg, 1, 60000,
+			    &errstr);
+			if (errstr) {
+				fprintf(stderr, "bench_util: -t %s: %s\n",
+				    optarg, errstr);
+				return (2);
+			}
+			break;
+		default:
+			fprintf(stderr,
+			    "usage: bench_util [-t msecs] [filter]\n");
+			return (2);
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (0 < argc)
+		filter = argv[0];
+
+	if (0 > log_init("bench_util"))
+		return (1);
+
+	(void)snprintf(path, sizeof(path), "%s/../tests/test07-japanese.ogg",
+	    SRCDIR);
+	md = mdata_create();
+	if (0 > mdata_parse_file(md, path))
+		return (1);
+	tmpl = cfg_template_compile(placeholders);
+	mdata_tmpl = cfg_template_compile(mdata_format);
+	arena = xarena_create(0);
+
+	for (bc = cases; bc->name; bc++) {
+		if (NULL == filter || NULL != strstr(bc->name, filter))
+			_run(bc);
+	}
+
+	xarena_destroy(&arena);
+	util_template_destroy(&mdata_tmpl);
+	util_template_destroy(&tmpl);
+	mdata_destroy(&md);
+	log_exit();
+
+	return (0);
+}
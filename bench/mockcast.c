@@ -0,0 +1,472 @@
+/*
+ * Copyright (c) 2026 Moritz Grimm <mgrimm@mrsserver.net>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * mockcast: a minimal stand-in for an Icecast server, for benchmarking.
+ *
+ * Accepts source connections (HTTP PUT or SOURCE) and metadata updates on
+ * the loopback interface, runs the given command (usually ezstream) as a
+ * child process, and prints a report of what the server observed once the
+ * child exits or the time limit is reached:
+ *
+ *     mockcast -l port [-D bytes] [-t seconds] command [args ...]
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MOCK_MAX_CLIENTS	16
+#define MOCK_HDR_SIZE		8192
+#define MOCK_BUF_SIZE		65536
+#define MOCK_TAIL_SIZE		5	/* Ogg capture pattern, version */
+
+enum mock_state {
+	MOCK_FREE = 0,
+	MOCK_HEADERS,
+	MOCK_SOURCE
+};
+
+struct mock_client {
+	enum mock_state state;
+	int		fd;
+	char		hdr[MOCK_HDR_SIZE];
+	size_t		hdr_len;
+	char		tail[MOCK_TAIL_SIZE];	/* Pages spanning reads */
+	size_t		tail_len;
+	int		bos_seen;
+};
+
+struct mock_stats {
+	double		first_data;
+	double		last_data;
+	unsigned long long
+			bytes;
+	unsigned long	chunks;
+	unsigned long	connects;
+	unsigned long	metadata;
+	unsigned long	track_changes;
+	double		gap_sum;
+	double		gap_max;
+	double		gap_pending;	/* Start of a metadata gap, or 0 */
+	double		drop_time;
+	double		reconnect;
+};
+
+static struct mock_client	clients[MOCK_MAX_CLIENTS];
+static struct mock_stats	stats;
+static unsigned long long	drop_bytes;
+static volatile sig_atomic_t	got_signal;
+
+static void	_usage(void);
+static double	_now(void);
+static void	_sig_handler(int);
+static int	_listen(unsigned short);
+static void	_accept(int);
+static void	_close(struct mock_client *);
+static int	_reply(struct mock_client *, const char *);
+static void	_track_change(double, double);
+static void	_read_headers(struct mock_client *);
+static void	_read_source(struct mock_client *);
+static void	_report(double, const struct rusage *, int);
+
+static void
+_usage(void)
+{
+	fprintf(stderr,
+	    "usage: mockcast -l port [-D bytes] [-t seconds] command [args ...]\n");
+	exit(2);
+}
+
+static double
+_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0);
+}
+
+static void
+_sig_handler(int sig)
+{
+	got_signal = sig;
+}
+
+static int
+_listen(unsigned short port)
+{
+	struct sockaddr_in	sin;
+	int			fd, on = 1;
+
+	if (0 > (fd = socket(AF_INET, SOCK_STREAM, 0))) {
+		perror("socket");
+		return (-1);
+	}
+	(void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(port);
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (0 > bind(fd, (struct sockaddr *)&sin, sizeof(sin)) ||
+	    0 > listen(fd, MOCK_MAX_CLIENTS)) {
+		fprintf(stderr, "mockcast: port %u: %s\n", (unsigned int)port,
+		    strerror(errno));
+		close(fd);
+		return (-1);
+	}
+
+	return (fd);
+}
+
+static void
+_accept(int lfd)
+{
+	unsigned int	i;
+	int		fd;
+
+	if (0 > (fd = accept(lfd, NULL, NULL)))
+		return;
+	for (i = 0; i < MOCK_MAX_CLIENTS; i++) {
+		if (MOCK_FREE == clients[i].state)
+			break;
+	}
+	if (MOCK_MAX_CLIENTS == i) {
+		close(fd);
+		return;
+	}
+	memset(&clients[i], 0, sizeof(clients[i]));
+	clients[i].fd = fd;
+	clients[i].state = MOCK_HEADERS;
+}
+
+static void
+_close(struct mock_client *c)
+{
+	close(c->fd);
+	c->fd = -1;
+	c->state = MOCK_FREE;
+}
+
+static int
+_reply(struct mock_client *c, const char *msg)
+{
+	size_t	len = strlen(msg);
+
+	if ((ssize_t)len != write(c->fd, msg, len)) {
+		_close(c);
+		return (-1);
+	}
+
+	return (0);
+}
+
+static void
+_track_change(double now, double since)
+{
+	double	gap = now - since;
+
+	stats.track_changes++;
+	stats.gap_sum += gap;
+	if (gap > stats.gap_max)
+		stats.gap_max = gap;
+}
+
+static void
+_read_headers(struct mock_client *c)
+{
+	static const char	 ok[] = "HTTP/1.0 200 OK\r\n\r\n";
+	static const char	 upd[] =
+	    "HTTP/1.0 200 OK\r\n"
+	    "Content-Type: text/xml\r\n"
+	    "\r\n"
+	    "<?xml version=\"1.0\"?>\n"
+	    "<iceresponse><message>Metadata update successful</message>"
+	    "<return>1</return></iceresponse>\n";
+	static const char	 options[] =
+	    "HTTP/1.1 200 OK\r\n"
+	    "Allow: GET, PUT, SOURCE, OPTIONS\r\n"
+	    "Content-Length: 0\r\n"
+	    "\r\n";
+	static const char	 notfound[] = "HTTP/1.0 404 Not Found\r\n\r\n";
+	char			*end;
+	size_t			 rest;
+	ssize_t 		 n;
+
+	n = read(c->fd, c->hdr + c->hdr_len, sizeof(c->hdr) - c->hdr_len - 1);
+	if (0 >= n) {
+		_close(c);
+		return;
+	}
+	c->hdr_len += (size_t)n;
+	c->hdr[c->hdr_len] = '\0';
+	if (NULL == (end = strstr(c->hdr, "\r\n\r\n"))) {
+		if (c->hdr_len == sizeof(c->hdr) - 1)
+			_close(c);
+		return;
+	}
+	end += strlen("\r\n\r\n");
+	rest = c->hdr_len - (size_t)(end - c->hdr);
+
+	if (0 == strncmp(c->hdr, "PUT ", 4) ||
+	    0 == strncmp(c->hdr, "SOURCE ", 7)) {
+		double	now = _now();
+
+		if (0 > _reply(c, ok))
+			return;
+		c->state = MOCK_SOURCE;
+		stats.connects++;
+		if (0.0 < stats.drop_time && 0.0 == stats.reconnect)
+			stats.reconnect = now - stats.drop_time;
+		/* Any data that arrived along with the headers: */
+		if (rest) {
+			stats.bytes += rest;
+			stats.last_data = now;
+			if (0.0 == stats.first_data)
+				stats.first_data = now;
+		}
+		return;
+	}
+	if (0 == strncmp(c->hdr, "OPTIONS ", 8)) {
+		/* No TLS upgrade; the actual request follows on this socket. */
+		if (0 > _reply(c, options))
+			return;
+		memmove(c->hdr, end, rest);
+		c->hdr_len = rest;
+		return;
+	}
+	if (0 == strncmp(c->hdr, "GET /admin/metadata", 19)) {
+		stats.metadata++;
+		if (0.0 == stats.gap_pending)
+			stats.gap_pending = stats.last_data;
+		if (0 > _reply(c, upd))
+			return;
+	} else if (0 > _reply(c, notfound))
+		return;
+	_close(c);
+}
+
+static void
+_read_source(struct mock_client *c)
+{
+	static char	buf[MOCK_TAIL_SIZE + MOCK_BUF_SIZE];
+	char		*p;
+	size_t		 len;
+	ssize_t 	 n;
+	double		 now, prev;
+
+	memcpy(buf, c->tail, c->tail_len);
+	n = read(c->fd, buf + c->tail_len, MOCK_BUF_SIZE);
+	if (0 >= n) {
+		_close(c);
+		return;
+	}
+	now = _now();
+	prev = stats.last_data;
+	stats.bytes += (unsigned long long)n;
+	stats.chunks++;
+	stats.last_data = now;
+	if (0.0 == stats.first_data)
+		stats.first_data = now;
+	if (0.0 < stats.gap_pending) {
+		_track_change(now, stats.gap_pending);
+		stats.gap_pending = 0.0;
+	}
+
+	/* Ogg beginning-of-stream pages mark new tracks: */
+	len = c->tail_len + (size_t)n;
+	for (p = buf; p + 6 <= buf + len; p++) {
+		if (0 != memcmp(p, "OggS", 4) || 0 == (p[5] & 0x02))
+			continue;
+		if (c->bos_seen && 0.0 < prev)
+			_track_change(now, prev);
+		c->bos_seen = 1;
+		/* Chained streams may have several BOS pages in a row: */
+		prev = now;
+	}
+	c->tail_len = len < MOCK_TAIL_SIZE ? len : MOCK_TAIL_SIZE;
+	memcpy(c->tail, buf + len - c->tail_len, c->tail_len);
+
+	if (drop_bytes && stats.bytes >= drop_bytes) {
+		drop_bytes = 0;
+		stats.drop_time = now;
+		_close(c);
+	}
+}
+
+static void
+_report(double elapsed, const struct rusage *ru, int status)
+{
+	double	streamed = stats.last_data - stats.first_data;
+
+	if (0.0 >= streamed)
+		streamed = elapsed;
+
+	printf("elapsed_s          %.3f\n", elapsed);
+	printf("bytes              %llu\n", stats.bytes);
+	printf("bytes_per_s        %.0f\n", (double)stats.bytes / streamed);
+	printf("chunks             %lu\n", stats.chunks);
+	printf("chunks_per_s       %.1f\n", (double)stats.chunks / streamed);
+	printf("source_connects    %lu\n", stats.connects);
+	printf("metadata_updates   %lu\n", stats.metadata);
+	printf("track_changes      %lu\n", stats.track_changes);
+	printf("track_gap_avg_ms   %.3f\n", stats.track_changes ?
+	    stats.gap_sum * 1000.0 / (double)stats.track_changes : 0.0);
+	printf("track_gap_max_ms   %.3f\n", stats.gap_max * 1000.0);
+	if (0.0 < stats.drop_time)
+		printf("reconnect_ms       %.3f\n", stats.reconnect * 1000.0);
+	printf("cpu_user_s         %.3f\n", (double)ru->ru_utime.tv_sec +
+	    (double)ru->ru_utime.tv_usec / 1000000.0);
+	printf("cpu_sys_s          %.3f\n", (double)ru->ru_stime.tv_sec +
+	    (double)ru->ru_stime.tv_usec / 1000000.0);
+	/* ru_maxrss is in kilobytes on most systems, but in bytes on macOS: */
+	printf("maxrss             %ld\n", ru->ru_maxrss);
+	printf("exit_status        %d\n",
+	    WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct pollfd		pfd[MOCK_MAX_CLIENTS + 1];
+	struct mock_client	*map[MOCK_MAX_CLIENTS + 1];
+	struct sigaction	act;
+	struct rusage		ru;
+	unsigned long		port = 0, limit = 30;
+	double			start;
+	pid_t			pid;
+	int			lfd, ch, status = 0, reaped = 0;
+	unsigned int		i, n;
+	char			*ep;
+
+	while (-1 != (ch = getopt(argc, argv, "+D:l:t:"))) {
+		switch (ch) {
+		case 'D':
+			drop_bytes = strtoull(optarg, &ep, 10);
+			if ('\0' != *ep)
+				_usage();
+			break;
+		case 'l':
+			port = strtoul(optarg, &ep, 10);
+			if ('\0' != *ep || 0 == port || USHRT_MAX < port)
+				_usage();
+			break;
+		case 't':
+			limit = strtoul(optarg, &ep, 10);
+			if ('\0' != *ep || 0 == limit)
+				_usage();
+			break;
+		default:
+			_usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (0 == port || 0 == argc)
+		_usage();
+
+	memset(&act, 0, sizeof(act));
+	act.sa_handler = _sig_handler;
+	(void)sigaction(SIGINT, &act, NULL);
+	(void)sigaction(SIGTERM, &act, NULL);
+	act.sa_handler = SIG_IGN;
+	(void)sigaction(SIGPIPE, &act, NULL);
+
+	if (0 > (lfd = _listen((unsigned short)port)))
+		return (1);
+
+	start = _now();
+	switch ((pid = fork())) {
+	case -1:
+		perror("fork");
+		return (1);
+	case 0:
+		close(lfd);
+		execvp(argv[0], argv);
+		perror(argv[0]);
+		_exit(127);
+	default:
+		break;
+	}
+
+	while (!reaped) {
+		if (got_signal || _now() - start >= (double)limit) {
+			/* Ask nicely first, so that the child can clean up: */
+			(void)kill(pid, SIGTERM);
+			if (0 > wait4(pid, &status, 0, &ru))
+				memset(&ru, 0, sizeof(ru));
+			break;
+		}
+		if (pid == wait4(pid, &status, WNOHANG, &ru)) {
+			reaped = 1;
+			break;
+		}
+
+		n = 0;
+		pfd[n].fd = lfd;
+		pfd[n].events = POLLIN;
+		map[n++] = NULL;
+		for (i = 0; i < MOCK_MAX_CLIENTS; i++) {
+			if (MOCK_FREE == clients[i].state)
+				continue;
+			pfd[n].fd = clients[i].fd;
+			pfd[n].events = POLLIN;
+			map[n++] = &clients[i];
+		}
+		if (0 >= poll(pfd, n, 100))
+			continue;
+		for (i = 0; i < n; i++) {
+			if (0 == (pfd[i].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+			if (NULL == map[i])
+				_accept(lfd);
+			else if (MOCK_HEADERS == map[i]->state)
+				_read_headers(map[i]);
+			else
+				_read_source(map[i]);
+		}
+	}
+
+	_report(_now() - start, &ru, status);
+
+	for (i = 0; i < MOCK_MAX_CLIENTS; i++) {
+		if (MOCK_FREE != clients[i].state)
+			_close(&clients[i]);
+	}
+	close(lfd);
+
+	return (0);
+}
@@ -0,0 +1,152 @@
+#!/bin/sh
+#
+# Run ezstream against the mockcast stand-in server on the loopback
+# interface, and report throughput, track change gaps, reconnect recovery
+# time and resource usage for a set of scenarios.
+#
+# Usage: run-bench.sh ezstream mockcast srcdir [scenario ...]
+#
+# Environment:
+#   BENCH_DURATION  Time limit per scenario, in seconds (default: 20)
+#   BENCH_PORT      TCP port to use on 127.0.0.1 (default: 18000)
+#   BENCH_TRACKS    Number of playlist entries per scenario (default: 20)
+#
+# Scenarios: throughput ogg mp3 reconnect (default: all of them)
+#
+# Ogg and MP3 test files are generated from tests/null.raw (one second of
+# 44.1 kHz, 16 bit stereo silence) with oggenc and lame, if available.
+# Scenarios that lack their input files are skipped.
+
+set -e
+
+if [ $# -lt 3 ]; then
+	echo "usage: $0 ezstream mockcast srcdir [scenario ...]" >&2
+	exit 2
+fi
+EZSTREAM="$1"
+MOCKCAST="$2"
+SRCDIR="$3"
+shift 3
+
+DURATION="${BENCH_DURATION:-20}"
+PORT="${BENCH_PORT:-18000}"
+TRACKS="${BENCH_TRACKS:-20}"
+SCENARIOS="${*:-throughput ogg mp3 reconnect}"
+
+WORKDIR="$(mktemp -d "${TMPDIR:-/tmp}/ezstream-bench.XXXXXX")"
+trap 'rm -rf "${WORKDIR}"' EXIT INT TERM
+
+RAW="${SRCDIR}/../tests/null.raw"
+
+# Generate test files from the raw PCM sample:
+if command -v oggenc > /dev/null 2>&1; then
+	oggenc -Q -r -B 16 -C 2 -R 44100 -o "${WORKDIR}/gen.ogg" "${RAW}" \
+	    || true
+fi
+if command -v lame > /dev/null 2>&1; then
+	lame --quiet -r -s 44.1 --bitwidth 16 -m s "${RAW}" \
+	    "${WORKDIR}/gen.mp3" || true
+fi
+
+# write_playlist file ...
+write_playlist()
+{
+	: > "${WORKDIR}/playlist.txt"
+	i=0
+	while [ ${i} -lt ${TRACKS} ]; do
+		for f in "$@"; do
+			echo "${f}" >> "${WORKDIR}/playlist.txt"
+		done
+		i=$((i + 1))
+	done
+}
+
+# write_config format mountpoint
+write_config()
+{
+	cat > "${WORKDIR}/ezstream.xml" << __EOT
+<?xml version="1.0" encoding="UTF-8"?>
+<ezstream>
+  <servers>
+    <server>
+      <protocol>HTTP</protocol>
+      <hostname>127.0.0.1</hostname>
+      <port>${PORT}</port>
+      <password>bench</password>
+      <tls>None</tls>
+      <reconnect_attempts>10</reconnect_attempts>
+    </server>
+  </servers>
+  <streams>
+    <stream>
+      <mountpoint>$2</mountpoint>
+      <format>$1</format>
+    </stream>
+  </streams>
+  <intakes>
+    <intake>
+      <type>playlist</type>
+      <filename>${WORKDIR}/playlist.txt</filename>
+      <stream_once>Yes</stream_once>
+    </intake>
+  </intakes>
+  <logging>
+    <target>${WORKDIR}/ezstream.log</target>
+  </logging>
+</ezstream>
+__EOT
+	chmod 0600 "${WORKDIR}/ezstream.xml"
+}
+
+# run scenario [mockcast options]
+run()
+{
+	name="$1"
+	shift
+	echo "== ${name}"
+	"${MOCKCAST}" -l "${PORT}" -t "${DURATION}" "$@" \
+	    "${EZSTREAM}" -c "${WORKDIR}/ezstream.xml" \
+	    | sed 's/^/  /'
+}
+
+for scenario in ${SCENARIOS}; do
+	case "${scenario}" in
+	throughput)
+		# The raw file contains no MP3 frames, so libshout cannot
+		# pace the stream, which measures the maximum send rate.
+		cp "${RAW}" "${WORKDIR}/null.mp3"
+		write_playlist "${WORKDIR}/null.mp3"
+		write_config MP3 /bench.mp3
+		run throughput
+		;;
+	ogg)
+		set -- "${SRCDIR}"/../tests/test0[1-3]-*.ogg
+		if [ -f "${WORKDIR}/gen.ogg" ]; then
+			set -- "$@" "${WORKDIR}/gen.ogg"
+		fi
+		write_playlist "$@"
+		write_config Ogg /bench.ogg
+		run ogg
+		;;
+	mp3)
+		if [ ! -f "${WORKDIR}/gen.mp3" ]; then
+			echo "== mp3: skipped (lame not found)"
+			continue
+		fi
+		write_playlist "${WORKDIR}/gen.mp3"
+		write_config MP3 /bench.mp3
+		run mp3
+		;;
+	reconnect)
+		# Drop the source connection after the first 64 KiB:
+		cp "${RAW}" "${WORKDIR}/null.mp3"
+		write_playlist "${WORKDIR}/null.mp3"
+		write_config MP3 /bench.mp3
+		run reconnect -D 65536
+		;;
+	*)
+		echo "$0: ${scenario}: unknown scenario" >&2
+		exit 2
+		;;
+	esac
+done
@@ -0,0 +1,878 @@
+/*
+ * Copyright (c) 2026 Moritz Grimm <mgrimm@mrsserver.net>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <sys/types.h>
+#include <sys/queue.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+# include <sched.h>
+# include <signal.h>
+#endif /* HAVE_PTHREAD */
+#include <stdio.h>
+#include <string.h>
+
+#include "analysis.h"
+#include "log.h"
+#include "pcm.h"
+#include "plugin.h"
+#include "xalloc.h"
+
+#define ANALYSIS_FRAMES 	4096
+#define ANALYSIS_MIN_BUCKETS	64U
+#define ANALYSIS_CACHE_MAGIC	"# ezstream analysis cache 1"
+/* Reference loudness of ReplayGain 2.0, in LUFS */
+#define ANALYSIS_REFERENCE	-18.0f
+/* Samples at or below ANALYSIS_SILENCE_DB are silent */
+#define ANALYSIS_SILENCE	0.001f
+/* Gating thresholds of BS.1770-4, in LUFS and LU */
+#define ANALYSIS_GATE_ABS	-70.0
+#define ANALYSIS_GATE_REL	-10.0
+/*
+ * The interpolation below never exceeds the largest of the four samples
+ * it uses by more than this factor.
+ */
+#define ANALYSIS_ISP_MAX	1.25f
+
+enum analysis_state {
+	ANALYSIS_QUEUED = 0,
+	ANALYSIS_DONE,
+	ANALYSIS_FAILED
+};
+
+/*
+ * Entries are never removed before analysis_exit(), so that the workers
+ * can use the path of an entry without holding the lock.
+ */
+struct analysis_entry {
+	struct analysis_entry	*next;
+	TAILQ_ENTRY(analysis_entry)
+				 job;
+	size_t			 hash;
+	char			*path;
+	char			*plugin;
+	off_t			 size;
+	time_t			 mtime;
+	enum analysis_state	 state;
+	struct analysis_result	 result;
+};
+TAILQ_HEAD(analysis_jobs, analysis_entry);
+
+struct analysis_chan {
+	/* State of the K-weighting filters: */
+	double	 shelf[2];
+	double	 hipass[2];
+	/* The last four samples, for the true peak: */
+	float	 hist[4];
+};
+
+struct analysis_meter {
+	unsigned int	 rate;
+	size_t		 channels;
+	double		 shelf_b[3], shelf_a[3];
+	double		 hipass_b[3], hipass_a[3];
+	struct analysis_chan
+			*chan;
+	/* Energy of the 100 ms sub-blocks of the gating blocks: */
+	size_t		 sub_frames;
+	size_t		 sub_pos;
+	double		 sub_energy;
+	double		*subs;
+	size_t		 subs_num;
+	size_t		 subs_size;
+	unsigned long	 frames;
+	unsigned long	 first;
+	unsigned long	 last;
+	int		 audible;
+	float		 peak;
+};
+
+static struct analysis {
+	struct analysis_entry **buckets;
+	size_t			nbuckets;
+	size_t			nentries;
+	struct analysis_jobs	jobs;
+	FILE		       *cache;
+	unsigned int		nworkers;
+	int			stop;
+} analysis;
+
+#ifdef HAVE_PTHREAD
+static pthread_t		*analysis_workers;
+static pthread_mutex_t		 analysis_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t		 analysis_cv = PTHREAD_COND_INITIALIZER;
+# define ANALYSIS_LOCK()	pthread_mutex_lock(&analysis_mtx)
+# define ANALYSIS_UNLOCK()	pthread_mutex_unlock(&analysis_mtx)
+#else
+# define ANALYSIS_LOCK()	do { } while (0)
+# define ANALYSIS_UNLOCK()	do { } while (0)
+#endif /* HAVE_PTHREAD */
+
+static void	_analysis_meter_init(struct analysis_meter *, unsigned int,
+		    unsigned int);
+static void	_analysis_meter_free(struct analysis_meter *);
+static void	_analysis_meter_peak(struct analysis_meter *,
+		    struct analysis_chan *, float);
+static void	_analysis_meter_feed(struct analysis_meter *, const float *,
+		    size_t);
+static float	_analysis_meter_loudness(const struct analysis_meter *);
+static void	_analysis_meter_result(const struct analysis_meter *,
+		    struct analysis_result *);
+static int	_analysis_stopping(void);
+static int	_analysis_run(const char *, const char *,
+		    struct analysis_result *, int);
+static int	_analysis_stat(const char *, off_t *, time_t *);
+static size_t	_analysis_hash(const char *);
+static void	_analysis_grow(void);
+static struct analysis_entry *
+		_analysis_find(const char *);
+static struct analysis_entry *
+		_analysis_insert(const char *);
+static int	_analysis_parse(char *);
+static void	_analysis_write(FILE *, const struct analysis_entry *);
+static int	_analysis_rewrite(const char *);
+static int	_analysis_load(const char *);
+static void	_analysis_store(const struct analysis_entry *);
+#ifdef HAVE_PTHREAD
+static void *	_analysis_worker(void *);
+#endif /* HAVE_PTHREAD */
+
+/*
+ * Sets up the K-weighting filters of BS.1770 for the sample rate, with the
+ * analog prototypes of libebur128 so that they apply to any rate.
+ */
+static void
+_analysis_meter_init(struct analysis_meter *m, unsigned int rate,
+    unsigned int channels)
+{
+	double	f0, g, q, k, vh, vb, a0;
+
+	memset(m, 0, sizeof(*m));
+	m->rate = rate;
+	m->channels = channels;
+	m->chan = xcalloc(channels, sizeof(*m->chan));
+	m->sub_frames = rate / 10;
+
+	f0 = 1681.974450955533;
+	g = 3.999843853973347;
+	q = 0.7071752369554196;
+	k = tan(M_PI * f0 / (double)rate);
+	vh = pow(10.0, g / 20.0);
+	vb = pow(vh, 0.4996667741545416);
+	a0 = 1.0 + k / q + k * k;
+	m->shelf_b[0] = (vh + vb * k / q + k * k) / a0;
+	m->shelf_b[1] = 2.0 * (k * k - vh) / a0;
+	m->shelf_b[2] = (vh - vb * k / q + k * k) / a0;
+	m->shelf_a[0] = 1.0;
+	m->shelf_a[1] = 2.0 * (k * k - 1.0) / a0;
+	m->shelf_a[2] = (1.0 - k / q + k * k) / a0;
+
+	f0 = 38.13547087602444;
+	q = 0.5003270373238773;
+	k = tan(M_PI * f0 / (double)rate);
+	a0 = 1.0 + k / q + k * k;
+	m->hipass_b[0] = 1.0;
+	m->hipass_b[1] = -2.0;
+	m->hipass_b[2] = 1.0;
+	m->hipass_a[0] = 1.0;
+	m->hipass_a[1] = 2.0 * (k * k - 1.0) / a0;
+	m->hipass_a[2] = (1.0 - k / q + k * k) / a0;
+}
+
+static void
+_analysis_meter_free(struct analysis_meter *m)
+{
+	xfree(m->chan);
+	xfree(m->subs);
+	memset(m, 0, sizeof(*m));
+}
+
+/*
+ * Tracks the true peak, with inter-sample peaks estimated by Catmull-Rom
+ * interpolation at a quarter, half and three quarters between the middle
+ * two of the last four samples.
+ */
+static void
+_analysis_meter_peak(struct analysis_meter *m, struct analysis_chan *s,
+    float x)
+{
+	float	*h = s->hist;
+	float	 max, t, v;
+	int	 i;
+
+	h[0] = h[1];
+	h[1] = h[2];
+	h[2] = h[3];
+	h[3] = x;
+	max = fmaxf(fmaxf(fabsf(h[0]), fabsf(h[1])),
+	    fmaxf(fabsf(h[2]), fabsf(h[3])));
+	if (max * ANALYSIS_ISP_MAX <= m->peak)
+		return;
+	for (i = 1; i < 4; i++) {
+		t = (float)i * 0.25f;
+		v = 0.5f * (2.0f * h[1] + (h[2] - h[0]) * t +
+		    (2.0f * h[0] - 5.0f * h[1] + 4.0f * h[2] - h[3]) * t * t +
+		    (3.0f * h[1] - h[0] - 3.0f * h[2] + h[3]) * t * t * t);
+		if (fabsf(v) > m->peak)
+			m->peak = fabsf(v);
+	}
+}
+
+static void
+_analysis_meter_feed(struct analysis_meter *m, const float *pcm,
+    size_t frames)
+{
+	size_t	ch = m->channels, i, c;
+	float	peak;
+
+	peak = pcm_peak(pcm, frames * ch);
+	if (peak > m->peak)
+		m->peak = peak;
+	if (peak > ANALYSIS_SILENCE) {
+		if (!m->audible) {
+			for (i = 0; i < frames; i++) {
+				if (pcm_peak(pcm + i * ch, ch) > ANALYSIS_SILENCE)
+					break;
+			}
+			m->first = m->frames + i;
+			m->audible = 1;
+		}
+		for (i = frames; i > 0; i--) {
+			if (pcm_peak(pcm + (i - 1) * ch, ch) > ANALYSIS_SILENCE)
+				break;
+		}
+		m->last = m->frames + i - 1;
+	}
+
+	for (i = 0; i < frames; i++) {
+		for (c = 0; c < ch; c++) {
+			struct analysis_chan	*s = &m->chan[c];
+			double			 x = pcm[i * ch + c], y, z;
+
+			y = m->shelf_b[0] * x + s->shelf[0];
+			s->shelf[0] = m->shelf_b[1] * x - m->shelf_a[1] * y +
+			    s->shelf[1];
+			s->shelf[1] = m->shelf_b[2] * x - m->shelf_a[2] * y;
+			z = m->hipass_b[0] * y + s->hipass[0];
+			s->hipass[0] = m->hipass_b[1] * y -
+			    m->hipass_a[1] * z + s->hipass[1];
+			s->hipass[1] = m->hipass_b[2] * y - m->hipass_a[2] * z;
+			/* Channels are weighted equally, as for stereo: */
+			m->sub_energy += z * z;
+			_analysis_meter_peak(m, s, pcm[i * ch + c]);
+		}
+		if (++m->sub_pos < m->sub_frames)
+			continue;
+		if (m->subs_num == m->subs_size) {
+			m->subs_size = m->subs_size ? m->subs_size * 2 : 64;
+			m->subs = xreallocarray(m->subs, m->subs_size,
+			    sizeof(*m->subs));
+		}
+		m->subs[m->subs_num++] = m->sub_energy;
+		m->sub_energy = 0.0;
+		m->sub_pos = 0;
+	}
+	m->frames += frames;
+
+	/* Keep the filters out of denormals in silence: */
+	for (c = 0; c < ch; c++) {
+		struct analysis_chan	*s = &m->chan[c];
+
+		for (i = 0; i < 2; i++) {
+			if (fabs(s->shelf[i]) < 1e-20)
+				s->shelf[i] = 0.0;
+			if (fabs(s->hipass[i]) < 1e-20)
+				s->hipass[i] = 0.0;
+		}
+	}
+}
+
+/*
+ * Integrated loudness over gating blocks of 400 ms that overlap by 75%,
+ * i.e. of four consecutive sub-blocks.
+ */
+static float
+_analysis_meter_loudness(const struct analysis_meter *m)
+{
+	double	abs_gate, rel_gate, norm, z, sum;
+	size_t	i, n;
+
+	if (m->subs_num < 4)
+		return (-INFINITY);
+	abs_gate = pow(10.0, (ANALYSIS_GATE_ABS + 0.691) / 10.0);
+	norm = 4.0 * (double)m->sub_frames;
+
+	sum = 0.0;
+	n = 0;
+	for (i = 0; i + 3 < m->subs_num; i++) {
+		z = (m->subs[i] + m->subs[i + 1] + m->subs[i + 2] +
+		    m->subs[i + 3]) / norm;
+		if (z > abs_gate) {
+			sum += z;
+			n++;
+		}
+	}
+	if (0 == n)
+		return (-INFINITY);
+	rel_gate = sum / (double)n * pow(10.0, ANALYSIS_GATE_REL / 10.0);
+
+	sum = 0.0;
+	n = 0;
+	for (i = 0; i + 3 < m->subs_num; i++) {
+		z = (m->subs[i] + m->subs[i + 1] + m->subs[i + 2] +
+		    m->subs[i + 3]) / norm;
+		if (z > abs_gate && z > rel_gate) {
+			sum += z;
+			n++;
+		}
+	}
+
+	return ((float)(-0.691 + 10.0 * log10(sum / (double)n)));
+}
+
+static void
+_analysis_meter_result(const struct analysis_meter *m,
+    struct analysis_result *res)
+{
+	double	ms = 1000.0 / (double)m->rate;
+
+	res->loudness = _analysis_meter_loudness(m);
+	res->true_peak = m->peak;
+	res->duration = (unsigned long)((double)m->frames * ms);
+	if (m->audible) {
+		res->audio_start = (unsigned long)((double)m->first * ms);
+		res->audio_end = (unsigned long)((double)(m->last + 1) * ms);
+	} else {
+		res->audio_start = 0;
+		res->audio_end = res->duration;
+	}
+}
+
+static int
+_analysis_stopping(void)
+{
+	int	stop;
+
+	ANALYSIS_LOCK();
+	stop = analysis.stop;
+	ANALYSIS_UNLOCK();
+
+	return (stop);
+}
+
+static int
+_analysis_run(const char *plugin, const char *file,
+    struct analysis_result *res, int cancelable)
+{
+	const struct ezstream_decoder_plugin	*dec;
+	struct ezstream_pcm_format		 fmt;
+	struct analysis_meter			 m;
+	void					*handle;
+	float					*pcm;
+	long					 frames;
+
+	if (NULL == (dec = plugin_get_decoder(plugin)))
+		return (-1);
+	memset(&fmt, 0, sizeof(fmt));
+	if (NULL == (handle = dec->open(file, &fmt))) {
+		log_error("%s: %s: cannot decode", file, dec->name);
+		return (-1);
+	}
+	if (0 == fmt.rate || 0 == fmt.channels) {
+		log_error("%s: %s: invalid audio format", file, dec->name);
+		dec->close(handle);
+		return (-1);
+	}
+
+	pcm = xreallocarray(NULL, ANALYSIS_FRAMES * (size_t)fmt.channels,
+	    sizeof(*pcm));
+	_analysis_meter_init(&m, fmt.rate, fmt.channels);
+	while (0 < (frames = dec->decode(handle, pcm, ANALYSIS_FRAMES))) {
+		if (cancelable && _analysis_stopping())
+			break;
+		if ((unsigned long)frames > ANALYSIS_FRAMES)
+			frames = ANALYSIS_FRAMES;
+		_analysis_meter_feed(&m, pcm, (size_t)frames);
+	}
+	if (0 > frames)
+		log_error("%s: %s: decoding error", file, dec->name);
+	else if (0 == frames)
+		_analysis_meter_result(&m, res);
+	_analysis_meter_free(&m);
+	xfree(pcm);
+	dec->close(handle);
+	if (0 != frames)
+		return (-1);
+
+	log_debug("%s: analyzed: %.1f LUFS, true peak %.1f dBTP, audio from %lu to %lu ms",
+	    file, res->loudness, 20.0 * log10(res->true_peak),
+	    res->audio_start, res->audio_end);
+
+	return (0);
+}
+
+static int
+_analysis_stat(const char *file, off_t *size_p, time_t *mtime_p)
+{
+	struct stat	st;
+
+	if (0 > stat(file, &st))
+		return (-1);
+	*size_p = st.st_size;
+	*mtime_p = st.st_mtime;
+
+	return (0);
+}
+
+static size_t
+_analysis_hash(const char *key)
+{
+	const unsigned char	*p;
+	size_t			 h = 2166136261U;
+
+	/* FNV-1a */
+	for (p = (const unsigned char *)key; *p; p++) {
+		h ^= (size_t)*p;
+		h *= 16777619U;
+	}
+
+	return (h);
+}
+
+static void
+_analysis_grow(void)
+{
+	struct analysis_entry	**buckets;
+	size_t			  nbuckets, i;
+
+	nbuckets = analysis.nbuckets ?
+	    analysis.nbuckets * 2 : ANALYSIS_MIN_BUCKETS;
+	buckets = xcalloc(nbuckets, sizeof(*buckets));
+	for (i = 0; i < analysis.nbuckets; i++) {
+		struct analysis_entry	*e, *next;
+
+		for (e = analysis.buckets[i]; e; e = next) {
+			next = e->next;
+			e->next = buckets[e->hash & (nbuckets - 1)];
+			buckets[e->hash & (nbuckets - 1)] = e;
+		}
+	}
+	xfree(analysis.buckets);
+	analysis.buckets = buckets;
+	analysis.nbuckets = nbuckets;
+}
+
+static struct analysis_entry *
+_analysis_find(const char *path)
+{
+	struct analysis_entry	*e;
+	size_t			 hash;
+
+	if (0 == analysis.nbuckets)
+		return (NULL);
+	hash = _analysis_hash(path);
+	for (e = analysis.buckets[hash & (analysis.nbuckets - 1)]; e;
+	    e = e->next) {
+		if (e->hash == hash && 0 == strcmp(e->path, path))
+			return (e);
+	}
+
+	return (NULL);
+}
+
+static struct analysis_entry *
+_analysis_insert(const char *path)
+{
+	struct analysis_entry	*e;
+
+	if (analysis.nentries >= analysis.nbuckets)
+		_analysis_grow();
+	e = xcalloc(1UL, sizeof(*e));
+	e->hash = _analysis_hash(path);
+	e->path = xstrdup(path);
+	e->next = analysis.buckets[e->hash & (analysis.nbuckets - 1)];
+	analysis.buckets[e->hash & (analysis.nbuckets - 1)] = e;
+	analysis.nentries++;
+
+	return (e);
+}
+
+/*
+ * Cache lines consist of the size, modification time, loudness, true peak,
+ * duration, audio start and audio end, followed by the path, separated by
+ * tabs. Later lines for the same path replace earlier ones.
+ */
+static int
+_analysis_parse(char *line)
+{
+	struct analysis_entry	*e;
+	struct analysis_result	 res;
+	long long		 size, mtime;
+	size_t			 len;
+	int			 off = 0;
+
+	len = strlen(line);
+	if (0 == len || '\n' != line[len - 1])
+		return (-1);
+	line[len - 1] = '\0';
+	if (7 != sscanf(line, "%lld\t%lld\t%f\t%f\t%lu\t%lu\t%lu%n", &size,
+	    &mtime, &res.loudness, &res.true_peak, &res.duration,
+	    &res.audio_start, &res.audio_end, &off) ||
+	    '\t' != line[off] || '\0' == line[off + 1])
+		return (-1);
+
+	if (NULL == (e = _analysis_find(line + off + 1)))
+		e = _analysis_insert(line + off + 1);
+	e->size = (off_t)size;
+	e->mtime = (time_t)mtime;
+	e->state = ANALYSIS_DONE;
+	e->result = res;
+
+	return (0);
+}
+
+static void
+_analysis_write(FILE *fp, const struct analysis_entry *e)
+{
+	fprintf(fp, "%lld\t%lld\t%.2f\t%.6f\t%lu\t%lu\t%lu\t%s\n",
+	    (long long)e->size, (long long)e->mtime,
+	    (double)e->result.loudness, (double)e->result.true_peak,
+	    e->result.duration, e->result.audio_start, e->result.audio_end,
+	    e->path);
+}
+
+static int
+_analysis_rewrite(const char *path)
+{
+	char	 tmp[PATH_MAX];
+	FILE	*fp;
+	size_t	 i;
+
+	if ((size_t)snprintf(tmp, sizeof(tmp), "%s.tmp", path) >=
+	    sizeof(tmp)) {
+		log_error("%s: path too long", path);
+		return (-1);
+	}
+	if (NULL == (fp = fopen(tmp, "w"))) {
+		log_error("%s: %s", tmp, strerror(errno));
+		return (-1);
+	}
+	fprintf(fp, "%s\n", ANALYSIS_CACHE_MAGIC);
+	for (i = 0; i < analysis.nbuckets; i++) {
+		struct analysis_entry	*e;
+
+		for (e = analysis.buckets[i]; e; e = e->next) {
+			if (ANALYSIS_DONE == e->state)
+				_analysis_write(fp, e);
+		}
+	}
+	if (0 != fclose(fp) || 0 > rename(tmp, path)) {
+		log_error("%s: %s", tmp, strerror(errno));
+		(void)remove(tmp);
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Results are appended to the cache file as they become available, and the
+ * file is compacted the next time it is loaded.
+ */
+static int
+_analysis_load(const char *path)
+{
+	char		 buf[PATH_MAX + 128];
+	FILE		*fp;
+	unsigned long	 lines = 0;
+	int		 rewrite = 0;
+
+	if (NULL == (fp = fopen(path, "r"))) {
+		if (ENOENT != errno) {
+			log_error("%s: %s", path, strerror(errno));
+			return (-1);
+		}
+		rewrite = 1;
+	} else {
+		if (NULL == fgets(buf, (int)sizeof(buf), fp) ||
+		    0 != strcmp(buf, ANALYSIS_CACHE_MAGIC "\n")) {
+			if (!feof(fp) || ftell(fp) > 0)
+				log_warning("%s: unknown file format, discarding",
+				    path);
+			rewrite = 1;
+		} else {
+			while (NULL != fgets(buf, (int)sizeof(buf), fp)) {
+				lines++;
+				if (0 > _analysis_parse(buf))
+					rewrite = 1;
+			}
+		}
+		fclose(fp);
+	}
+	if ((rewrite || lines != analysis.nentries) &&
+	    0 > _analysis_rewrite(path))
+		return (-1);
+
+	if (NULL == (analysis.cache = fopen(path, "a"))) {
+		log_error("%s: %s", path, strerror(errno));
+		return (-1);
+	}
+
+	return (0);
+}
+
+static void
+_analysis_store(const struct analysis_entry *e)
+{
+	if (NULL == analysis.cache || NULL != strchr(e->path, '\n'))
+		return;
+	_analysis_write(analysis.cache, e);
+	if (0 != fflush(analysis.cache)) {
+		log_error("analysis: cannot write cache: %s", strerror(errno));
+		fclose(analysis.cache);
+		analysis.cache = NULL;
+	}
+}
+
+#ifdef HAVE_PTHREAD
+static void *
+_analysis_worker(void *arg)
+{
+	struct analysis_entry	*e;
+	struct analysis_result	 res;
+	char			*plugin;
+	int			 ret;
+
+	(void)arg;
+
+#ifdef SCHED_IDLE
+	{
+		struct sched_param	sp;
+
+		/* Only use otherwise idle CPU time: */
+		memset(&sp, 0, sizeof(sp));
+		(void)pthread_setschedparam(pthread_self(), SCHED_IDLE, &sp);
+	}
+#endif /* SCHED_IDLE */
+
+	ANALYSIS_LOCK();
+	for (;;) {
+		while (!analysis.stop && TAILQ_EMPTY(&analysis.jobs))
+			pthread_cond_wait(&analysis_cv, &analysis_mtx);
+		if (analysis.stop)
+			break;
+		e = TAILQ_FIRST(&analysis.jobs);
+		TAILQ_REMOVE(&analysis.jobs, e, job);
+		plugin = e->plugin;
+		e->plugin = NULL;
+		ANALYSIS_UNLOCK();
+
+		memset(&res, 0, sizeof(res));
+		ret = _analysis_run(plugin, e->path, &res, 1);
+		xfree(plugin);
+
+		ANALYSIS_LOCK();
+		if (analysis.stop)
+			break;
+		if (0 == ret) {
+			e->result = res;
+			e->state = ANALYSIS_DONE;
+			_analysis_store(e);
+		} else
+			e->state = ANALYSIS_FAILED;
+	}
+	ANALYSIS_UNLOCK();
+
+	return (NULL);
+}
+#endif /* HAVE_PTHREAD */
+
+int
+analysis_init(const char *cache, unsigned int workers)
+{
+	TAILQ_INIT(&analysis.jobs);
+	analysis.stop = 0;
+	_analysis_grow();
+	if (0 > _analysis_load(cache)) {
+		analysis_exit();
+		return (-1);
+	}
+
+#ifdef HAVE_PTHREAD
+	if (workers) {
+		sigset_t	all, old;
+		unsigned int	i;
+		int		error = 0;
+
+		analysis_workers = xcalloc(workers, sizeof(*analysis_workers));
+		/* Leave signal handling to the main thread: */
+		sigfillset(&all);
+		pthread_sigmask(SIG_SETMASK, &all, &old);
+		for (i = 0; i < workers; i++) {
+			if (0 != (error = pthread_create(&analysis_workers[i],
+			    NULL, _analysis_worker, NULL)))
+				break;
+			analysis.nworkers++;
+		}
+		pthread_sigmask(SIG_SETMASK, &old, NULL);
+		if (error) {
+			log_error("analysis: cannot start worker: %s",
+			    strerror(error));
+			analysis_exit();
+			return (-1);
+		}
+	}
+#else /* HAVE_PTHREAD */
+	if (workers)
+		log_warning("analysis: no thread support, using cached results only");
+#endif /* HAVE_PTHREAD */
+
+	log_debug("analysis: %s: %lu cached result(s), %u worker(s)", cache,
+	    (unsigned long)analysis.nentries, analysis.nworkers);
+
+	return (0);
+}
+
+void
+analysis_exit(void)
+{
+	size_t	i;
+
+	ANALYSIS_LOCK();
+	analysis.stop = 1;
+#ifdef HAVE_PTHREAD
+	pthread_cond_broadcast(&analysis_cv);
+#endif /* HAVE_PTHREAD */
+	ANALYSIS_UNLOCK();
+#ifdef HAVE_PTHREAD
+	for (i = 0; i < analysis.nworkers; i++)
+		pthread_join(analysis_workers[i], NULL);
+	xfree(analysis_workers);
+	analysis_workers = NULL;
+#endif /* HAVE_PTHREAD */
+	analysis.nworkers = 0;
+
+	for (i = 0; i < analysis.nbuckets; i++) {
+		struct analysis_entry	*e;
+
+		while (NULL != (e = analysis.buckets[i])) {
+			analysis.buckets[i] = e->next;
+			xfree(e->path);
+			xfree(e->plugin);
+			xfree(e);
+		}
+	}
+	xfree(analysis.buckets);
+	analysis.buckets = NULL;
+	analysis.nbuckets = analysis.nentries = 0;
+	TAILQ_INIT(&analysis.jobs);
+	if (analysis.cache) {
+		fclose(analysis.cache);
+		analysis.cache = NULL;
+	}
+}
+
+int
+analysis_queue(const char *file, const char *plugin)
+{
+	struct analysis_entry	*e;
+	off_t			 size;
+	time_t			 mtime;
+
+	if (NULL == plugin || 0 > _analysis_stat(file, &size, &mtime))
+		return (-1);
+
+	ANALYSIS_LOCK();
+	if (0 == analysis.nworkers) {
+		ANALYSIS_UNLOCK();
+		return (0);
+	}
+	e = _analysis_find(file);
+	if (e && (ANALYSIS_QUEUED == e->state ||
+	    (e->size == size && e->mtime == mtime))) {
+		ANALYSIS_UNLOCK();
+		return (0);
+	}
+	if (NULL == e)
+		e = _analysis_insert(file);
+	e->size = size;
+	e->mtime = mtime;
+	e->state = ANALYSIS_QUEUED;
+	e->plugin = xstrdup(plugin);
+	TAILQ_INSERT_TAIL(&analysis.jobs, e, job);
+#ifdef HAVE_PTHREAD
+	pthread_cond_signal(&analysis_cv);
+#endif /* HAVE_PTHREAD */
+	ANALYSIS_UNLOCK();
+
+	log_debug("%s: queued for analysis", file);
+
+	return (0);
+}
+
+int
+analysis_lookup(const char *file, struct analysis_result *res)
+{
+	struct analysis_entry	*e;
+	off_t			 size;
+	time_t			 mtime;
+	int			 ret = -1;
+
+	if (0 > _analysis_stat(file, &size, &mtime))
+		return (-1);
+
+	ANALYSIS_LOCK();
+	e = _analysis_find(file);
+	if (e && ANALYSIS_DONE == e->state &&
+	    e->size == size && e->mtime == mtime) {
+		*res = e->result;
+		ret = 0;
+	}
+	ANALYSIS_UNLOCK();
+
+	return (ret);
+}
+
+int
+analysis_file(const char *plugin, const char *file,
+    struct analysis_result *res)
+{
+	return (_analysis_run(plugin, file, res, 0));
+}
+
+void
+analysis_apply(mdata_t md, const char *file)
+{
+	struct analysis_result	res;
+	float			 gain;
+
+	if (NULL == file || 0 > analysis_lookup(file, &res))
+		return;
+
+	if (0 > mdata_get_track_gain(md, &gain) && isfinite(res.loudness))
+		mdata_set_track_gain(md, ANALYSIS_REFERENCE - res.loudness);
+	mdata_set_true_peak(md, res.true_peak);
+	mdata_set_audio_bounds(md, res.audio_start, res.audio_end);
+}
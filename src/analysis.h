@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2026 Moritz Grimm <mgrimm@mrsserver.net>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __ANALYSIS_H__
+#define __ANALYSIS_H__
+
+#include "mdata.h"
+
+/*
+ * Analysis of the audio of a file, which is too expensive to do while the
+ * file is streamed: its integrated loudness according to ITU-R BS.1770-4,
+ * its true peak, and where its leading and trailing silence ends and
+ * begins. Files are analyzed ahead of play by a pool of low-priority
+ * worker threads, and the results are kept in a cache file, keyed by path,
+ * size and modification time.
+ */
+/* Level in dBFS at or below which samples are silent */
+#define ANALYSIS_SILENCE_DB	-60
+
+struct analysis_result {
+	float		 loudness;	/* LUFS, or -INFINITY if silent */
+	float		 true_peak;	/* linear amplitude */
+	unsigned long	 duration;	/* ms */
+	unsigned long	 audio_start;	/* ms of the first audible sample */
+	unsigned long	 audio_end;	/* ms after the last audible sample */
+};
+
+/*
+ * Loads the cache file, creating it if needed, and starts the given number
+ * of worker threads. Without workers, only results in the cache are
+ * available.
+ */
+int	analysis_init(const char * /* cache */, unsigned int /* workers */);
+
+/*
+ * Stops the workers, abandoning the files that are being analyzed, and
+ * closes the cache file.
+ */
+void	analysis_exit(void);
+
+/*
+ * Queues a file for analysis with the given decoder plugin, unless results
+ * for it are cached or it is already queued.
+ */
+int	analysis_queue(const char * /* file */, const char * /* plugin */);
+
+/*
+ * Looks up the cached results for a file. Returns -1 if there are none, or
+ * if the file changed since it was analyzed.
+ */
+int	analysis_lookup(const char *, struct analysis_result *);
+
+/*
+ * Analyzes a file with the given decoder plugin right away, without the
+ * cache.
+ */
+int	analysis_file(const char * /* plugin */, const char * /* file */,
+	    struct analysis_result *);
+
+/*
+ * Adds the cached results for a file to its metadata, which may have come
+ * from a metadata program instead of the file itself. A gain from tags
+ * takes precedence over one derived from the measured loudness.
+ */
+void	analysis_apply(mdata_t, const char * /* file */);
+
+#endif /* __ANALYSIS_H__ */
@@ -0,0 +1,511 @@
+/*
+ * Copyright (c) 2026 Moritz Grimm <mgrimm@mrsserver.net>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+# include <signal.h>
+#endif /* HAVE_PTHREAD */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "archive.h"
+#include "log.h"
+#include "xalloc.h"
+
+#define ARCHIVE_MARKS		256
+/* The writer waits for this much data, or for ARCHIVE_FLUSH seconds: */
+#define ARCHIVE_BATCH		(256 * 1024)
+#define ARCHIVE_FLUSH		1
+/* Seconds that a due rotation waits for a point to begin a new file at */
+#define ARCHIVE_GRACE		60
+#define ARCHIVE_SUFFIX_MAX	100
+
+/*
+ * A mark begins a segment of the buffered data, which lasts until the next
+ * mark. The wait of the segment in the buffer is measured from the time
+ * the mark was set; data that was added without a mark of its own, while
+ * all marks were in use, counts as having waited as long as its segment.
+ */
+struct archive_mark {
+	uint64_t		 pos;
+	struct timespec 	 queued;
+	int			 rotate;
+	time_t			 wall;
+};
+
+struct archive {
+	char			*dir;
+	char			*name;
+	char			*ext;
+	unsigned int		 rotate_secs;
+	unsigned long long	 rotate_bytes;
+
+	/* Shared between the stream and the writer, under the lock: */
+	char			*buf;
+	size_t			 size;
+	uint64_t		 head;
+	uint64_t		 tail;
+	struct archive_mark	 marks[ARCHIVE_MARKS];
+	size_t			 mark_first;
+	size_t			 mark_num;
+	int			 stop;
+	struct archive_stats	 stats;
+
+	/* Used by the stream only: */
+	int			 started;
+	int			 dropping;
+	int			 due;
+	struct timespec 	 due_since;
+	time_t			 next_rotate;
+	unsigned long long	 file_bytes;
+
+	/* Used by the writer only: */
+	int			 fd;
+	char			 path[PATH_MAX];
+
+#ifdef HAVE_PTHREAD
+	pthread_t		 thread;
+	pthread_mutex_t 	 mtx;
+	pthread_cond_t		 cv;
+#endif /* HAVE_PTHREAD */
+};
+
+#ifdef HAVE_PTHREAD
+# define ARCHIVE_LOCK(a)	pthread_mutex_lock(&(a)->mtx)
+# define ARCHIVE_UNLOCK(a)	pthread_mutex_unlock(&(a)->mtx)
+#else
+# define ARCHIVE_LOCK(a)	do { } while (0)
+# define ARCHIVE_UNLOCK(a)	do { } while (0)
+#endif /* HAVE_PTHREAD */
+
+static int	_archive_due(struct archive *);
+static void	_archive_rotate(struct archive *, const char *, size_t);
+static int	_archive_queue(struct archive *, const char *, size_t, int);
+#ifdef HAVE_PTHREAD
+static void	_archive_open(struct archive *, time_t);
+static void	_archive_close(struct archive *);
+static int	_archive_out(struct archive *, const char *, size_t);
+static void *	_archive_writer(void *);
+#endif /* HAVE_PTHREAD */
+
+static int
+_archive_due(struct archive *a)
+{
+	struct timespec now;
+
+	if (a->started &&
+	    !(a->rotate_bytes && a->file_bytes >= a->rotate_bytes) &&
+	    !(a->next_rotate && time(NULL) >= a->next_rotate)) {
+		a->due = 0;
+		return (0);
+	}
+	if (!a->due) {
+		a->due = 1;
+		clock_gettime(CLOCK_MONOTONIC, &a->due_since);
+		return (1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (now.tv_sec - a->due_since.tv_sec >= ARCHIVE_GRACE) {
+		_archive_rotate(a, NULL, 0);
+		if (!a->due)
+			log_warning("archive: %s: no point to begin a new file at, began one anyway",
+			    a->name);
+	}
+
+	return (a->due);
+}
+
+static void
+_archive_rotate(struct archive *a, const char *header, size_t header_len)
+{
+	time_t	now = time(NULL);
+
+	/* Try again at the next point if there is no room: */
+	if (0 > _archive_queue(a, header, header_len, 1))
+		return;
+	a->started = 1;
+	a->due = 0;
+	a->file_bytes = header_len;
+	if (a->rotate_secs)
+		a->next_rotate = (now / a->rotate_secs + 1) * a->rotate_secs;
+}
+
+static int
+_archive_queue(struct archive *a, const char *data, size_t len, int rotate)
+{
+	struct archive_mark	*m = NULL;
+	size_t			 off, n;
+	int			 empty;
+
+	ARCHIVE_LOCK(a);
+	if (a->size - (size_t)(a->head - a->tail) < len) {
+		if (!rotate)
+			a->stats.dropped += len;
+		ARCHIVE_UNLOCK(a);
+		if (!rotate && !a->dropping) {
+			log_warning("archive: %s: writing falls behind, dropping data",
+			    a->name);
+			a->dropping = 1;
+		}
+		return (-1);
+	}
+	if (a->mark_num) {
+		m = &a->marks[(a->mark_first + a->mark_num - 1) %
+		    ARCHIVE_MARKS];
+		/* An empty segment is taken over: */
+		if (m->pos != a->head)
+			m = NULL;
+	}
+	if (NULL == m && ARCHIVE_MARKS > a->mark_num) {
+		m = &a->marks[(a->mark_first + a->mark_num) % ARCHIVE_MARKS];
+		a->mark_num++;
+		m->pos = a->head;
+		m->rotate = 0;
+	}
+	if (NULL == m && rotate) {
+		ARCHIVE_UNLOCK(a);
+		return (-1);
+	}
+	if (m) {
+		clock_gettime(CLOCK_MONOTONIC, &m->queued);
+		if (rotate) {
+			m->rotate = 1;
+			m->wall = time(NULL);
+		}
+	}
+	empty = a->head == a->tail;
+	off = (size_t)(a->head % a->size);
+	n = a->size - off < len ? a->size - off : len;
+	if (n)
+		memcpy(a->buf + off, data, n);
+	if (len - n)
+		memcpy(a->buf, data + n, len - n);
+	a->head += len;
+#ifdef HAVE_PTHREAD
+	/* The writer only looks at the time while there is data: */
+	if (rotate || empty || ARCHIVE_BATCH <= a->head - a->tail)
+		pthread_cond_signal(&a->cv);
+#endif /* HAVE_PTHREAD */
+	ARCHIVE_UNLOCK(a);
+	a->dropping = 0;
+
+	return (0);
+}
+
+#ifdef HAVE_PTHREAD
+static void
+_archive_open(struct archive *a, time_t wall)
+{
+	struct tm	tm;
+	char		tbuf[32];
+	size_t		len;
+	unsigned int	i;
+
+	_archive_close(a);
+
+	if (NULL == localtime_r(&wall, &tm) ||
+	    0 == strftime(tbuf, sizeof(tbuf), "%Y%m%d-%H%M%S", &tm))
+		(void)snprintf(tbuf, sizeof(tbuf), "%lld", (long long)wall);
+	for (i = 0; i < ARCHIVE_SUFFIX_MAX; i++) {
+		if (i)
+			len = (size_t)snprintf(a->path, sizeof(a->path),
+			    "%s/%s-%s-%u.%s", a->dir, a->name, tbuf, i, a->ext);
+		else
+			len = (size_t)snprintf(a->path, sizeof(a->path),
+			    "%s/%s-%s.%s", a->dir, a->name, tbuf, a->ext);
+		if (len >= sizeof(a->path)) {
+			log_error("archive: %s/%s: path too long", a->dir,
+			    a->name);
+			return;
+		}
+		a->fd = open(a->path, O_WRONLY | O_CREAT | O_EXCL | O_APPEND,
+		    S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+		if (0 <= a->fd) {
+			log_info("archive: %s: new file", a->path);
+			return;
+		}
+		if (EEXIST != errno)
+			break;
+	}
+	log_error("archive: %s: %s", a->path, strerror(errno));
+}
+
+static void
+_archive_close(struct archive *a)
+{
+	if (0 > a->fd)
+		return;
+	if (0 > fsync(a->fd) && EINVAL != errno)
+		log_warning("archive: %s: %s", a->path, strerror(errno));
+	if (0 > close(a->fd))
+		log_warning("archive: %s: %s", a->path, strerror(errno));
+	a->fd = -1;
+}
+
+/*
+ * Data that cannot be written is dropped, and so is everything after it
+ * until the next file begins.
+ */
+static int
+_archive_out(struct archive *a, const char *data, size_t len)
+{
+	ssize_t ret;
+
+	while (0 <= a->fd && len) {
+		if (0 > (ret = write(a->fd, data, len))) {
+			if (EINTR == errno)
+				continue;
+			log_error("archive: %s: %s", a->path, strerror(errno));
+			_archive_close(a);
+			break;
+		}
+		data += ret;
+		len -= (size_t)ret;
+	}
+
+	return (len ? -1 : 0);
+}
+
+/*
+ * Writes out everything up to the next point at which a new file begins,
+ * across as many segments as there are, with one write(2) or two where the
+ * data wraps around the end of the buffer. Marks only serve to measure how
+ * long their segments waited, once they are written.
+ */
+static void *
+_archive_writer(void *arg)
+{
+	struct archive		*a = arg;
+	struct archive_mark	*m, *r;
+	struct timespec 	 deadline, now;
+	uint64_t		 end, next;
+	size_t			 off, n, wrap, i;
+	time_t			 wall;
+	int			 rotate, flush = 0, ret;
+
+	ARCHIVE_LOCK(a);
+	for (;;) {
+		if (a->head == a->tail) {
+			if (a->stop)
+				break;
+			flush = 0;
+			pthread_cond_wait(&a->cv, &a->mtx);
+			continue;
+		}
+		m = &a->marks[a->mark_first];
+		if (!a->stop && !flush && !m->rotate &&
+		    ARCHIVE_BATCH > a->head - a->tail) {
+			/* Collect more data, but not for too long: */
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_sec += ARCHIVE_FLUSH;
+			if (ETIMEDOUT == pthread_cond_timedwait(&a->cv,
+			    &a->mtx, &deadline))
+				flush = 1;
+			continue;
+		}
+		end = a->head;
+		for (i = 1; i < a->mark_num; i++) {
+			r = &a->marks[(a->mark_first + i) % ARCHIVE_MARKS];
+			if (r->rotate) {
+				end = r->pos;
+				break;
+			}
+		}
+		rotate = m->rotate;
+		wall = m->wall;
+		m->rotate = 0;
+		off = (size_t)(a->tail % a->size);
+		n = (size_t)(end - a->tail);
+		wrap = n > a->size - off ? n - (a->size - off) : 0;
+		ARCHIVE_UNLOCK(a);
+
+		if (rotate)
+			_archive_open(a, wall);
+		ret = _archive_out(a, a->buf + off, n - wrap);
+		if (0 == ret && wrap)
+			ret = _archive_out(a, a->buf, wrap);
+
+		ARCHIVE_LOCK(a);
+		a->tail += n;
+		if (0 == ret)
+			a->stats.written += n;
+		else
+			a->stats.dropped += n;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		while (a->mark_num) {
+			m = &a->marks[a->mark_first];
+			next = 1 < a->mark_num ?
+			    a->marks[(a->mark_first + 1) % ARCHIVE_MARKS].pos :
+			    a->head;
+			/* A new file still has to begin at the next one: */
+			if (m->rotate || next > a->tail)
+				break;
+			if (ARCHIVE_LAGS > a->stats.lag_num)
+				a->stats.lag[a->stats.lag_num++] =
+				    (double)(now.tv_sec - m->queued.tv_sec) +
+				    (double)(now.tv_nsec - m->queued.tv_nsec) /
+				    1000000000.0;
+			a->mark_first = (a->mark_first + 1) % ARCHIVE_MARKS;
+			a->mark_num--;
+		}
+	}
+	ARCHIVE_UNLOCK(a);
+
+	_archive_close(a);
+
+	return (NULL);
+}
+#endif /* HAVE_PTHREAD */
+
+struct archive *
+archive_create(const char *dir, const char *name, const char *ext,
+    unsigned int rotate_secs, unsigned long long rotate_bytes,
+    size_t buffer_size)
+{
+#ifdef HAVE_PTHREAD
+	struct archive	*a;
+	struct stat	 st;
+	sigset_t	 all, old;
+	char		*p;
+	int		 error;
+
+	if (0 > stat(dir, &st)) {
+		log_error("archive: %s: %s", dir, strerror(errno));
+		return (NULL);
+	}
+	if (!S_ISDIR(st.st_mode)) {
+		log_error("archive: %s: not a directory", dir);
+		return (NULL);
+	}
+
+	a = xcalloc(1UL, sizeof(*a));
+	a->dir = xstrdup(dir);
+	a->name = xstrdup(name);
+	/* Stream names become part of file names: */
+	for (p = a->name; *p; p++) {
+		if ('/' == *p)
+			*p = '_';
+	}
+	a->ext = xstrdup(ext);
+	a->rotate_secs = rotate_secs;
+	a->rotate_bytes = rotate_bytes;
+	a->size = buffer_size;
+	a->buf = xmalloc(a->size);
+	a->fd = -1;
+	pthread_mutex_init(&a->mtx, NULL);
+	pthread_cond_init(&a->cv, NULL);
+
+	/* Leave signal handling to the main thread: */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	error = pthread_create(&a->thread, NULL, _archive_writer, a);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (error) {
+		log_error("archive: cannot start writer: %s",
+		    strerror(error));
+		pthread_cond_destroy(&a->cv);
+		pthread_mutex_destroy(&a->mtx);
+		xfree(a->buf);
+		xfree(a->ext);
+		xfree(a->name);
+		xfree(a->dir);
+		xfree(a);
+		return (NULL);
+	}
+
+	log_debug("archive: %s: %s files in %s, %zu byte buffer", name, ext,
+	    dir, buffer_size);
+
+	return (a);
+#else /* HAVE_PTHREAD */
+	(void)dir;
+	(void)ext;
+	(void)rotate_secs;
+	(void)rotate_bytes;
+	(void)buffer_size;
+	log_error("archive: %s: no thread support", name);
+	return (NULL);
+#endif /* HAVE_PTHREAD */
+}
+
+void
+archive_destroy(struct archive **a_p)
+{
+	struct archive	*a = *a_p;
+
+	if (!a)
+		return;
+
+#ifdef HAVE_PTHREAD
+	ARCHIVE_LOCK(a);
+	a->stop = 1;
+	pthread_cond_signal(&a->cv);
+	ARCHIVE_UNLOCK(a);
+	pthread_join(a->thread, NULL);
+	pthread_cond_destroy(&a->cv);
+	pthread_mutex_destroy(&a->mtx);
+#endif /* HAVE_PTHREAD */
+
+	xfree(a->buf);
+	xfree(a->ext);
+	xfree(a->name);
+	xfree(a->dir);
+	xfree(a);
+	*a_p = NULL;
+}
+
+void
+archive_write(struct archive *a, const char *data, size_t len)
+{
+	if (0 == len)
+		return;
+	(void)_archive_due(a);
+	if (!a->started)
+		return;
+	if (0 == _archive_queue(a, data, len, 0))
+		a->file_bytes += len;
+}
+
+void
+archive_cut(struct archive *a, const char *header, size_t header_len)
+{
+	if (_archive_due(a))
+		_archive_rotate(a, header, header_len);
+}
+
+void
+archive_poll(struct archive *a, struct archive_stats *stats)
+{
+	ARCHIVE_LOCK(a);
+	memcpy(stats, &a->stats, sizeof(*stats));
+	a->stats.written = 0;
+	a->stats.dropped = 0;
+	a->stats.lag_num = 0;
+	ARCHIVE_UNLOCK(a);
+}
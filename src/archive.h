@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2026 Moritz Grimm <mgrimm@mrsserver.net>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __ARCHIVE_H__
+#define __ARCHIVE_H__
+
+#include <stddef.h>
+
+/*
+ * A local copy of an outgoing stream, in files that are rotated by time or
+ * size. Data is buffered in memory and written to disk by a thread of its
+ * own, so that a slow disk never holds up streaming. Data that does not
+ * fit into the buffer is dropped instead.
+ */
+typedef struct archive *	archive_t;
+
+#define ARCHIVE_LAGS	64
+
+struct archive_stats {
+	unsigned long	 written;		/* bytes */
+	unsigned long	 dropped;		/* bytes */
+	double		 lag[ARCHIVE_LAGS];	/* seconds */
+	size_t		 lag_num;
+};
+
+/*
+ * Archive files are named after the stream, the local time at which they
+ * begin and the extension, as in <directory>/<name>-YYYYmmdd-HHMMSS.<ext>.
+ * A rotation time of 0 or a rotation size of 0 disables the respective
+ * rotation. Time-based rotation happens on multiples of the interval.
+ */
+archive_t
+	archive_create(const char * /* directory */, const char * /* name */,
+	    const char * /* ext */, unsigned int /* rotate secs */,
+	    unsigned long long /* rotate bytes */, size_t /* buffer size */);
+/*
+ * Writes out all buffered data, closes the current file, and stops the
+ * writer thread.
+ */
+void	archive_destroy(archive_t *);
+
+/* Adds data of the stream to the archive. */
+void	archive_write(archive_t, const char *, size_t);
+/*
+ * Marks a point in the stream at which a new file may begin, with the
+ * stream header that a new file needs to start with there. Data is only
+ * archived after the first such point, unless none comes up for a minute.
+ */
+void	archive_cut(archive_t, const char * /* header */, size_t);
+
+/*
+ * Collects the number of bytes written and dropped, and how long written
+ * data waited in the buffer, since the last call.
+ */
+void	archive_poll(archive_t, struct archive_stats *);
+
+#endif /* __ARCHIVE_H__ */
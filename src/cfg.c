@@ -22,6 +22,7 @@
 
 #include <sys/stat.h>
 
+#include <ctype.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,6 +35,7 @@
 static struct cfg_program	cfg_program;
 static struct cfg		cfg;
 static struct cfg		cfg_tmp;
+static unsigned int		cfg_generation;
 
 static void	_cfg_reset(struct cfg *);
 static void	_cfg_switch(struct cfg *, struct cfg *);
@@ -41,6 +43,186 @@ static int	_cfg_load(void);
 static void	_cfg_save(void);
 static void	_cfg_restore(void);
 static void	_cfg_commit(void);
+static size_t	_cfg_index_hash(const char *);
+static void	_cfg_index_grow(struct cfg_index *);
+
+util_template_t
+cfg_template_compile(const char *str)
+{
+	static const char *const	placeholders[CFG_PH_MAX + 1] = {
+		PLACEHOLDER_METADATA,
+		PLACEHOLDER_ARTIST,
+		PLACEHOLDER_ALBUM,
+		PLACEHOLDER_TITLE,
+		PLACEHOLDER_TRACK,
+		PLACEHOLDER_STRING,
+		NULL
+	};
+
+	return (util_template_compile(str, placeholders));
+}
+
+#define CFG_INDEX_MIN_BUCKETS	16U
+
+struct cfg_index_entry {
+	struct cfg_index_entry	*next;
+	size_t			 hash;
+	char			*key;
+	void			*value;
+};
+
+struct cfg_index {
+	struct cfg_index_entry	**buckets;
+	size_t			  nbuckets;
+	size_t			  nentries;
+};
+
+static size_t
+_cfg_index_hash(const char *key)
+{
+	const unsigned char	*p;
+	size_t			 h = 2166136261U;
+
+	/* FNV-1a of the lower-cased key */
+	for (p = (const unsigned char *)key; *p; p++) {
+		h ^= (size_t)tolower(*p);
+		h *= 16777619U;
+	}
+
+	return (h);
+}
+
+static void
+_cfg_index_grow(struct cfg_index *idx)
+{
+	struct cfg_index_entry	**buckets;
+	size_t			  nbuckets, i;
+
+	nbuckets = idx->nbuckets ? idx->nbuckets * 2 : CFG_INDEX_MIN_BUCKETS;
+	buckets = xcalloc(nbuckets, sizeof(*buckets));
+	for (i = 0; i < idx->nbuckets; i++) {
+		struct cfg_index_entry	*e, *next;
+
+		for (e = idx->buckets[i]; e; e = next) {
+			next = e->next;
+			e->next = buckets[e->hash & (nbuckets - 1)];
+			buckets[e->hash & (nbuckets - 1)] = e;
+		}
+	}
+	xfree(idx->buckets);
+	idx->buckets = buckets;
+	idx->nbuckets = nbuckets;
+}
+
+struct cfg_index *
+cfg_index_create(void)
+{
+	struct cfg_index	*idx;
+
+	idx = xcalloc(1UL, sizeof(*idx));
+	_cfg_index_grow(idx);
+
+	return (idx);
+}
+
+void
+cfg_index_destroy(struct cfg_index **idx_p)
+{
+	struct cfg_index	*idx = *idx_p;
+	size_t			 i;
+
+	if (!idx)
+		return;
+
+	for (i = 0; i < idx->nbuckets; i++) {
+		struct cfg_index_entry	*e;
+
+		while (NULL != (e = idx->buckets[i])) {
+			idx->buckets[i] = e->next;
+			xfree(e->key);
+			xfree(e);
+		}
+	}
+	xfree(idx->buckets);
+	xfree(idx);
+	*idx_p = NULL;
+}
+
+void
+cfg_index_set(struct cfg_index *idx, const char *key, void *value)
+{
+	struct cfg_index_entry	*e;
+	size_t			 hash = _cfg_index_hash(key);
+
+	for (e = idx->buckets[hash & (idx->nbuckets - 1)]; e; e = e->next) {
+		if (e->hash == hash && 0 == strcasecmp(e->key, key)) {
+			e->value = value;
+			return;
+		}
+	}
+
+	if (idx->nentries >= idx->nbuckets)
+		_cfg_index_grow(idx);
+	e = xcalloc(1UL, sizeof(*e));
+	e->hash = hash;
+	e->key = xstrdup(key);
+	e->value = value;
+	e->next = idx->buckets[hash & (idx->nbuckets - 1)];
+	idx->buckets[hash & (idx->nbuckets - 1)] = e;
+	idx->nentries++;
+}
+
+void
+cfg_index_remove(struct cfg_index *idx, const char *key, const void *value)
+{
+	struct cfg_index_entry	**e_p, *e;
+	size_t			  hash = _cfg_index_hash(key);
+
+	for (e_p = &idx->buckets[hash & (idx->nbuckets - 1)]; *e_p;
+	    e_p = &(*e_p)->next) {
+		e = *e_p;
+		if (e->hash != hash || 0 != strcasecmp(e->key, key))
+			continue;
+		/* Only remove the entry if it still refers to value: */
+		if (e->value != value)
+			return;
+		*e_p = e->next;
+		xfree(e->key);
+		xfree(e);
+		idx->nentries--;
+		return;
+	}
+}
+
+void *
+cfg_index_get(struct cfg_index *idx, const char *key)
+{
+	struct cfg_index_entry	*e;
+	size_t			 hash;
+
+	if (!key)
+		return (NULL);
+
+	hash = _cfg_index_hash(key);
+	for (e = idx->buckets[hash & (idx->nbuckets - 1)]; e; e = e->next) {
+		if (e->hash == hash && 0 == strcasecmp(e->key, key))
+			return (e->value);
+	}
+
+	return (NULL);
+}
+
+void
+cfg_bump_generation(void)
+{
+	cfg_generation++;
+}
+
+unsigned int
+cfg_get_generation(void)
+{
+	return (cfg_generation);
+}
 
 static void
 _cfg_reset(struct cfg *c)
@@ -51,11 +233,14 @@ _cfg_reset(struct cfg *c)
 	cfg_encoder_list_destroy(&c->encoders);
 	cfg_decoder_list_destroy(&c->decoders);
 
-	xfree(c->metadata.format_str);
+	util_template_destroy(&c->metadata.format_tmpl);
 
 	memset(c, 0, sizeof(*c));
 
 	c->metadata.refresh_interval = -1;
+	c->archive.rotate_time = -1;
+
+	cfg_bump_generation();
 }
 
 static void
@@ -122,17 +307,38 @@ cfg_exit(void)
 
 int
 cfg_file_reload(void)
+{
+	if (0 > cfg_file_reload_begin())
+		return (-1);
+	cfg_file_reload_commit();
+
+	return (0);
+}
+
+int
+cfg_file_reload_begin(void)
 {
 	_cfg_save();
 	if (0 > _cfg_load()) {
 		_cfg_restore();
 		return (-1);
 	}
-	_cfg_commit();
 
 	return (0);
 }
 
+void
+cfg_file_reload_commit(void)
+{
+	_cfg_commit();
+}
+
+void
+cfg_file_reload_rollback(void)
+{
+	_cfg_restore();
+}
+
 int
 cfg_check(const char **not_used)
 {
@@ -258,6 +464,37 @@ cfg_set_program_rtstatus_output(int rtstatus_output, const char **not_used)
 	return (0);
 }
 
+int
+cfg_set_program_rtstatus_interval(const char *num_str, const char **errstrp)
+{
+	const char	*errstr;
+	unsigned int	 num;
+
+	if (!num_str || !num_str[0]) {
+		if (errstrp)
+			*errstrp = "empty";
+		return (-1);
+	}
+	num = (unsigned int)strtonum(num_str, CFG_RTSTATUS_INTERVAL_MIN,
+	    CFG_RTSTATUS_INTERVAL_MAX, &errstr);
+	if (errstr) {
+		if (errstrp)
+			*errstrp = errstr;
+		return (-1);
+	}
+	cfg_program.rtstatus_interval = num;
+
+	return (0);
+}
+
+int
+cfg_set_program_rtstatus_json(int rtstatus_json, const char **not_used)
+{
+	(void)not_used;
+	cfg_program.rtstatus_json = rtstatus_json ? 1 : 0;
+	return (0);
+}
+
 int
 cfg_set_program_verbosity(unsigned int verbosity, const char **not_used)
 {
@@ -288,9 +525,8 @@ cfg_set_metadata_format_str(const char *format_str, const char **errstrp)
 	CHECKPH_DUPLICATE(format_str, PLACEHOLDER_ARTIST);
 	CHECKPH_DUPLICATE(format_str, PLACEHOLDER_TITLE);
 
-	if (cfg.metadata.format_str)
-		xfree(cfg.metadata.format_str);
-	cfg.metadata.format_str = xstrdup(format_str);
+	util_template_destroy(&cfg.metadata.format_tmpl);
+	cfg.metadata.format_tmpl = cfg_template_compile(format_str);
 
 	return (0);
 }
@@ -319,6 +555,181 @@ cfg_set_metadata_no_updates(const char *no_updates, const char **errstrp)
 	return (0);
 }
 
+int
+cfg_set_metrics_listen(const char *listen, const char **errstrp)
+{
+	SET_STRLCPY(cfg.metrics.listen, listen, errstrp);
+	return (0);
+}
+
+int
+cfg_set_control_socket(const char *socket, const char **errstrp)
+{
+	if (socket && socket[0] && '/' != socket[0]) {
+		if (errstrp)
+			*errstrp = "not an absolute path";
+		return (-1);
+	}
+	SET_STRLCPY(cfg.control.socket, socket, errstrp);
+	return (0);
+}
+
+int
+cfg_set_analysis_cache(const char *cache, const char **errstrp)
+{
+	SET_STRLCPY(cfg.analysis.cache, cache, errstrp);
+	return (0);
+}
+
+int
+cfg_set_analysis_workers(const char *num_str, const char **errstrp)
+{
+	const char	*errstr;
+	unsigned int	 num;
+
+	if (!num_str || !num_str[0]) {
+		if (errstrp)
+			*errstrp = "empty";
+		return (-1);
+	}
+	num = (unsigned int)strtonum(num_str, 1, CFG_ANALYSIS_WORKERS_MAX,
+	    &errstr);
+	if (errstr) {
+		if (errstrp)
+			*errstrp = errstr;
+		return (-1);
+	}
+	cfg.analysis.workers = num;
+
+	return (0);
+}
+
+int
+cfg_set_archive_directory(const char *dir, const char **errstrp)
+{
+	SET_STRLCPY(cfg.archive.directory, dir, errstrp);
+	return (0);
+}
+
+int
+cfg_set_archive_rotate_time(const char *num_str, const char **errstrp)
+{
+	const char	*errstr;
+	int		 num;
+
+	if (!num_str || !num_str[0]) {
+		if (errstrp)
+			*errstrp = "empty";
+		return (-1);
+	}
+	num = (int)strtonum(num_str, 0, CFG_ARCHIVE_ROTATE_TIME_MAX, &errstr);
+	if (errstr) {
+		if (errstrp)
+			*errstrp = errstr;
+		return (-1);
+	}
+	cfg.archive.rotate_time = num;
+
+	return (0);
+}
+
+int
+cfg_set_archive_rotate_size(const char *num_str, const char **errstrp)
+{
+	const char	*errstr;
+	unsigned int	 num;
+
+	if (!num_str || !num_str[0]) {
+		if (errstrp)
+			*errstrp = "empty";
+		return (-1);
+	}
+	num = (unsigned int)strtonum(num_str, 0, CFG_ARCHIVE_ROTATE_SIZE_MAX,
+	    &errstr);
+	if (errstr) {
+		if (errstrp)
+			*errstrp = errstr;
+		return (-1);
+	}
+	cfg.archive.rotate_size = num;
+
+	return (0);
+}
+
+int
+cfg_set_archive_buffer_size(const char *num_str, const char **errstrp)
+{
+	const char	*errstr;
+	unsigned int	 num;
+
+	if (!num_str || !num_str[0]) {
+		if (errstrp)
+			*errstrp = "empty";
+		return (-1);
+	}
+	num = (unsigned int)strtonum(num_str, 1, CFG_ARCHIVE_BUFFER_SIZE_MAX,
+	    &errstr);
+	if (errstr) {
+		if (errstrp)
+			*errstrp = errstr;
+		return (-1);
+	}
+	cfg.archive.buffer_size = num;
+
+	return (0);
+}
+
+int
+cfg_set_logging_target(const char *target, const char **errstrp)
+{
+	if (target && target[0] &&
+	    0 != strcmp(target, "syslog") &&
+	    0 != strcmp(target, "stderr") &&
+	    '/' != target[0]) {
+		if (errstrp)
+			*errstrp = "invalid";
+		return (-1);
+	}
+	SET_STRLCPY(cfg.logging.target, target, errstrp);
+	return (0);
+}
+
+int
+cfg_set_logging_async(const char *async, const char **errstrp)
+{
+	SET_BOOLEAN(cfg.logging.async, async, errstrp);
+	return (0);
+}
+
+int
+cfg_set_logging_rate_limit(const char *num_str, const char **errstrp)
+{
+	SET_UINTNUM(cfg.logging.rate_limit, num_str, errstrp);
+	return (0);
+}
+
+int
+cfg_set_logging_format(const char *format, const char **errstrp)
+{
+	if (!format || !format[0]) {
+		if (errstrp)
+			*errstrp = "empty";
+		return (-1);
+	}
+
+	if (0 == strcasecmp(format, "text"))
+		cfg.logging.format = CFG_LOG_FORMAT_TEXT;
+	else if (0 == strcasecmp(format, "json"))
+		cfg.logging.format = CFG_LOG_FORMAT_JSON;
+	else {
+		if (errstrp)
+			*errstrp = "invalid";
+		return (-1);
+	}
+
+	return (0);
+}
+
 const char *
 cfg_get_program_name(void)
 {
@@ -355,6 +766,19 @@ cfg_get_program_rtstatus_output(void)
 	return (cfg_program.rtstatus_output);
 }
 
+unsigned int
+cfg_get_program_rtstatus_interval(void)
+{
+	return (cfg_program.rtstatus_interval ?
+	    cfg_program.rtstatus_interval : CFG_RTSTATUS_INTERVAL_DEFAULT);
+}
+
+int
+cfg_get_program_rtstatus_json(void)
+{
+	return (cfg_program.rtstatus_json);
+}
+
 unsigned int
 cfg_get_program_verbosity(void)
 {
@@ -370,7 +794,14 @@ cfg_get_metadata_program(void)
 const char *
 cfg_get_metadata_format_str(void)
 {
-	return (cfg.metadata.format_str);
+	return (cfg.metadata.format_tmpl ?
+	    util_template_get_source(cfg.metadata.format_tmpl) : NULL);
+}
+
+util_template_t
+cfg_get_metadata_format_template(void)
+{
+	return (cfg.metadata.format_tmpl);
 }
 
 int
@@ -390,3 +821,79 @@ cfg_get_metadata_no_updates(void)
 {
 	return (cfg.metadata.no_updates);
 }
+
+const char *
+cfg_get_metrics_listen(void)
+{
+	return (cfg.metrics.listen[0] ? cfg.metrics.listen : NULL);
+}
+
+const char *
+cfg_get_control_socket(void)
+{
+	return (cfg.control.socket[0] ? cfg.control.socket : NULL);
+}
+
+const char *
+cfg_get_analysis_cache(void)
+{
+	return (cfg.analysis.cache[0] ? cfg.analysis.cache : NULL);
+}
+
+unsigned int
+cfg_get_analysis_workers(void)
+{
+	return (cfg.analysis.workers ?
+	    cfg.analysis.workers : CFG_ANALYSIS_WORKERS_DEFAULT);
+}
+
+const char *
+cfg_get_archive_directory(void)
+{
+	return (cfg.archive.directory[0] ? cfg.archive.directory : NULL);
+}
+
+unsigned int
+cfg_get_archive_rotate_time(void)
+{
+	return (0 > cfg.archive.rotate_time ?
+	    CFG_ARCHIVE_ROTATE_TIME_DEFAULT :
+	    (unsigned int)cfg.archive.rotate_time);
+}
+
+unsigned int
+cfg_get_archive_rotate_size(void)
+{
+	return (cfg.archive.rotate_size);
+}
+
+unsigned int
+cfg_get_archive_buffer_size(void)
+{
+	return (cfg.archive.buffer_size ?
+	    cfg.archive.buffer_size : CFG_ARCHIVE_BUFFER_SIZE_DEFAULT);
+}
+
+const char *
+cfg_get_logging_target(void)
+{
+	return (cfg.logging.target[0] ? cfg.logging.target : NULL);
+}
+
+int
+cfg_get_logging_async(void)
+{
+	return (cfg.logging.async);
+}
+
+unsigned int
+cfg_get_logging_rate_limit(void)
+{
+	return (cfg.logging.rate_limit);
+}
+
+enum cfg_log_format
+cfg_get_logging_format(void)
+{
+	return (cfg.logging.format);
+}
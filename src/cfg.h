@@ -24,14 +24,46 @@
 #define PLACEHOLDER_TRACK	"@T@"
 #define PLACEHOLDER_STRING	"@s@"
 
+/* Placeholder indexes in compiled templates: */
+enum cfg_placeholder {
+	CFG_PH_METADATA = 0,
+	CFG_PH_ARTIST,
+	CFG_PH_ALBUM,
+	CFG_PH_TITLE,
+	CFG_PH_TRACK,
+	CFG_PH_STRING,
+	CFG_PH_MAX
+};
+
 #define CFG_DEFAULT		"default"
 
+#define CFG_RTSTATUS_INTERVAL_MIN	10
+#define CFG_RTSTATUS_INTERVAL_MAX	60000
+#define CFG_RTSTATUS_INTERVAL_DEFAULT	500
+
+#define CFG_ANALYSIS_WORKERS_MAX	16
+#define CFG_ANALYSIS_WORKERS_DEFAULT	1
+
+/* Archive rotation in seconds, and sizes in MiB: */
+#define CFG_ARCHIVE_ROTATE_TIME_MAX	604800
+#define CFG_ARCHIVE_ROTATE_TIME_DEFAULT 3600
+#define CFG_ARCHIVE_ROTATE_SIZE_MAX	1048576
+#define CFG_ARCHIVE_BUFFER_SIZE_MAX	1024
+#define CFG_ARCHIVE_BUFFER_SIZE_DEFAULT 16
+
+enum cfg_log_format {
+	CFG_LOG_FORMAT_TEXT = 0,
+	CFG_LOG_FORMAT_JSON,
+};
+
 enum cfg_config_type {
 	CFG_TYPE_XMLFILE = 0,
 	CFG_TYPE_MIN = CFG_TYPE_XMLFILE,
 	CFG_TYPE_MAX = CFG_TYPE_XMLFILE,
 };
 
+#include "util.h"
+
 #include "cfg_decoder.h"
 #include "cfg_encoder.h"
 #include "cfg_intake.h"
@@ -42,11 +74,24 @@ int	cfg_init(void);
 void	cfg_exit(void);
 
 int	cfg_file_reload(void);
+int	cfg_file_reload_begin(void);
+void	cfg_file_reload_commit(void);
+void	cfg_file_reload_rollback(void);
 
 int	cfg_check(const char **);
 
+util_template_t
+	cfg_template_compile(const char *);
+
 int	cfg_file_check(const char *);
 
+/*
+ * Changes whenever objects in the configuration lists may have been
+ * replaced or renamed, so that callers can cache what they look up.
+ */
+unsigned int
+	cfg_get_generation(void);
+
 cfg_decoder_list_t
 	cfg_get_decoders(void);
 cfg_encoder_list_t
@@ -64,6 +109,8 @@ int	cfg_set_program_config_file(const char *, const char **);
 int	cfg_set_program_pid_file(const char *, const char **);
 int	cfg_set_program_quiet_stderr(int, const char **);
 int	cfg_set_program_rtstatus_output(int, const char **);
+int	cfg_set_program_rtstatus_interval(const char *, const char **);
+int	cfg_set_program_rtstatus_json(int, const char **);
 int	cfg_set_program_verbosity(unsigned int, const char **);
 
 int	cfg_set_metadata_program(const char *, const char **);
@@ -72,6 +119,23 @@ int	cfg_set_metadata_refresh_interval(const char *, const char **);
 int	cfg_set_metadata_normalize_strings(const char *, const char **);
 int	cfg_set_metadata_no_updates(const char *, const char **);
 
+int	cfg_set_metrics_listen(const char *, const char **);
+
+int	cfg_set_control_socket(const char *, const char **);
+
+int	cfg_set_analysis_cache(const char *, const char **);
+int	cfg_set_analysis_workers(const char *, const char **);
+
+int	cfg_set_archive_directory(const char *, const char **);
+int	cfg_set_archive_rotate_time(const char *, const char **);
+int	cfg_set_archive_rotate_size(const char *, const char **);
+int	cfg_set_archive_buffer_size(const char *, const char **);
+
+int	cfg_set_logging_target(const char *, const char **);
+int	cfg_set_logging_async(const char *, const char **);
+int	cfg_set_logging_rate_limit(const char *, const char **);
+int	cfg_set_logging_format(const char *, const char **);
+
 const char *
 	cfg_get_program_name(void);
 enum cfg_config_type
@@ -82,6 +146,9 @@ const char *
 	cfg_get_program_pid_file(void);
 int	cfg_get_program_quiet_stderr(void);
 int	cfg_get_program_rtstatus_output(void);
+unsigned int
+	cfg_get_program_rtstatus_interval(void);
+int	cfg_get_program_rtstatus_json(void);
 unsigned int
 	cfg_get_program_verbosity(void);
 
@@ -89,8 +156,38 @@ const char *
 	cfg_get_metadata_program(void);
 const char *
 	cfg_get_metadata_format_str(void);
+util_template_t
+	cfg_get_metadata_format_template(void);
 int	cfg_get_metadata_refresh_interval(void);
 int	cfg_get_metadata_normalize_strings(void);
 int	cfg_get_metadata_no_updates(void);
 
+const char *
+	cfg_get_metrics_listen(void);
+
+const char *
+	cfg_get_control_socket(void);
+
+const char *
+	cfg_get_analysis_cache(void);
+unsigned int
+	cfg_get_analysis_workers(void);
+
+const char *
+	cfg_get_archive_directory(void);
+unsigned int
+	cfg_get_archive_rotate_time(void);
+unsigned int
+	cfg_get_archive_rotate_size(void);
+unsigned int
+	cfg_get_archive_buffer_size(void);
+
+const char *
+	cfg_get_logging_target(void);
+int	cfg_get_logging_async(void);
+unsigned int
+	cfg_get_logging_rate_limit(void);
+enum cfg_log_format
+	cfg_get_logging_format(void);
+
 #endif /* __CFG_H__ */
@@ -37,10 +37,18 @@ struct cfg_decoder {
 	TAILQ_ENTRY(cfg_decoder) entry;
 	char			*name;
 	char			*program;
+	util_template_t 	 program_tmpl;
+	char			*plugin;
 	struct file_ext_list	 exts;
 };
 
-TAILQ_HEAD(cfg_decoder_list, cfg_decoder);
+TAILQ_HEAD(cfg_decoder_head, cfg_decoder);
+
+struct cfg_decoder_list {
+	struct cfg_decoder_head	 head;
+	struct cfg_index	*names;
+	struct cfg_index	*exts;
+};
 
 struct cfg_decoder_list *
 cfg_decoder_list_create(void)
@@ -48,7 +56,9 @@ cfg_decoder_list_create(void)
 	struct cfg_decoder_list *dl;
 
 	dl = xcalloc(1UL, sizeof(*dl));
-	TAILQ_INIT(dl);
+	TAILQ_INIT(&dl->head);
+	dl->names = cfg_index_create();
+	dl->exts = cfg_index_create();
 
 	return (dl);
 }
@@ -62,9 +72,11 @@ cfg_decoder_list_destroy(struct cfg_decoder_list **dl_p)
 	if (!dl)
 		return;
 
-	while (NULL != (d = TAILQ_FIRST(dl)))
+	while (NULL != (d = TAILQ_FIRST(&dl->head)))
 		cfg_decoder_list_remove(dl, &d);
 
+	cfg_index_destroy(&dl->names);
+	cfg_index_destroy(&dl->exts);
 	xfree(dl);
 	*dl_p = NULL;
 }
@@ -75,7 +87,7 @@ cfg_decoder_list_nentries(struct cfg_decoder_list *dl)
 	struct cfg_decoder	*d;
 	unsigned int		 n = 0;
 
-	TAILQ_FOREACH(d, dl, entry) {
+	TAILQ_FOREACH(d, &dl->head, entry) {
 		n++;
 	}
 
@@ -85,27 +97,13 @@ cfg_decoder_list_nentries(struct cfg_decoder_list *dl)
 struct cfg_decoder *
 cfg_decoder_list_find(struct cfg_decoder_list *dl, const char *name)
 {
-	struct cfg_decoder	*d;
-
-	TAILQ_FOREACH(d, dl, entry) {
-		if (0 == strcasecmp(d->name, name))
-			return (d);
-	}
-
-	return (NULL);
+	return (cfg_index_get(dl->names, name));
 }
 
 struct cfg_decoder *
 cfg_decoder_list_findext(struct cfg_decoder_list *dl, const char *ext)
 {
-	struct cfg_decoder	*d;
-
-	TAILQ_FOREACH(d, dl, entry) {
-		if (cfg_decoder_extsupport(d, ext))
-			return (d);
-	}
-
-	return (NULL);
+	return (cfg_index_get(dl->exts, ext));
 }
 
 
@@ -121,7 +119,8 @@ cfg_decoder_list_get(struct cfg_decoder_list *dl, const char *name)
 	if (!d)
 		return (NULL);
 
-	TAILQ_INSERT_TAIL(dl, d, entry);
+	TAILQ_INSERT_TAIL(&dl->head, d, entry);
+	cfg_index_set(dl->names, d->name, d);
 
 	return (d);
 }
@@ -129,8 +128,16 @@ cfg_decoder_list_get(struct cfg_decoder_list *dl, const char *name)
 void
 cfg_decoder_list_remove(struct cfg_decoder_list *dl, struct cfg_decoder **d_p)
 {
-	TAILQ_REMOVE(dl, *d_p, entry);
+	struct cfg_decoder	*d = *d_p;
+	struct file_ext 	*e;
+
+	TAILQ_REMOVE(&dl->head, d, entry);
+	cfg_index_remove(dl->names, d->name, d);
+	TAILQ_FOREACH(e, &d->exts, entry) {
+		cfg_index_remove(dl->exts, e->ext, d);
+	}
 	cfg_decoder_destroy(d_p);
+	cfg_bump_generation();
 }
 
 void
@@ -139,7 +146,7 @@ cfg_decoder_list_foreach(struct cfg_decoder_list *dl,
 {
 	struct cfg_decoder	*d;
 
-	TAILQ_FOREACH(d, dl, entry) {
+	TAILQ_FOREACH(d, &dl->head, entry) {
 		cb(d, cb_arg);
 	}
 }
@@ -167,6 +174,8 @@ cfg_decoder_destroy(struct cfg_decoder **d_p)
 
 	xfree(d->name);
 	xfree(d->program);
+	util_template_destroy(&d->program_tmpl);
+	xfree(d->plugin);
 	while (NULL != (e = TAILQ_FIRST(&d->exts))) {
 		TAILQ_REMOVE(&d->exts, e, entry);
 		xfree(e->ext);
@@ -195,7 +204,10 @@ cfg_decoder_set_name(struct cfg_decoder *d, struct cfg_decoder_list *dl,
 		return (-1);
 	}
 
+	cfg_index_remove(dl->names, d->name, d);
 	SET_XSTRDUP(d->name, name, errstrp);
+	cfg_index_set(dl->names, d->name, d);
+	cfg_bump_generation();
 	return (0);
 }
 
@@ -214,6 +226,20 @@ cfg_decoder_set_program(struct cfg_decoder *d,
 
 	xfree(d->program);
 	d->program = xstrdup(program);
+	util_template_destroy(&d->program_tmpl);
+	d->program_tmpl = cfg_template_compile(program);
+
+	return (0);
+}
+
+int
+cfg_decoder_set_plugin(struct cfg_decoder *d,
+    struct cfg_decoder_list *not_used, const char *plugin,
+    const char **errstrp)
+{
+	(void)not_used;
+
+	SET_XSTRDUP(d->plugin, plugin, errstrp);
 
 	return (0);
 }
@@ -251,6 +277,7 @@ cfg_decoder_add_match(struct cfg_decoder *d, struct cfg_decoder_list *dl,
 		e->ext = xstrdup(ext);
 	}
 	TAILQ_INSERT_TAIL(&d->exts, e, entry);
+	cfg_index_set(dl->exts, e->ext, d);
 
 	return (0);
 }
@@ -261,11 +288,16 @@ cfg_decoder_validate(struct cfg_decoder *d, const char **errstrp)
 	struct file_ext *e;
 	unsigned int	 num_exts;
 
-	if (!d->program) {
+	if (!d->program && !d->plugin) {
 		if (errstrp)
 			*errstrp = "program not set";
 		return (-1);
 	}
+	if (d->program && d->plugin) {
+		if (errstrp)
+			*errstrp = "program and plugin are mutually exclusive";
+		return (-1);
+	}
 
 	num_exts = 0;
 	TAILQ_FOREACH(e, &d->exts, entry) {
@@ -277,6 +309,9 @@ cfg_decoder_validate(struct cfg_decoder *d, const char **errstrp)
 		return (-1);
 	}
 
+	if (!d->program)
+		return (0);
+
 	CHECKPH_PROHIBITED(d->program, PLACEHOLDER_STRING);
 	CHECKPH_DUPLICATE(d->program, PLACEHOLDER_TRACK);
 	CHECKPH_DUPLICATE(d->program, PLACEHOLDER_METADATA);
@@ -322,3 +357,15 @@ cfg_decoder_get_program(struct cfg_decoder *d)
 {
 	return (d->program);
 }
+
+util_template_t
+cfg_decoder_get_program_template(struct cfg_decoder *d)
+{
+	return (d->program_tmpl);
+}
+
+const char *
+cfg_decoder_get_plugin(struct cfg_decoder *d)
+{
+	return (d->plugin);
+}
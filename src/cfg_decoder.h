@@ -17,6 +17,8 @@
 #ifndef __CFG_DECODER_H__
 #define __CFG_DECODER_H__
 
+#include "util.h"
+
 typedef struct cfg_decoder *		cfg_decoder_t;
 typedef struct cfg_decoder_list *	cfg_decoder_list_t;
 
@@ -44,6 +46,8 @@ int	cfg_decoder_set_name(cfg_decoder_t, cfg_decoder_list_t, const char *,
 	    const char **);
 int	cfg_decoder_set_program(cfg_decoder_t, cfg_decoder_list_t,
 	    const char *, const char **);
+int	cfg_decoder_set_plugin(cfg_decoder_t, cfg_decoder_list_t,
+	    const char *, const char **);
 int	cfg_decoder_add_match(cfg_decoder_t, cfg_decoder_list_t, const char *,
 	    const char **);
 
@@ -57,5 +61,9 @@ const char *
 	cfg_decoder_get_name(cfg_decoder_t);
 const char *
 	cfg_decoder_get_program(cfg_decoder_t);
+util_template_t
+	cfg_decoder_get_program_template(cfg_decoder_t);
+const char *
+	cfg_decoder_get_plugin(cfg_decoder_t);
 
 #endif /* __CFG_DECODER_H__ */
@@ -32,9 +32,16 @@ struct cfg_encoder {
 	char			*name;
 	enum cfg_stream_format	 format;
 	char			*program;
+	util_template_t 	 program_tmpl;
+	char			*plugin;
 };
 
-TAILQ_HEAD(cfg_encoder_list, cfg_encoder);
+TAILQ_HEAD(cfg_encoder_head, cfg_encoder);
+
+struct cfg_encoder_list {
+	struct cfg_encoder_head	 head;
+	struct cfg_index	*names;
+};
 
 struct cfg_encoder_list *
 cfg_encoder_list_create(void)
@@ -42,7 +49,8 @@ cfg_encoder_list_create(void)
 	struct cfg_encoder_list *el;
 
 	el = xcalloc(1UL, sizeof(*el));
-	TAILQ_INIT(el);
+	TAILQ_INIT(&el->head);
+	el->names = cfg_index_create();
 
 	return (el);
 }
@@ -56,9 +64,10 @@ cfg_encoder_list_destroy(struct cfg_encoder_list **el_p)
 	if (!el)
 		return;
 
-	while (NULL != (e = TAILQ_FIRST(el)))
+	while (NULL != (e = TAILQ_FIRST(&el->head)))
 		cfg_encoder_list_remove(el, &e);
 
+	cfg_index_destroy(&el->names);
 	xfree(el);
 	*el_p = NULL;
 }
@@ -69,7 +78,7 @@ cfg_encoder_list_nentries(struct cfg_encoder_list *el)
 	struct cfg_encoder	*e;
 	unsigned int		 n = 0;
 
-	TAILQ_FOREACH(e, el, entry) {
+	TAILQ_FOREACH(e, &el->head, entry) {
 		n++;
 	}
 
@@ -79,14 +88,7 @@ cfg_encoder_list_nentries(struct cfg_encoder_list *el)
 struct cfg_encoder *
 cfg_encoder_list_find(struct cfg_encoder_list *el, const char *name)
 {
-	struct cfg_encoder	*e;
-
-	TAILQ_FOREACH(e, el, entry) {
-		if (0 == strcasecmp(e->name, name))
-			return (e);
-	}
-
-	return (NULL);
+	return (cfg_index_get(el->names, name));
 }
 
 struct cfg_encoder *
@@ -101,7 +103,8 @@ cfg_encoder_list_get(struct cfg_encoder_list *el, const char *name)
 	if (!e)
 		return (NULL);
 
-	TAILQ_INSERT_TAIL(el, e, entry);
+	TAILQ_INSERT_TAIL(&el->head, e, entry);
+	cfg_index_set(el->names, e->name, e);
 
 	return (e);
 }
@@ -112,7 +115,7 @@ cfg_encoder_list_foreach(struct cfg_encoder_list *el,
 {
 	struct cfg_encoder	*e;
 
-	TAILQ_FOREACH(e, el, entry) {
+	TAILQ_FOREACH(e, &el->head, entry) {
 		cb(e, cb_arg);
 	}
 }
@@ -120,8 +123,10 @@ cfg_encoder_list_foreach(struct cfg_encoder_list *el,
 void
 cfg_encoder_list_remove(struct cfg_encoder_list *el, struct cfg_encoder **e_p)
 {
-	TAILQ_REMOVE(el, *e_p, entry);
+	TAILQ_REMOVE(&el->head, *e_p, entry);
+	cfg_index_remove(el->names, (*e_p)->name, *e_p);
 	cfg_encoder_destroy(e_p);
+	cfg_bump_generation();
 }
 
 struct cfg_encoder *
@@ -145,6 +150,8 @@ cfg_encoder_destroy(struct cfg_encoder **e_p)
 
 	xfree(e->name);
 	xfree(e->program);
+	util_template_destroy(&e->program_tmpl);
+	xfree(e->plugin);
 	xfree(e);
 	*e_p = NULL;
 }
@@ -176,7 +183,10 @@ cfg_encoder_set_name(struct cfg_encoder *e, struct cfg_encoder_list *el,
 		return (-1);
 	}
 
+	cfg_index_remove(el->names, e->name, e);
 	SET_XSTRDUP(e->name, name, errstrp);
+	cfg_index_set(el->names, e->name, e);
+	cfg_bump_generation();
 
 	return (0);
 }
@@ -222,6 +232,20 @@ cfg_encoder_set_program(struct cfg_encoder *e,
 
 	xfree(e->program);
 	e->program = xstrdup(program);
+	util_template_destroy(&e->program_tmpl);
+	e->program_tmpl = cfg_template_compile(program);
+
+	return (0);
+}
+
+int
+cfg_encoder_set_plugin(struct cfg_encoder *e,
+    struct cfg_encoder_list *not_used, const char *plugin,
+    const char **errstrp)
+{
+	(void)not_used;
+
+	SET_XSTRDUP(e->plugin, plugin, errstrp);
 
 	return (0);
 }
@@ -235,11 +259,18 @@ cfg_encoder_validate(struct cfg_encoder *e, const char **errstrp)
 		return (-1);
 	}
 
-	if (!e->program) {
+	if (!e->program && !e->plugin) {
 		if (errstrp)
 			*errstrp = "program not set";
 		return (-1);
 	}
+	if (e->program && e->plugin) {
+		if (errstrp)
+			*errstrp = "program and plugin are mutually exclusive";
+		return (-1);
+	}
+	if (!e->program)
+		return (0);
 
 	CHECKPH_PROHIBITED(e->program, PLACEHOLDER_TRACK);
 	CHECKPH_PROHIBITED(e->program, PLACEHOLDER_STRING);
@@ -267,3 +298,15 @@ cfg_encoder_get_program(struct cfg_encoder *e)
 {
 	return (e->program);
 }
+
+util_template_t
+cfg_encoder_get_program_template(struct cfg_encoder *e)
+{
+	return (e->program_tmpl);
+}
+
+const char *
+cfg_encoder_get_plugin(struct cfg_encoder *e)
+{
+	return (e->plugin);
+}
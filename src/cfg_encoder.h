@@ -18,6 +18,7 @@
 #define __CFG_ENCODER_H__
 
 #include "cfg_stream.h"
+#include "util.h"
 
 typedef struct cfg_encoder *		cfg_encoder_t;
 typedef struct cfg_encoder_list *	cfg_encoder_list_t;
@@ -49,6 +50,9 @@ int	cfg_encoder_set_format_str(cfg_encoder_t, cfg_encoder_list_t,
 int	cfg_encoder_set_program(cfg_encoder_t, cfg_encoder_list_t,
 	    const char *, const char **);
 
+int	cfg_encoder_set_plugin(cfg_encoder_t, cfg_encoder_list_t,
+	    const char *, const char **);
+
 int	cfg_encoder_validate(cfg_encoder_t, const char **);
 
 const char *
@@ -57,5 +61,9 @@ enum cfg_stream_format
 	cfg_encoder_get_format(cfg_encoder_t);
 const char *
 	cfg_encoder_get_program(cfg_encoder_t);
+util_template_t
+	cfg_encoder_get_program_template(cfg_encoder_t);
+const char *
+	cfg_encoder_get_plugin(cfg_encoder_t);
 
 #endif /* __CFG_ENCODER_H__ */
@@ -37,7 +37,12 @@ struct cfg_intake {
 	int			 stream_once;
 };
 
-TAILQ_HEAD(cfg_intake_list, cfg_intake);
+TAILQ_HEAD(cfg_intake_head, cfg_intake);
+
+struct cfg_intake_list {
+	struct cfg_intake_head	 head;
+	struct cfg_index	*names;
+};
 
 struct cfg_intake_list *
 cfg_intake_list_create(void)
@@ -45,7 +50,8 @@ cfg_intake_list_create(void)
 	struct cfg_intake_list	*il;
 
 	il = xcalloc(1UL, sizeof(*il));
-	TAILQ_INIT(il);
+	TAILQ_INIT(&il->head);
+	il->names = cfg_index_create();
 
 	return (il);
 }
@@ -59,11 +65,12 @@ cfg_intake_list_destroy(cfg_intake_list_t *il_p)
 	if (!il)
 		return;
 
-	while (NULL != (i = TAILQ_FIRST(il))) {
-		TAILQ_REMOVE(il, i, entry);
+	while (NULL != (i = TAILQ_FIRST(&il->head))) {
+		TAILQ_REMOVE(&il->head, i, entry);
 		cfg_intake_destroy(&i);
 	}
 
+	cfg_index_destroy(&il->names);
 	xfree(il);
 	*il_p = NULL;
 }
@@ -74,7 +81,7 @@ cfg_intake_list_nentries(struct cfg_intake_list *il)
 	struct cfg_intake	*i;
 	unsigned int		 n = 0;
 
-	TAILQ_FOREACH(i, il, entry) {
+	TAILQ_FOREACH(i, &il->head, entry) {
 		n++;
 	}
 
@@ -84,14 +91,7 @@ cfg_intake_list_nentries(struct cfg_intake_list *il)
 struct cfg_intake *
 cfg_intake_list_find(struct cfg_intake_list *il, const char *name)
 {
-	struct cfg_intake	*i;
-
-	TAILQ_FOREACH(i, il, entry) {
-		if (0 == strcasecmp(i->name, name))
-			return (i);
-	}
-
-	return (NULL);
+	return (cfg_index_get(il->names, name));
 }
 
 struct cfg_intake *
@@ -106,7 +106,8 @@ cfg_intake_list_get(struct cfg_intake_list *il, const char *name)
 	if (!i)
 		return (NULL);
 
-	TAILQ_INSERT_TAIL(il, i, entry);
+	TAILQ_INSERT_TAIL(&il->head, i, entry);
+	cfg_index_set(il->names, i->name, i);
 
 	return (i);
 }
@@ -117,7 +118,7 @@ cfg_intake_list_foreach(struct cfg_intake_list *il,
 {
 	struct cfg_intake	*i;
 
-	TAILQ_FOREACH(i, il, entry) {
+	TAILQ_FOREACH(i, &il->head, entry) {
 		cb(i, cb_arg);
 	}
 }
@@ -165,7 +166,10 @@ cfg_intake_set_name(struct cfg_intake *i, struct cfg_intake_list *il,
 		return (-1);
 	}
 
+	cfg_index_remove(il->names, i->name, i);
 	SET_XSTRDUP(i->name, name, errstrp);
+	cfg_index_set(il->names, i->name, i);
+	cfg_bump_generation();
 
 	return (0);
 }
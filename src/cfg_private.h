@@ -36,6 +36,8 @@ struct cfg_program {
 	char			 pid_file[PATH_MAX];
 	int			 quiet_stderr;
 	int			 rtstatus_output;
+	unsigned int		 rtstatus_interval;
+	int			 rtstatus_json;
 	unsigned int		 verbosity;
 };
 
@@ -47,13 +49,51 @@ struct cfg {
 	cfg_stream_list_t		 streams;
 	struct metadata {
 		char			 program[PATH_MAX];
-		char			*format_str;
+		util_template_t		 format_tmpl;
 		int			 refresh_interval;
 		int			 normalize_strings;
 		int			 no_updates;
 	} metadata;
+	struct cfg_metrics {
+		char			 listen[PATH_MAX];
+	} metrics;
+	struct cfg_control {
+		char			 socket[PATH_MAX];
+	} control;
+	struct cfg_analysis {
+		char			 cache[PATH_MAX];
+		unsigned int		 workers;
+	} analysis;
+	struct cfg_archive {
+		char			 directory[PATH_MAX];
+		int			 rotate_time;
+		unsigned int		 rotate_size;
+		unsigned int		 buffer_size;
+	} archive;
+	struct cfg_logging {
+		char			 target[PATH_MAX];
+		int			 async;
+		unsigned int		 rate_limit;
+		enum cfg_log_format	 format;
+	} logging;
 };
 
+/*
+ * Case-insensitive index from names to configuration objects, which the
+ * cfg_*_list modules keep alongside their lists.
+ */
+struct cfg_index;
+
+struct cfg_index *
+	cfg_index_create(void);
+void	cfg_index_destroy(struct cfg_index **);
+void	cfg_index_set(struct cfg_index *, const char *, void *);
+void	cfg_index_remove(struct cfg_index *, const char *, const void *);
+void *	cfg_index_get(struct cfg_index *, const char *);
+
+/* Invalidates handles that were resolved by name, see cfg_get_generation() */
+void	cfg_bump_generation(void);
+
 #define SET_STRLCPY(t, s, e)	do {		\
 	if (!(s) || !(s)[0]) {			\
 		if ((e))			\
@@ -45,7 +45,12 @@ struct cfg_server {
 	unsigned int		 reconnect_attempts;
 };
 
-TAILQ_HEAD(cfg_server_list, cfg_server);
+TAILQ_HEAD(cfg_server_head, cfg_server);
+
+struct cfg_server_list {
+	struct cfg_server_head	 head;
+	struct cfg_index	*names;
+};
 
 struct cfg_server_list *
 cfg_server_list_create(void)
@@ -53,7 +58,8 @@ cfg_server_list_create(void)
 	struct cfg_server_list *sl;
 
 	sl = xcalloc(1UL, sizeof(*sl));
-	TAILQ_INIT(sl);
+	TAILQ_INIT(&sl->head);
+	sl->names = cfg_index_create();
 
 	return (sl);
 }
@@ -67,11 +73,12 @@ cfg_server_list_destroy(cfg_server_list_t *sl_p)
 	if (!sl)
 		return;
 
-	while (NULL != (s = TAILQ_FIRST(sl))) {
-		TAILQ_REMOVE(sl, s, entry);
+	while (NULL != (s = TAILQ_FIRST(&sl->head))) {
+		TAILQ_REMOVE(&sl->head, s, entry);
 		cfg_server_destroy(&s);
 	}
 
+	cfg_index_destroy(&sl->names);
 	xfree(sl);
 	*sl_p = NULL;
 }
@@ -82,7 +89,7 @@ cfg_server_list_nentries(struct cfg_server_list *sl)
 	struct cfg_server	*s;
 	unsigned int		 n = 0;
 
-	TAILQ_FOREACH(s, sl, entry) {
+	TAILQ_FOREACH(s, &sl->head, entry) {
 		n++;
 	}
 
@@ -92,14 +99,7 @@ cfg_server_list_nentries(struct cfg_server_list *sl)
 struct cfg_server *
 cfg_server_list_find(struct cfg_server_list *sl, const char *name)
 {
-	struct cfg_server	*s;
-
-	TAILQ_FOREACH(s, sl, entry) {
-		if (0 == strcasecmp(s->name, name))
-			return (s);
-	}
-
-	return (NULL);
+	return (cfg_index_get(sl->names, name));
 }
 
 struct cfg_server *
@@ -114,7 +114,8 @@ cfg_server_list_get(struct cfg_server_list *sl, const char *name)
 	if (!s)
 		return (NULL);
 
-	TAILQ_INSERT_TAIL(sl, s, entry);
+	TAILQ_INSERT_TAIL(&sl->head, s, entry);
+	cfg_index_set(sl->names, s->name, s);
 
 	return (s);
 }
@@ -125,7 +126,7 @@ cfg_server_list_foreach(struct cfg_server_list *sl,
 {
 	struct cfg_server	*s;
 
-	TAILQ_FOREACH(s, sl, entry) {
+	TAILQ_FOREACH(s, &sl->head, entry) {
 		cb(s, cb_arg);
 	}
 }
@@ -173,7 +174,10 @@ cfg_server_set_name(struct cfg_server *s, struct cfg_server_list *sl,
 		return (-1);
 	}
 
+	cfg_index_remove(sl->names, s->name, s);
 	SET_XSTRDUP(s->name, name, errstrp);
+	cfg_index_set(sl->names, s->name, s);
+	cfg_bump_generation();
 
 	return (0);
 }
@@ -18,6 +18,8 @@
 # include "config.h"
 #endif /* HAVE_CONFIG_H */
 
+#include "compat.h"
+
 #include <sys/queue.h>
 
 #include <string.h>
@@ -43,9 +45,18 @@ struct cfg_stream {
 	char			*stream_bitrate;
 	char			*stream_samplerate;
 	char			*stream_channels;
+	unsigned int		 crossfade;
+	enum cfg_stream_fade	 crossfade_curve;
+	enum cfg_stream_norm	 normalization;
+	int			 silence_threshold;
 };
 
-TAILQ_HEAD(cfg_stream_list, cfg_stream);
+TAILQ_HEAD(cfg_stream_head, cfg_stream);
+
+struct cfg_stream_list {
+	struct cfg_stream_head	 head;
+	struct cfg_index	*names;
+};
 
 struct cfg_stream_list *
 cfg_stream_list_create(void)
@@ -53,7 +64,8 @@ cfg_stream_list_create(void)
 	struct cfg_stream_list *sl;
 
 	sl = xcalloc(1UL, sizeof(*sl));
-	TAILQ_INIT(sl);
+	TAILQ_INIT(&sl->head);
+	sl->names = cfg_index_create();
 
 	return (sl);
 }
@@ -67,11 +79,12 @@ cfg_stream_list_destroy(cfg_stream_list_t *sl_p)
 	if (!sl)
 		return;
 
-	while (NULL != (s = TAILQ_FIRST(sl))) {
-		TAILQ_REMOVE(sl, s, entry);
+	while (NULL != (s = TAILQ_FIRST(&sl->head))) {
+		TAILQ_REMOVE(&sl->head, s, entry);
 		cfg_stream_destroy(&s);
 	}
 
+	cfg_index_destroy(&sl->names);
 	xfree(sl);
 	*sl_p = NULL;
 }
@@ -82,7 +95,7 @@ cfg_stream_list_nentries(struct cfg_stream_list *sl)
 	struct cfg_stream	*s;
 	unsigned int		 n = 0;
 
-	TAILQ_FOREACH(s, sl, entry) {
+	TAILQ_FOREACH(s, &sl->head, entry) {
 		n++;
 	}
 
@@ -92,14 +105,7 @@ cfg_stream_list_nentries(struct cfg_stream_list *sl)
 struct cfg_stream *
 cfg_stream_list_find(struct cfg_stream_list *sl, const char *name)
 {
-	struct cfg_stream	*s;
-
-	TAILQ_FOREACH(s, sl, entry) {
-		if (0 == strcasecmp(s->name, name))
-			return (s);
-	}
-
-	return (NULL);
+	return (cfg_index_get(sl->names, name));
 }
 
 struct cfg_stream *
@@ -114,7 +120,8 @@ cfg_stream_list_get(struct cfg_stream_list *sl, const char *name)
 	if (!s)
 		return (NULL);
 
-	TAILQ_INSERT_TAIL(sl, s, entry);
+	TAILQ_INSERT_TAIL(&sl->head, s, entry);
+	cfg_index_set(sl->names, s->name, s);
 
 	return (s);
 }
@@ -125,7 +132,7 @@ cfg_stream_list_foreach(struct cfg_stream_list *sl,
 {
 	struct cfg_stream	*s;
 
-	TAILQ_FOREACH(s, sl, entry) {
+	TAILQ_FOREACH(s, &sl->head, entry) {
 		cb(s, cb_arg);
 	}
 }
@@ -199,6 +206,59 @@ cfg_stream_fmt2str(enum cfg_stream_format fmt)
 	}
 }
 
+int
+cfg_stream_str2fade(const char *str, enum cfg_stream_fade *fade_p)
+{
+	if (0 == strcasecmp(str, CFG_SFADE_LINEAR)) {
+		*fade_p = CFG_STREAM_FADE_LINEAR;
+	} else if (0 == strcasecmp(str, CFG_SFADE_EQUAL_POWER)) {
+		*fade_p = CFG_STREAM_FADE_EQUAL_POWER;
+	} else
+		return (-1);
+	return (0);
+}
+
+const char *
+cfg_stream_fade2str(enum cfg_stream_fade fade)
+{
+	switch (fade) {
+	case CFG_STREAM_FADE_LINEAR:
+		return (CFG_SFADE_LINEAR);
+	case CFG_STREAM_FADE_EQUAL_POWER:
+		return (CFG_SFADE_EQUAL_POWER);
+	default:
+		return (NULL);
+	}
+}
+
+int
+cfg_stream_str2norm(const char *str, enum cfg_stream_norm *norm_p)
+{
+	if (0 == strcasecmp(str, CFG_SNORM_NONE)) {
+		*norm_p = CFG_STREAM_NORM_NONE;
+	} else if (0 == strcasecmp(str, CFG_SNORM_TRACK)) {
+		*norm_p = CFG_STREAM_NORM_TRACK;
+	} else if (0 == strcasecmp(str, CFG_SNORM_ALBUM)) {
+		*norm_p = CFG_STREAM_NORM_ALBUM;
+	} else
+		return (-1);
+	return (0);
+}
+
+const char *
+cfg_stream_norm2str(enum cfg_stream_norm norm)
+{
+	switch (norm) {
+	case CFG_STREAM_NORM_NONE:
+		return (CFG_SNORM_NONE);
+	case CFG_STREAM_NORM_TRACK:
+		return (CFG_SNORM_TRACK);
+	case CFG_STREAM_NORM_ALBUM:
+		return (CFG_SNORM_ALBUM);
+	default:
+		return (NULL);
+	}
+}
 
 int
 cfg_stream_set_name(struct cfg_stream *s, struct cfg_stream_list *sl,
@@ -219,7 +279,10 @@ cfg_stream_set_name(struct cfg_stream *s, struct cfg_stream_list *sl,
 		return (-1);
 	}
 
+	cfg_index_remove(sl->names, s->name, s);
 	SET_XSTRDUP(s->name, name, errstrp);
+	cfg_index_set(sl->names, s->name, s);
+	cfg_bump_generation();
 
 	return (0);
 }
@@ -240,6 +303,7 @@ cfg_stream_set_intake(struct cfg_stream *s, struct cfg_stream_list *not_used,
 {
 	(void)not_used;
 	SET_XSTRDUP(s->intake, intake, errstrp);
+	cfg_bump_generation();
 	return (0);
 }
 
@@ -249,6 +313,7 @@ cfg_stream_set_server(struct cfg_stream *s, struct cfg_stream_list *not_used,
 {
 	(void)not_used;
 	SET_XSTRDUP(s->server, server, errstrp);
+	cfg_bump_generation();
 	return (0);
 }
 
@@ -383,6 +448,112 @@ cfg_stream_set_stream_channels(struct cfg_stream *s,
 	return (0);
 }
 
+int
+cfg_stream_set_crossfade(struct cfg_stream *s,
+    struct cfg_stream_list *not_used, const char *crossfade_str,
+    const char **errstrp)
+{
+	const char	*errstr;
+	unsigned int	 crossfade;
+
+	(void)not_used;
+
+	if (!crossfade_str || !crossfade_str[0]) {
+		if (errstrp)
+			*errstrp = "empty";
+		return (-1);
+	}
+
+	crossfade = (unsigned int)strtonum(crossfade_str, 0,
+	    CFG_STREAM_CROSSFADE_MAX, &errstr);
+	if (errstr) {
+		if (errstrp)
+			*errstrp = errstr;
+		return (-1);
+	}
+	s->crossfade = crossfade;
+
+	return (0);
+}
+
+int
+cfg_stream_set_crossfade_curve(struct cfg_stream *s,
+    struct cfg_stream_list *not_used, const char *curve_str,
+    const char **errstrp)
+{
+	enum cfg_stream_fade	curve;
+
+	(void)not_used;
+
+	if (!curve_str || !curve_str[0]) {
+		if (errstrp)
+			*errstrp = "empty";
+		return (-1);
+	}
+
+	if (0 > cfg_stream_str2fade(curve_str, &curve)) {
+		if (errstrp)
+			*errstrp = "unsupported crossfade curve";
+		return (-1);
+	}
+	s->crossfade_curve = curve;
+
+	return (0);
+}
+
+int
+cfg_stream_set_normalization(struct cfg_stream *s,
+    struct cfg_stream_list *not_used, const char *norm_str,
+    const char **errstrp)
+{
+	enum cfg_stream_norm	norm;
+
+	(void)not_used;
+
+	if (!norm_str || !norm_str[0]) {
+		if (errstrp)
+			*errstrp = "empty";
+		return (-1);
+	}
+
+	if (0 > cfg_stream_str2norm(norm_str, &norm)) {
+		if (errstrp)
+			*errstrp = "unsupported normalization";
+		return (-1);
+	}
+	s->normalization = norm;
+
+	return (0);
+}
+
+int
+cfg_stream_set_silence_threshold(struct cfg_stream *s,
+    struct cfg_stream_list *not_used, const char *threshold_str,
+    const char **errstrp)
+{
+	const char	*errstr;
+	int		 threshold;
+
+	(void)not_used;
+
+	if (!threshold_str || !threshold_str[0]) {
+		if (errstrp)
+			*errstrp = "empty";
+		return (-1);
+	}
+
+	threshold = (int)strtonum(threshold_str, CFG_STREAM_SILENCE_MIN,
+	    CFG_STREAM_SILENCE_MAX, &errstr);
+	if (errstr) {
+		if (errstrp)
+			*errstrp = errstr;
+		return (-1);
+	}
+	s->silence_threshold = threshold;
+
+	return (0);
+}
+
 int
 cfg_stream_validate(struct cfg_stream *s, const char **errstrp)
 {
@@ -490,3 +661,27 @@ cfg_stream_get_stream_channels(struct cfg_stream *s)
 {
 	return (s->stream_channels);
 }
+
+unsigned int
+cfg_stream_get_crossfade(struct cfg_stream *s)
+{
+	return (s->crossfade);
+}
+
+enum cfg_stream_fade
+cfg_stream_get_crossfade_curve(struct cfg_stream *s)
+{
+	return (s->crossfade_curve);
+}
+
+enum cfg_stream_norm
+cfg_stream_get_normalization(struct cfg_stream *s)
+{
+	return (s->normalization);
+}
+
+int
+cfg_stream_get_silence_threshold(struct cfg_stream *s)
+{
+	return (s->silence_threshold);
+}
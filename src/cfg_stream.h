@@ -32,6 +32,30 @@ enum cfg_stream_format {
 	CFG_STREAM_MAX = CFG_STREAM_MATROSKA,
 };
 
+#define CFG_SFADE_LINEAR	"linear"
+#define CFG_SFADE_EQUAL_POWER	"equal-power"
+
+enum cfg_stream_fade {
+	CFG_STREAM_FADE_EQUAL_POWER = 0,
+	CFG_STREAM_FADE_LINEAR,
+};
+
+#define CFG_SNORM_NONE		"none"
+#define CFG_SNORM_TRACK 	"track"
+#define CFG_SNORM_ALBUM 	"album"
+
+enum cfg_stream_norm {
+	CFG_STREAM_NORM_NONE = 0,
+	CFG_STREAM_NORM_TRACK,
+	CFG_STREAM_NORM_ALBUM,
+};
+
+/* Longest crossfade between tracks, in milliseconds */
+#define CFG_STREAM_CROSSFADE_MAX	30000
+/* Range of the silence threshold, in dBFS */
+#define CFG_STREAM_SILENCE_MIN		-120
+#define CFG_STREAM_SILENCE_MAX		-1
+
 typedef struct cfg_stream *		cfg_stream_t;
 typedef struct cfg_stream_list *	cfg_stream_list_t;
 
@@ -55,6 +79,12 @@ void	cfg_stream_destroy(cfg_stream_t *);
 int	cfg_stream_str2fmt(const char *, enum cfg_stream_format *);
 const char *
 	cfg_stream_fmt2str(enum cfg_stream_format);
+int	cfg_stream_str2fade(const char *, enum cfg_stream_fade *);
+const char *
+	cfg_stream_fade2str(enum cfg_stream_fade);
+int	cfg_stream_str2norm(const char *, enum cfg_stream_norm *);
+const char *
+	cfg_stream_norm2str(enum cfg_stream_norm);
 
 int	cfg_stream_set_name(cfg_stream_t, cfg_stream_list_t, const char *,
 	    const char **);
@@ -86,6 +116,14 @@ int	cfg_stream_set_stream_samplerate(cfg_stream_t, cfg_stream_list_t,
 	    const char *, const char **);
 int	cfg_stream_set_stream_channels(cfg_stream_t, cfg_stream_list_t,
 	    const char *, const char **);
+int	cfg_stream_set_crossfade(cfg_stream_t, cfg_stream_list_t,
+	    const char *, const char **);
+int	cfg_stream_set_crossfade_curve(cfg_stream_t, cfg_stream_list_t,
+	    const char *, const char **);
+int	cfg_stream_set_normalization(cfg_stream_t, cfg_stream_list_t,
+	    const char *, const char **);
+int	cfg_stream_set_silence_threshold(cfg_stream_t, cfg_stream_list_t,
+	    const char *, const char **);
 
 int	cfg_stream_validate(cfg_stream_t, const char **);
 
@@ -120,5 +158,13 @@ const char *
 	cfg_stream_get_stream_samplerate(cfg_stream_t);
 const char *
 	cfg_stream_get_stream_channels(cfg_stream_t);
+unsigned int
+	cfg_stream_get_crossfade(cfg_stream_t);
+enum cfg_stream_fade
+	cfg_stream_get_crossfade_curve(cfg_stream_t);
+enum cfg_stream_norm
+	cfg_stream_get_normalization(cfg_stream_t);
+/* Returns 0 if silence is not trimmed */
+int	cfg_stream_get_silence_threshold(cfg_stream_t);
 
 #endif /* __CFG_STREAM_H__ */
@@ -37,6 +37,11 @@ static int	_cfgfile_xml_parse_streams(xmlDocPtr, xmlNodePtr);
 static int	_cfgfile_xml_parse_intake(xmlDocPtr, xmlNodePtr);
 static int	_cfgfile_xml_parse_intakes(xmlDocPtr, xmlNodePtr);
 static int	_cfgfile_xml_parse_metadata(xmlDocPtr, xmlNodePtr);
+static int	_cfgfile_xml_parse_metrics(xmlDocPtr, xmlNodePtr);
+static int	_cfgfile_xml_parse_control(xmlDocPtr, xmlNodePtr);
+static int	_cfgfile_xml_parse_analysis(xmlDocPtr, xmlNodePtr);
+static int	_cfgfile_xml_parse_archive(xmlDocPtr, xmlNodePtr);
+static int	_cfgfile_xml_parse_logging(xmlDocPtr, xmlNodePtr);
 static int	_cfgfile_xml_parse_decoder(xmlDocPtr, xmlNodePtr);
 static int	_cfgfile_xml_parse_decoders(xmlDocPtr, xmlNodePtr);
 static int	_cfgfile_xml_parse_encoder(xmlDocPtr, xmlNodePtr);
@@ -163,6 +168,10 @@ _cfgfile_xml_parse_stream(xmlDocPtr doc, xmlNodePtr cur)
 		XML_STREAM_SET(s, sl, cfg_stream_set_stream_bitrate,     "stream_bitrate");
 		XML_STREAM_SET(s, sl, cfg_stream_set_stream_samplerate,  "stream_samplerate");
 		XML_STREAM_SET(s, sl, cfg_stream_set_stream_channels,    "stream_channels");
+		XML_STREAM_SET(s, sl, cfg_stream_set_crossfade,          "crossfade");
+		XML_STREAM_SET(s, sl, cfg_stream_set_crossfade_curve,    "crossfade_curve");
+		XML_STREAM_SET(s, sl, cfg_stream_set_normalization,      "normalization");
+		XML_STREAM_SET(s, sl, cfg_stream_set_silence_threshold,  "silence_threshold");
 	}
 
 	if (0 > cfg_stream_validate(s, &errstr)) {
@@ -281,6 +290,93 @@ _cfgfile_xml_parse_metadata(xmlDocPtr doc, xmlNodePtr cur)
 	return (0);
 }
 
+static int
+_cfgfile_xml_parse_metrics(xmlDocPtr doc, xmlNodePtr cur)
+{
+	int	error = 0;
+
+	for (cur = cur->xmlChildrenNode; cur; cur = cur->next) {
+		XML_STRCONFIG("metrics", cfg_set_metrics_listen, "listen");
+	}
+
+	if (error)
+		return (-1);
+
+	return (0);
+}
+
+static int
+_cfgfile_xml_parse_control(xmlDocPtr doc, xmlNodePtr cur)
+{
+	int	error = 0;
+
+	for (cur = cur->xmlChildrenNode; cur; cur = cur->next) {
+		XML_STRCONFIG("control", cfg_set_control_socket, "socket");
+	}
+
+	if (error)
+		return (-1);
+
+	return (0);
+}
+
+static int
+_cfgfile_xml_parse_analysis(xmlDocPtr doc, xmlNodePtr cur)
+{
+	int	error = 0;
+
+	for (cur = cur->xmlChildrenNode; cur; cur = cur->next) {
+		XML_STRCONFIG("analysis", cfg_set_analysis_cache, "cache");
+		XML_STRCONFIG("analysis", cfg_set_analysis_workers, "workers");
+	}
+
+	if (error)
+		return (-1);
+
+	return (0);
+}
+
+static int
+_cfgfile_xml_parse_archive(xmlDocPtr doc, xmlNodePtr cur)
+{
+	int	error = 0;
+
+	for (cur = cur->xmlChildrenNode; cur; cur = cur->next) {
+		XML_STRCONFIG("archive", cfg_set_archive_directory,
+		    "directory");
+		XML_STRCONFIG("archive", cfg_set_archive_rotate_time,
+		    "rotate_time");
+		XML_STRCONFIG("archive", cfg_set_archive_rotate_size,
+		    "rotate_size");
+		XML_STRCONFIG("archive", cfg_set_archive_buffer_size,
+		    "buffer_size");
+	}
+
+	if (error)
+		return (-1);
+
+	return (0);
+}
+
+static int
+_cfgfile_xml_parse_logging(xmlDocPtr doc, xmlNodePtr cur)
+{
+	int	error = 0;
+
+	for (cur = cur->xmlChildrenNode; cur; cur = cur->next) {
+		XML_STRCONFIG("logging", cfg_set_logging_target, "target");
+		XML_STRCONFIG("logging", cfg_set_logging_async, "async");
+		XML_STRCONFIG("logging", cfg_set_logging_rate_limit,
+		    "rate_limit");
+		XML_STRCONFIG("logging", cfg_set_logging_format, "format");
+	}
+
+	if (error)
+		return (-1);
+
+	return (0);
+}
+
 #define XML_DECODER_SET(c, l, f, e)	do {				\
 	if (0 == xmlStrcasecmp(cur->name, XML_CHAR((e)))) {		\
 		xmlChar 	*val;					\
@@ -314,6 +410,7 @@ _cfgfile_xml_parse_decoder(xmlDocPtr doc, xmlNodePtr cur)
 	for (cur = cur->xmlChildrenNode; cur; cur = cur->next) {
 		XML_DECODER_SET(d, dl, cfg_decoder_set_name,    "name");
 		XML_DECODER_SET(d, dl, cfg_decoder_set_program, "program");
+		XML_DECODER_SET(d, dl, cfg_decoder_set_plugin,  "plugin");
 		XML_DECODER_SET(d, dl, cfg_decoder_add_match,   "file_ext");
 	}
 
@@ -372,6 +469,7 @@ _cfgfile_xml_parse_encoder(xmlDocPtr doc, xmlNodePtr cur)
 		XML_ENCODER_SET(e, el, cfg_encoder_set_name,       "name");
 		XML_ENCODER_SET(e, el, cfg_encoder_set_format_str, "format");
 		XML_ENCODER_SET(e, el, cfg_encoder_set_program,    "program");
+		XML_ENCODER_SET(e, el, cfg_encoder_set_plugin,     "plugin");
 	}
 
 	if (0 > cfg_encoder_validate(e, &errstr)) {
@@ -431,6 +529,10 @@ _cfgfile_xml_parse_encoders(xmlDocPtr doc, xmlNodePtr cur)
  *             stream_bitrate
  *             stream_samplerate
  *             stream_channels
+ *             crossfade
+ *             crossfade_curve
+ *             normalization
+ *             silence_threshold
  *         ...
  *     intakes
  *         intake
@@ -445,10 +547,28 @@ _cfgfile_xml_parse_encoders(xmlDocPtr doc, xmlNodePtr cur)
  *         refresh_interval
  *         normalize_strings
  *         no_updates
+ *     metrics
+ *         listen
+ *     control
+ *         socket
+ *     analysis
+ *         cache
+ *         workers
+ *     archive
+ *         directory
+ *         rotate_time
+ *         rotate_size
+ *         buffer_size
+ *     logging
+ *         target
+ *         async
+ *         rate_limit
+ *         format
  *     decoders
  *         decoder
  *             name
  *             program
+ *             plugin
  *             file_ext
  *             ...
  *         ...
@@ -457,6 +577,7 @@ _cfgfile_xml_parse_encoders(xmlDocPtr doc, xmlNodePtr cur)
  *             name
  *             format
  *             program
+ *             plugin
  *         ...
  */
 int
@@ -510,6 +631,31 @@ cfgfile_xml_parse(const char *config_file)
 				error = 1;
 			continue;
 		}
+		if (0 == xmlStrcasecmp(cur->name, XML_CHAR("metrics"))) {
+			if (0 > _cfgfile_xml_parse_metrics(doc, cur))
+				error = 1;
+			continue;
+		}
+		if (0 == xmlStrcasecmp(cur->name, XML_CHAR("control"))) {
+			if (0 > _cfgfile_xml_parse_control(doc, cur))
+				error = 1;
+			continue;
+		}
+		if (0 == xmlStrcasecmp(cur->name, XML_CHAR("analysis"))) {
+			if (0 > _cfgfile_xml_parse_analysis(doc, cur))
+				error = 1;
+			continue;
+		}
+		if (0 == xmlStrcasecmp(cur->name, XML_CHAR("archive"))) {
+			if (0 > _cfgfile_xml_parse_archive(doc, cur))
+				error = 1;
+			continue;
+		}
+		if (0 == xmlStrcasecmp(cur->name, XML_CHAR("logging"))) {
+			if (0 > _cfgfile_xml_parse_logging(doc, cur))
+				error = 1;
+			continue;
+		}
 		if (0 == xmlStrcasecmp(cur->name, XML_CHAR("decoders"))) {
 			if (0 > _cfgfile_xml_parse_decoders(doc, cur))
 				error = 1;
@@ -628,6 +774,18 @@ _cfgfile_xml_print_stream(cfg_stream_t s, void *arg)
 	if (cfg_stream_get_stream_channels(s))
 		fprintf(fp, "      <stream_channels>%s</stream_channels>\n",
 		    cfg_stream_get_stream_channels(s));
+	if (cfg_stream_get_crossfade(s)) {
+		fprintf(fp, "      <crossfade>%u</crossfade>\n",
+		    cfg_stream_get_crossfade(s));
+		fprintf(fp, "      <crossfade_curve>%s</crossfade_curve>\n",
+		    cfg_stream_fade2str(cfg_stream_get_crossfade_curve(s)));
+	}
+	if (cfg_stream_get_normalization(s))
+		fprintf(fp, "      <normalization>%s</normalization>\n",
+		    cfg_stream_norm2str(cfg_stream_get_normalization(s)));
+	if (cfg_stream_get_silence_threshold(s))
+		fprintf(fp, "      <silence_threshold>%d</silence_threshold>\n",
+		    cfg_stream_get_silence_threshold(s));
 	fprintf(fp, "    </stream>\n");
 }
 
@@ -673,6 +831,9 @@ _cfgfile_xml_print_decoder(cfg_decoder_t d, void *arg)
 	if (cfg_decoder_get_program(d))
 		fprintf(fp, "      <program>%s</program>\n",
 		    cfg_decoder_get_program(d));
+	if (cfg_decoder_get_plugin(d))
+		fprintf(fp, "      <plugin>%s</plugin>\n",
+		    cfg_decoder_get_plugin(d));
 	cfg_decoder_ext_foreach(d, _cfgfile_xml_print_decoder_ext, fp);
 	fprintf(fp, "    </decoder>\n");
 }
@@ -691,6 +852,9 @@ _cfgfile_xml_print_encoder(cfg_encoder_t e, void *arg)
 	if (cfg_encoder_get_program(e))
 		fprintf(fp, "      <program>%s</program>\n",
 		    cfg_encoder_get_program(e));
+	if (cfg_encoder_get_plugin(e))
+		fprintf(fp, "      <plugin>%s</plugin>\n",
+		    cfg_encoder_get_plugin(e));
 	fprintf(fp, "    </encoder>\n");
 }
 
@@ -749,5 +913,59 @@ cfgfile_xml_print(FILE *fp)
 			fprintf(fp, "    <no_updates>yes</no_updates>\n");
 		fprintf(fp, "  </metadata>\n");
 	}
+	if (cfg_get_metrics_listen()) {
+		fprintf(fp, "\n");
+		fprintf(fp, "  <metrics>\n");
+		fprintf(fp, "    <listen>%s</listen>\n",
+		    cfg_get_metrics_listen());
+		fprintf(fp, "  </metrics>\n");
+	}
+	if (cfg_get_control_socket()) {
+		fprintf(fp, "\n");
+		fprintf(fp, "  <control>\n");
+		fprintf(fp, "    <socket>%s</socket>\n",
+		    cfg_get_control_socket());
+		fprintf(fp, "  </control>\n");
+	}
+	if (cfg_get_analysis_cache()) {
+		fprintf(fp, "\n");
+		fprintf(fp, "  <analysis>\n");
+		fprintf(fp, "    <cache>%s</cache>\n",
+		    cfg_get_analysis_cache());
+		fprintf(fp, "    <workers>%u</workers>\n",
+		    cfg_get_analysis_workers());
+		fprintf(fp, "  </analysis>\n");
+	}
+	if (cfg_get_archive_directory()) {
+		fprintf(fp, "\n");
+		fprintf(fp, "  <archive>\n");
+		fprintf(fp, "    <directory>%s</directory>\n",
+		    cfg_get_archive_directory());
+		fprintf(fp, "    <rotate_time>%u</rotate_time>\n",
+		    cfg_get_archive_rotate_time());
+		fprintf(fp, "    <rotate_size>%u</rotate_size>\n",
+		    cfg_get_archive_rotate_size());
+		fprintf(fp, "    <buffer_size>%u</buffer_size>\n",
+		    cfg_get_archive_buffer_size());
+		fprintf(fp, "  </archive>\n");
+	}
+	if (cfg_get_logging_target() ||
+	    cfg_get_logging_async() ||
+	    cfg_get_logging_rate_limit() ||
+	    CFG_LOG_FORMAT_TEXT != cfg_get_logging_format()) {
+		fprintf(fp, "\n");
+		fprintf(fp, "  <logging>\n");
+		if (cfg_get_logging_target())
+			fprintf(fp, "    <target>%s</target>\n",
+			    cfg_get_logging_target());
+		if (cfg_get_logging_async())
+			fprintf(fp, "    <async>yes</async>\n");
+		if (cfg_get_logging_rate_limit())
+			fprintf(fp, "    <rate_limit>%u</rate_limit>\n",
+			    cfg_get_logging_rate_limit());
+		if (CFG_LOG_FORMAT_JSON == cfg_get_logging_format())
+			fprintf(fp, "    <format>json</format>\n");
+		fprintf(fp, "  </logging>\n");
+	}
 	fprintf(fp, "</%s>\n", CFGFILE_XML_NAME);
 }
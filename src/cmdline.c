@@ -33,10 +33,12 @@
 #include "playlist.h"
 #include "util.h"
 
-#define OPTSTRING	"c:hp:qrs:Vv"
+#define OPTSTRING	"c:hi:jp:qrs:Vv"
 enum opt_vals {
 	OPT_CONFIGFILE		= 'c',
 	OPT_HELP		= 'h',
+	OPT_RTSTATUSINTERVAL	= 'i',
+	OPT_RTSTATUSJSON	= 'j',
 	OPT_PIDFILE		= 'p',
 	OPT_QUIETSTDERR 	= 'q',
 	OPT_RTSTATUS		= 'r',
@@ -52,7 +54,7 @@ static void	_usage_help(void);
 static void
 _usage(void)
 {
-	fprintf(stderr, "usage: %s [-hqrVv] -c cfgfile [-p pidfile]\n",
+	fprintf(stderr, "usage: %s [-hjqrVv] -c cfgfile [-i interval] [-p pidfile]\n",
 	    cfg_get_program_name());
 	fprintf(stderr, "       %s -s file\n",
 	    cfg_get_program_name());
@@ -64,6 +66,8 @@ _usage_help(void)
 	fprintf(stderr, "\n");
 	fprintf(stderr, "    -c cfgfile  use XML configuration in cfgfile\n");
 	fprintf(stderr, "    -h          print this help and exit\n");
+	fprintf(stderr, "    -i interval refresh real-time stream information every interval ms\n");
+	fprintf(stderr, "    -j          show real-time stream information as JSON lines\n");
 	fprintf(stderr, "    -p pidfile  write PID to pidfile\n");
 	fprintf(stderr, "    -q          suppress STDERR output from external en-/decoders\n");
 	fprintf(stderr, "    -r          show real-time stream information on stdout\n");
@@ -106,6 +110,16 @@ cmdline_parse(int argc, char *argv[], int *ret_p)
 			_usage_help();
 			*ret_p = 0;
 			return (-1);
+		case OPT_RTSTATUSINTERVAL:
+			if (0 > cfg_set_program_rtstatus_interval(optarg,
+			    &err_str)) {
+				fprintf(stderr, "-%c: argument %s\n",
+				    OPT_RTSTATUSINTERVAL, err_str);
+				_usage();
+				*ret_p = 2;
+				return (-1);
+			}
+			break;
 		case OPT_PIDFILE:
 			if (0 > cfg_set_program_pid_file(optarg, &err_str)) {
 				fprintf(stderr, "-%c: argument %s\n",
@@ -115,6 +129,9 @@ cmdline_parse(int argc, char *argv[], int *ret_p)
 				return (-1);
 			}
 			break;
+		case OPT_RTSTATUSJSON:
+			cfg_set_program_rtstatus_json(1, NULL);
+			/* FALLTHROUGH */
 		case OPT_RTSTATUS:
 			cfg_set_program_rtstatus_output(1, NULL);
 			/* FALLTHROUGH */
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2026 Moritz Grimm <mgrimm@mrsserver.net>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "compat.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "control.h"
+#include "log.h"
+#include "sock.h"
+
+#define CONTROL_REPLY_SIZE	2048
+
+static const struct control_command	*control_commands;
+static sock_listener_t			 control_listener;
+
+static int	_control_help(char *, size_t);
+static int	_control_handler(sock_client_t, const char *, void *);
+
+static int
+_control_help(char *reply, size_t reply_size)
+{
+	const struct control_command	*cmd;
+
+	(void)snprintf(reply, reply_size, "OK commands: help");
+	for (cmd = control_commands; cmd && cmd->name; cmd++) {
+		(void)strlcat(reply, ", ", reply_size);
+		(void)strlcat(reply, cmd->name, reply_size);
+		if (cmd->args) {
+			(void)strlcat(reply, " ", reply_size);
+			(void)strlcat(reply, cmd->args, reply_size);
+		}
+	}
+
+	return (0);
+}
+
+static int
+_control_handler(sock_client_t client, const char *request, void *arg)
+{
+	char	reply[CONTROL_REPLY_SIZE];
+
+	(void)arg;
+
+	/* Ignore empty lines, as they are sent by interactive users. */
+	if ('\0' == request[0])
+		return (SOCK_KEEP);
+
+	(void)control_dispatch(request, reply, sizeof(reply));
+	sock_client_printf(client, "%s\n", reply);
+	if (0 == strcmp(request, "quit"))
+		return (SOCK_CLOSE);
+
+	return (SOCK_KEEP);
+}
+
+int
+control_init(const char *path, const struct control_command *commands)
+{
+	control_commands = commands;
+	if (NULL == path)
+		return (0);
+
+	control_listener = sock_listen(path, "\n", _control_handler, NULL);
+	if (NULL == control_listener) {
+		log_error("control: %s: cannot listen", path);
+		return (-1);
+	}
+	log_info("control: listening on %s", path);
+
+	return (0);
+}
+
+void
+control_exit(void)
+{
+	sock_close(&control_listener);
+	control_commands = NULL;
+}
+
+void
+control_poll(void)
+{
+	sock_poll(control_listener);
+}
+
+int
+control_dispatch(const char *request, char *reply, size_t reply_size)
+{
+	const struct control_command	*cmd;
+	char				 msg[CONTROL_REPLY_SIZE];
+	const char			*arg;
+	size_t				 len;
+	int				 ret;
+
+	while (isspace((unsigned char)*request))
+		request++;
+	for (len = 0; request[len] && !isspace((unsigned char)request[len]);
+	     len++)
+		;
+	for (arg = request + len; isspace((unsigned char)*arg); arg++)
+		;
+
+	if (len == strlen("help") && 0 == strncmp(request, "help", len))
+		return (_control_help(reply, reply_size));
+	if (len == strlen("quit") && 0 == strncmp(request, "quit", len)) {
+		(void)snprintf(reply, reply_size, "OK bye");
+		return (0);
+	}
+
+	for (cmd = control_commands; cmd && cmd->name; cmd++) {
+		if (len == strlen(cmd->name) &&
+		    0 == strncmp(request, cmd->name, len))
+			break;
+	}
+	if (NULL == cmd || NULL == cmd->name) {
+		(void)snprintf(reply, reply_size,
+		    "ERR unknown command: %.*s (try: help)", (int)len, request);
+		return (-1);
+	}
+	if (NULL == cmd->args && '\0' != *arg) {
+		(void)snprintf(reply, reply_size,
+		    "ERR %s: unexpected argument", cmd->name);
+		return (-1);
+	}
+	if (NULL != cmd->args && '\0' == *arg) {
+		(void)snprintf(reply, reply_size,
+		    "ERR %s: missing argument %s", cmd->name, cmd->args);
+		return (-1);
+	}
+
+	msg[0] = '\0';
+	ret = cmd->handler(arg, msg, sizeof(msg));
+	log_info("control: %s%s%s: %s", cmd->name, '\0' == *arg ? "" : " ",
+	    arg, 0 == ret ? "ok" : "failed");
+	(void)snprintf(reply, reply_size, "%s%s%s", 0 == ret ? "OK" : "ERR",
+	    '\0' == msg[0] ? "" : " ", msg);
+
+	return (ret);
+}
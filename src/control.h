@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2026 Moritz Grimm <mgrimm@mrsserver.net>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __CONTROL_H__
+#define __CONTROL_H__
+
+#include <stddef.h>
+
+/*
+ * Line-based control protocol: every request is a single line consisting
+ * of a command name and an optional argument, and every request is
+ * answered with a single line starting with either "OK" or "ERR".
+ */
+
+/*
+ * Command handlers write a human-readable message into the reply buffer
+ * and return 0 on success, or -1 on failure.
+ */
+typedef int (*control_handler_t)(const char *, char *, size_t);
+
+struct control_command {
+	const char		*name;
+	const char		*args;	/* Argument synopsis, or NULL */
+	const char		*help;
+	control_handler_t	 handler;
+};
+
+int	control_init(const char *, const struct control_command *);
+void	control_exit(void);
+void	control_poll(void);
+
+int	control_dispatch(const char *, char *, size_t);
+
+#endif /* __CONTROL_H__ */
@@ -21,13 +21,22 @@
 
 #include "ezstream.h"
 
+#include <sys/queue.h>
+
 #include <signal.h>
 
+#include "analysis.h"
+#include "archive.h"
 #include "cfg.h"
 #include "cmdline.h"
+#include "control.h"
 #include "log.h"
 #include "mdata.h"
+#include "metrics.h"
+#include "pcm.h"
+#include "pipeline.h"
 #include "playlist.h"
+#include "plugin.h"
 #include "stream.h"
 #include "util.h"
 #include "xalloc.h"
@@ -38,10 +47,53 @@
 #define STREAM_SERVERR	3
 #define STREAM_UPDMDATA 4
 
+/* How often to service the metrics and control sockets, in milliseconds */
+#define POLL_INTERVAL	100
+/* Number of call sites in allocation profile logs and control replies */
+#define ALLOC_PROFILE_LOG_SITES 	50
+#define ALLOC_PROFILE_REPLY_SITES	5
+/* Number of upcoming playlist entries to analyze in the background */
+#define ANALYSIS_AHEAD	8
+
 stream_t		 main_stream;
 playlist_t		 playlist;
 int			 playlistMode;
 unsigned int		 resource_errors;
+int			 paused;
+/* When sending actually stopped, while paused: */
+struct timespec 	 pauseTime;
+char			 currentTrack[PATH_MAX];
+struct timespec 	 currentTrackStart;
+/* Scratch memory for the current track, reset in streamFile(): */
+xarena_t		 track_arena;
+/* In-process decoding, for decoders that are plugins: */
+pipeline_t		 pipeline;
+/* Local copy of the outgoing stream: */
+archive_t		 archive;
+
+/* Where the data of the current track comes from: */
+struct resource {
+	FILE		*fp;
+	int		 popen;
+	int		 pipeline;
+};
+
+/* What the archive depends on, to tell whether a reload changed it: */
+struct archive_settings {
+	char		*dir;
+	const char	*ext;
+	unsigned int	 rotate_time;
+	unsigned int	 rotate_size;
+	unsigned int	 buffer_size;
+};
+
+struct queue_entry {
+	TAILQ_ENTRY(queue_entry) entry;
+	char			*path;
+};
+TAILQ_HEAD(queue_list, queue_entry);
+struct queue_list	 enqueued = TAILQ_HEAD_INITIALIZER(enqueued);
+unsigned int		 num_enqueued;
 
 const int		 ezstream_signals[] = {
 	SIGTERM, SIGINT, SIGHUP, SIGUSR1, SIGUSR2
@@ -51,17 +103,70 @@ volatile sig_atomic_t	 rereadPlaylist;
 volatile sig_atomic_t	 rereadPlaylist_notify;
 volatile sig_atomic_t	 skipTrack;
 volatile sig_atomic_t	 queryMetadata;
+volatile sig_atomic_t	 reloadConfig;
 volatile sig_atomic_t	 quit;
 
 void		sig_handler(int);
 
+static void	_poll_sockets(void);
+static void	_sleep_polling(unsigned int);
+static char *	_dequeue(void);
+static int	_reload_config(stream_t, unsigned int *);
+static int	_playlist_mode(cfg_intake_t);
+static int	_configure_logging(void);
+static void	_set_log_context(stream_t);
+static const char *
+		_archive_ext(stream_t);
+static void	_archive_settings(stream_t, struct archive_settings *);
+static int	_start_archive(stream_t);
+static void	_reload_archive(stream_t, const struct archive_settings *);
+static void	_reload_analysis(const char *, unsigned int);
+static void	_drain_encoder(stream_t);
+static double	_elapsed(const struct timespec *);
+
+static int	_cmd_skip(const char *, char *, size_t);
+static int	_cmd_enqueue(const char *, char *, size_t);
+static int	_cmd_set_metadata(const char *, char *, size_t);
+static int	_cmd_reload_playlist(const char *, char *, size_t);
+static int	_cmd_reload_config(const char *, char *, size_t);
+static int	_cmd_status(const char *, char *, size_t);
+static int	_cmd_pause(const char *, char *, size_t);
+static int	_cmd_resume(const char *, char *, size_t);
+static int	_cmd_alloc_profile(const char *, char *, size_t);
+
+const struct control_command	ezstream_commands[] = {
+	{ "skip", NULL, "skip the current track", _cmd_skip },
+	{ "enqueue", "<path>", "stream a file next", _cmd_enqueue },
+	{ "set-metadata", "<text>", "replace the stream metadata",
+	  _cmd_set_metadata },
+	{ "reload-playlist", NULL, "reread the playlist after this track",
+	  _cmd_reload_playlist },
+	{ "reload-config", NULL, "reread the configuration after this track",
+	  _cmd_reload_config },
+	{ "status", NULL, "report the current state", _cmd_status },
+	{ "pause", NULL, "stop sending audio data", _cmd_pause },
+	{ "resume", NULL, "continue a paused stream", _cmd_resume },
+	{ "alloc-profile", "<on|off|dump>",
+	  "profile heap allocations by call site", _cmd_alloc_profile },
+	{ NULL, NULL, NULL, NULL }
+};
+
 static char *	_build_reencode_cmd(const char *, const char *, cfg_stream_t,
-				    mdata_t);
-static FILE *	openResource(stream_t, const char *, int *, mdata_t *,
-			     int *, long *);
+				    mdata_t, cfg_decoder_t *, cfg_encoder_t *);
+static float	_get_track_gain(cfg_stream_t, mdata_t);
+static void	_queue_analysis(cfg_stream_t);
+static int	openResource(stream_t, const char *, struct resource *,
+			     mdata_t *, int *, long *);
+static size_t	readResource(struct resource *, char *, size_t);
+static void	closeResource(struct resource *);
 int		reconnect(stream_t);
 const char *	getTimeString(long);
-int		sendStream(stream_t, FILE *, const char *, int, const char *,
+static void	_get_position(stream_t, const struct timespec *,
+			      const struct timespec *, long *, double *);
+static void	_print_rtstatus(stream_t, int, long, const struct timespec *,
+				const struct timespec *);
+static void	_send_to_boundary(stream_t, struct resource *);
+int		sendStream(stream_t, struct resource *, const char *, int, long,
 			   struct timespec *);
 int		streamFile(stream_t, const char *);
 int		streamPlaylist(stream_t);
@@ -76,6 +181,7 @@ sig_handler(int sig)
 		quit = 1;
 		break;
 	case SIGHUP:
+		reloadConfig = 1;
 		rereadPlaylist = 1;
 		rereadPlaylist_notify = 1;
 		break;
@@ -90,19 +196,467 @@ sig_handler(int sig)
 	}
 }
 
+static void
+_poll_sockets(void)
+{
+	static struct timespec	last;
+	struct timespec 	now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if ((now.tv_sec - last.tv_sec) * 1000 +
+	    (now.tv_nsec - last.tv_nsec) / 1000000 < POLL_INTERVAL)
+		return;
+	last = now;
+
+	metrics_poll();
+	control_poll();
+}
+
+static void
+_sleep_polling(unsigned int msecs)
+{
+	struct timespec ts;
+	unsigned int	i;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = POLL_INTERVAL * 1000000L;
+	for (i = 0; i < msecs / POLL_INTERVAL && !quit; i++) {
+		_poll_sockets();
+		nanosleep(&ts, NULL);
+	}
+}
+
+static char *
+_dequeue(void)
+{
+	struct queue_entry	*e;
+	char			*path;
+
+	if (NULL == (e = TAILQ_FIRST(&enqueued)))
+		return (NULL);
+	TAILQ_REMOVE(&enqueued, e, entry);
+	num_enqueued--;
+	path = e->path;
+	xfree(e);
+
+	return (path);
+}
+
+static int
+_reload_config(stream_t stream, unsigned int *changes_p)
+{
+	char			*analysis_cache;
+	unsigned int		 analysis_workers;
+	struct archive_settings	 archive_old;
+
+	reloadConfig = 0;
+	*changes_p = 0;
+	log_notice("reloading configuration: %s",
+	    cfg_get_program_config_file());
+	analysis_cache = cfg_get_analysis_cache() ?
+	    xstrdup(cfg_get_analysis_cache()) : NULL;
+	analysis_workers = cfg_get_analysis_workers();
+	_archive_settings(stream, &archive_old);
+	if (0 > cfg_file_reload_begin()) {
+		xfree(analysis_cache);
+		xfree(archive_old.dir);
+		log_error("configuration reload failed: keeping current configuration");
+		return (0);
+	}
+	if (0 > stream_check(stream)) {
+		cfg_file_reload_rollback();
+		xfree(analysis_cache);
+		xfree(archive_old.dir);
+		log_error("configuration reload failed: keeping current configuration");
+		return (0);
+	}
+	cfg_file_reload_commit();
+	/* Pick up locale changes along with the new configuration: */
+	util_reset_codeset();
+	(void)_configure_logging();
+	_reload_analysis(analysis_cache, analysis_workers);
+	xfree(analysis_cache);
+	if (0 > stream_reload(stream, changes_p)) {
+		xfree(archive_old.dir);
+		log_error("%s: cannot apply the new configuration",
+		    stream_get_name(stream));
+		return (-1);
+	}
+	_reload_archive(stream, &archive_old);
+	xfree(archive_old.dir);
+	_set_log_context(stream);
+	log_event(NOTICE, "config_reload", -1.0, "configuration reloaded");
+
+	/* Streams whose server or stream settings are unchanged stay up: */
+	if (*changes_p & STREAM_CHANGED_CONNECTION) {
+		log_notice("server or stream settings changed: reconnecting");
+		if (0 > reconnect(stream))
+			return (-1);
+	}
+	if (*changes_p & STREAM_CHANGED_INTAKE)
+		log_notice("intake changed: %s",
+		    cfg_intake_get_filename(stream_get_cfg_intake(stream)));
+
+	return (0);
+}
+
+static int
+_playlist_mode(cfg_intake_t cfg_intake)
+{
+	switch (cfg_intake_get_type(cfg_intake)) {
+	case CFG_INTAKE_PROGRAM:
+	case CFG_INTAKE_PLAYLIST:
+		return (1);
+	case CFG_INTAKE_AUTODETECT:
+		return (util_strrcasecmp(cfg_intake_get_filename(cfg_intake), ".m3u") == 0 ||
+		    util_strrcasecmp(cfg_intake_get_filename(cfg_intake), ".txt") == 0);
+	default:
+		return (0);
+	}
+}
+
+static int
+_configure_logging(void)
+{
+	const char	*target = cfg_get_logging_target();
+	int		 ret;
+
+	if (NULL == target || 0 == strcmp(target, "syslog"))
+		ret = log_set_target(LOG_TARGET_SYSLOG, NULL);
+	else if (0 == strcmp(target, "stderr"))
+		ret = log_set_target(LOG_TARGET_STDERR, NULL);
+	else
+		ret = log_set_target(LOG_TARGET_FILE, target);
+	if (0 > ret) {
+		log_syserr(ERROR, errno, target);
+		return (-1);
+	}
+
+	log_set_ratelimit(cfg_get_logging_rate_limit());
+	log_set_format(CFG_LOG_FORMAT_JSON == cfg_get_logging_format() ?
+	    LOG_FORMAT_JSON : LOG_FORMAT_TEXT);
+
+	if (0 > log_set_async(cfg_get_logging_async()))
+		log_syserr(WARNING, errno,
+		    "asynchronous logging unavailable");
+
+	return (0);
+}
+
+static void
+_set_log_context(stream_t stream)
+{
+	cfg_server_t	cfg_server = stream_get_cfg_server(stream);
+	cfg_stream_t	cfg_stream = stream_get_cfg_stream(stream);
+
+	log_set_context(LOG_CTX_STREAM, stream_get_name(stream));
+	log_set_context(LOG_CTX_SERVER, cfg_server_get_hostname(cfg_server));
+	log_set_context(LOG_CTX_MOUNTPOINT,
+	    cfg_stream_get_mountpoint(cfg_stream));
+}
+
+/* Restarts the analysis with the new configuration, if it changed */
+static void
+_reload_analysis(const char *cache, unsigned int workers)
+{
+	const char	*new_cache = cfg_get_analysis_cache();
+
+	if (workers == cfg_get_analysis_workers() &&
+	    ((NULL == cache && NULL == new_cache) ||
+	     (cache && new_cache && 0 == strcmp(cache, new_cache))))
+		return;
+
+	log_notice("analysis settings changed: restarting analysis");
+	analysis_exit();
+	if (new_cache && 0 > analysis_init(new_cache,
+	    cfg_get_analysis_workers()))
+		log_error("analysis: continuing without analysis");
+}
+
+static const char *
+_archive_ext(stream_t stream)
+{
+	switch (cfg_stream_get_format(stream_get_cfg_stream(stream))) {
+	case CFG_STREAM_MP3:
+		return ("mp3");
+	case CFG_STREAM_WEBM:
+		return ("webm");
+	case CFG_STREAM_MATROSKA:
+		return ("mkv");
+	case CFG_STREAM_OGG:
+	default:
+		return ("ogg");
+	}
+}
+
+static void
+_archive_settings(stream_t stream, struct archive_settings *as)
+{
+	as->dir = cfg_get_archive_directory() ?
+	    xstrdup(cfg_get_archive_directory()) : NULL;
+	as->ext = _archive_ext(stream);
+	as->rotate_time = cfg_get_archive_rotate_time();
+	as->rotate_size = cfg_get_archive_rotate_size();
+	as->buffer_size = cfg_get_archive_buffer_size();
+}
+
+static int
+_start_archive(stream_t stream)
+{
+	if (!cfg_get_archive_directory())
+		return (0);
+
+	archive = archive_create(cfg_get_archive_directory(),
+	    stream_get_name(stream), _archive_ext(stream),
+	    cfg_get_archive_rotate_time(),
+	    (unsigned long long)cfg_get_archive_rotate_size() * 1024 * 1024,
+	    (size_t)cfg_get_archive_buffer_size() * 1024 * 1024);
+	if (NULL == archive)
+		return (-1);
+	stream_set_archive(stream, archive);
+
+	return (0);
+}
+
+/* Restarts the archive with the new configuration, if it changed */
+static void
+_reload_archive(stream_t stream, const struct archive_settings *old)
+{
+	struct archive_settings new;
+	int			same;
+
+	_archive_settings(stream, &new);
+	if (NULL == old->dir || NULL == new.dir)
+		same = old->dir == new.dir;
+	else
+		same = 0 == strcmp(old->dir, new.dir) &&
+		    0 == strcmp(old->ext, new.ext) &&
+		    old->rotate_time == new.rotate_time &&
+		    old->rotate_size == new.rotate_size &&
+		    old->buffer_size == new.buffer_size;
+	xfree(new.dir);
+	if (same)
+		return;
+
+	log_notice("archive settings changed: restarting archive");
+	stream_set_archive(stream, NULL);
+	archive_destroy(&archive);
+	if (0 > _start_archive(stream))
+		log_error("archive: continuing without archive");
+}
+
+static double
+_elapsed(const struct timespec *since)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((double)(now.tv_sec - since->tv_sec) +
+	    (double)(now.tv_nsec - since->tv_nsec) / 1000000000.0);
+}
+
+static int
+_cmd_skip(const char *arg, char *reply, size_t reply_size)
+{
+	(void)arg;
+
+	skipTrack = 1;
+	(void)snprintf(reply, reply_size, "skipping current track");
+
+	return (0);
+}
+
+static int
+_cmd_enqueue(const char *arg, char *reply, size_t reply_size)
+{
+	struct queue_entry	*e;
+
+	if (!playlistMode) {
+		(void)snprintf(reply, reply_size, "not in playlist mode");
+		return (-1);
+	}
+	if (0 > access(arg, R_OK)) {
+		(void)snprintf(reply, reply_size, "%s: %s", arg,
+		    strerror(errno));
+		return (-1);
+	}
+
+	e = xcalloc(1UL, sizeof(*e));
+	e->path = xstrdup(arg);
+	TAILQ_INSERT_TAIL(&enqueued, e, entry);
+	num_enqueued++;
+	(void)snprintf(reply, reply_size, "enqueued at position %u: %s",
+	    num_enqueued, arg);
+
+	return (0);
+}
+
+static int
+_cmd_set_metadata(const char *arg, char *reply, size_t reply_size)
+{
+	if (cfg_get_metadata_no_updates()) {
+		(void)snprintf(reply, reply_size, "metadata updates disabled");
+		return (-1);
+	}
+	if (!stream_get_connected(main_stream)) {
+		(void)snprintf(reply, reply_size, "not connected");
+		return (-1);
+	}
+	if (0 > stream_set_metadata_str(main_stream, arg)) {
+		(void)snprintf(reply, reply_size, "metadata update failed");
+		return (-1);
+	}
+	(void)snprintf(reply, reply_size, "metadata updated");
+
+	return (0);
+}
+
+static int
+_cmd_reload_playlist(const char *arg, char *reply, size_t reply_size)
+{
+	(void)arg;
+
+	if (!playlistMode) {
+		(void)snprintf(reply, reply_size, "not in playlist mode");
+		return (-1);
+	}
+	rereadPlaylist = 1;
+	(void)snprintf(reply, reply_size, "playlist re-read scheduled");
+
+	return (0);
+}
+
+static int
+_cmd_reload_config(const char *arg, char *reply, size_t reply_size)
+{
+	(void)arg;
+
+	reloadConfig = 1;
+	(void)snprintf(reply, reply_size, "configuration reload scheduled");
+
+	return (0);
+}
+
+static int
+_cmd_status(const char *arg, char *reply, size_t reply_size)
+{
+	struct timespec now;
+	char		position[64];
+	long		elapsed = 0;
+	double		kbps = metrics_get_kbps(stream_get_metrics(main_stream));
+
+	(void)arg;
+
+	if (currentTrack[0]) {
+		/* Time spent paused does not count towards the track: */
+		if (paused && 0 != pauseTime.tv_sec)
+			now = pauseTime;
+		else
+			clock_gettime(CLOCK_MONOTONIC, &now);
+		_get_position(main_stream, &currentTrackStart, &now,
+		    &elapsed, &kbps);
+	}
+	if (playlistMode && playlist)
+		(void)snprintf(position, sizeof(position), "%lu/%lu",
+		    playlist_get_position(playlist),
+		    playlist_get_num_items(playlist));
+	else
+		(void)strlcpy(position, "-", sizeof(position));
+
+	(void)snprintf(reply, reply_size,
+	    "state=%s connected=%d position=%s elapsed=%ld queued=%u"
+	    " kbps=%.2f track=%s",
+	    paused ? "paused" : "playing",
+	    stream_get_connected(main_stream), position, elapsed,
+	    num_enqueued, kbps, currentTrack[0] ? currentTrack : "-");
+
+	return (0);
+}
+
+static int
+_cmd_pause(const char *arg, char *reply, size_t reply_size)
+{
+	(void)arg;
+
+	if (paused) {
+		(void)snprintf(reply, reply_size, "already paused");
+		return (-1);
+	}
+	paused = 1;
+	(void)snprintf(reply, reply_size, "paused");
+
+	return (0);
+}
+
+static int
+_cmd_resume(const char *arg, char *reply, size_t reply_size)
+{
+	(void)arg;
+
+	if (!paused) {
+		(void)snprintf(reply, reply_size, "not paused");
+		return (-1);
+	}
+	paused = 0;
+	(void)snprintf(reply, reply_size, "resuming");
+
+	return (0);
+}
+
+static int
+_cmd_alloc_profile(const char *arg, char *reply, size_t reply_size)
+{
+	struct xalloc_site	sites[ALLOC_PROFILE_REPLY_SITES], total;
+	size_t			i, n;
+
+	if (0 == strcmp(arg, "on") || 0 == strcmp(arg, "off")) {
+		xalloc_profile_set('n' == arg[1]);
+		(void)snprintf(reply, reply_size, "allocation profiling %s",
+		    arg);
+		return (0);
+	}
+	if (0 != strcmp(arg, "dump")) {
+		(void)snprintf(reply, reply_size, "expected on, off or dump");
+		return (-1);
+	}
+	if (!xalloc_profile_get()) {
+		(void)snprintf(reply, reply_size,
+		    "allocation profiling not enabled");
+		return (-1);
+	}
+
+	xalloc_profile_dump(ALLOC_PROFILE_LOG_SITES);
+	n = xalloc_profile_get_sites(sites, ALLOC_PROFILE_REPLY_SITES,
+	    &total);
+	(void)snprintf(reply, reply_size,
+	    "allocs=%lu bytes=%llu live=%lu live_bytes=%llu top=",
+	    total.allocs, total.bytes, total.live, total.live_bytes);
+	for (i = 0; i < n; i++) {
+		char	site[PATH_MAX];
+
+		(void)snprintf(site, sizeof(site), "%s%s:%u:%llu",
+		    i ? "," : "", sites[i].file, sites[i].line,
+		    sites[i].live_bytes);
+		(void)strlcat(reply, site, reply_size);
+	}
+
+	return (0);
+}
+
 static char *
 _build_reencode_cmd(const char *extension, const char *filename,
-    cfg_stream_t cfg_stream, mdata_t md)
+    cfg_stream_t cfg_stream, mdata_t md, cfg_decoder_t *decoder_p,
+    cfg_encoder_t *encoder_p)
 {
 	cfg_decoder_t		 decoder;
 	cfg_encoder_t		 encoder;
 	char			*artist, *album, *title, *songinfo, *tmp;
 	char			*filename_quoted;
-	char			*custom_songinfo;
-	struct util_dict	 dicts[6];
-	char			*dec_str;
+	const char		*custom_songinfo;
+	const char		*values[CFG_PH_MAX];
+	util_template_t 	 dec_tmpl, enc_tmpl;
 	char			*cmd_str;
-	size_t			 cmd_str_size;
+	size_t			 cmd_str_size, dec_len;
 
 	decoder = cfg_decoder_list_findext(cfg_get_decoders(), extension);
 	if (!decoder) {
@@ -110,6 +664,7 @@ _build_reencode_cmd(const char *extension, const char *filename,
 		    filename, extension);
 		return (NULL);
 	}
+	*decoder_p = decoder;
 	encoder = cfg_encoder_list_find(cfg_get_encoders(),
 	    cfg_stream_get_encoder(cfg_stream));
 	if (!encoder) {
@@ -117,24 +672,27 @@ _build_reencode_cmd(const char *extension, const char *filename,
 		    cfg_stream_get_encoder(cfg_stream));
 		return (NULL);
 	}
+	*encoder_p = encoder;
+	if (cfg_encoder_get_plugin(encoder) && !cfg_decoder_get_plugin(decoder)) {
+		log_error("cannot encode: %s: encoder plugin needs a decoder plugin",
+		    filename);
+		return (NULL);
+	}
 
-	tmp = util_utf82char(mdata_get_artist(md));
-	artist = util_shellquote(tmp, 0);
-	xfree(tmp);
+	/* Everything here, including the result, lives in the track arena: */
+	tmp = util_utf82char_arena(track_arena, mdata_get_artist(md));
+	artist = util_shellquote_arena(track_arena, tmp, 0);
 
-	tmp = util_utf82char(mdata_get_album(md));
-	album = util_shellquote(tmp, 0);
-	xfree(tmp);
+	tmp = util_utf82char_arena(track_arena, mdata_get_album(md));
+	album = util_shellquote_arena(track_arena, tmp, 0);
 
-	tmp = util_utf82char(mdata_get_title(md));
-	title = util_shellquote(tmp, 0);
-	xfree(tmp);
+	tmp = util_utf82char_arena(track_arena, mdata_get_title(md));
+	title = util_shellquote_arena(track_arena, tmp, 0);
 
-	tmp = util_utf82char(mdata_get_songinfo(md));
-	songinfo = util_shellquote(tmp, 0);
-	xfree(tmp);
+	tmp = util_utf82char_arena(track_arena, mdata_get_songinfo(md));
+	songinfo = util_shellquote_arena(track_arena, tmp, 0);
 
-	filename_quoted = util_shellquote(filename, 0);
+	filename_quoted = util_shellquote_arena(track_arena, filename, 0);
 
 	/*
 	 * if (prog && format)
@@ -148,81 +706,129 @@ _build_reencode_cmd(const char *extension, const char *filename,
 	if (cfg_get_metadata_program() &&
 	    cfg_get_metadata_format_str()) {
 		char	 buf[BUFSIZ];
-		char	*unquoted;
 
-		mdata_strformat(md, buf, sizeof(buf),
-		    cfg_get_metadata_format_str());
-		unquoted = util_utf82char(buf);
-		custom_songinfo = util_shellquote(unquoted, 0);
-		xfree(unquoted);
+		mdata_strformat_template(md, buf, sizeof(buf),
+		    cfg_get_metadata_format_template());
+		tmp = util_utf82char_arena(track_arena, buf);
+		custom_songinfo = util_shellquote_arena(track_arena, tmp, 0);
 	} else {
 		if (!cfg_get_metadata_program() &&
+		    cfg_decoder_get_program(decoder) &&
 		    strstr(cfg_decoder_get_program(decoder),
 			PLACEHOLDER_TITLE) != NULL) {
-			custom_songinfo = xstrdup("");
+			custom_songinfo = "";
 		} else {
-			custom_songinfo = xstrdup(songinfo);
+			custom_songinfo = songinfo;
 		}
 	}
-	xfree(songinfo);
 
-	memset(dicts, 0, sizeof(dicts));
-	dicts[0].from = PLACEHOLDER_ARTIST;
-	dicts[0].to = artist;
-	dicts[1].from = PLACEHOLDER_ALBUM;
-	dicts[1].to = album;
-	dicts[2].from = PLACEHOLDER_TITLE;
-	dicts[2].to = title;
-	dicts[3].from = PLACEHOLDER_TRACK;
-	dicts[3].to = filename_quoted;
-	dicts[4].from = PLACEHOLDER_METADATA;
-	dicts[4].to = custom_songinfo;
+	memset(values, 0, sizeof(values));
+	values[CFG_PH_ARTIST] = artist;
+	values[CFG_PH_ALBUM] = album;
+	values[CFG_PH_TITLE] = title;
+	values[CFG_PH_TRACK] = filename_quoted;
+	values[CFG_PH_METADATA] = custom_songinfo;
 
 	if (!cfg_get_metadata_program() &&
+	    cfg_encoder_get_program(encoder) &&
 	    strstr(cfg_encoder_get_program(encoder),
-		PLACEHOLDER_TITLE) != NULL) {
-		xfree(custom_songinfo);
-		dicts[4].to = custom_songinfo = xstrdup("");
-	}
-
-	dec_str = util_expand_words(cfg_decoder_get_program(decoder), dicts);
-	cmd_str_size = strlen(dec_str) + 1;
-	if (cfg_encoder_get_program(encoder)) {
-		char	*enc_str;
-
-		enc_str = util_expand_words(cfg_encoder_get_program(encoder),
-		    dicts);
-		cmd_str_size += strlen(" | ") + strlen(enc_str);
-		cmd_str = xcalloc(cmd_str_size, sizeof(char));
-		snprintf(cmd_str, cmd_str_size, "%s | %s", dec_str, enc_str);
-		xfree(enc_str);
-		xfree(dec_str);
-	} else {
-		cmd_str = xcalloc(cmd_str_size, sizeof(char));
-		snprintf(cmd_str, cmd_str_size, "%s", dec_str);
-		xfree(dec_str);
+		PLACEHOLDER_TITLE) != NULL)
+		values[CFG_PH_METADATA] = "";
+
+	/* Size the whole pipeline first, so that it is rendered in place: */
+	dec_tmpl = cfg_decoder_get_program_template(decoder);
+	enc_tmpl = cfg_encoder_get_program_template(encoder);
+	if (!dec_tmpl) {
+		/* Decoder plugins only need the encoder command: */
+		if (!enc_tmpl)
+			return (xarena_strdup(track_arena, ""));
+		cmd_str_size = util_template_render(enc_tmpl, values, NULL,
+		    0) + 1;
+		cmd_str = xarena_alloc(track_arena, cmd_str_size);
+		(void)util_template_render(enc_tmpl, values, cmd_str,
+		    cmd_str_size);
+		return (cmd_str);
+	}
+	dec_len = util_template_render(dec_tmpl, values, NULL, 0);
+	cmd_str_size = dec_len + 1;
+	if (enc_tmpl)
+		cmd_str_size += strlen(" | ") +
+		    util_template_render(enc_tmpl, values, NULL, 0);
+	cmd_str = xarena_alloc(track_arena, cmd_str_size);
+	(void)util_template_render(dec_tmpl, values, cmd_str, cmd_str_size);
+	if (enc_tmpl) {
+		(void)strlcat(cmd_str, " | ", cmd_str_size);
+		(void)util_template_render(enc_tmpl, values,
+		    cmd_str + dec_len + strlen(" | "),
+		    cmd_str_size - dec_len - strlen(" | "));
 	}
-
-	xfree(artist);
-	xfree(album);
-	xfree(title);
-	xfree(filename_quoted);
-	xfree(custom_songinfo);
 
 	return (cmd_str);
 }
 
-static FILE *
-openResource(stream_t stream, const char *filename, int *popenFlag,
+/* Album normalization falls back to the track gain, if there is no album: */
+static float
+_get_track_gain(cfg_stream_t cfg_stream, mdata_t md)
+{
+	float	gain = 0.0f;
+
+	switch (cfg_stream_get_normalization(cfg_stream)) {
+	case CFG_STREAM_NORM_ALBUM:
+		if (0 == mdata_get_album_gain(md, &gain))
+			break;
+		/* FALLTHROUGH */
+	case CFG_STREAM_NORM_TRACK:
+		if (0 > mdata_get_track_gain(md, &gain))
+			log_info("%s: no loudness information, not normalizing",
+			    mdata_get_filename(md));
+		break;
+	case CFG_STREAM_NORM_NONE:
+	default:
+		break;
+	}
+
+	return (gain);
+}
+
+/*
+ * Has the next playlist entries analyzed ahead of play, for those that are
+ * going to be decoded by a plugin.
+ */
+static void
+_queue_analysis(cfg_stream_t cfg_stream)
+{
+	cfg_decoder_t	 decoder;
+	const char	*file, *ext;
+	unsigned long	 i;
+
+	if (!cfg_get_analysis_cache() || !cfg_stream_get_encoder(cfg_stream))
+		return;
+
+	for (i = 0; i < ANALYSIS_AHEAD; i++) {
+		if (NULL == (file = playlist_peek(playlist, i)))
+			break;
+		if (NULL == (ext = strrchr(file, '.')))
+			continue;
+		decoder = cfg_decoder_list_findext(cfg_get_decoders(), ext);
+		if (decoder && cfg_decoder_get_plugin(decoder))
+			(void)analysis_queue(file,
+			    cfg_decoder_get_plugin(decoder));
+	}
+}
+
+static int
+openResource(stream_t stream, const char *filename, struct resource *res,
 	     mdata_t *md_p, int *isStdin, long *songLen)
 {
-	FILE		*filep = NULL;
 	char		 extension[25];
 	char		*p = NULL;
 	char		*pCommandString = NULL;
 	mdata_t 	 md;
+	cfg_decoder_t	 decoder = NULL;
+	cfg_encoder_t	 encoder = NULL;
 	cfg_stream_t	 cfg_stream = stream_get_cfg_stream(stream);
 
+	memset(res, 0, sizeof(*res));
 	if (md_p != NULL)
 		*md_p = NULL;
 	if (songLen != NULL)
@@ -231,12 +837,12 @@ openResource(stream_t stream, const char *filename, int *popenFlag,
 	if ((isStdin && *isStdin) ||
 	    strcasecmp(filename, "stdin") == 0) {
 		if (cfg_get_metadata_program()) {
-			md = mdata_create();
+			md = mdata_create_arena(track_arena);
 
 			if (0 > mdata_run_program(md, cfg_get_metadata_program()) ||
 			    0 > stream_set_metadata(stream, md, NULL)) {
 				mdata_destroy(&md);
-				return (NULL);
+				return (-1);
 			}
 
 			if (md_p != NULL)
@@ -247,8 +853,8 @@ openResource(stream_t stream, const char *filename, int *popenFlag,
 
 		if (isStdin != NULL)
 			*isStdin = 1;
-		filep = stdin;
-		return (filep);
+		res->fp = stdin;
+		return (0);
 	}
 
 	if (isStdin != NULL)
@@ -263,10 +869,10 @@ openResource(stream_t stream, const char *filename, int *popenFlag,
 
 	if (strlen(extension) == 0) {
 		log_error("%s: cannot determine file type", filename);
-		return (filep);
+		return (-1);
 	}
 
-	md = mdata_create();
+	md = mdata_create_arena(track_arena);
 	if (cfg_get_metadata_program()) {
 		if (0 > mdata_run_program(md, cfg_get_metadata_program()))
 			mdata_destroy(&md);
@@ -275,24 +881,77 @@ openResource(stream_t stream, const char *filename, int *popenFlag,
 			mdata_destroy(&md);
 	}
 	if (NULL == md)
-		return (NULL);
+		return (-1);
+	analysis_apply(md, filename);
 	if (songLen != NULL)
 		*songLen = mdata_get_length(md);
 
-	*popenFlag = 0;
 	if (cfg_stream_get_encoder(cfg_stream)) {
-		int	stderr_fd = -1;
+		int		stderr_fd = -1;
+		struct timespec spawn_start;
+		float		gain, peak;
+		unsigned long	start, end;
 
 		pCommandString = _build_reencode_cmd(extension, filename,
-		    cfg_stream, md);
+		    cfg_stream, md, &decoder, &encoder);
 		if (NULL == pCommandString) {
 			mdata_destroy(&md);
-			return (NULL);
+			return (-1);
 		}
+		gain = cfg_decoder_get_plugin(decoder) ?
+		    _get_track_gain(cfg_stream, md) : 0.0f;
+		if (0 > mdata_get_true_peak(md, &peak))
+			peak = -1.0f;
+		/* Bounds measured above the trimming level cut off audio: */
+		if (ANALYSIS_SILENCE_DB >
+		    cfg_stream_get_silence_threshold(cfg_stream) ||
+		    0 > mdata_get_audio_bounds(md, &start, &end))
+			start = end = 0;
 		if (md_p != NULL)
 			*md_p = md;
 		else
 			mdata_destroy(&md);
+
+		if (cfg_decoder_get_plugin(decoder)) {
+			if (0 > pipeline_set_encoder(pipeline,
+			    cfg_encoder_get_plugin(encoder)))
+				return (-1);
+			pipeline_set_crossfade(pipeline,
+			    cfg_stream_get_crossfade(cfg_stream),
+			    cfg_stream_get_crossfade_curve(cfg_stream));
+			pipeline_set_gain(pipeline, gain,
+			    CFG_STREAM_NORM_NONE !=
+			    cfg_stream_get_normalization(cfg_stream));
+			pipeline_set_peak(pipeline, peak);
+			pipeline_set_silence(pipeline,
+			    cfg_stream_get_silence_threshold(cfg_stream));
+			pipeline_set_bounds(pipeline, start, end);
+			if (cfg_encoder_get_plugin(encoder))
+				log_info("decoding with plugin: %s, encoding with plugin: %s",
+				    cfg_decoder_get_plugin(decoder),
+				    cfg_encoder_get_plugin(encoder));
+			else
+				log_info("decoding with plugin: %s%s%s",
+				    cfg_decoder_get_plugin(decoder),
+				    pCommandString[0] ? ", running command: " : "",
+				    pCommandString);
+			clock_gettime(CLOCK_MONOTONIC, &spawn_start);
+			if (0 > pipeline_start(pipeline, decoder, filename,
+			    pCommandString[0] ? pCommandString : NULL))
+				return (-1);
+			metrics_observe_since(stream_get_metrics(stream),
+			    METRICS_DECODER_SPAWN, &spawn_start);
+			res->pipeline = 1;
+			return (0);
+		}
+
+		if (CFG_STREAM_NORM_NONE !=
+		    cfg_stream_get_normalization(cfg_stream))
+			log_warning("%s: loudness normalization requires a decoder plugin",
+			    filename);
+		if (cfg_stream_get_silence_threshold(cfg_stream))
+			log_warning("%s: silence trimming requires a decoder plugin",
+			    filename);
 		log_info("running command: %s", pCommandString);
 
 		if (cfg_get_program_quiet_stderr()) {
@@ -315,7 +974,8 @@ openResource(stream_t stream, const char *filename, int *popenFlag,
 
 		fflush(NULL);
 		errno = 0;
-		if ((filep = popen(pCommandString, "r")) == NULL) {
+		clock_gettime(CLOCK_MONOTONIC, &spawn_start);
+		if ((res->fp = popen(pCommandString, "r")) == NULL) {
 			/* popen() does not set errno reliably ... */
 			if (errno)
 				log_error("execution error: %s: %s",
@@ -324,9 +984,10 @@ openResource(stream_t stream, const char *filename, int *popenFlag,
 				log_error("execution error: %s",
 				    pCommandString);
 		} else {
-			*popenFlag = 1;
+			res->popen = 1;
+			metrics_observe_since(stream_get_metrics(stream),
+			    METRICS_DECODER_SPAWN, &spawn_start);
 		}
-		xfree(pCommandString);
 
 		if (cfg_get_program_quiet_stderr())
 			dup2(stderr_fd, fileno(stderr));
@@ -334,7 +995,7 @@ openResource(stream_t stream, const char *filename, int *popenFlag,
 		if (stderr_fd != -1)
 			close(stderr_fd);
 
-		return (filep);
+		return (res->fp ? 0 : -1);
 	}
 
 	if (md_p != NULL)
@@ -342,34 +1003,86 @@ openResource(stream_t stream, const char *filename, int *popenFlag,
 	else
 		mdata_destroy(&md);
 
-	if ((filep = fopen(filename, "rb")) == NULL) {
+	if ((res->fp = fopen(filename, "rb")) == NULL) {
 		log_error("%s: %s", filename, strerror(errno));
-		return (NULL);
+		return (-1);
 	}
 
-	return (filep);
+	return (0);
+}
+
+static size_t
+readResource(struct resource *res, char *buf, size_t size)
+{
+	ssize_t	n;
+
+	if (!res->pipeline)
+		return (fread(buf, 1, size, res->fp));
+
+	n = pipeline_read(pipeline, buf, size);
+	return (0 < n ? (size_t)n : 0);
+}
+
+static void
+closeResource(struct resource *res)
+{
+	if (res->pipeline)
+		pipeline_stop(pipeline);
+	else if (res->popen)
+		pclose(res->fp);
+	else if (res->fp && res->fp != stdin)
+		fclose(res->fp);
+	memset(res, 0, sizeof(*res));
+}
+
+/*
+ * Sends what the pipeline still holds back of the last track, and the final
+ * output of an encoder plugin, to end the stream cleanly.
+ */
+static void
+_drain_encoder(stream_t stream)
+{
+	char	buff[4096];
+	ssize_t n;
+
+	pipeline_drain(pipeline);
+	while (0 < (n = pipeline_read(pipeline, buff, sizeof(buff)))) {
+		if (!stream_get_connected(stream))
+			continue;
+		stream_sync(stream);
+		(void)stream_send(stream, buff, (size_t)n);
+	}
 }
 
 int
 reconnect(stream_t stream)
 {
 	unsigned int	i;
+	struct timespec start;
 	cfg_server_t	cfg_server = stream_get_cfg_server(stream);
 
+	clock_gettime(CLOCK_MONOTONIC, &start);
 	i = 0;
 	while (++i) {
 		if (cfg_server_get_reconnect_attempts(cfg_server) > 0)
-			log_notice("reconnect: %s: attempt #%u/%u ...",
+			log_event(NOTICE, "reconnect", -1.0,
+			    "reconnect: %s: attempt #%u/%u ...",
 			    cfg_server_get_hostname(cfg_server), i,
 			    cfg_server_get_reconnect_attempts(cfg_server));
 		else
-			log_notice("reconnect: %s: attempt #%u ...",
+			log_event(NOTICE, "reconnect", -1.0,
+			    "reconnect: %s: attempt #%u ...",
 			    cfg_server_get_hostname(cfg_server), i);
 
 		stream_disconnect(stream);
 		if (0 == stream_connect(stream)) {
-			log_notice("reconnect: %s: success",
+			log_event(NOTICE, "reconnected", _elapsed(&start),
+			    "reconnect: %s: success",
 			    cfg_server_get_hostname(cfg_server));
+			metrics_count(stream_get_metrics(stream),
+			    METRICS_RECONNECTS, 1);
+			/* The new connection needs a new encoded stream: */
+			pipeline_restart_encoder(pipeline);
 			return (0);
 		}
 
@@ -380,10 +1093,11 @@ reconnect(stream_t stream)
 		if (quit)
 			return (-1);
 		else
-			sleep(5);
+			_sleep_polling(5000);
 	};
 
-	log_warning("reconnect failed: giving up");
+	log_event(WARNING, "reconnect_failed", _elapsed(&start),
+	    "reconnect failed: giving up");
 
 	return (-1);
 }
@@ -407,29 +1121,141 @@ getTimeString(long seconds)
 	return ((const char *)str);
 }
 
+/*
+ * Reports the elapsed time and bitrate of the current track from the media,
+ * if the stream format allows, or from the wall clock and the sent data
+ * otherwise.
+ */
+static void
+_get_position(stream_t stream, const struct timespec *startTime,
+    const struct timespec *now, long *secs, double *kbps)
+{
+	double	media_secs, media_kbps;
+
+	if (0 == stream_get_position(stream, &media_secs, &media_kbps)) {
+		*secs = (long)media_secs;
+		*kbps = media_kbps;
+		return;
+	}
+	*secs = (long)(now->tv_sec - startTime->tv_sec);
+	*kbps = metrics_get_kbps(stream_get_metrics(stream));
+}
+
+static void
+_print_rtstatus(stream_t stream, int isStdin, long songLen,
+    const struct timespec *startTime, const struct timespec *now)
+{
+	cfg_intake_t	 cfg_intake = stream_get_cfg_intake(stream);
+	metrics_t	 m = stream_get_metrics(stream);
+	char		 position[PATH_MAX + 16];
+	char		 elapsed[25], length[32];
+	long		 secs;
+	double		 kbps, media_length;
+
+	_get_position(stream, startTime, now, &secs, &kbps);
+	if (0 == stream_get_length(stream, &media_length))
+		songLen = (long)(media_length + 0.5);
+
+	if (cfg_get_program_rtstatus_json()) {
+		char	*track;
+		char	 entries[32];
+
+		if (!isStdin && playlistMode && playlist &&
+		    CFG_INTAKE_PROGRAM != cfg_intake_get_type(cfg_intake)) {
+			(void)snprintf(position, sizeof(position), "%lu",
+			    playlist_get_position(playlist));
+			(void)snprintf(entries, sizeof(entries), "%lu",
+			    playlist_get_num_items(playlist));
+		} else {
+			(void)strlcpy(position, "null", sizeof(position));
+			(void)strlcpy(entries, "null", sizeof(entries));
+		}
+		if (songLen > 0)
+			(void)snprintf(length, sizeof(length), "%ld", songLen);
+		else
+			(void)strlcpy(length, "null", sizeof(length));
+		track = util_jsonquote(currentTrack);
+		printf("{\"track\":%s,\"position\":%s,\"entries\":%s,"
+		    "\"elapsed\":%ld,\"length\":%s,\"kbps\":%.2f,"
+		    "\"bytes\":%llu,\"connected\":%s,\"paused\":%s}\n",
+		    track, position, entries, secs, length, kbps,
+		    metrics_get_counter(m, METRICS_BYTES_SENT),
+		    stream_get_connected(stream) ? "true" : "false",
+		    paused ? "true" : "false");
+		xfree(track);
+		fflush(stdout);
+		return;
+	}
+
+	position[0] = '\0';
+	if (!isStdin && playlistMode) {
+		if (CFG_INTAKE_PROGRAM == cfg_intake_get_type(cfg_intake)) {
+			char *tmp = xstrdup(cfg_intake_get_filename(cfg_intake));
+			(void)strlcpy(position, "  [", sizeof(position));
+			(void)strlcat(position, basename(tmp), sizeof(position));
+			(void)strlcat(position, "]", sizeof(position));
+			xfree(tmp);
+		} else
+			(void)snprintf(position, sizeof(position),
+			    "  [%4lu/%-4lu]",
+			    playlist_get_position(playlist),
+			    playlist_get_num_items(playlist));
+	}
+	(void)strlcpy(elapsed, getTimeString(secs), sizeof(elapsed));
+	length[0] = '\0';
+	if (songLen > 0)
+		(void)snprintf(length, sizeof(length), "/%s",
+		    getTimeString(songLen));
+
+	if (0.0 < kbps)
+		printf("%s  [ %s%s]  [%8.2f kbps]  \r", position, elapsed,
+		    length, kbps);
+	else
+		printf("%s  [ %s%s]                   \r", position, elapsed,
+		    length);
+	fflush(stdout);
+}
+
+/*
+ * Completes the Ogg page or MP3 frame that is currently being sent, so that
+ * a track ends on a boundary when it is skipped or stopped, and metadata
+ * updates happen in between frames.
+ */
+static void
+_send_to_boundary(stream_t stream, struct resource *res)
+{
+	char	buff[4096];
+	size_t	len, bytes_read;
+
+	while (0 < (len = stream_get_boundary(stream))) {
+		if (len > sizeof(buff))
+			len = sizeof(buff);
+		if (0 == (bytes_read = readResource(res, buff, len)) ||
+		    0 > stream_send(stream, buff, bytes_read))
+			break;
+	}
+}
+
 int
-sendStream(stream_t stream, FILE *filepstream, const char *fileName,
-	   int isStdin, const char *songLenStr, struct timespec *tv)
+sendStream(stream_t stream, struct resource *res, const char *fileName,
+	   int isStdin, long songLen, struct timespec *startTime)
 {
 	char		  buff[4096];
-	size_t		  bytes_read, total, oldTotal;
+	size_t		  bytes_read;
 	int		  ret;
-	double		  kbps = -1.0;
-	struct timespec	  timeStamp, *startTime = tv;
-	struct timespec	  callTime, currentTime;
+	struct timespec	  callTime, currentTime, statusTime;
 	cfg_server_t	  cfg_server = stream_get_cfg_server(stream);
 	cfg_intake_t	  cfg_intake = stream_get_cfg_intake(stream);
 
 	clock_gettime(CLOCK_MONOTONIC, &callTime);
+	statusTime.tv_sec = 0;
+	statusTime.tv_nsec = 0;
 
-	timeStamp.tv_sec = startTime->tv_sec;
-	timeStamp.tv_nsec = startTime->tv_nsec;
-
-	total = oldTotal = 0;
 	ret = STREAM_DONE;
-	while ((bytes_read = fread(buff, 1, sizeof(buff), filepstream)) > 0) {
+	while ((bytes_read = readResource(res, buff, sizeof(buff))) > 0) {
 		if (!stream_get_connected(stream)) {
-			log_warning("%s: connection lost",
+			log_event(WARNING, "connection_lost", -1.0,
+			    "%s: connection lost",
 			    cfg_server_get_hostname(cfg_server));
 			if (0 > reconnect(stream)) {
 				ret = STREAM_SERVERR;
@@ -445,12 +1271,56 @@ sendStream(stream_t stream, FILE *filepstream, const char *fileName,
 			break;
 		}
 
+		_poll_sockets();
+
+		if (paused) {
+			struct timespec resumeTime;
+
+			log_event(NOTICE, "pause", -1.0, "%s: paused",
+			    fileName);
+			clock_gettime(CLOCK_MONOTONIC, &pauseTime);
+			stream_pause(stream);
+			while (paused && !quit)
+				_sleep_polling(POLL_INTERVAL);
+			stream_resume(stream);
+			/* Time spent paused does not count towards the track: */
+			clock_gettime(CLOCK_MONOTONIC, &resumeTime);
+			startTime->tv_sec += resumeTime.tv_sec - pauseTime.tv_sec;
+			startTime->tv_nsec += resumeTime.tv_nsec -
+			    pauseTime.tv_nsec;
+			if (startTime->tv_nsec < 0) {
+				startTime->tv_sec--;
+				startTime->tv_nsec += 1000000000L;
+			} else if (startTime->tv_nsec >= 1000000000L) {
+				startTime->tv_sec++;
+				startTime->tv_nsec -= 1000000000L;
+			}
+			currentTrackStart = *startTime;
+			pauseTime.tv_sec = 0;
+			if (quit)
+				break;
+			log_event(NOTICE, "resume", -1.0, "%s: resuming",
+			    fileName);
+			/*
+			 * The connection stays up while paused, unless the
+			 * server gave up on the idle source:
+			 */
+			if (!stream_get_connected(stream) &&
+			    0 > reconnect(stream)) {
+				ret = STREAM_SERVERR;
+				break;
+			}
+			stream_sync(stream);
+		}
+
 		if (quit)
 			break;
 		if (rereadPlaylist_notify) {
 			rereadPlaylist_notify = 0;
 			if (CFG_INTAKE_PLAYLIST == cfg_intake_get_type(cfg_intake))
-				log_notice("HUP signal received: playlist re-read scheduled");
+				log_notice("HUP signal received: configuration reload and playlist re-read scheduled");
+			else
+				log_notice("HUP signal received: configuration reload scheduled");
 		}
 		if (skipTrack) {
 			skipTrack = 0;
@@ -471,53 +1341,25 @@ sendStream(stream_t stream, FILE *filepstream, const char *fileName,
 			}
 		}
 
-		total += bytes_read;
-		if (cfg_get_program_rtstatus_output()) {
-			double	oldTime, newTime;
-
-			if (!isStdin && playlistMode) {
-				if (CFG_INTAKE_PROGRAM == cfg_intake_get_type(cfg_intake)) {
-					char *tmp = xstrdup(cfg_intake_get_filename(cfg_intake));
-					printf("  [%s]", basename(tmp));
-					xfree(tmp);
-				} else
-					printf("  [%4lu/%-4lu]",
-					    playlist_get_position(playlist),
-					    playlist_get_num_items(playlist));
-			}
-
-			oldTime = (double)timeStamp.tv_sec
-			    + (double)timeStamp.tv_nsec / 1000000000.0;
-			newTime = (double)currentTime.tv_sec
-			    + (double)currentTime.tv_nsec / 1000000000.0;
-			if (songLenStr == NULL)
-				printf("  [ %s]",
-				    getTimeString(currentTime.tv_sec -
-					startTime->tv_sec));
-			else
-				printf("  [ %s/%s]",
-				    getTimeString(currentTime.tv_sec -
-					startTime->tv_sec),
-				    songLenStr);
-			if (newTime - oldTime >= 1.0) {
-				kbps = (((double)(total - oldTotal)
-				    / (newTime - oldTime)) * 8.0) / 1000.0;
-				timeStamp.tv_sec = currentTime.tv_sec;
-				timeStamp.tv_nsec = currentTime.tv_nsec;
-				oldTotal = total;
-			}
-			if (kbps < 0)
-				printf("                 ");
-			else
-				printf("  [%8.2f kbps]", kbps);
-
-			printf("  \r");
-			fflush(stdout);
+		/*
+		 * The status line is rendered on a timer, so that a slow
+		 * stdout does not throttle the stream:
+		 */
+		if (cfg_get_program_rtstatus_output() &&
+		    (currentTime.tv_sec - statusTime.tv_sec) * 1000 +
+		    (currentTime.tv_nsec - statusTime.tv_nsec) / 1000000 >=
+		    (long)cfg_get_program_rtstatus_interval()) {
+			statusTime = currentTime;
+			_print_rtstatus(stream, isStdin, songLen, startTime,
+			    &currentTime);
 		}
 	}
-	if (ferror(filepstream)) {
+	if ((quit || STREAM_SKIP == ret || STREAM_UPDMDATA == ret) &&
+	    stream_get_connected(stream))
+		_send_to_boundary(stream, res);
+	if (res->fp && ferror(res->fp)) {
 		if (errno == EINTR) {
-			clearerr(filepstream);
+			clearerr(res->fp);
 			ret = STREAM_CONT;
 		} else if (errno == EBADF && isStdin)
 			log_notice("no (more) data available on standard input");
@@ -532,19 +1374,23 @@ sendStream(stream_t stream, FILE *filepstream, const char *fileName,
 int
 streamFile(stream_t stream, const char *fileName)
 {
-	FILE		*filepstream = NULL;
-	int		 popenFlag = 0;
-	char		*songLenStr = NULL;
+	struct resource  res;
 	int		 ret, retval = 0;
 	long		 songLen;
 	mdata_t 	 md = NULL;
-	struct timespec	 startTime;
+	struct timespec	 openTime, startTime;
 	cfg_stream_t	 cfg_stream = stream_get_cfg_stream(stream);
 	cfg_intake_t	 cfg_intake = stream_get_cfg_intake(stream);
 	int		 isStdin = cfg_intake_get_type(cfg_intake) == CFG_INTAKE_STDIN;
 
-	if ((filepstream = openResource(stream, fileName, &popenFlag, &md, &isStdin, &songLen))
-	    == NULL) {
+	if (xarena_get_stats(track_arena)->allocs)
+		log_debug("track arena: %zu bytes in %lu allocations",
+		    xarena_get_stats(track_arena)->bytes,
+		    xarena_get_stats(track_arena)->allocs);
+	xarena_reset(track_arena);
+
+	clock_gettime(CLOCK_MONOTONIC, &openTime);
+	if (0 > openResource(stream, fileName, &res, &md, &isStdin, &songLen)) {
 		mdata_destroy(&md);
 		if (++resource_errors > 100) {
 			log_error("too many errors; giving up");
@@ -554,6 +1400,10 @@ streamFile(stream_t stream, const char *fileName)
 		return (1);
 	}
 	resource_errors = 0;
+	metrics_count(stream_get_metrics(stream), METRICS_TRACK_CHANGES, 1);
+	(void)strlcpy(currentTrack, isStdin ? "stdin" : fileName,
+	    sizeof(currentTrack));
+	log_set_context(LOG_CTX_TRACK, currentTrack);
 
 	if (md != NULL) {
 		const char	*tmp;
@@ -561,10 +1411,10 @@ streamFile(stream_t stream, const char *fileName)
 
 		tmp = mdata_get_songinfo(md) ?
 		    mdata_get_songinfo(md) : mdata_get_name(md);
-		metaData = util_utf82char(tmp);
-		log_notice("streaming: %s (%s)", metaData,
+		metaData = util_utf82char_arena(track_arena, tmp);
+		log_event(NOTICE, "track_change", _elapsed(&openTime),
+		    "streaming: %s (%s)", metaData,
 		    isStdin ? "stdin" : fileName);
-		xfree(metaData);
 
 		/* MP3 streams are special, so set the metadata explicitly: */
 		if (CFG_STREAM_MP3 == cfg_stream_get_format(cfg_stream))
@@ -572,14 +1422,15 @@ streamFile(stream_t stream, const char *fileName)
 
 		mdata_destroy(&md);
 	} else if (isStdin)
-		log_notice("streaming: standard input");
+		log_event(NOTICE, "track_change", _elapsed(&openTime),
+		    "streaming: standard input");
 
-	if (songLen > 0)
-		songLenStr = xstrdup(getTimeString(songLen));
 	clock_gettime(CLOCK_MONOTONIC, &startTime);
+	currentTrackStart = startTime;
+	stream_mark(stream);
 	do {
-		ret = sendStream(stream, filepstream, fileName, isStdin,
-		    songLenStr, &startTime);
+		ret = sendStream(stream, &res, fileName, isStdin,
+		    songLen, &startTime);
 		if (quit)
 			break;
 		if (ret != STREAM_DONE) {
@@ -595,7 +1446,8 @@ streamFile(stream_t stream, const char *fileName)
 			if (ret == STREAM_SKIP || skipTrack) {
 				skipTrack = 0;
 				if (!isStdin)
-					log_notice("USR1 signal received: skipping current track");
+					log_event(NOTICE, "skip", -1.0,
+					    "USR1 signal received: skipping current track");
 				retval = 1;
 				ret = STREAM_DONE;
 			}
@@ -604,7 +1456,7 @@ streamFile(stream_t stream, const char *fileName)
 				if (cfg_get_metadata_no_updates())
 					continue;
 				if (cfg_get_metadata_program()) {
-					char		*mdataStr = NULL;
+					const char	*mdataStr = NULL;
 
 					log_info("running metadata program: %s",
 					    cfg_get_metadata_program());
@@ -616,9 +1468,8 @@ streamFile(stream_t stream, const char *fileName)
 						ret = STREAM_DONE;
 						continue;
 					}
-					mdata_destroy(&md);
 					log_info("new metadata: %s", mdataStr);
-					xfree(mdataStr);
+					mdata_destroy(&md);
 				}
 			}
 			if (ret == STREAM_SERVERR) {
@@ -629,13 +1480,8 @@ streamFile(stream_t stream, const char *fileName)
 			retval = 1;
 	} while (ret != STREAM_DONE);
 
-	if (popenFlag)
-		pclose(filepstream);
-	else if (!isStdin)
-		fclose(filepstream);
-
-	if (songLenStr != NULL)
-		xfree(songLenStr);
+	closeResource(&res);
+	log_set_context(LOG_CTX_TRACK, NULL);
 
 	return (retval);
 }
@@ -644,9 +1490,14 @@ int
 streamPlaylist(stream_t stream)
 {
 	const char	*song;
+	char		*queued;
 	char		 lastSong[PATH_MAX];
+	int		 cont;
+	unsigned int	 changes;
 	cfg_intake_t	 cfg_intake = stream_get_cfg_intake(stream);
 
+	lastSong[0] = '\0';
+
 	if (playlist == NULL) {
 		switch (cfg_intake_get_type(cfg_intake)) {
 		case CFG_INTAKE_PROGRAM:
@@ -678,22 +1529,43 @@ streamPlaylist(stream_t stream)
 	    cfg_intake_get_shuffle(cfg_intake))
 		playlist_shuffle(playlist);
 
-	while ((song = playlist_get_next(playlist)) != NULL) {
-		strlcpy(lastSong, song, sizeof(lastSong));
-		if (!streamFile(stream, song))
+	for (;;) {
+		/* Enqueued files take precedence over the playlist: */
+		if ((queued = _dequeue()) != NULL)
+			song = queued;
+		else if ((song = playlist_get_next(playlist)) != NULL)
+			strlcpy(lastSong, song, sizeof(lastSong));
+		else
+			break;
+		_queue_analysis(stream_get_cfg_stream(stream));
+		cont = streamFile(stream, song);
+		xfree(queued);
+		if (!cont)
 			return (0);
 		if (quit)
 			break;
+		if (reloadConfig) {
+			if (0 > _reload_config(stream, &changes))
+				return (0);
+			if (changes & STREAM_CHANGED_INTAKE) {
+				/* Start over with the new intake: */
+				rereadPlaylist = rereadPlaylist_notify = 0;
+				playlist_free(&playlist);
+				return (1);
+			}
+			cfg_intake = stream_get_cfg_intake(stream);
+		}
 		if (rereadPlaylist) {
 			rereadPlaylist = rereadPlaylist_notify = 0;
 			if (CFG_INTAKE_PROGRAM == cfg_intake_get_type(cfg_intake))
 				continue;
-			log_notice("rereading playlist");
+			log_event(NOTICE, "playlist_reread", -1.0,
+			    "rereading playlist");
 			if (!playlist_reread(&playlist))
 				return (0);
 			if (cfg_intake_get_shuffle(cfg_intake))
 				playlist_shuffle(playlist);
-			else {
+			else if (lastSong[0]) {
 				playlist_goto_entry(playlist, lastSong);
 				playlist_skip_next(playlist);
 			}
@@ -707,10 +1579,23 @@ streamPlaylist(stream_t stream)
 int
 ez_shutdown(int exitval)
 {
+	char	*queued;
+
+	pipeline_destroy(&pipeline);
 	if (main_stream)
 		stream_destroy(&main_stream);
+	archive_destroy(&archive);
+	xarena_destroy(&track_arena);
+	analysis_exit();
+	plugin_exit();
+
+	while ((queued = _dequeue()) != NULL)
+		xfree(queued);
 
+	control_exit();
+	metrics_exit();
 	stream_exit();
+	util_reset_codeset();
 	playlist_exit();
 	log_exit();
 	cfg_exit();
@@ -722,10 +1607,12 @@ int
 main(int argc, char *argv[])
 {
 	int		 ret, cont;
+	unsigned int	 changes;
 	const char	*errstr;
 	extern char	*optarg;
 	extern int	 optind;
 	struct sigaction act;
+	struct timespec  connectTime;
 	unsigned int	 i;
 	cfg_server_t	 cfg_server;
 	cfg_stream_t	 cfg_stream;
@@ -747,8 +1634,21 @@ main(int argc, char *argv[])
 		return (ez_shutdown(2));
 	}
 
+	if (0 > _configure_logging() ||
+	    0 > metrics_init(cfg_get_metrics_listen()) ||
+	    0 > control_init(cfg_get_control_socket(), ezstream_commands))
+		return (ez_shutdown(1));
+	if (cfg_get_analysis_cache() &&
+	    0 > analysis_init(cfg_get_analysis_cache(),
+	    cfg_get_analysis_workers()))
+		return (ez_shutdown(1));
+
+	track_arena = xarena_create(0);
 	main_stream = stream_create(CFG_DEFAULT);
-	if (0 > stream_configure(main_stream)) {
+	pipeline = pipeline_create(stream_get_metrics(main_stream));
+	log_debug("audio processing: %s", pcm_init());
+	if (0 > stream_configure(main_stream) ||
+	    0 > _start_archive(main_stream)) {
 		stream_destroy(&main_stream);
 		return (ez_shutdown(1));
 	}
@@ -785,25 +1685,21 @@ main(int argc, char *argv[])
 	if (0 > util_write_pid_file(cfg_get_program_pid_file()))
 		log_syserr(WARNING, errno, cfg_get_program_pid_file());
 
+	_set_log_context(main_stream);
+	clock_gettime(CLOCK_MONOTONIC, &connectTime);
 	if (0 > stream_connect(main_stream)) {
 		log_error("initial server connection failed");
 		stream_destroy(&main_stream);
 		return (ez_shutdown(1));
 	}
-	log_notice("connected: %s://%s:%u%s",
+	log_event(NOTICE, "connected", _elapsed(&connectTime),
+	    "connected: %s://%s:%u%s",
 	    cfg_server_get_protocol_str(cfg_server),
 	    cfg_server_get_hostname(cfg_server),
 	    cfg_server_get_port(cfg_server),
 	    cfg_stream_get_mountpoint(cfg_stream));
 
-	if (CFG_INTAKE_PROGRAM == cfg_intake_get_type(cfg_intake) ||
-	    CFG_INTAKE_PLAYLIST == cfg_intake_get_type(cfg_intake) ||
-	    (CFG_INTAKE_AUTODETECT == cfg_intake_get_type(cfg_intake) &&
-		(util_strrcasecmp(cfg_intake_get_filename(cfg_intake), ".m3u") == 0 ||
-		    util_strrcasecmp(cfg_intake_get_filename(cfg_intake), ".txt") == 0)))
-		playlistMode = 1;
-	else
-		playlistMode = 0;
+	playlistMode = _playlist_mode(cfg_intake);
 
 	do {
 		if (playlistMode) {
@@ -814,10 +1710,19 @@ main(int argc, char *argv[])
 		}
 		if (quit)
 			break;
+		if (reloadConfig) {
+			if (0 > _reload_config(main_stream, &changes))
+				break;
+			if (changes & STREAM_CHANGED_INTAKE)
+				playlist_free(&playlist);
+		}
+		cfg_intake = stream_get_cfg_intake(main_stream);
+		playlistMode = _playlist_mode(cfg_intake);
 		if (cfg_intake_get_stream_once(cfg_intake))
 			break;
 	} while (cont);
 
+	_drain_encoder(main_stream);
 	stream_disconnect(main_stream);
 	stream_destroy(&main_stream);
 
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2026 Moritz Grimm <mgrimm@mrsserver.net>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Interface for decoder and encoder plugins, which are shared objects that
+ * ezstream loads with dlopen(3) to decode media files and encode streams
+ * in-process.
+ *
+ * A decoder plugin exports a struct ezstream_decoder_plugin under the name
+ * of EZSTREAM_DECODER_PLUGIN_SYMBOL, and an encoder plugin exports a struct
+ * ezstream_encoder_plugin under the name of EZSTREAM_ENCODER_PLUGIN_SYMBOL,
+ * with abi_version set to EZSTREAM_PLUGIN_ABI_VERSION. One shared object
+ * may export both. Audio is exchanged as interleaved 32-bit floating point
+ * samples in the range of [-1.0, 1.0].
+ *
+ * Each decoder or encoder handle is only ever used from one thread at a
+ * time, but different handles of the same plugin may be in use from
+ * different threads concurrently.
+ */
+
+#ifndef __EZSTREAM_PLUGIN_H__
+#define __EZSTREAM_PLUGIN_H__
+
+#include <stddef.h>
+
+#define EZSTREAM_PLUGIN_ABI_VERSION	1
+
+#define EZSTREAM_DECODER_PLUGIN_SYMBOL	"ezstream_decoder_plugin"
+#define EZSTREAM_ENCODER_PLUGIN_SYMBOL	"ezstream_encoder_plugin"
+
+struct ezstream_pcm_format {
+	unsigned int	 rate;
+	unsigned int	 channels;
+};
+
+struct ezstream_decoder_plugin {
+	unsigned int	 abi_version;
+	const char	*name;
+	/*
+	 * Opens a file for decoding and stores the format of its audio in
+	 * the second argument. Returns a handle for the other functions, or
+	 * NULL on error.
+	 */
+	void *	(*open)(const char *, struct ezstream_pcm_format *);
+	/*
+	 * Decodes up to the given number of frames (samples per channel)
+	 * into the buffer. Returns the number of frames decoded, 0 at the
+	 * end of the file, or -1 on error.
+	 */
+	long	(*decode)(void *, float *, size_t);
+	void	(*close)(void *);
+};
+
+/*
+ * An encoder instance lives as long as the stream it encodes, and is fed
+ * the audio of one track after the other, so that its output is a single
+ * continuous stream. A new instance is opened when the audio format
+ * changes between tracks, or when the stream reconnects. The old instance
+ * is drained first, and its final output is sent before that of the new
+ * one.
+ */
+struct ezstream_encoder_plugin {
+	unsigned int	 abi_version;
+	const char	*name;
+	/*
+	 * Starts a new stream of audio in the given format. Returns a handle
+	 * for the other functions, or NULL on error.
+	 */
+	void *	(*open)(const struct ezstream_pcm_format *);
+	/*
+	 * Encodes the given number of frames, and points the last argument
+	 * to the encoded data that is ready, which must remain valid until
+	 * the next call. Returns the number of bytes of encoded data, which
+	 * may be 0 while the encoder buffers audio, or -1 on error.
+	 */
+	long	(*encode)(void *, const float *, size_t,
+		    const unsigned char **);
+	/*
+	 * Ends the stream, and points the last argument to the encoded data
+	 * that is still held back, as with encode. Called before close,
+	 * repeatedly until it returns 0 or -1, unless the encoder failed or
+	 * its output has nowhere to go. May be NULL for encoders that hold
+	 * nothing back.
+	 */
+	long	(*drain)(void *, const unsigned char **);
+	void	(*close)(void *);
+};
+
+#endif /* __EZSTREAM_PLUGIN_H__ */
@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2026 Moritz Grimm <mgrimm@mrsserver.net>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <math.h>
+#include <string.h>
+
+#include "limiter.h"
+#include "pcm.h"
+#include "xalloc.h"
+
+/* Look-ahead and release time, in seconds */
+#define LIMITER_LOOKAHEAD	0.0015
+#define LIMITER_RELEASE 	0.1
+/*
+ * The interpolation below never exceeds the sample peak by more than this
+ * factor, so audio below the ceiling divided by it needs no limiting.
+ */
+#define LIMITER_ISP_MAX 	1.25f
+
+struct limiter {
+	size_t	 channels;
+	size_t	 lookahead;
+	size_t	 delay;
+	float	 ceiling;
+	float	 release;
+	/* Input of the last delay + 1 frames, followed by the current block: */
+	float	*buf;
+	size_t	 buf_size;
+	/* Ring of the gains that the last lookahead + 1 frames require: */
+	float	*req;
+	size_t	 req_pos;
+	size_t	 req_below;
+	/* Ring of the last lookahead released gains, which are averaged: */
+	float	*env;
+	size_t	 env_pos;
+	size_t	 env_below;
+	double	 env_sum;
+	/* Gain reduction being released, which is more precise near 0 dB: */
+	float	 reduction;
+	/* The history is known to need no limiting: */
+	int	 bypassed;
+};
+
+static float	_limiter_required(struct limiter *, size_t);
+static float	_limiter_gain(struct limiter *, float);
+static int	_limiter_idle(struct limiter *);
+
+/*
+ * Returns the gain that a frame requires to stay below the ceiling, with
+ * inter-sample peaks estimated by cubic interpolation halfway to the
+ * neighboring frames. Needs two frames of context on either side.
+ */
+static float
+_limiter_required(struct limiter *l, size_t frame)
+{
+	const float	*x = l->buf + (frame - 2) * l->channels;
+	size_t		 ch = l->channels, c;
+	float		 peak = 0.0f;
+
+	for (c = 0; c < ch; c++) {
+		float	a = x[c], b = x[ch + c], s = x[2 * ch + c];
+		float	e = x[3 * ch + c], f = x[4 * ch + c];
+		float	v;
+
+		v = fabsf(s);
+		if (v > peak)
+			peak = v;
+		v = fabsf((9.0f * (b + s) - a - e) / 16.0f);
+		if (v > peak)
+			peak = v;
+		v = fabsf((9.0f * (s + e) - b - f) / 16.0f);
+		if (v > peak)
+			peak = v;
+	}
+
+	return (peak > l->ceiling ? l->ceiling / peak : 1.0f);
+}
+
+/*
+ * Takes the gain that the newest frame requires, and returns the gain for
+ * the frame that leaves the look-ahead: The smallest required gain within
+ * the look-ahead, released slowly, then averaged over the look-ahead so
+ * that gain reduction ramps down smoothly before each peak.
+ */
+static float
+_limiter_gain(struct limiter *l, float req)
+{
+	size_t	i;
+	float	min, g, old;
+
+	old = l->req[l->req_pos];
+	if (old < 1.0f)
+		l->req_below--;
+	l->req[l->req_pos] = req;
+	if (req < 1.0f)
+		l->req_below++;
+	l->req_pos = (l->req_pos + 1) % (l->lookahead + 1);
+	min = 1.0f;
+	if (l->req_below) {
+		for (i = 0; i < l->lookahead + 1; i++) {
+			if (l->req[i] < min)
+				min = l->req[i];
+		}
+	}
+
+	l->reduction *= l->release;
+	if (l->reduction < 0.0001f)
+		l->reduction = 0.0f;
+	g = 1.0f - l->reduction;
+	if (min < g) {
+		g = min;
+		l->reduction = 1.0f - min;
+	}
+
+	old = l->env[l->env_pos];
+	if (old < 1.0f)
+		l->env_below--;
+	l->env[l->env_pos] = g;
+	if (g < 1.0f)
+		l->env_below++;
+	l->env_pos = (l->env_pos + 1) % l->lookahead;
+	if (0 == l->env_below) {
+		/* Also keeps rounding errors from accumulating: */
+		l->env_sum = (double)l->lookahead;
+		return (1.0f);
+	}
+	l->env_sum += (double)g - (double)old;
+
+	return ((float)(l->env_sum / (double)l->lookahead));
+}
+
+static int
+_limiter_idle(struct limiter *l)
+{
+	return (0 == l->req_below && 0 == l->env_below &&
+	    0.0f == l->reduction);
+}
+
+struct limiter *
+limiter_create(unsigned int rate, unsigned int channels, float ceiling)
+{
+	struct limiter	*l;
+	size_t		 i;
+
+	l = xcalloc(1UL, sizeof(*l));
+	l->channels = channels;
+	l->lookahead = (size_t)(LIMITER_LOOKAHEAD * rate);
+	if (0 == l->lookahead)
+		l->lookahead = 1;
+	/* The inter-sample peak estimate looks two frames further ahead: */
+	l->delay = l->lookahead + 2;
+	l->ceiling = ceiling;
+	l->release = (float)exp(-1.0 / (LIMITER_RELEASE * rate));
+	l->buf_size = (l->delay + 1) * l->channels;
+	l->buf = xcalloc(l->buf_size, sizeof(*l->buf));
+	l->req = xreallocarray(NULL, l->lookahead + 1, sizeof(*l->req));
+	for (i = 0; i < l->lookahead + 1; i++)
+		l->req[i] = 1.0f;
+	l->env = xreallocarray(NULL, l->lookahead, sizeof(*l->env));
+	for (i = 0; i < l->lookahead; i++)
+		l->env[i] = 1.0f;
+	l->env_sum = (double)l->lookahead;
+
+	return (l);
+}
+
+void
+limiter_destroy(struct limiter **l_p)
+{
+	struct limiter	*l = *l_p;
+
+	if (!l)
+		return;
+
+	xfree(l->buf);
+	xfree(l->req);
+	xfree(l->env);
+	xfree(l);
+	*l_p = NULL;
+}
+
+void
+limiter_process(struct limiter *l, float *pcm, size_t frames)
+{
+	size_t	ch = l->channels;
+	size_t	hist = l->delay + 1;
+	size_t	i, c;
+
+	if (l->buf_size < (hist + frames) * ch) {
+		l->buf = xreallocarray(l->buf, hist + frames,
+		    ch * sizeof(*l->buf));
+		l->buf_size = (hist + frames) * ch;
+	}
+	memcpy(l->buf + hist * ch, pcm, frames * ch * sizeof(*pcm));
+
+	if (_limiter_idle(l) &&
+	    pcm_peak(l->buf, (hist + frames) * ch) * LIMITER_ISP_MAX <=
+	    l->ceiling) {
+		/* Nothing to limit, only delay: */
+		memcpy(pcm, l->buf + ch, frames * ch * sizeof(*pcm));
+	} else {
+		for (i = 0; i < frames; i++) {
+			const float	*x;
+			float		 g;
+
+			g = _limiter_gain(l, _limiter_required(l,
+			    hist + i - 2));
+			x = l->buf + (hist + i - l->delay) * ch;
+			for (c = 0; c < ch; c++)
+				pcm[i * ch + c] = x[c] * g;
+		}
+	}
+
+	memmove(l->buf, l->buf + frames * ch, hist * ch * sizeof(*l->buf));
+	l->bypassed = 0;
+}
+
+void
+limiter_bypass(struct limiter *l, float *pcm, size_t frames)
+{
+	size_t	ch = l->channels;
+	size_t	hist = l->delay + 1;
+
+	/* Only the history may still need limiting, but not the frames: */
+	if (!_limiter_idle(l) || (!l->bypassed &&
+	    pcm_peak(l->buf, hist * ch) * LIMITER_ISP_MAX > l->ceiling)) {
+		limiter_process(l, pcm, frames);
+		return;
+	}
+
+	if (l->buf_size < (hist + frames) * ch) {
+		l->buf = xreallocarray(l->buf, hist + frames,
+		    ch * sizeof(*l->buf));
+		l->buf_size = (hist + frames) * ch;
+	}
+	memcpy(l->buf + hist * ch, pcm, frames * ch * sizeof(*pcm));
+	memcpy(pcm, l->buf + ch, frames * ch * sizeof(*pcm));
+	memmove(l->buf, l->buf + frames * ch, hist * ch * sizeof(*l->buf));
+	l->bypassed = 1;
+}
+
+size_t
+limiter_get_delay(struct limiter *l)
+{
+	return (l->delay);
+}
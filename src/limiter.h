@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2026 Moritz Grimm <mgrimm@mrsserver.net>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#ifndef __LIMITER_H__
+#define __LIMITER_H__
+
+#include <stddef.h>
+
+/*
+ * A look-ahead limiter that keeps the true peak of interleaved audio below
+ * a ceiling. Gain reduction starts ahead of a peak and is released slowly
+ * afterwards, so that the audio is not distorted by clipping. Inter-sample
+ * peaks are estimated by interpolating halfway between samples.
+ */
+typedef struct limiter *	limiter_t;
+
+limiter_t
+	limiter_create(unsigned int, unsigned int, float);
+void	limiter_destroy(limiter_t *);
+
+/*
+ * Limits the frames of audio in place. The audio is delayed by the look-
+ * ahead, which is filled with silence initially.
+ */
+void	limiter_process(limiter_t, float *, size_t);
+/*
+ * Delays the frames like limiter_process(), for audio that is known to stay
+ * below the ceiling. Gain reduction that is still being released carries
+ * on.
+ */
+void	limiter_bypass(limiter_t, float *, size_t);
+size_t	limiter_get_delay(limiter_t);
+
+#endif /* __LIMITER_H__ */
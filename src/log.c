@@ -20,20 +20,168 @@
 
 #include "attributes.h"
 
+#include <sys/types.h>
+
+#include <errno.h>
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif /* HAVE_PTHREAD */
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <syslog.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "log.h"
 
+#if defined(HAVE_PTHREAD) && defined(HAVE_ATOMIC_BUILTINS)
+# define LOG_ASYNC	1
+#endif
+
+#define LOG_MSG_SIZE		2048
+#define LOG_CTX_SIZE		512
+#define LOG_JSON_RESERVE	2	/* Closing brace and NUL */
+#define LOG_RING_SIZE		256	/* Must be a power of 2 */
+#define LOG_RATELIMIT_SLOTS	256
+#define LOG_RATELIMIT_WINDOW	60	/* seconds */
+#define LOG_FNV_BASIS		0xcbf29ce484222325ULL
+#define LOG_FNV_PRIME		0x100000001b3ULL
+
+struct log_record {
+	unsigned long	seq;
+	int		prio;
+	time_t		when;
+	char		msg[LOG_MSG_SIZE];
+};
+
+struct log_buf {
+	char		*data;
+	size_t		 size;
+	size_t		 len;
+};
+
+/*
+ * Messages are rate limited by their text, with a slot per distinct message
+ * that is found by its hash. A slot is only given up after its window has
+ * passed and its suppressed messages have been reported.
+ */
+struct log_ratelimit {
+	unsigned long	 key;		/* 0 if free */
+	long		 window;	/* seconds */
+	unsigned long	 count;
+	unsigned long	 suppressed;
+};
+
 static unsigned int	_log_verbosity;
+static char		_log_progname[256];
+static enum log_target	_log_target = LOG_TARGET_SYSLOG;
+static FILE		*_log_file;
+static enum log_format	_log_format_type = LOG_FORMAT_TEXT;
+static char		_log_context[LOG_CTX_MAX][LOG_CTX_SIZE];
+static const char	*_log_context_keys[LOG_CTX_MAX] = {
+	"stream", "server", "mountpoint", "track"
+};
+
+static unsigned int	_log_ratelimit_max;
+static struct log_ratelimit
+			_log_ratelimit_tbl[LOG_RATELIMIT_SLOTS];
+static unsigned long	_log_suppressed;
+static long		_log_ratelimit_swept;
+
+/*
+ * The rate limit is kept without locks where the compiler can do atomic
+ * operations, so that producers never wait for each other:
+ */
+#ifdef HAVE_ATOMIC_BUILTINS
+# define LOG_RL_LOCK()		do { } while (0)
+# define LOG_RL_UNLOCK()	do { } while (0)
+# define LOG_RL_LOAD(p)		__atomic_load_n((p), __ATOMIC_ACQUIRE)
+# define LOG_RL_STORE(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+# define LOG_RL_CAS(p, e, v)	__atomic_compare_exchange_n((p), (e), (v), \
+				    0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+# define LOG_RL_ADD(p, v)	__atomic_add_fetch((p), (v), __ATOMIC_RELAXED)
+# define LOG_RL_XCHG(p, v)	__atomic_exchange_n((p), (v), __ATOMIC_ACQ_REL)
+#else /* HAVE_ATOMIC_BUILTINS */
+# ifdef HAVE_PTHREAD
+static pthread_mutex_t	_log_ratelimit_mtx = PTHREAD_MUTEX_INITIALIZER;
+#  define LOG_RL_LOCK()		pthread_mutex_lock(&_log_ratelimit_mtx)
+#  define LOG_RL_UNLOCK()	pthread_mutex_unlock(&_log_ratelimit_mtx)
+# else /* HAVE_PTHREAD */
+#  define LOG_RL_LOCK()		do { } while (0)
+#  define LOG_RL_UNLOCK()	do { } while (0)
+# endif /* HAVE_PTHREAD */
+# define LOG_RL_LOAD(p)		(*(p))
+# define LOG_RL_STORE(p, v)	(*(p) = (v))
+# define LOG_RL_CAS(p, e, v)	(*(p) == *(e) ? (*(p) = (v), 1) : \
+				    (*(e) = *(p), 0))
+# define LOG_RL_ADD(p, v)	(*(p) += (v))
+# define LOG_RL_XCHG(p, v)	_log_rl_xchg((p), (v))
+static unsigned long	_log_rl_xchg(unsigned long *, unsigned long);
+#endif /* HAVE_ATOMIC_BUILTINS */
+
+#ifdef HAVE_PTHREAD
+/*
+ * Messages are logged from any thread, while the target, format, context
+ * and the asynchronous ring buffer are only changed from the main thread.
+ * Producers hold the lock for reading, so that none of it changes or goes
+ * away underneath them.
+ */
+static pthread_rwlock_t _log_cfg_lock = PTHREAD_RWLOCK_INITIALIZER;
+# define LOG_RDLOCK()		pthread_rwlock_rdlock(&_log_cfg_lock)
+# define LOG_WRLOCK()		pthread_rwlock_wrlock(&_log_cfg_lock)
+# define LOG_UNLOCK()		pthread_rwlock_unlock(&_log_cfg_lock)
+#else /* HAVE_PTHREAD */
+# define LOG_RDLOCK()		do { } while (0)
+# define LOG_WRLOCK()		do { } while (0)
+# define LOG_UNLOCK()		do { } while (0)
+#endif /* HAVE_PTHREAD */
+
+#ifdef LOG_ASYNC
+static struct log_record
+			*_log_ring;
+static unsigned long	_log_ring_head;
+static unsigned long	_log_ring_tail;
+static unsigned long	_log_dropped;
+static unsigned long	_log_dropped_unreported;
+static int		_log_async_stop;
+static pthread_t	_log_async_thread;
+#endif /* LOG_ASYNC */
+static int		_log_async;
 
 static int	_log(enum log_levels, const char *, ...)
     ATTRIBUTE_NONNULL(2)
     ATTRIBUTE_FORMAT(printf, 2, 3);
-static int	_vlog(enum log_levels, const char *, va_list)
-    ATTRIBUTE_NONNULL(2);
+static int	_vlog(enum log_levels, const char *, double, const char *,
+		    va_list)
+    ATTRIBUTE_NONNULL(4);
+static void	_log_buf_puts(struct log_buf *, const char *);
+static void	_log_buf_putjson(struct log_buf *, const char *, const char *);
+static void	_log_format(char *, size_t, enum log_levels, const char *,
+		    double, int, const char *, va_list)
+    ATTRIBUTE_NONNULL(7);
+static void	_log_formatf(char *, size_t, enum log_levels, const char *,
+		    double, int, const char *, ...)
+    ATTRIBUTE_NONNULL(7)
+    ATTRIBUTE_FORMAT(printf, 7, 8);
+static void	_log_write(int, time_t, const char *);
+static unsigned long
+		_log_ratelimit_key(const char *, va_list);
+static int	_log_ratelimit(unsigned long, long, unsigned long *);
+static void	_log_ratelimit_sweep(long, int);
+static void	_log_suppressed_write(unsigned long, int);
+#ifdef LOG_ASYNC
+static struct log_record *
+		_log_ring_reserve(void);
+static void	_log_ring_publish(struct log_record *);
+static unsigned int
+		_log_ring_drain(void);
+static void *	_log_async_main(void *);
+#endif /* LOG_ASYNC */
+static int	_log_async_start(void);
+static void	_log_async_stop_join(void);
 
 static int
 _log(enum log_levels lvl, const char *fmt, ...)
@@ -42,17 +190,20 @@ _log(enum log_levels lvl, const char *fmt, ...)
 	int	ret;
 
 	va_start(ap, fmt);
-	ret = _vlog(lvl, fmt, ap);
+	ret = _vlog(lvl, NULL, -1.0, fmt, ap);
 	va_end(ap);
 
 	return (ret);
 }
 
 static int
-_vlog(enum log_levels lvl, const char *fmt, va_list ap)
+_vlog(enum log_levels lvl, const char *event, double duration,
+    const char *fmt, va_list ap)
 {
-	va_list ap2;
-	int	p;
+	char			 msg[LOG_MSG_SIZE];
+	unsigned long		 key, suppressed = 0;
+	struct timespec 	 now;
+	int			 p;
 
 	switch (lvl) {
 	case ALERT:
@@ -82,16 +233,497 @@ _vlog(enum log_levels lvl, const char *fmt, va_list ap)
 		break;
 	};
 
+	LOG_RDLOCK();
+	if (ALERT != lvl && _log_ratelimit_max) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		/* The background thread reports floods that have stopped: */
+		if (!_log_async)
+			_log_ratelimit_sweep((long)now.tv_sec, 1);
+		key = _log_ratelimit_key(fmt, ap);
+		if (!_log_ratelimit(key, (long)now.tv_sec, &suppressed)) {
+			LOG_UNLOCK();
+			return (0);
+		}
+	}
+#ifdef LOG_ASYNC
+	/*
+	 * Alerts usually precede an exit, so they are always written
+	 * synchronously. Everything else is formatted straight into the
+	 * ring buffer, and written by the background thread.
+	 */
+	if (_log_async && ALERT != lvl) {
+		struct log_record	*rec;
+
+		if (suppressed && NULL != (rec = _log_ring_reserve())) {
+			rec->prio = LOG_NOTICE;
+			rec->when = time(NULL);
+			_log_formatf(rec->msg, sizeof(rec->msg), NOTICE,
+			    "log_suppressed", -1.0, 1,
+			    "%lu similar messages suppressed", suppressed);
+			_log_ring_publish(rec);
+		}
+		if (NULL == (rec = _log_ring_reserve())) {
+			__atomic_fetch_add(&_log_dropped, 1UL,
+			    __ATOMIC_RELAXED);
+			__atomic_fetch_add(&_log_dropped_unreported, 1UL,
+			    __ATOMIC_RELAXED);
+			LOG_UNLOCK();
+			return (0);
+		}
+		rec->prio = p;
+		rec->when = time(NULL);
+		_log_format(rec->msg, sizeof(rec->msg), lvl, event, duration,
+		    1, fmt, ap);
+		_log_ring_publish(rec);
+		LOG_UNLOCK();
+
+		return (1);
+	}
+#endif /* LOG_ASYNC */
+
+	if (suppressed)
+		_log_suppressed_write(suppressed, 1);
+	_log_format(msg, sizeof(msg), lvl, event, duration, 1, fmt, ap);
+	_log_write(p, time(NULL), msg);
+	LOG_UNLOCK();
+
+	return (1);
+}
+
+static void
+_log_buf_puts(struct log_buf *b, const char *str)
+{
+	size_t	len = strlen(str);
+
+	/* All or nothing, so that the output remains well-formed: */
+	if (b->len + len + LOG_JSON_RESERVE >= b->size)
+		return;
+	memcpy(b->data + b->len, str, len + 1);
+	b->len += len;
+}
+
+static void
+_log_buf_putjson(struct log_buf *b, const char *key, const char *val)
+{
+	const char	*p;
+	char		 esc[8];
+	size_t		 len;
+
+	if (b->len + strlen(key) + 6 + LOG_JSON_RESERVE >= b->size)
+		return;
+	b->len += (size_t)snprintf(b->data + b->len, b->size - b->len,
+	    "%s\"%s\":\"", 1 < b->len ? "," : "", key);
+	for (p = val; *p; p++) {
+		if ('"' == *p || '\\' == *p) {
+			esc[0] = '\\';
+			esc[1] = *p;
+			esc[2] = '\0';
+		} else if (0x20 > (unsigned char)*p) {
+			(void)snprintf(esc, sizeof(esc), "\\u%04x",
+			    (unsigned int)(unsigned char)*p);
+		} else {
+			esc[0] = *p;
+			esc[1] = '\0';
+		}
+		len = strlen(esc);
+		/* Leave room for the closing quote: */
+		if (b->len + len + 1 + LOG_JSON_RESERVE >= b->size)
+			break;
+		memcpy(b->data + b->len, esc, len);
+		b->len += len;
+	}
+	b->data[b->len++] = '"';
+	b->data[b->len] = '\0';
+}
+
+static void
+_log_format(char *buf, size_t size, enum log_levels lvl, const char *event,
+    double duration, int with_context, const char *fmt, va_list ap)
+{
+	static const char	*levels[] = {
+		"alert", "error", "warning", "notice", "info", "debug"
+	};
+	struct log_buf		 b;
+	char			 msg[LOG_MSG_SIZE];
+	char			 tmp[64];
+	struct timespec 	 now;
+	struct tm		 tm;
+	va_list 		 ap2;
+	unsigned int		 i;
+
 	va_copy(ap2, ap);
-	vsyslog(p, fmt, ap2);
+	if (LOG_FORMAT_JSON != _log_format_type) {
+		(void)vsnprintf(buf, size, fmt, ap2);
+		va_end(ap2);
+		return;
+	}
+	(void)vsnprintf(msg, sizeof(msg), fmt, ap2);
 	va_end(ap2);
 
-	return (1);
+	b.data = buf;
+	b.size = size;
+	b.len = 0;
+	_log_buf_puts(&b, "{");
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	if (NULL != gmtime_r(&now.tv_sec, &tm) &&
+	    0 != strftime(tmp, sizeof(tmp), "%Y-%m-%dT%H:%M:%S", &tm)) {
+		size_t	len = strlen(tmp);
+
+		(void)snprintf(tmp + len, sizeof(tmp) - len, ".%03ldZ",
+		    now.tv_nsec / 1000000L);
+		_log_buf_putjson(&b, "time", tmp);
+	}
+	_log_buf_putjson(&b, "level",
+	    levels[(unsigned int)lvl < sizeof(levels) / sizeof(levels[0]) ?
+		lvl : DEBUG]);
+	if (event)
+		_log_buf_putjson(&b, "event", event);
+	for (i = 0; with_context && i < LOG_CTX_MAX; i++) {
+		if (_log_context[i][0])
+			_log_buf_putjson(&b, _log_context_keys[i],
+			    _log_context[i]);
+	}
+	if (0.0 <= duration) {
+		(void)snprintf(tmp, sizeof(tmp), ",\"duration\":%.6f",
+		    duration);
+		_log_buf_puts(&b, tmp);
+	}
+	_log_buf_putjson(&b, "message", msg);
+	/* LOG_JSON_RESERVE guarantees room for the closing brace: */
+	b.data[b.len++] = '}';
+	b.data[b.len] = '\0';
+}
+
+static void
+_log_formatf(char *buf, size_t size, enum log_levels lvl, const char *event,
+    double duration, int with_context, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	_log_format(buf, size, lvl, event, duration, with_context, fmt, ap);
+	va_end(ap);
+}
+
+static void
+_log_write(int prio, time_t when, const char *msg)
+{
+	char		tbuf[32];
+	struct tm	tm;
+
+	switch (_log_target) {
+	case LOG_TARGET_STDERR:
+		if (LOG_FORMAT_JSON == _log_format_type)
+			fprintf(stderr, "%s\n", msg);
+		else
+			fprintf(stderr, "%s[%ld]: %s\n", _log_progname,
+			    (long)getpid(), msg);
+		break;
+	case LOG_TARGET_FILE:
+		if (LOG_FORMAT_JSON == _log_format_type) {
+			fprintf(_log_file, "%s\n", msg);
+			fflush(_log_file);
+			break;
+		}
+		if (NULL == localtime_r(&when, &tm) ||
+		    0 == strftime(tbuf, sizeof(tbuf), "%Y-%m-%d %H:%M:%S",
+			&tm))
+			tbuf[0] = '\0';
+		fprintf(_log_file, "%s %s[%ld]: %s\n", tbuf, _log_progname,
+		    (long)getpid(), msg);
+		fflush(_log_file);
+		break;
+	case LOG_TARGET_SYSLOG:
+	default:
+		syslog(prio, "%s", msg);
+		break;
+	}
+}
+
+/* Identifies a message by the hash of its text: */
+static unsigned long
+_log_ratelimit_key(const char *fmt, va_list ap)
+{
+	char		 msg[LOG_MSG_SIZE];
+	const char	*p;
+	uint64_t	 hash = LOG_FNV_BASIS;
+	va_list 	 ap2;
+
+	va_copy(ap2, ap);
+	(void)vsnprintf(msg, sizeof(msg), fmt, ap2);
+	va_end(ap2);
+	for (p = msg; *p; p++) {
+		hash ^= (unsigned char)*p;
+		hash *= LOG_FNV_PRIME;
+	}
+
+	return ((unsigned long)hash ? (unsigned long)hash : 1UL);
+}
+
+/*
+ * Allow at most _log_ratelimit_max messages per message text and window;
+ * returns 0 for messages that are to be suppressed. The number suppressed
+ * in the previous window of the message is reported through suppressed_p.
+ */
+static int
+_log_ratelimit(unsigned long key, long now, unsigned long *suppressed_p)
+{
+	struct log_ratelimit	*rl = NULL;
+	unsigned long		 k, i, slot;
+	long			 window;
+	int			 ret = 1;
+
+	LOG_RL_LOCK();
+	slot = key % LOG_RATELIMIT_SLOTS;
+	for (i = 0; i < LOG_RATELIMIT_SLOTS; i++) {
+		rl = &_log_ratelimit_tbl[(slot + i) % LOG_RATELIMIT_SLOTS];
+		k = LOG_RL_LOAD(&rl->key);
+		if (k == key)
+			break;
+		if (0 == k) {
+			if (LOG_RL_CAS(&rl->key, &k, key)) {
+				LOG_RL_STORE(&rl->window, now);
+				break;
+			}
+			if (k == key)
+				break;
+		}
+		rl = NULL;
+	}
+	/* With all slots taken, messages go through: */
+	if (NULL == rl) {
+		LOG_RL_UNLOCK();
+		return (1);
+	}
+
+	window = LOG_RL_LOAD(&rl->window);
+	if (now - window >= LOG_RATELIMIT_WINDOW &&
+	    LOG_RL_CAS(&rl->window, &window, now)) {
+		LOG_RL_STORE(&rl->count, 0UL);
+		*suppressed_p = LOG_RL_XCHG(&rl->suppressed, 0UL);
+	}
+	if (LOG_RL_ADD(&rl->count, 1UL) > _log_ratelimit_max) {
+		(void)LOG_RL_ADD(&rl->suppressed, 1UL);
+		(void)LOG_RL_ADD(&_log_suppressed, 1UL);
+		ret = 0;
+	}
+	LOG_RL_UNLOCK();
+
+	return (ret);
+}
+
+/*
+ * Reports the messages suppressed in windows that have passed, and frees
+ * their slots, at most once a second.
+ */
+static void
+_log_ratelimit_sweep(long now, int with_context)
+{
+	struct log_ratelimit	*rl;
+	unsigned long		 k, n, i;
+	long			 swept, window;
+
+	LOG_RL_LOCK();
+	swept = LOG_RL_LOAD(&_log_ratelimit_swept);
+	if (swept == now || !LOG_RL_CAS(&_log_ratelimit_swept, &swept, now)) {
+		LOG_RL_UNLOCK();
+		return;
+	}
+	LOG_RL_UNLOCK();
+
+	for (i = 0; i < LOG_RATELIMIT_SLOTS; i++) {
+		rl = &_log_ratelimit_tbl[i];
+		LOG_RL_LOCK();
+		k = LOG_RL_LOAD(&rl->key);
+		window = LOG_RL_LOAD(&rl->window);
+		if (0 == k || now - window < LOG_RATELIMIT_WINDOW) {
+			LOG_RL_UNLOCK();
+			continue;
+		}
+		n = LOG_RL_XCHG(&rl->suppressed, 0UL);
+		if (0 == n) {
+			LOG_RL_STORE(&rl->count, 0UL);
+			(void)LOG_RL_CAS(&rl->key, &k, 0UL);
+		}
+		LOG_RL_UNLOCK();
+		if (n)
+			_log_suppressed_write(n, with_context);
+	}
+}
+
+static void
+_log_suppressed_write(unsigned long n, int with_context)
+{
+	char	msg[LOG_MSG_SIZE];
+
+	_log_formatf(msg, sizeof(msg), NOTICE, "log_suppressed", -1.0,
+	    with_context, "%lu similar messages suppressed", n);
+	_log_write(LOG_NOTICE, time(NULL), msg);
+}
+
+#ifndef HAVE_ATOMIC_BUILTINS
+static unsigned long
+_log_rl_xchg(unsigned long *p, unsigned long v)
+{
+	unsigned long	old = *p;
+
+	*p = v;
+	return (old);
+}
+#endif /* !HAVE_ATOMIC_BUILTINS */
+
+#ifdef LOG_ASYNC
+/*
+ * Bounded multi-producer ring buffer after Dmitry Vyukov: every slot
+ * carries a sequence number that tells producers and the consumer whether
+ * the slot is free for the current lap, or holds a published record.
+ */
+static struct log_record *
+_log_ring_reserve(void)
+{
+	struct log_record	*rec;
+	unsigned long		 pos, seq;
+	long			 diff;
+
+	pos = __atomic_load_n(&_log_ring_head, __ATOMIC_RELAXED);
+	for (;;) {
+		rec = &_log_ring[pos & (LOG_RING_SIZE - 1)];
+		seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+		diff = (long)(seq - pos);
+		if (0 == diff) {
+			if (__atomic_compare_exchange_n(&_log_ring_head, &pos,
+			    pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				return (rec);
+		} else if (0 > diff) {
+			/* Full */
+			return (NULL);
+		} else
+			pos = __atomic_load_n(&_log_ring_head,
+			    __ATOMIC_RELAXED);
+	}
+}
+
+static void
+_log_ring_publish(struct log_record *rec)
+{
+	unsigned long	pos;
+
+	pos = __atomic_load_n(&rec->seq, __ATOMIC_RELAXED);
+	__atomic_store_n(&rec->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+static unsigned int
+_log_ring_drain(void)
+{
+	struct log_record	*rec;
+	unsigned long		 dropped;
+	unsigned int		 n = 0;
+
+	for (;;) {
+		rec = &_log_ring[_log_ring_tail & (LOG_RING_SIZE - 1)];
+		if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) !=
+		    _log_ring_tail + 1)
+			break;
+		_log_write(rec->prio, rec->when, rec->msg);
+		__atomic_store_n(&rec->seq, _log_ring_tail + LOG_RING_SIZE,
+		    __ATOMIC_RELEASE);
+		_log_ring_tail++;
+		n++;
+	}
+
+	dropped = __atomic_exchange_n(&_log_dropped_unreported, 0UL,
+	    __ATOMIC_RELAXED);
+	if (dropped) {
+		char	msg[LOG_MSG_SIZE];
+
+		/* Context belongs to the producers, so leave it out here: */
+		_log_formatf(msg, sizeof(msg), WARNING, "log_dropped", -1.0,
+		    0, "log buffer overflow: %lu messages dropped", dropped);
+		_log_write(LOG_WARNING, time(NULL), msg);
+	}
+
+	return (n);
+}
+
+static void *
+_log_async_main(void *arg)
+{
+	struct timespec ts;
+
+	(void)arg;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = 10 * 1000000L;
+	for (;;) {
+		if (_log_ratelimit_max) {
+			struct timespec now;
+
+			/* Context belongs to the producers: */
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			_log_ratelimit_sweep((long)now.tv_sec, 0);
+		}
+		if (0 < _log_ring_drain())
+			continue;
+		if (__atomic_load_n(&_log_async_stop, __ATOMIC_ACQUIRE))
+			break;
+		nanosleep(&ts, NULL);
+	}
+	(void)_log_ring_drain();
+
+	return (NULL);
+}
+#endif /* LOG_ASYNC */
+
+static int
+_log_async_start(void)
+{
+#ifdef LOG_ASYNC
+	unsigned long	i;
+	int		error;
+
+	_log_ring = calloc(LOG_RING_SIZE, sizeof(*_log_ring));
+	if (NULL == _log_ring)
+		return (-1);
+	for (i = 0; i < LOG_RING_SIZE; i++)
+		_log_ring[i].seq = i;
+	_log_ring_head = _log_ring_tail = 0;
+	_log_async_stop = 0;
+	if (0 != (error = pthread_create(&_log_async_thread, NULL,
+	    _log_async_main, NULL))) {
+		free(_log_ring);
+		_log_ring = NULL;
+		errno = error;
+		return (-1);
+	}
+	_log_async = 1;
+
+	return (0);
+#else /* LOG_ASYNC */
+	errno = ENOTSUP;
+	return (-1);
+#endif /* LOG_ASYNC */
+}
+
+static void
+_log_async_stop_join(void)
+{
+#ifdef LOG_ASYNC
+	if (!_log_async)
+		return;
+	__atomic_store_n(&_log_async_stop, 1, __ATOMIC_RELEASE);
+	pthread_join(_log_async_thread, NULL);
+	_log_async = 0;
+	free(_log_ring);
+	_log_ring = NULL;
+#endif /* LOG_ASYNC */
 }
 
 int
 log_init(const char *program_name)
 {
+	(void)snprintf(_log_progname, sizeof(_log_progname), "%s",
+	    program_name ? program_name : "");
 	openlog(program_name,
 	    LOG_PID|LOG_CONS|LOG_NDELAY|LOG_PERROR,
 	    LOG_USER);
@@ -101,6 +733,15 @@ log_init(const char *program_name)
 void
 log_exit(void)
 {
+	(void)log_set_async(0);
+	(void)log_set_target(LOG_TARGET_SYSLOG, NULL);
+	LOG_WRLOCK();
+	_log_ratelimit_max = 0;
+	memset(_log_ratelimit_tbl, 0, sizeof(_log_ratelimit_tbl));
+	_log_ratelimit_swept = 0;
+	_log_format_type = LOG_FORMAT_TEXT;
+	memset(_log_context, 0, sizeof(_log_context));
+	LOG_UNLOCK();
 	closelog();
 }
 
@@ -110,6 +751,99 @@ log_set_verbosity(unsigned int verbosity)
 	_log_verbosity = verbosity;
 }
 
+int
+log_set_target(enum log_target target, const char *file)
+{
+	FILE	*fp = NULL;
+	int	 async = _log_async;
+
+	if (LOG_TARGET_FILE == target) {
+		if (NULL == file) {
+			errno = EINVAL;
+			return (-1);
+		}
+		if (NULL == (fp = fopen(file, "a")))
+			return (-1);
+	}
+
+	LOG_WRLOCK();
+	/* Let the background thread finish with the previous target: */
+	_log_async_stop_join();
+	if (_log_file)
+		fclose(_log_file);
+	_log_file = fp;
+	_log_target = target;
+	if (async && 0 > _log_async_start()) {
+		LOG_UNLOCK();
+		return (-1);
+	}
+	LOG_UNLOCK();
+
+	return (0);
+}
+
+int
+log_set_async(int async)
+{
+	int	ret = 0;
+
+	LOG_WRLOCK();
+	if (async && !_log_async)
+		ret = _log_async_start();
+	if (!async)
+		_log_async_stop_join();
+	LOG_UNLOCK();
+
+	return (ret);
+}
+
+void
+log_set_ratelimit(unsigned int max_per_window)
+{
+	_log_ratelimit_max = max_per_window;
+}
+
+void
+log_set_format(enum log_format format)
+{
+	LOG_WRLOCK();
+	_log_format_type = format;
+	LOG_UNLOCK();
+}
+
+void
+log_set_context(enum log_context ctx, const char *value)
+{
+	if ((unsigned int)ctx >= LOG_CTX_MAX)
+		return;
+	LOG_WRLOCK();
+	(void)snprintf(_log_context[ctx], sizeof(_log_context[ctx]), "%s",
+	    value ? value : "");
+	LOG_UNLOCK();
+}
+
+unsigned long
+log_get_dropped(void)
+{
+#ifdef LOG_ASYNC
+	return (__atomic_load_n(&_log_dropped, __ATOMIC_RELAXED));
+#else /* LOG_ASYNC */
+	return (0);
+#endif /* LOG_ASYNC */
+}
+
+unsigned long
+log_get_suppressed(void)
+{
+	unsigned long	suppressed;
+
+	LOG_RL_LOCK();
+	suppressed = LOG_RL_LOAD(&_log_suppressed);
+	LOG_RL_UNLOCK();
+
+	return (suppressed);
+}
+
 int
 log_syserr(enum log_levels lvl, int error, const char *pfx)
 {
@@ -134,7 +868,7 @@ log_alert(const char *fmt, ...)
 	int	ret;
 
 	va_start(ap, fmt);
-	ret = _vlog(ALERT, fmt, ap);
+	ret = _vlog(ALERT, NULL, -1.0, fmt, ap);
 	va_end(ap);
 
 	return (ret);
@@ -147,7 +881,7 @@ log_error(const char *fmt, ...)
 	int	ret;
 
 	va_start(ap, fmt);
-	ret = _vlog(ERROR, fmt, ap);
+	ret = _vlog(ERROR, NULL, -1.0, fmt, ap);
 	va_end(ap);
 
 	return (ret);
@@ -160,7 +894,7 @@ log_warning(const char *fmt, ...)
 	int	ret;
 
 	va_start(ap, fmt);
-	ret = _vlog(WARNING, fmt, ap);
+	ret = _vlog(WARNING, NULL, -1.0, fmt, ap);
 	va_end(ap);
 
 	return (ret);
@@ -173,7 +907,7 @@ log_notice(const char *fmt, ...)
 	int	ret;
 
 	va_start(ap, fmt);
-	ret = _vlog(NOTICE, fmt, ap);
+	ret = _vlog(NOTICE, NULL, -1.0, fmt, ap);
 	va_end(ap);
 
 	return (ret);
@@ -186,7 +920,7 @@ log_info(const char *fmt, ...)
 	int	ret;
 
 	va_start(ap, fmt);
-	ret = _vlog(INFO, fmt, ap);
+	ret = _vlog(INFO, NULL, -1.0, fmt, ap);
 	va_end(ap);
 
 	return (ret);
@@ -199,7 +933,21 @@ log_debug(const char *fmt, ...)
 	int	ret;
 
 	va_start(ap, fmt);
-	ret = _vlog(DEBUG, fmt, ap);
+	ret = _vlog(DEBUG, NULL, -1.0, fmt, ap);
+	va_end(ap);
+
+	return (ret);
+}
+
+int
+log_event(enum log_levels lvl, const char *event, double duration,
+    const char *fmt, ...)
+{
+	va_list ap;
+	int	ret;
+
+	va_start(ap, fmt);
+	ret = _vlog(lvl, event, duration, fmt, ap);
 	va_end(ap);
 
 	return (ret);
@@ -28,10 +28,39 @@ enum log_levels {
 	DEBUG
 };
 
+enum log_format {
+	LOG_FORMAT_TEXT = 0,
+	LOG_FORMAT_JSON
+};
+
+enum log_context {
+	LOG_CTX_STREAM = 0,
+	LOG_CTX_SERVER,
+	LOG_CTX_MOUNTPOINT,
+	LOG_CTX_TRACK,
+	LOG_CTX_MAX
+};
+
+enum log_target {
+	LOG_TARGET_SYSLOG = 0,
+	LOG_TARGET_STDERR,
+	LOG_TARGET_FILE
+};
+
 int	log_init(const char *);
 void	log_exit(void);
 
 void	log_set_verbosity(unsigned int);
+int	log_set_target(enum log_target, const char *);
+int	log_set_async(int);
+void	log_set_ratelimit(unsigned int);
+void	log_set_format(enum log_format);
+void	log_set_context(enum log_context, const char *);
+
+unsigned long
+	log_get_dropped(void);
+unsigned long
+	log_get_suppressed(void);
 
 int	log_syserr(enum log_levels, int, const char *);
 
@@ -54,4 +83,13 @@ int	log_debug(const char *, ...)
     ATTRIBUTE_NONNULL(1)
     ATTRIBUTE_FORMAT(printf, 1, 2);
 
+/*
+ * Log a message that marks a particular event, like a track change. In the
+ * JSON format, the event name, the duration (in seconds, if not negative)
+ * and the current context are added as separate fields.
+ */
+int	log_event(enum log_levels, const char *, double, const char *, ...)
+    ATTRIBUTE_NONNULL_2(2, 4)
+    ATTRIBUTE_FORMAT(printf, 4, 5);
+
 #endif /* __LOG_H__ */
@@ -31,6 +31,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 
 #include <taglib/tag_c.h>
@@ -49,8 +50,21 @@ struct mdata {
 	char	*title;
 	char	*songinfo;
 	int	 length;
+	/* Gain to the ReplayGain 2.0 reference loudness, in dB: */
+	float	 track_gain;
+	float	 album_gain;
+	int	 has_track_gain;
+	int	 has_album_gain;
+	float	 true_peak;
+	int	 has_true_peak;
+	unsigned long
+		 audio_start;
+	unsigned long
+		 audio_end;
+	int	 has_audio_bounds;
 	int	 normalize_strings;
 	int	 run_program;
+	xarena_t arena;
 };
 
 enum mdata_request {
@@ -60,32 +74,61 @@ enum mdata_request {
 	MDATA_SONGINFO
 };
 
+static char *	_mdata_strdup(struct mdata *, const char *);
+static void	_mdata_free(struct mdata *, char **);
 static void	_mdata_clear(struct mdata *);
-static char *	_mdata_get_name_from_filename(const char *);
+static char *	_mdata_get_name_from_filename(struct mdata *, const char *);
 static void	_mdata_generate_songinfo(struct mdata *);
-static void	_mdata_normalize_string(char **);
+static void	_mdata_normalize_string(char *);
 static void	_mdata_normalize_strings(struct mdata *);
-static char *	_mdata_run(const char *, enum mdata_request);
+static char *	_mdata_run(struct mdata *, const char *, enum mdata_request);
+#ifdef HAVE_TAGLIB_PROPERTY_GET
+static int	_mdata_tag_gain(TagLib_File *, const char *, float *);
+static void	_mdata_parse_gain(struct mdata *, TagLib_File *);
+#endif /* HAVE_TAGLIB_PROPERTY_GET */
+
+/* Sanity limit of loudness gains, in dB: */
+#define MDATA_GAIN_MAX		64.0
+/* R128 gain tags are relative to -23 LUFS, ReplayGain 2.0 to -18 LUFS: */
+#define MDATA_R128_OFFSET	5.0
+
+/* Strings of metadata created in an arena live until the arena is reset: */
+static char *
+_mdata_strdup(struct mdata *md, const char *str)
+{
+	return (md->arena ? xarena_strdup(md->arena, str) : xstrdup(str));
+}
+
+static void
+_mdata_free(struct mdata *md, char **str_p)
+{
+	if (!md->arena)
+		xfree(*str_p);
+	*str_p = NULL;
+}
 
 static void
 _mdata_clear(struct mdata *md)
 {
-	int	normalize_strings;
+	int		normalize_strings;
+	xarena_t	arena;
 
 	normalize_strings = md->normalize_strings;
-	xfree(md->filename);
-	xfree(md->name);
-	xfree(md->artist);
-	xfree(md->album);
-	xfree(md->title);
-	xfree(md->songinfo);
+	arena = md->arena;
+	_mdata_free(md, &md->filename);
+	_mdata_free(md, &md->name);
+	_mdata_free(md, &md->artist);
+	_mdata_free(md, &md->album);
+	_mdata_free(md, &md->title);
+	_mdata_free(md, &md->songinfo);
 	memset(md, 0, sizeof(*md));
 	md->length = -1;
 	md->normalize_strings = normalize_strings;
+	md->arena = arena;
 }
 
 static char *
-_mdata_get_name_from_filename(const char *filename)
+_mdata_get_name_from_filename(struct mdata *md, const char *filename)
 {
 	char	*tmp;
 	char	*p1, *p2, *name;
@@ -94,7 +137,7 @@ _mdata_get_name_from_filename(const char *filename)
 	 * Make a copy of filename in case basename() is broken and attempts
 	 * to modify its argument.
 	 */
-	tmp = xstrdup(filename);
+	tmp = _mdata_strdup(md, filename);
 	if ((p1 = basename(tmp)) == NULL) {
 		/*
 		 * Some implementations limit the input to PATH_MAX; bail out
@@ -108,11 +151,13 @@ _mdata_get_name_from_filename(const char *filename)
 		*p2 = '\0';
 
 	if (strlen(p1) == 0)
-		name = xstrdup("[unknown]");
+		name = _mdata_strdup(md, "[unknown]");
+	else if (md->arena)
+		name = util_char2utf8_arena(md->arena, p1);
 	else
 		name = util_char2utf8(p1);
 
-	xfree(tmp);
+	_mdata_free(md, &tmp);
 
 	return (name);
 }
@@ -139,7 +184,11 @@ _mdata_generate_songinfo(struct mdata *md)
 	if (!str_size)
 		return;
 	str_size++;
-	str = xcalloc(str_size, sizeof(*str));
+	if (md->arena) {
+		str = xarena_alloc(md->arena, str_size);
+		str[0] = '\0';
+	} else
+		str = xcalloc(str_size, sizeof(*str));
 
 	if (md->artist)
 		strlcpy(str, md->artist, str_size);
@@ -158,18 +207,16 @@ _mdata_generate_songinfo(struct mdata *md)
 }
 
 static void
-_mdata_normalize_string(char **s)
+_mdata_normalize_string(char *str)
 {
-	char	*str, *cp, *tmpstr, *tp;
+	char	*cp, *tp;
 	int	 is_space;
 
-	str = *s;
 	if (NULL == str)
 		return;
 
-	tmpstr = xcalloc(strlen(str) + 1, sizeof(char));
-
-	tp = tmpstr;
+	/* The result is never longer than the input; squeeze in place. */
+	tp = str;
 	is_space = 1;
 	for (cp = str; *cp != '\0'; cp++) {
 		if (*cp == ' ') {
@@ -181,24 +228,22 @@ _mdata_normalize_string(char **s)
 			is_space = 0;
 		}
 	}
-	if (strlen(tmpstr) > 0 && tmpstr[strlen(tmpstr) - 1] == ' ')
-		tmpstr[strlen(tmpstr) - 1] = '\0';
-
-	xfree(str);
-	*s = xreallocarray(tmpstr, strlen(tmpstr) + 1, sizeof(*tmpstr));
+	if (tp > str && tp[-1] == ' ')
+		tp--;
+	*tp = '\0';
 }
 
 static void
 _mdata_normalize_strings(struct mdata *md)
 {
-	_mdata_normalize_string(&md->artist);
-	_mdata_normalize_string(&md->album);
-	_mdata_normalize_string(&md->title);
-	_mdata_normalize_string(&md->songinfo);
+	_mdata_normalize_string(md->artist);
+	_mdata_normalize_string(md->album);
+	_mdata_normalize_string(md->title);
+	_mdata_normalize_string(md->songinfo);
 }
 
 static char *
-_mdata_run(const char *program, enum mdata_request md_req)
+_mdata_run(struct mdata *md, const char *program, enum mdata_request md_req)
 {
 	char	 cmd[PATH_MAX + sizeof(" artist")];
 	char	 buf[BUFSIZ];
@@ -258,8 +303,64 @@ _mdata_run(const char *program, enum mdata_request md_req)
 	buf[strcspn(buf, "\n")] = '\0';
 	buf[strcspn(buf, "\r")] = '\0';
 
-	return (xstrdup(buf));
+	return (_mdata_strdup(md, buf));
+}
+
+#ifdef HAVE_TAGLIB_PROPERTY_GET
+/*
+ * Reads a gain tag. ReplayGain tags are in dB with an optional unit, as in
+ * "-6.50 dB", and R128 tags are Q7.8 fixed-point numbers.
+ */
+static int
+_mdata_tag_gain(TagLib_File *tf, const char *name, float *gain_p)
+{
+	char		**values;
+	char		 *ep;
+	double		  gain;
+	int		  ret = -1;
+
+	if ((values = taglib_property_get(tf, name)) == NULL)
+		return (-1);
+	if (NULL == values[0])
+		goto done;
+
+	errno = 0;
+	if (0 == strncasecmp(name, "R128_", strlen("R128_"))) {
+		long	q = strtol(values[0], &ep, 10);
+
+		gain = (double)q / 256.0 + MDATA_R128_OFFSET;
+	} else {
+		gain = strtod(values[0], &ep);
+		ep += strspn(ep, " ");
+		if (0 == strncasecmp(ep, "dB", strlen("dB")))
+			ep += strlen("dB");
+	}
+	if (ep == values[0] || '\0' != *ep || 0 != errno ||
+	    gain < -MDATA_GAIN_MAX || gain > MDATA_GAIN_MAX) {
+		log_info("ignoring invalid %s tag: %s", name, values[0]);
+		goto done;
+	}
+	*gain_p = (float)gain;
+	ret = 0;
+
+done:
+	taglib_property_free(values);
+	return (ret);
+}
+
+static void
+_mdata_parse_gain(struct mdata *md, TagLib_File *tf)
+{
+	if (0 == _mdata_tag_gain(tf, "REPLAYGAIN_TRACK_GAIN",
+		&md->track_gain) ||
+	    0 == _mdata_tag_gain(tf, "R128_TRACK_GAIN", &md->track_gain))
+		md->has_track_gain = 1;
+	if (0 == _mdata_tag_gain(tf, "REPLAYGAIN_ALBUM_GAIN",
+		&md->album_gain) ||
+	    0 == _mdata_tag_gain(tf, "R128_ALBUM_GAIN", &md->album_gain))
+		md->has_album_gain = 1;
 }
+#endif /* HAVE_TAGLIB_PROPERTY_GET */
 
 struct mdata *
 mdata_create(void)
@@ -272,14 +373,29 @@ mdata_create(void)
 	return (md);
 }
 
+struct mdata *
+mdata_create_arena(xarena_t arena)
+{
+	struct mdata	*md;
+
+	md = xarena_alloc(arena, sizeof(*md));
+	memset(md, 0, sizeof(*md));
+	md->length = -1;
+	md->arena = arena;
+
+	return (md);
+}
+
 void
 mdata_destroy(struct mdata **md_p)
 {
 	struct mdata	*md = *md_p;
 
-	if (md)
+	if (md) {
 		_mdata_clear(md);
-	xfree(md);
+		if (!md->arena)
+			xfree(md);
+	}
 	*md_p = NULL;
 }
 
@@ -310,13 +426,13 @@ mdata_parse_file(struct mdata *md, const char *filename)
 #endif /* HAVE_ICONV */
 
 	_mdata_clear(md);
-	md->filename = xstrdup(filename);
-	md->name = _mdata_get_name_from_filename(filename);
+	md->filename = _mdata_strdup(md, filename);
+	md->name = _mdata_get_name_from_filename(md, filename);
 
 	if ((tf = taglib_file_new(md->filename)) == NULL) {
 		log_info("%s: unable to extract metadata",
 		    md->filename);
-		md->songinfo = xstrdup(md->name);
+		md->songinfo = _mdata_strdup(md, md->name);
 		return (0);
 	}
 
@@ -324,19 +440,23 @@ mdata_parse_file(struct mdata *md, const char *filename)
 
 	str = taglib_tag_artist(tt);
 	if (0 < strlen(str))
-		md->artist = xstrdup(str);
+		md->artist = _mdata_strdup(md, str);
 	str = taglib_tag_album(tt);
 	if (0 < strlen(str))
-		md->album = xstrdup(str);
+		md->album = _mdata_strdup(md, str);
 	str = taglib_tag_title(tt);
 	if (0 < strlen(str))
-		md->title = xstrdup(str);
+		md->title = _mdata_strdup(md, str);
 
 	taglib_tag_free_strings();
 
 	ta = taglib_file_audioproperties(tf);
 	md->length = taglib_audioproperties_length(ta);
 
+#ifdef HAVE_TAGLIB_PROPERTY_GET
+	_mdata_parse_gain(md, tf);
+#endif /* HAVE_TAGLIB_PROPERTY_GET */
+
 	taglib_file_free(tf);
 
 	if (md->normalize_strings)
@@ -368,33 +488,33 @@ mdata_run_program(struct mdata *md, const char *program)
 	}
 
 	artist = album = title = songinfo = NULL;
-	if (NULL == (artist   = _mdata_run(program, MDATA_ARTIST)) ||
-	    NULL == (album    = _mdata_run(program, MDATA_ALBUM)) ||
-	    NULL == (title    = _mdata_run(program, MDATA_TITLE)) ||
-	    NULL == (songinfo = _mdata_run(program, MDATA_SONGINFO)))
+	if (NULL == (artist   = _mdata_run(md, program, MDATA_ARTIST)) ||
+	    NULL == (album    = _mdata_run(md, program, MDATA_ALBUM)) ||
+	    NULL == (title    = _mdata_run(md, program, MDATA_TITLE)) ||
+	    NULL == (songinfo = _mdata_run(md, program, MDATA_SONGINFO)))
 		goto error;
 
 	_mdata_clear(md);
-	md->filename = xstrdup(program);
-	md->name = xstrdup("[unknown]");
+	md->filename = _mdata_strdup(md, program);
+	md->name = _mdata_strdup(md, "[unknown]");
 
 	if (0 == strlen(artist))
-		xfree(artist);
+		_mdata_free(md, &artist);
 	else
 		md->artist = artist;
 
 	if (0 == strlen(album))
-		xfree(album);
+		_mdata_free(md, &album);
 	else
 		md->album = album;
 
 	if (0 == strlen(title))
-		xfree(title);
+		_mdata_free(md, &title);
 	else
 		md->title = title;
 
 	if (0 == strlen(songinfo))
-		xfree(songinfo);
+		_mdata_free(md, &songinfo);
 	else
 		md->songinfo = songinfo;
 
@@ -406,10 +526,10 @@ mdata_run_program(struct mdata *md, const char *program)
 	return (0);
 
 error:
-	xfree(artist);
-	xfree(album);
-	xfree(title);
-	xfree(songinfo);
+	_mdata_free(md, &artist);
+	_mdata_free(md, &album);
+	_mdata_free(md, &title);
+	_mdata_free(md, &songinfo);
 
 	return (-1);
 }
@@ -417,14 +537,14 @@ error:
 int
 mdata_refresh(struct mdata *md)
 {
-	char	*filename = xstrdup(md->filename);
+	char	*filename = _mdata_strdup(md, md->filename);
 	int	 ret;
 
 	if (md->run_program)
 		ret = mdata_run_program(md, filename);
 	else
 		ret = mdata_parse_file(md, filename);
-	xfree(filename);
+	_mdata_free(md, &filename);
 
 	return (ret);
 }
@@ -471,33 +591,98 @@ mdata_get_length(struct mdata *md)
 	return (md->length);
 }
 
+int
+mdata_get_track_gain(struct mdata *md, float *gain_p)
+{
+	if (!md->has_track_gain)
+		return (-1);
+	*gain_p = md->track_gain;
+	return (0);
+}
+
+int
+mdata_get_album_gain(struct mdata *md, float *gain_p)
+{
+	if (!md->has_album_gain)
+		return (-1);
+	*gain_p = md->album_gain;
+	return (0);
+}
+
+void
+mdata_set_track_gain(struct mdata *md, float gain)
+{
+	md->track_gain = gain;
+	md->has_track_gain = 1;
+}
+
+int
+mdata_get_true_peak(struct mdata *md, float *peak_p)
+{
+	if (!md->has_true_peak)
+		return (-1);
+	*peak_p = md->true_peak;
+	return (0);
+}
+
+void
+mdata_set_true_peak(struct mdata *md, float peak)
+{
+	md->true_peak = peak;
+	md->has_true_peak = 1;
+}
+
+int
+mdata_get_audio_bounds(struct mdata *md, unsigned long *start_p,
+    unsigned long *end_p)
+{
+	if (!md->has_audio_bounds)
+		return (-1);
+	*start_p = md->audio_start;
+	*end_p = md->audio_end;
+	return (0);
+}
+
+void
+mdata_set_audio_bounds(struct mdata *md, unsigned long start,
+    unsigned long end)
+{
+	md->audio_start = start;
+	md->audio_end = end;
+	md->has_audio_bounds = 1;
+}
+
 int
 mdata_strformat(struct mdata *md, char *buf, size_t bufsize, const char *format)
 {
-	struct util_dict	 dicts[6];
-	char			*str;
-	int			 ret;
+	util_template_t tmpl;
+	int		ret;
 
 	if (format == NULL)
 		return (-1);
 
-	memset(dicts, 0, sizeof(dicts));
-	dicts[0].from = PLACEHOLDER_ARTIST;
-	dicts[0].to = mdata_get_artist(md) ? mdata_get_artist(md) : "";
-	dicts[1].from = PLACEHOLDER_ALBUM;
-	dicts[1].to = mdata_get_album(md) ? mdata_get_album(md) : "";
-	dicts[2].from = PLACEHOLDER_TITLE;
-	dicts[2].to = mdata_get_title(md) ? mdata_get_title(md) : "";
-	dicts[3].from = PLACEHOLDER_TRACK;
-	dicts[3].to = mdata_get_filename(md);
-	dicts[4].from = PLACEHOLDER_STRING;
-	dicts[4].to = mdata_get_songinfo(md) ? mdata_get_songinfo(md) : "";
+	tmpl = cfg_template_compile(format);
+	ret = mdata_strformat_template(md, buf, bufsize, tmpl);
+	util_template_destroy(&tmpl);
+
+	return (ret);
+}
+
+int
+mdata_strformat_template(struct mdata *md, char *buf, size_t bufsize,
+    util_template_t tmpl)
+{
+	const char	*values[CFG_PH_MAX];
 
-	str = util_expand_words(format, dicts);
-	ret = (int)strlen(str);
+	if (tmpl == NULL)
+		return (-1);
 
-	strlcpy(buf, str, bufsize);
-	xfree(str);
+	memset(values, 0, sizeof(values));
+	values[CFG_PH_ARTIST] = mdata_get_artist(md);
+	values[CFG_PH_ALBUM] = mdata_get_album(md);
+	values[CFG_PH_TITLE] = mdata_get_title(md);
+	values[CFG_PH_TRACK] = mdata_get_filename(md);
+	values[CFG_PH_STRING] = mdata_get_songinfo(md);
 
-	return (ret);
+	return ((int)util_template_render(tmpl, values, buf, bufsize));
 }
@@ -17,9 +17,12 @@
 #ifndef __MDATA_H__
 #define __MDATA_H__
 
+#include "util.h"
+
 typedef struct mdata * mdata_t;
 
 mdata_t mdata_create(void);
+mdata_t mdata_create_arena(xarena_t);
 void	mdata_destroy(mdata_t *);
 
 void	mdata_set_normalize_strings(mdata_t, int);
@@ -44,6 +47,26 @@ const char *
 
 int	mdata_get_length(mdata_t);
 
+/*
+ * Loudness normalization gain in dB, from ReplayGain or R128 tags, that
+ * brings the track or its album to the ReplayGain 2.0 reference loudness
+ * of -18 LUFS. The getters return -1 if the gain is unknown.
+ */
+int	mdata_get_track_gain(mdata_t, float *);
+int	mdata_get_album_gain(mdata_t, float *);
+void	mdata_set_track_gain(mdata_t, float);
+
+/*
+ * Results of a prior analysis of the audio, see analysis.h: the true peak
+ * as a linear amplitude, and the positions of the first and last audible
+ * sample in milliseconds. The getters return -1 if the value is unknown.
+ */
+int	mdata_get_true_peak(mdata_t, float *);
+void	mdata_set_true_peak(mdata_t, float);
+int	mdata_get_audio_bounds(mdata_t, unsigned long *, unsigned long *);
+void	mdata_set_audio_bounds(mdata_t, unsigned long, unsigned long);
+
 int	mdata_strformat(mdata_t, char *, size_t, const char *);
+int	mdata_strformat_template(mdata_t, char *, size_t, util_template_t);
 
 #endif /* __MDATA_H__ */
@@ -0,0 +1,411 @@
+/*
+ * Copyright (c) 2026 Moritz Grimm <mgrimm@mrsserver.net>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "compat.h"
+
+#include "attributes.h"
+
+#include <sys/queue.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "log.h"
+#include "metrics.h"
+#include "sock.h"
+#include "xalloc.h"
+
+/* Bucket upper bounds in seconds, shared by all histograms */
+static const double	_metrics_buckets[] = {
+	0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5,
+	1.0, 2.5, 5.0, 10.0
+};
+#define METRICS_NBUCKETS \
+	(sizeof(_metrics_buckets) / sizeof(_metrics_buckets[0]))
+
+struct metrics_histogram_data {
+	unsigned long long	buckets[METRICS_NBUCKETS];
+	unsigned long long	count;
+	double			sum;
+};
+
+struct metrics {
+	TAILQ_ENTRY(metrics)		 entry;
+	char				*name;
+	unsigned long long		 counters[METRICS_COUNTER_MAX];
+	struct metrics_histogram_data	 histograms[METRICS_HISTOGRAM_MAX];
+	int				 connected;
+	double				 kbps;
+	struct timespec 		 kbps_window;
+	unsigned long long		 kbps_bytes;
+};
+TAILQ_HEAD(metrics_list, metrics);
+
+static const struct {
+	const char	*name;
+	const char	*help;
+} _metrics_counter_info[METRICS_COUNTER_MAX] = {
+	{ "ezstream_sent_bytes_total",
+	    "Bytes handed to the streaming server." },
+	{ "ezstream_sent_chunks_total",
+	    "Data chunks handed to the streaming server." },
+	{ "ezstream_send_errors_total",
+	    "Failed attempts to send data to the streaming server." },
+	{ "ezstream_track_changes_total",
+	    "Tracks started." },
+	{ "ezstream_reconnects_total",
+	    "Successful reconnects to the streaming server." },
+	{ "ezstream_metadata_updates_total",
+	    "Successful metadata updates." },
+	{ "ezstream_metadata_allocations_total",
+	    "Heap allocations made while preparing metadata updates." },
+	{ "ezstream_archive_bytes_total",
+	    "Bytes written to the local archive." },
+	{ "ezstream_archive_dropped_bytes_total",
+	    "Bytes left out of the local archive, as writing fell behind or failed." },
+}, _metrics_histogram_info[METRICS_HISTOGRAM_MAX] = {
+	{ "ezstream_send_latency_seconds",
+	    "Time spent handing a chunk of data to the streaming server." },
+	{ "ezstream_sync_wait_seconds",
+	    "Time spent waiting for the pacing of the outgoing stream." },
+	{ "ezstream_metadata_update_seconds",
+	    "Time spent sending a metadata update to the streaming server." },
+	{ "ezstream_decoder_spawn_seconds",
+	    "Time spent starting the decoder/encoder pipeline of a track." },
+	{ "ezstream_decode_seconds",
+	    "Time spent decoding a block of audio with a decoder plugin." },
+	{ "ezstream_encode_seconds",
+	    "Time spent encoding a block of audio with an encoder plugin." },
+	{ "ezstream_archive_lag_seconds",
+	    "Time data waited in memory before it was written to the local archive." },
+};
+
+static struct metrics_list	 metrics_list =
+	TAILQ_HEAD_INITIALIZER(metrics_list);
+static sock_listener_t		 metrics_listener;
+
+struct metrics_buf {
+	char	*data;
+	size_t	 len;
+	size_t	 size;
+};
+
+static double	_metrics_elapsed(const struct timespec *,
+		    const struct timespec *);
+static void	_metrics_printf(struct metrics_buf *, const char *, ...)
+    ATTRIBUTE_NONNULL(2)
+    ATTRIBUTE_FORMAT(printf, 2, 3);
+static void	_metrics_print_label(struct metrics_buf *, const char *);
+static void	_metrics_print_header(struct metrics_buf *, const char *,
+		    const char *, const char *);
+static int	_metrics_handler(sock_client_t, const char *, void *);
+
+static double
+_metrics_elapsed(const struct timespec *from, const struct timespec *to)
+{
+	return ((double)(to->tv_sec - from->tv_sec) +
+	    (double)(to->tv_nsec - from->tv_nsec) / 1000000000.0);
+}
+
+static void
+_metrics_printf(struct metrics_buf *b, const char *fmt, ...)
+{
+	va_list ap;
+	int	len;
+
+	for (;;) {
+		va_start(ap, fmt);
+		len = vsnprintf(b->data + b->len, b->size - b->len, fmt, ap);
+		va_end(ap);
+		if (0 > len)
+			return;
+		if ((size_t)len < b->size - b->len)
+			break;
+		b->size *= 2;
+		b->data = xreallocarray(b->data, b->size, sizeof(char));
+	}
+	b->len += (size_t)len;
+}
+
+static void
+_metrics_print_label(struct metrics_buf *b, const char *name)
+{
+	const char	*p;
+
+	_metrics_printf(b, "{stream=\"");
+	for (p = name; *p; p++) {
+		switch (*p) {
+		case '\\':
+			_metrics_printf(b, "\\\\");
+			break;
+		case '"':
+			_metrics_printf(b, "\\\"");
+			break;
+		case '\n':
+			_metrics_printf(b, "\\n");
+			break;
+		default:
+			_metrics_printf(b, "%c", *p);
+			break;
+		}
+	}
+	_metrics_printf(b, "\"");
+}
+
+static void
+_metrics_print_header(struct metrics_buf *b, const char *name,
+    const char *help, const char *type)
+{
+	_metrics_printf(b, "# HELP %s %s\n", name, help);
+	_metrics_printf(b, "# TYPE %s %s\n", name, type);
+}
+
+static int
+_metrics_handler(sock_client_t client, const char *request, void *arg)
+{
+	char	*body;
+	size_t	 body_len;
+
+	(void)arg;
+
+	if (0 != strncmp(request, "GET ", strlen("GET "))) {
+		sock_client_printf(client,
+		    "HTTP/1.0 405 Method Not Allowed\r\n"
+		    "Allow: GET\r\n"
+		    "Content-Length: 0\r\n"
+		    "Connection: close\r\n"
+		    "\r\n");
+		return (SOCK_CLOSE);
+	}
+
+	body = metrics_render(&body_len);
+	sock_client_printf(client,
+	    "HTTP/1.0 200 OK\r\n"
+	    "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+	    "Content-Length: %lu\r\n"
+	    "Connection: close\r\n"
+	    "\r\n", (unsigned long)body_len);
+	sock_client_write(client, body, body_len);
+	xfree(body);
+
+	return (SOCK_CLOSE);
+}
+
+int
+metrics_init(const char *address)
+{
+	if (NULL == address)
+		return (0);
+
+	metrics_listener = sock_listen(address, "\r\n\r\n", _metrics_handler,
+	    NULL);
+	if (NULL == metrics_listener) {
+		log_error("metrics: %s: cannot listen", address);
+		return (-1);
+	}
+	log_info("metrics: listening on %s", address);
+
+	return (0);
+}
+
+void
+metrics_exit(void)
+{
+	sock_close(&metrics_listener);
+}
+
+void
+metrics_poll(void)
+{
+	sock_poll(metrics_listener);
+}
+
+struct metrics *
+metrics_create(const char *name)
+{
+	struct metrics	*m;
+
+	m = xcalloc(1UL, sizeof(*m));
+	m->name = xstrdup(name);
+	clock_gettime(CLOCK_MONOTONIC, &m->kbps_window);
+	TAILQ_INSERT_TAIL(&metrics_list, m, entry);
+
+	return (m);
+}
+
+void
+metrics_destroy(struct metrics **m_p)
+{
+	struct metrics	*m = *m_p;
+
+	if (NULL == m)
+		return;
+
+	TAILQ_REMOVE(&metrics_list, m, entry);
+	xfree(m->name);
+	xfree(m);
+	*m_p = NULL;
+}
+
+void
+metrics_count(struct metrics *m, enum metrics_counter c, unsigned long n)
+{
+	m->counters[c] += n;
+
+	if (METRICS_BYTES_SENT == c) {
+		struct timespec now;
+		double		elapsed;
+
+		m->kbps_bytes += n;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		elapsed = _metrics_elapsed(&m->kbps_window, &now);
+		if (elapsed >= 1.0) {
+			m->kbps = (double)m->kbps_bytes * 8.0 / 1000.0 /
+			    elapsed;
+			m->kbps_bytes = 0;
+			m->kbps_window = now;
+		}
+	}
+}
+
+void
+metrics_observe(struct metrics *m, enum metrics_histogram h, double value)
+{
+	struct metrics_histogram_data	*hd = &m->histograms[h];
+	size_t				 i;
+
+	for (i = 0; i < METRICS_NBUCKETS; i++) {
+		if (value <= _metrics_buckets[i])
+			hd->buckets[i]++;
+	}
+	hd->count++;
+	hd->sum += value;
+}
+
+void
+metrics_observe_since(struct metrics *m, enum metrics_histogram h,
+    const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	metrics_observe(m, h, _metrics_elapsed(start, &now));
+}
+
+void
+metrics_set_connected(struct metrics *m, int connected)
+{
+	m->connected = connected ? 1 : 0;
+	if (!m->connected)
+		m->kbps = 0.0;
+}
+
+unsigned long long
+metrics_get_counter(struct metrics *m, enum metrics_counter c)
+{
+	return (m->counters[c]);
+}
+
+double
+metrics_get_kbps(struct metrics *m)
+{
+	return (m->kbps);
+}
+
+char *
+metrics_render(size_t *len_p)
+{
+	struct metrics_buf	 b;
+	struct metrics		*m;
+	unsigned int		 i;
+	size_t			 j;
+
+	b.size = BUFSIZ;
+	b.len = 0;
+	b.data = xcalloc(b.size, sizeof(char));
+
+	_metrics_print_header(&b, "ezstream_connected",
+	    "Whether the stream is connected to the streaming server.",
+	    "gauge");
+	TAILQ_FOREACH(m, &metrics_list, entry) {
+		_metrics_printf(&b, "ezstream_connected");
+		_metrics_print_label(&b, m->name);
+		_metrics_printf(&b, "} %d\n", m->connected);
+	}
+	_metrics_print_header(&b, "ezstream_kbps",
+	    "Current outgoing bitrate in kbit/s.", "gauge");
+	TAILQ_FOREACH(m, &metrics_list, entry) {
+		_metrics_printf(&b, "ezstream_kbps");
+		_metrics_print_label(&b, m->name);
+		_metrics_printf(&b, "} %.2f\n", m->kbps);
+	}
+
+	for (i = 0; i < METRICS_COUNTER_MAX; i++) {
+		_metrics_print_header(&b, _metrics_counter_info[i].name,
+		    _metrics_counter_info[i].help, "counter");
+		TAILQ_FOREACH(m, &metrics_list, entry) {
+			_metrics_printf(&b, "%s", _metrics_counter_info[i].name);
+			_metrics_print_label(&b, m->name);
+			_metrics_printf(&b, "} %llu\n", m->counters[i]);
+		}
+	}
+
+	for (i = 0; i < METRICS_HISTOGRAM_MAX; i++) {
+		const char	*name = _metrics_histogram_info[i].name;
+
+		_metrics_print_header(&b, name,
+		    _metrics_histogram_info[i].help, "histogram");
+		TAILQ_FOREACH(m, &metrics_list, entry) {
+			struct metrics_histogram_data	*hd = &m->histograms[i];
+
+			for (j = 0; j < METRICS_NBUCKETS; j++) {
+				_metrics_printf(&b, "%s_bucket", name);
+				_metrics_print_label(&b, m->name);
+				_metrics_printf(&b, ",le=\"%g\"} %llu\n",
+				    _metrics_buckets[j], hd->buckets[j]);
+			}
+			_metrics_printf(&b, "%s_bucket", name);
+			_metrics_print_label(&b, m->name);
+			_metrics_printf(&b, ",le=\"+Inf\"} %llu\n", hd->count);
+			_metrics_printf(&b, "%s_sum", name);
+			_metrics_print_label(&b, m->name);
+			_metrics_printf(&b, "} %.6f\n", hd->sum);
+			_metrics_printf(&b, "%s_count", name);
+			_metrics_print_label(&b, m->name);
+			_metrics_printf(&b, "} %llu\n", hd->count);
+		}
+	}
+
+	_metrics_print_header(&b, "ezstream_log_dropped_total",
+	    "Log messages lost to a full asynchronous log buffer.",
+	    "counter");
+	_metrics_printf(&b, "ezstream_log_dropped_total %lu\n",
+	    log_get_dropped());
+	_metrics_print_header(&b, "ezstream_log_suppressed_total",
+	    "Log messages suppressed by rate limiting.", "counter");
+	_metrics_printf(&b, "ezstream_log_suppressed_total %lu\n",
+	    log_get_suppressed());
+
+	if (len_p)
+		*len_p = b.len;
+
+	return (b.data);
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2026 Moritz Grimm <mgrimm@mrsserver.net>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <stddef.h>
+#include <time.h>
+
+enum metrics_counter {
+	METRICS_BYTES_SENT = 0,
+	METRICS_CHUNKS_SENT,
+	METRICS_SEND_ERRORS,
+	METRICS_TRACK_CHANGES,
+	METRICS_RECONNECTS,
+	METRICS_METADATA_UPDATES,
+	METRICS_METADATA_ALLOCS,
+	METRICS_ARCHIVE_BYTES,
+	METRICS_ARCHIVE_DROPPED,
+	METRICS_COUNTER_MAX
+};
+
+enum metrics_histogram {
+	METRICS_SEND_LATENCY = 0,
+	METRICS_SYNC_WAIT,
+	METRICS_METADATA_LATENCY,
+	METRICS_DECODER_SPAWN,
+	METRICS_DECODE_LATENCY,
+	METRICS_ENCODE_LATENCY,
+	METRICS_ARCHIVE_LAG,
+	METRICS_HISTOGRAM_MAX
+};
+
+typedef struct metrics *	metrics_t;
+
+int	metrics_init(const char *);
+void	metrics_exit(void);
+void	metrics_poll(void);
+
+metrics_t
+	metrics_create(const char *);
+void	metrics_destroy(metrics_t *);
+
+void	metrics_count(metrics_t, enum metrics_counter, unsigned long);
+void	metrics_observe(metrics_t, enum metrics_histogram, double);
+void	metrics_observe_since(metrics_t, enum metrics_histogram,
+	    const struct timespec *);
+void	metrics_set_connected(metrics_t, int);
+
+unsigned long long
+	metrics_get_counter(metrics_t, enum metrics_counter);
+double	metrics_get_kbps(metrics_t);
+
+char *	metrics_render(size_t *);
+
+#endif /* __METRICS_H__ */
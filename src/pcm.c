@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2026 Moritz Grimm <mgrimm@mrsserver.net>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#ifdef HAVE_X86_SIMD
+# include <immintrin.h>
+#endif /* HAVE_X86_SIMD */
+#include <string.h>
+
+#include "pcm.h"
+
+struct pcm_impl {
+	const char	*name;
+	int		(*supported)(void);
+	void		(*mix)(float *, const float *, const float *,
+			    const float *, size_t);
+	void		(*scale)(float *, const float *, size_t);
+	void		(*gain)(float *, float, size_t);
+	float		(*peak)(const float *, size_t);
+};
+
+static int	_pcm_supported_scalar(void);
+static void	_pcm_mix_scalar(float *, const float *, const float *,
+		    const float *, size_t);
+static void	_pcm_scale_scalar(float *, const float *, size_t);
+static void	_pcm_gain_scalar(float *, float, size_t);
+static float	_pcm_peak_scalar(const float *, size_t);
+#ifdef HAVE_X86_SIMD
+static int	_pcm_supported_sse2(void);
+static void	_pcm_mix_sse2(float *, const float *, const float *,
+		    const float *, size_t);
+static void	_pcm_scale_sse2(float *, const float *, size_t);
+static void	_pcm_gain_sse2(float *, float, size_t);
+static float	_pcm_peak_sse2(const float *, size_t);
+static int	_pcm_supported_avx2(void);
+static void	_pcm_mix_avx2(float *, const float *, const float *,
+		    const float *, size_t);
+static void	_pcm_scale_avx2(float *, const float *, size_t);
+static void	_pcm_gain_avx2(float *, float, size_t);
+static float	_pcm_peak_avx2(const float *, size_t);
+#endif /* HAVE_X86_SIMD */
+
+/* In order of preference, with the portable fallback last: */
+static const struct pcm_impl	pcm_impls[] = {
+#ifdef HAVE_X86_SIMD
+	{ "avx2", _pcm_supported_avx2, _pcm_mix_avx2, _pcm_scale_avx2,
+	  _pcm_gain_avx2, _pcm_peak_avx2 },
+	{ "sse2", _pcm_supported_sse2, _pcm_mix_sse2, _pcm_scale_sse2,
+	  _pcm_gain_sse2, _pcm_peak_sse2 },
+#endif /* HAVE_X86_SIMD */
+	{ "scalar", _pcm_supported_scalar, _pcm_mix_scalar, _pcm_scale_scalar,
+	  _pcm_gain_scalar, _pcm_peak_scalar },
+};
+#define PCM_NIMPLS	(sizeof(pcm_impls) / sizeof(pcm_impls[0]))
+
+static const struct pcm_impl	*pcm_impl = &pcm_impls[PCM_NIMPLS - 1];
+
+static int
+_pcm_supported_scalar(void)
+{
+	return (1);
+}
+
+static void
+_pcm_mix_scalar(float *dst, const float *dst_gain, const float *src,
+    const float *src_gain, size_t n)
+{
+	size_t	i;
+
+	for (i = 0; i < n; i++)
+		dst[i] = dst[i] * dst_gain[i] + src[i] * src_gain[i];
+}
+
+static void
+_pcm_scale_scalar(float *dst, const float *gain, size_t n)
+{
+	size_t	i;
+
+	for (i = 0; i < n; i++)
+		dst[i] *= gain[i];
+}
+
+static void
+_pcm_gain_scalar(float *dst, float gain, size_t n)
+{
+	size_t	i;
+
+	for (i = 0; i < n; i++)
+		dst[i] *= gain;
+}
+
+static float
+_pcm_peak_scalar(const float *src, size_t n)
+{
+	float	peak = 0.0f;
+	size_t	i;
+
+	for (i = 0; i < n; i++) {
+		float	v = src[i] < 0.0f ? -src[i] : src[i];
+
+		if (v > peak)
+			peak = v;
+	}
+
+	return (peak);
+}
+
+#ifdef HAVE_X86_SIMD
+static int
+_pcm_supported_sse2(void)
+{
+	__builtin_cpu_init();
+	return (__builtin_cpu_supports("sse2"));
+}
+
+__attribute__((target("sse2"))) static void
+_pcm_mix_sse2(float *dst, const float *dst_gain, const float *src,
+    const float *src_gain, size_t n)
+{
+	size_t	i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128	a = _mm_mul_ps(_mm_loadu_ps(dst + i),
+			    _mm_loadu_ps(dst_gain + i));
+		__m128	b = _mm_mul_ps(_mm_loadu_ps(src + i),
+			    _mm_loadu_ps(src_gain + i));
+
+		_mm_storeu_ps(dst + i, _mm_add_ps(a, b));
+	}
+	_pcm_mix_scalar(dst + i, dst_gain + i, src + i, src_gain + i, n - i);
+}
+
+__attribute__((target("sse2"))) static void
+_pcm_scale_sse2(float *dst, const float *gain, size_t n)
+{
+	size_t	i;
+
+	for (i = 0; i + 4 <= n; i += 4)
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(dst + i),
+		    _mm_loadu_ps(gain + i)));
+	_pcm_scale_scalar(dst + i, gain + i, n - i);
+}
+
+__attribute__((target("sse2"))) static void
+_pcm_gain_sse2(float *dst, float gain, size_t n)
+{
+	__m128	g = _mm_set1_ps(gain);
+	size_t	i;
+
+	for (i = 0; i + 4 <= n; i += 4)
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(dst + i), g));
+	_pcm_gain_scalar(dst + i, gain, n - i);
+}
+
+__attribute__((target("sse2"))) static float
+_pcm_peak_sse2(const float *src, size_t n)
+{
+	/* Clearing the sign bit yields the absolute value: */
+	__m128	mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128	max = _mm_setzero_ps();
+	float	r[4], peak;
+	size_t	i;
+
+	for (i = 0; i + 4 <= n; i += 4)
+		max = _mm_max_ps(max, _mm_and_ps(_mm_loadu_ps(src + i), mask));
+	_mm_storeu_ps(r, max);
+	peak = _pcm_peak_scalar(r, 4);
+	r[0] = _pcm_peak_scalar(src + i, n - i);
+
+	return (r[0] > peak ? r[0] : peak);
+}
+
+static int
+_pcm_supported_avx2(void)
+{
+	__builtin_cpu_init();
+	return (__builtin_cpu_supports("avx2"));
+}
+
+__attribute__((target("avx2"))) static void
+_pcm_mix_avx2(float *dst, const float *dst_gain, const float *src,
+    const float *src_gain, size_t n)
+{
+	size_t	i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256	a = _mm256_mul_ps(_mm256_loadu_ps(dst + i),
+			    _mm256_loadu_ps(dst_gain + i));
+		__m256	b = _mm256_mul_ps(_mm256_loadu_ps(src + i),
+			    _mm256_loadu_ps(src_gain + i));
+
+		_mm256_storeu_ps(dst + i, _mm256_add_ps(a, b));
+	}
+	_pcm_mix_scalar(dst + i, dst_gain + i, src + i, src_gain + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+_pcm_scale_avx2(float *dst, const float *gain, size_t n)
+{
+	size_t	i;
+
+	for (i = 0; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(dst + i, _mm256_mul_ps(
+		    _mm256_loadu_ps(dst + i), _mm256_loadu_ps(gain + i)));
+	_pcm_scale_scalar(dst + i, gain + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+_pcm_gain_avx2(float *dst, float gain, size_t n)
+{
+	__m256	g = _mm256_set1_ps(gain);
+	size_t	i;
+
+	for (i = 0; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(dst + i, _mm256_mul_ps(
+		    _mm256_loadu_ps(dst + i), g));
+	_pcm_gain_scalar(dst + i, gain, n - i);
+}
+
+__attribute__((target("avx2"))) static float
+_pcm_peak_avx2(const float *src, size_t n)
+{
+	__m256	mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256	max = _mm256_setzero_ps();
+	float	r[8], peak;
+	size_t	i;
+
+	for (i = 0; i + 8 <= n; i += 8)
+		max = _mm256_max_ps(max, _mm256_and_ps(
+		    _mm256_loadu_ps(src + i), mask));
+	_mm256_storeu_ps(r, max);
+	peak = _pcm_peak_scalar(r, 8);
+	r[0] = _pcm_peak_scalar(src + i, n - i);
+
+	return (r[0] > peak ? r[0] : peak);
+}
+#endif /* HAVE_X86_SIMD */
+
+const char *
+pcm_init(void)
+{
+	size_t	i;
+
+	for (i = 0; i < PCM_NIMPLS; i++) {
+		if (pcm_impls[i].supported()) {
+			pcm_impl = &pcm_impls[i];
+			break;
+		}
+	}
+
+	return (pcm_impl->name);
+}
+
+int
+pcm_select(const char *name)
+{
+	size_t	i;
+
+	for (i = 0; i < PCM_NIMPLS; i++) {
+		if (0 == strcmp(pcm_impls[i].name, name)) {
+			if (!pcm_impls[i].supported())
+				return (-1);
+			pcm_impl = &pcm_impls[i];
+			return (0);
+		}
+	}
+
+	return (-1);
+}
+
+void
+pcm_float_to_s16le(const float *in, unsigned char *out, size_t samples)
+{
+	size_t	i;
+
+	for (i = 0; i < samples; i++) {
+		float	v = in[i] * 32768.0f;
+		int	s;
+
+		/* Clip, and round half away from zero: */
+		if (v >= 32767.0f)
+			s = 32767;
+		else if (v <= -32768.0f)
+			s = -32768;
+		else
+			s = (int)(v + (v >= 0.0f ? 0.5f : -0.5f));
+		out[2 * i] = (unsigned char)(s & 0xff);
+		out[2 * i + 1] = (unsigned char)((s >> 8) & 0xff);
+	}
+}
+
+void
+pcm_s16le_to_float(const unsigned char *in, float *out, size_t samples)
+{
+	size_t	i;
+
+	for (i = 0; i < samples; i++) {
+		int	s = (int)(in[2 * i] | (in[2 * i + 1] << 8));
+
+		if (s >= 0x8000)
+			s -= 0x10000;
+		out[i] = (float)s / 32768.0f;
+	}
+}
+
+void
+pcm_mix(float *dst, const float *dst_gain, const float *src,
+    const float *src_gain, size_t n)
+{
+	pcm_impl->mix(dst, dst_gain, src, src_gain, n);
+}
+
+void
+pcm_scale(float *dst, const float *gain, size_t n)
+{
+	pcm_impl->scale(dst, gain, n);
+}
+
+void
+pcm_gain(float *dst, float gain, size_t n)
+{
+	pcm_impl->gain(dst, gain, n);
+}
+
+float
+pcm_peak(const float *src, size_t n)
+{
+	return (pcm_impl->peak(src, n));
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2026 Moritz Grimm <mgrimm@mrsserver.net>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#ifndef __PCM_H__
+#define __PCM_H__
+
+#include <stddef.h>
+
+/*
+ * Audio is processed as interleaved 32-bit floating point samples in the
+ * range of [-1.0, 1.0]. External programs exchange 16-bit signed
+ * little-endian samples.
+ */
+#define PCM_S16_SIZE	2
+
+/*
+ * Selects the fastest implementation of the vectorized functions below that
+ * the CPU supports, and returns its name. Until then, or without SIMD
+ * support, the portable implementation is used. pcm_select() selects an
+ * implementation by name, and fails if the CPU does not support it.
+ */
+const char *
+	pcm_init(void);
+int	pcm_select(const char *);
+
+void	pcm_float_to_s16le(const float *, unsigned char *, size_t);
+void	pcm_s16le_to_float(const unsigned char *, float *, size_t);
+
+/* dst[i] = dst[i] * dst_gain[i] + src[i] * src_gain[i] */
+void	pcm_mix(float *, const float *, const float *, const float *,
+	    size_t);
+/* dst[i] = dst[i] * gain[i] */
+void	pcm_scale(float *, const float *, size_t);
+/* dst[i] = dst[i] * gain */
+void	pcm_gain(float *, float, size_t);
+/* Returns the largest absolute value of the samples */
+float	pcm_peak(const float *, size_t);
+
+#endif /* __PCM_H__ */
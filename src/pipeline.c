@@ -0,0 +1,1159 @@
+/*
+ * Copyright (c) 2026 Moritz Grimm <mgrimm@mrsserver.net>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "compat.h"
+
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#ifdef HAVE_PATHS_H
+# include <paths.h>
+#endif /* HAVE_PATHS_H */
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cfg.h"
+#include "limiter.h"
+#include "log.h"
+#include "pcm.h"
+#include "pipeline.h"
+#include "plugin.h"
+#include "xalloc.h"
+
+#ifndef _PATH_BSHELL
+# define _PATH_BSHELL		"/bin/sh"
+#endif /* !_PATH_BSHELL */
+#ifndef _PATH_DEVNULL
+# define _PATH_DEVNULL		"/dev/null"
+#endif /* !_PATH_DEVNULL */
+
+#ifndef M_PI_2
+# define M_PI_2 		1.57079632679489661923
+#endif /* !M_PI_2 */
+
+/* Frames decoded at a time */
+#define PIPELINE_FRAMES 	2048
+/* Ceiling of the limiter after loudness normalization, -1 dBTP */
+#define PIPELINE_CEILING	0.891251f
+/* Longest trailing silence that is trimmed, in seconds */
+#define PIPELINE_TRIM_MAX	5
+
+struct pipeline {
+	metrics_t		 metrics;
+	int			 running;
+	/* The file of the current or last track: */
+	char			*filename;
+
+	const struct ezstream_decoder_plugin *
+				 dec;
+	void			*dec_handle;
+	struct ezstream_pcm_format
+				 fmt;
+	int			 dec_eof;
+	double			 dec_seconds;
+	unsigned long long	 dec_frames;
+
+	/* The encoder plugin instance outlives the tracks that it encodes: */
+	const struct ezstream_encoder_plugin *
+				 enc;
+	void			*enc_handle;
+	struct ezstream_pcm_format
+				 enc_fmt;
+
+	/*
+	 * The last crossfade worth of audio is held back, so that the end
+	 * of a track can be mixed with the beginning of the next one:
+	 */
+	unsigned int		 xfade_ms;
+	enum cfg_stream_fade	 xfade_curve;
+	size_t			 xfade_frames;
+	float			*hold;
+	size_t			 hold_size;
+	size_t			 hold_start;
+	size_t			 hold_len;
+	struct ezstream_pcm_format
+				 hold_fmt;
+	/* Held back frames of the previous track that are being faded: */
+	size_t			 fade_len;
+	size_t			 fade_pos;
+	float			*fade_in;
+	float			*fade_out;
+	size_t			 fade_size;
+	size_t			 fade_tbl_len;
+	enum cfg_stream_fade	 fade_tbl_curve;
+
+	/* Loudness normalization of each track, and the limiter after it: */
+	float			 gain;
+	float			 peak;
+	int			 limit;
+	int			 lim_bypass;
+	limiter_t		 limiter;
+	struct ezstream_pcm_format
+				 lim_fmt;
+
+	/*
+	 * Silence trimming: leading silence is dropped as it is decoded,
+	 * and silent runs are held back until either audio resumes or the
+	 * track ends. Only the frames before the held back ones are passed
+	 * on, at most PIPELINE_FRAMES at a time. Known bounds of the audio
+	 * spare scanning the silence outside of them, and decoding the end.
+	 */
+	float			 trim_level;
+	int			 trim_lead;
+	int			 trim_eof;
+	float			*trim;
+	size_t			 trim_size;
+	size_t			 trim_start;
+	size_t			 trim_len;
+	size_t			 trim_silent;
+	size_t			 trim_max;
+	unsigned long long	 trim_lead_frames;
+	unsigned long		 bound_start;
+	unsigned long		 bound_end;
+	unsigned long long	 skip_frames;
+	unsigned long long	 end_frames;
+
+	float			*pcm;
+	size_t			 pcm_size;
+	unsigned char		*out;
+	size_t			 out_size;
+	/* Converted or encoded data that is waiting to be handed out: */
+	const unsigned char	*data;
+	size_t			 data_len;
+	size_t			 data_pos;
+	/* Final output of a closed encoder, which goes out before the rest: */
+	unsigned char		*tail;
+	size_t			 tail_size;
+	size_t			 tail_len;
+	size_t			 tail_pos;
+
+	pid_t			 enc_pid;
+	int			 enc_in;
+	int			 enc_out;
+	/* Encoder program of the last track, to encode what remains: */
+	char			*enc_cmd;
+};
+
+static double	_pipeline_elapsed(const struct timespec *);
+static long	_pipeline_decode_block(struct pipeline *);
+static long	_pipeline_bound(struct pipeline *, long);
+static int	_pipeline_decode(struct pipeline *);
+static int	_pipeline_encode(struct pipeline *, size_t);
+static size_t	_pipeline_hold(struct pipeline *, size_t);
+static int	_pipeline_silent(struct pipeline *, const float *, size_t);
+static size_t	_pipeline_trim_put(struct pipeline *, size_t);
+static size_t	_pipeline_trim_take(struct pipeline *);
+static void	_pipeline_trim_finish(struct pipeline *);
+static void	_pipeline_fade_prepare(struct pipeline *);
+static void	_pipeline_fade_finish(struct pipeline *);
+static void	_pipeline_tail_add(struct pipeline *, const unsigned char *,
+		    size_t);
+static void	_pipeline_drain_encoder(struct pipeline *);
+static size_t	_pipeline_flush_block(struct pipeline *, size_t *);
+static void	_pipeline_flush(struct pipeline *);
+static void	_pipeline_flush_program(struct pipeline *,
+		    const unsigned char *, size_t);
+static void	_pipeline_close_encoder(struct pipeline *, int);
+static int	_pipeline_spawn(struct pipeline *, const char *);
+static void	_pipeline_close_fd(int *);
+
+static double
+_pipeline_elapsed(const struct timespec *since)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((double)(now.tv_sec - since->tv_sec) +
+	    (double)(now.tv_nsec - since->tv_nsec) / 1000000000.0);
+}
+
+/* Decodes a block into p->pcm, and returns its frames or 0 at the end */
+static long
+_pipeline_decode_block(struct pipeline *p)
+{
+	struct timespec start;
+	long		frames;
+
+	do {
+		if (p->end_frames && p->dec_frames >= p->end_frames)
+			return (0);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		frames = p->dec->decode(p->dec_handle, p->pcm,
+		    PIPELINE_FRAMES);
+		p->dec_seconds += _pipeline_elapsed(&start);
+		metrics_observe_since(p->metrics, METRICS_DECODE_LATENCY,
+		    &start);
+		if (0 > frames) {
+			log_warning("%s: %s: decoding failed", p->filename,
+			    p->dec->name);
+			return (0);
+		}
+		if (0 == frames)
+			return (0);
+		if ((unsigned long)frames > PIPELINE_FRAMES)
+			frames = PIPELINE_FRAMES;
+		p->dec_frames += (unsigned long long)frames;
+	} while (0 == (frames = _pipeline_bound(p, frames)));
+
+	return (frames);
+}
+
+/*
+ * Drops the decoded frames outside of the known bounds of the audio.
+ * Returns the number of frames that are left in p->pcm.
+ */
+static long
+_pipeline_bound(struct pipeline *p, long frames)
+{
+	unsigned long long	end = p->dec_frames;
+	unsigned long long	start = end - (unsigned long long)frames;
+	unsigned long long	first = start;
+
+	if (p->end_frames && end > p->end_frames)
+		end = start > p->end_frames ? start : p->end_frames;
+	if (start < p->skip_frames) {
+		start = end < p->skip_frames ? end : p->skip_frames;
+		p->trim_lead_frames += start - first;
+	}
+	if (start > first)
+		memmove(p->pcm, p->pcm + (start - first) * p->fmt.channels,
+		    (end - start) * p->fmt.channels * sizeof(*p->pcm));
+
+	return ((long)(end - start));
+}
+
+static int
+_pipeline_decode(struct pipeline *p)
+{
+	long		frames;
+	size_t		samples;
+
+	/* An encoder plugin may take several blocks to produce output: */
+	while (!p->dec_eof) {
+		if (p->trim_level > 0.0f &&
+		    (p->trim_eof ||
+		     p->trim_len - p->trim_silent >= PIPELINE_FRAMES)) {
+			/* Catch up on audio that was held back: */
+			if (0 == (frames = (long)_pipeline_trim_take(p))) {
+				p->dec_eof = 1;
+				break;
+			}
+		} else if (0 == (frames = _pipeline_decode_block(p))) {
+			if (p->trim_level > 0.0f) {
+				_pipeline_trim_finish(p);
+				continue;
+			}
+			p->dec_eof = 1;
+			break;
+		} else if (p->trim_level > 0.0f &&
+		    0 == (frames = (long)_pipeline_trim_put(p, (size_t)frames)))
+			continue;
+
+		if (1.0f != p->gain)
+			pcm_gain(p->pcm, p->gain,
+			    (size_t)frames * p->fmt.channels);
+		if (p->xfade_frames) {
+			frames = (long)_pipeline_hold(p, (size_t)frames);
+			if (0 == frames)
+				continue;
+		}
+		if (p->lim_bypass)
+			limiter_bypass(p->limiter, p->pcm, (size_t)frames);
+		else if (p->limiter)
+			limiter_process(p->limiter, p->pcm, (size_t)frames);
+
+		if (p->enc) {
+			if (0 > _pipeline_encode(p, (size_t)frames)) {
+				p->dec_eof = 1;
+				break;
+			}
+			if (0 == p->data_len)
+				continue;
+			return (1);
+		}
+
+		samples = (size_t)frames * p->fmt.channels;
+		pcm_float_to_s16le(p->pcm, p->out, samples);
+		p->data = p->out;
+		p->data_len = samples * PCM_S16_SIZE;
+		p->data_pos = 0;
+		return (1);
+	}
+
+	return (0);
+}
+
+static int
+_pipeline_encode(struct pipeline *p, size_t frames)
+{
+	struct timespec 	 start;
+	const unsigned char	*data = NULL;
+	long			 len;
+
+	if (NULL == p->enc_handle) {
+		p->enc_handle = p->enc->open(&p->fmt);
+		if (NULL == p->enc_handle) {
+			log_error("%s: cannot start encoder", p->enc->name);
+			return (-1);
+		}
+		p->enc_fmt = p->fmt;
+		log_debug("%s: encoding %u Hz, %u channel(s)", p->enc->name,
+		    p->enc_fmt.rate, p->enc_fmt.channels);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	len = p->enc->encode(p->enc_handle, p->pcm, frames, &data);
+	metrics_observe_since(p->metrics, METRICS_ENCODE_LATENCY, &start);
+	if (0 > len || (0 < len && NULL == data)) {
+		log_error("%s: %s: encoding failed", p->filename, p->enc->name);
+		_pipeline_close_encoder(p, 0);
+		return (-1);
+	}
+
+	p->data = data;
+	p->data_len = (size_t)len;
+	p->data_pos = 0;
+
+	return (0);
+}
+
+/*
+ * Runs decoded audio through the crossfade delay line, mixing it into the
+ * held back end of the previous track first. Returns the number of frames
+ * that leave the delay line, which replace the contents of p->pcm.
+ */
+static size_t
+_pipeline_hold(struct pipeline *p, size_t frames)
+{
+	size_t	ch = p->fmt.channels;
+	size_t	mixed = 0, out;
+
+	if (p->fade_pos < p->fade_len) {
+		mixed = p->fade_len - p->fade_pos;
+		if (mixed > frames)
+			mixed = frames;
+		pcm_mix(p->hold + (p->hold_start + p->fade_pos) * ch,
+		    p->fade_out + p->fade_pos * ch, p->pcm,
+		    p->fade_in + p->fade_pos * ch, mixed * ch);
+		p->fade_pos += mixed;
+	}
+
+	if (frames > mixed) {
+		size_t	n = frames - mixed;
+
+		/* Compacting is rare enough, see _pipeline_fade_prepare(): */
+		if (p->hold_start + p->hold_len + n > p->hold_size / ch) {
+			memmove(p->hold, p->hold + p->hold_start * ch,
+			    p->hold_len * ch * sizeof(*p->hold));
+			p->hold_start = 0;
+		}
+		memcpy(p->hold + (p->hold_start + p->hold_len) * ch,
+		    p->pcm + mixed * ch, n * ch * sizeof(*p->hold));
+		p->hold_len += n;
+	}
+
+	if (p->hold_len <= p->xfade_frames)
+		return (0);
+	out = p->hold_len - p->xfade_frames;
+	if (out > PIPELINE_FRAMES)
+		out = PIPELINE_FRAMES;
+	memcpy(p->pcm, p->hold + p->hold_start * ch,
+	    out * ch * sizeof(*p->pcm));
+	p->hold_start += out;
+	p->hold_len -= out;
+
+	return (out);
+}
+
+/* Returns 1 if no sample of the frames exceeds the trimming level */
+static int
+_pipeline_silent(struct pipeline *p, const float *pcm, size_t frames)
+{
+	return (pcm_peak(pcm, frames * p->fmt.channels) <= p->trim_level);
+}
+
+/*
+ * Runs decoded audio through silence trimming. Returns the number of frames
+ * that can be passed on, which replace the contents of p->pcm.
+ */
+static size_t
+_pipeline_trim_put(struct pipeline *p, size_t frames)
+{
+	size_t		 ch = p->fmt.channels;
+	const float	*in = p->pcm;
+	size_t		 i, audible;
+
+	if (p->trim_lead) {
+		if (_pipeline_silent(p, in, frames)) {
+			p->trim_lead_frames += frames;
+			return (0);
+		}
+		for (i = 0; _pipeline_silent(p, in + i * ch, 1); i++)
+			;
+		p->trim_lead_frames += i;
+		in += i * ch;
+		frames -= i;
+		p->trim_lead = 0;
+	}
+
+	/* Find the end of the audible part, if any: */
+	audible = 0;
+	if (!_pipeline_silent(p, in, frames)) {
+		for (audible = frames;
+		    _pipeline_silent(p, in + (audible - 1) * ch, 1); audible--)
+			;
+	}
+
+	if (p->trim_start + p->trim_len + frames > p->trim_size / ch) {
+		memmove(p->trim, p->trim + p->trim_start * ch,
+		    p->trim_len * ch * sizeof(*p->trim));
+		p->trim_start = 0;
+	}
+	memcpy(p->trim + (p->trim_start + p->trim_len) * ch, in,
+	    frames * ch * sizeof(*p->trim));
+	p->trim_len += frames;
+	if (audible)
+		p->trim_silent = frames - audible;
+	else
+		p->trim_silent += frames;
+	/* Overly long silence is not trailing, or not trimmed entirely: */
+	if (p->trim_silent > p->trim_max)
+		p->trim_silent = p->trim_max;
+
+	return (_pipeline_trim_take(p));
+}
+
+static size_t
+_pipeline_trim_take(struct pipeline *p)
+{
+	size_t	ch = p->fmt.channels;
+	size_t	out = p->trim_len - p->trim_silent;
+
+	if (out > PIPELINE_FRAMES)
+		out = PIPELINE_FRAMES;
+	memcpy(p->pcm, p->trim + p->trim_start * ch,
+	    out * ch * sizeof(*p->pcm));
+	p->trim_start += out;
+	p->trim_len -= out;
+	if (0 == p->trim_len)
+		p->trim_start = 0;
+
+	return (out);
+}
+
+/* Drops the trailing silence, once the decoder reached the end of the track */
+static void
+_pipeline_trim_finish(struct pipeline *p)
+{
+	if (p->trim_lead_frames || p->trim_silent)
+		log_debug("%s: trimmed %.1f seconds of leading and %.1f seconds of trailing silence",
+		    p->filename,
+		    (double)p->trim_lead_frames / (double)p->fmt.rate,
+		    (double)p->trim_silent / (double)p->fmt.rate);
+	p->trim_len -= p->trim_silent;
+	p->trim_silent = 0;
+	p->trim_eof = 1;
+}
+
+/*
+ * Sets up the fade of the held back end of the previous track into the
+ * track that is starting. A format change means a hard cut.
+ */
+static void
+_pipeline_fade_prepare(struct pipeline *p)
+{
+	size_t	ch = p->fmt.channels;
+	size_t	frames, size, i;
+
+	p->fade_len = p->fade_pos = 0;
+	frames = (size_t)p->xfade_ms * p->fmt.rate / 1000;
+	if (p->hold_len &&
+	    (frames != p->xfade_frames ||
+	     p->fmt.rate != p->hold_fmt.rate ||
+	     p->fmt.channels != p->hold_fmt.channels)) {
+		log_debug("%s: not crossfading: audio format or crossfade changed",
+		    p->filename);
+		p->hold_start = p->hold_len = 0;
+	}
+	p->xfade_frames = frames;
+	p->hold_fmt = p->fmt;
+	if (0 == frames)
+		return;
+
+	/* Room to compact at most once per crossfade worth of audio: */
+	size = (2 * frames + PIPELINE_FRAMES) * ch;
+	if (p->hold_size < size) {
+		p->hold = xreallocarray(p->hold, size, sizeof(*p->hold));
+		p->hold_size = size;
+	}
+	if (0 == p->hold_len)
+		return;
+
+	p->fade_len = p->hold_len;
+	if (p->fade_tbl_len == p->fade_len * ch &&
+	    p->fade_tbl_curve == p->xfade_curve)
+		return;
+	if (p->fade_size < p->fade_len * ch) {
+		p->fade_in = xreallocarray(p->fade_in, p->fade_len * ch,
+		    sizeof(*p->fade_in));
+		p->fade_out = xreallocarray(p->fade_out, p->fade_len * ch,
+		    sizeof(*p->fade_out));
+		p->fade_size = p->fade_len * ch;
+	}
+	for (i = 0; i < p->fade_len; i++) {
+		double	t = (double)(i + 1) / (double)(p->fade_len + 1);
+		float	g_in, g_out;
+		size_t	c;
+
+		switch (p->xfade_curve) {
+		case CFG_STREAM_FADE_LINEAR:
+			g_in = (float)t;
+			g_out = (float)(1.0 - t);
+			break;
+		case CFG_STREAM_FADE_EQUAL_POWER:
+		default:
+			g_in = (float)sin(t * M_PI_2);
+			g_out = (float)cos(t * M_PI_2);
+			break;
+		}
+		for (c = 0; c < ch; c++) {
+			p->fade_in[i * ch + c] = g_in;
+			p->fade_out[i * ch + c] = g_out;
+		}
+	}
+	p->fade_tbl_len = p->fade_len * ch;
+	p->fade_tbl_curve = p->xfade_curve;
+}
+
+/* Fades out what remains of the previous track, if this one ended early */
+static void
+_pipeline_fade_finish(struct pipeline *p)
+{
+	size_t	ch = p->hold_fmt.channels;
+
+	if (p->fade_pos < p->fade_len)
+		pcm_scale(p->hold + (p->hold_start + p->fade_pos) * ch,
+		    p->fade_out + p->fade_pos * ch,
+		    (p->fade_len - p->fade_pos) * ch);
+	p->fade_len = p->fade_pos = 0;
+}
+
+static void
+_pipeline_tail_add(struct pipeline *p, const unsigned char *data, size_t len)
+{
+	if (p->tail_size - p->tail_len < len) {
+		p->tail_size = p->tail_len + len;
+		p->tail = xreallocarray(p->tail, p->tail_size,
+		    sizeof(*p->tail));
+	}
+	memcpy(p->tail + p->tail_len, data, len);
+	p->tail_len += len;
+}
+
+/* Collects what the encoder still holds back, behind any earlier tail */
+static void
+_pipeline_drain_encoder(struct pipeline *p)
+{
+	const unsigned char	*data;
+	long			 len;
+
+	if (NULL == p->enc->drain)
+		return;
+	for (;;) {
+		data = NULL;
+		len = p->enc->drain(p->enc_handle, &data);
+		if (0 == len)
+			break;
+		if (0 > len || NULL == data) {
+			log_warning("%s: draining failed", p->enc->name);
+			break;
+		}
+		_pipeline_tail_add(p, data, (size_t)len);
+	}
+}
+
+/*
+ * Takes the next block of the audio that remains after the last track: the
+ * held back end of it, followed by silence that pushes out the audio in the
+ * limiter's delay. Returns the number of frames in p->pcm, or 0 at the end.
+ */
+static size_t
+_pipeline_flush_block(struct pipeline *p, size_t *silence_p)
+{
+	size_t	ch = p->fmt.channels;
+	size_t	n = 0, m;
+
+	if (p->hold_len) {
+		n = p->hold_len < PIPELINE_FRAMES ?
+		    p->hold_len : PIPELINE_FRAMES;
+		memcpy(p->pcm, p->hold + p->hold_start * ch,
+		    n * ch * sizeof(*p->pcm));
+		p->hold_start += n;
+		p->hold_len -= n;
+	}
+	if (n < PIPELINE_FRAMES && *silence_p) {
+		m = PIPELINE_FRAMES - n < *silence_p ?
+		    PIPELINE_FRAMES - n : *silence_p;
+		memset(p->pcm + n * ch, 0, m * ch * sizeof(*p->pcm));
+		n += m;
+		*silence_p -= m;
+	}
+	if (n && p->limiter)
+		limiter_process(p->limiter, p->pcm, n);
+
+	return (n);
+}
+
+/*
+ * Encodes the audio that remains after the last track into the tail, the
+ * way that the last track was encoded.
+ */
+static void
+_pipeline_flush(struct pipeline *p)
+{
+	unsigned char	*out = NULL;
+	size_t		 out_len = 0, silence = 0, frames, samples;
+
+	if (p->limiter)
+		silence = limiter_get_delay(p->limiter);
+	if (NULL == p->pcm || (0 == p->hold_len && 0 == silence))
+		return;
+
+	while (0 < (frames = _pipeline_flush_block(p, &silence))) {
+		if (p->enc) {
+			if (0 > _pipeline_encode(p, frames))
+				break;
+			if (p->data_len)
+				_pipeline_tail_add(p, p->data, p->data_len);
+			p->data_len = p->data_pos = 0;
+			continue;
+		}
+		samples = frames * p->fmt.channels;
+		out = xreallocarray(out, out_len + samples * PCM_S16_SIZE, 1UL);
+		pcm_float_to_s16le(p->pcm, out + out_len, samples);
+		out_len += samples * PCM_S16_SIZE;
+	}
+	if (out_len && p->enc_cmd)
+		_pipeline_flush_program(p, out, out_len);
+	else if (out_len)
+		_pipeline_tail_add(p, out, out_len);
+	xfree(out);
+
+	p->hold_start = p->hold_len = 0;
+	limiter_destroy(&p->limiter);
+}
+
+/* Runs audio through another instance of the encoder program into the tail */
+static void
+_pipeline_flush_program(struct pipeline *p, const unsigned char *data,
+    size_t len)
+{
+	unsigned char	buf[4096];
+	size_t		pos = 0;
+
+	if (0 > _pipeline_spawn(p, p->enc_cmd))
+		return;
+
+	for (;;) {
+		struct pollfd	pfd[2];
+		nfds_t		nfds = 1;
+		ssize_t 	n;
+
+		if (0 <= p->enc_in && pos == len)
+			_pipeline_close_fd(&p->enc_in);
+
+		pfd[0].fd = p->enc_out;
+		pfd[0].events = POLLIN;
+		pfd[0].revents = 0;
+		if (0 <= p->enc_in) {
+			pfd[1].fd = p->enc_in;
+			pfd[1].events = POLLOUT;
+			pfd[1].revents = 0;
+			nfds++;
+		}
+		if (0 > poll(pfd, nfds, -1)) {
+			if (EINTR == errno)
+				continue;
+			log_syserr(ERROR, errno, "poll");
+			break;
+		}
+
+		if (pfd[0].revents) {
+			n = read(p->enc_out, buf, sizeof(buf));
+			if (0 > n) {
+				if (EINTR == errno || EAGAIN == errno)
+					continue;
+				log_syserr(ERROR, errno, "encoder");
+				break;
+			}
+			if (0 == n)
+				break;
+			_pipeline_tail_add(p, buf, (size_t)n);
+			continue;
+		}
+
+		if (1 < nfds && pfd[1].revents) {
+			n = write(p->enc_in, data + pos, len - pos);
+			if (0 > n) {
+				if (EINTR == errno || EAGAIN == errno)
+					continue;
+				log_syserr(WARNING, errno, "encoder");
+				_pipeline_close_fd(&p->enc_in);
+				continue;
+			}
+			pos += (size_t)n;
+		}
+	}
+
+	_pipeline_close_fd(&p->enc_in);
+	_pipeline_close_fd(&p->enc_out);
+	while (0 > waitpid(p->enc_pid, NULL, 0) && EINTR == errno)
+		;
+	p->enc_pid = -1;
+}
+
+static void
+_pipeline_close_encoder(struct pipeline *p, int drain)
+{
+	if (NULL == p->enc_handle)
+		return;
+
+	/* Data that was not handed out yet still precedes the tail: */
+	if (drain) {
+		if (p->data != p->out && p->data_pos < p->data_len)
+			_pipeline_tail_add(p, p->data + p->data_pos,
+			    p->data_len - p->data_pos);
+		_pipeline_drain_encoder(p);
+	}
+	p->enc->close(p->enc_handle);
+	p->enc_handle = NULL;
+	/* Encoded data belongs to the encoder, and is gone with it: */
+	if (p->data != p->out)
+		p->data_len = p->data_pos = 0;
+}
+
+static int
+_pipeline_spawn(struct pipeline *p, const char *command)
+{
+	int	in[2], out[2];
+	pid_t	pid;
+
+	if (0 > pipe(in)) {
+		log_syserr(ERROR, errno, "pipe");
+		return (-1);
+	}
+	if (0 > pipe(out)) {
+		log_syserr(ERROR, errno, "pipe");
+		close(in[0]);
+		close(in[1]);
+		return (-1);
+	}
+
+	fflush(NULL);
+	pid = fork();
+	if (0 > pid) {
+		log_syserr(ERROR, errno, "fork");
+		close(in[0]);
+		close(in[1]);
+		close(out[0]);
+		close(out[1]);
+		return (-1);
+	}
+	if (0 == pid) {
+		(void)dup2(in[0], STDIN_FILENO);
+		(void)dup2(out[1], STDOUT_FILENO);
+		close(in[0]);
+		close(in[1]);
+		close(out[0]);
+		close(out[1]);
+		if (cfg_get_program_quiet_stderr()) {
+			int	fd = open(_PATH_DEVNULL, O_RDWR, 0);
+
+			if (0 <= fd) {
+				(void)dup2(fd, STDERR_FILENO);
+				close(fd);
+			}
+		}
+		execl(_PATH_BSHELL, "sh", "-c", command, (char *)NULL);
+		_exit(127);
+	}
+
+	close(in[0]);
+	close(out[1]);
+	(void)fcntl(in[1], F_SETFD, FD_CLOEXEC);
+	(void)fcntl(out[0], F_SETFD, FD_CLOEXEC);
+	/* Feeding the encoder must never block reading from it: */
+	(void)fcntl(in[1], F_SETFL, fcntl(in[1], F_GETFL) | O_NONBLOCK);
+	p->enc_pid = pid;
+	p->enc_in = in[1];
+	p->enc_out = out[0];
+
+	return (0);
+}
+
+static void
+_pipeline_close_fd(int *fd_p)
+{
+	if (0 <= *fd_p) {
+		close(*fd_p);
+		*fd_p = -1;
+	}
+}
+
+struct pipeline *
+pipeline_create(metrics_t metrics)
+{
+	struct pipeline *p;
+
+	p = xcalloc(1UL, sizeof(*p));
+	p->metrics = metrics;
+	p->gain = 1.0f;
+	p->peak = -1.0f;
+	p->enc_pid = -1;
+	p->enc_in = -1;
+	p->enc_out = -1;
+
+	return (p);
+}
+
+void
+pipeline_destroy(struct pipeline **p_p)
+{
+	struct pipeline *p = *p_p;
+
+	if (!p)
+		return;
+
+	pipeline_stop(p);
+	_pipeline_close_encoder(p, 0);
+	limiter_destroy(&p->limiter);
+	xfree(p->filename);
+	xfree(p->enc_cmd);
+	xfree(p->tail);
+	xfree(p->hold);
+	xfree(p->trim);
+	xfree(p->fade_in);
+	xfree(p->fade_out);
+	xfree(p->pcm);
+	xfree(p->out);
+	xfree(p);
+	*p_p = NULL;
+}
+
+int
+pipeline_set_encoder(struct pipeline *p, const char *plugin)
+{
+	const struct ezstream_encoder_plugin	*enc = NULL;
+
+	if (plugin && NULL == (enc = plugin_get_encoder(plugin)))
+		return (-1);
+	if (enc != p->enc) {
+		_pipeline_close_encoder(p, 1);
+		p->enc = enc;
+	}
+
+	return (0);
+}
+
+void
+pipeline_restart_encoder(struct pipeline *p)
+{
+	_pipeline_close_encoder(p, 1);
+}
+
+void
+pipeline_drain(struct pipeline *p)
+{
+	if (!p->running)
+		_pipeline_flush(p);
+	_pipeline_close_encoder(p, 1);
+}
+
+void
+pipeline_set_crossfade(struct pipeline *p, unsigned int msecs,
+    enum cfg_stream_fade curve)
+{
+	p->xfade_ms = msecs;
+	p->xfade_curve = curve;
+}
+
+void
+pipeline_set_gain(struct pipeline *p, float gain_db, int limit)
+{
+	p->gain = powf(10.0f, gain_db / 20.0f);
+	p->limit = limit;
+}
+
+void
+pipeline_set_peak(struct pipeline *p, float peak)
+{
+	p->peak = peak;
+}
+
+void
+pipeline_set_silence(struct pipeline *p, int level_db)
+{
+	p->trim_level = level_db ? powf(10.0f, (float)level_db / 20.0f) :
+	    0.0f;
+}
+
+void
+pipeline_set_bounds(struct pipeline *p, unsigned long start_ms,
+    unsigned long end_ms)
+{
+	p->bound_start = start_ms;
+	p->bound_end = end_ms;
+}
+
+int
+pipeline_start(struct pipeline *p, cfg_decoder_t decoder,
+    const char *filename, const char *encoder_cmd)
+{
+	size_t	samples;
+
+	pipeline_stop(p);
+
+	p->dec = plugin_get_decoder(cfg_decoder_get_plugin(decoder));
+	if (NULL == p->dec)
+		return (-1);
+	memset(&p->fmt, 0, sizeof(p->fmt));
+	p->dec_handle = p->dec->open(filename, &p->fmt);
+	if (NULL == p->dec_handle) {
+		log_error("%s: %s: cannot decode", filename, p->dec->name);
+		return (-1);
+	}
+	if (0 == p->fmt.rate || 0 == p->fmt.channels) {
+		log_error("%s: %s: invalid audio format", filename,
+		    p->dec->name);
+		p->dec->close(p->dec_handle);
+		p->dec_handle = NULL;
+		return (-1);
+	}
+
+	samples = PIPELINE_FRAMES * (size_t)p->fmt.channels;
+	if (p->pcm_size < samples) {
+		p->pcm = xreallocarray(p->pcm, samples, sizeof(*p->pcm));
+		p->pcm_size = samples;
+		p->out = xreallocarray(p->out, samples, PCM_S16_SIZE);
+		p->out_size = samples * PCM_S16_SIZE;
+	}
+	p->data = NULL;
+	p->data_len = p->data_pos = 0;
+	p->dec_eof = 0;
+	p->dec_seconds = 0.0;
+	p->dec_frames = 0;
+	xfree(p->filename);
+	p->filename = xstrdup(filename);
+	p->running = 1;
+
+	if (p->enc_handle &&
+	    (p->fmt.rate != p->enc_fmt.rate ||
+	     p->fmt.channels != p->enc_fmt.channels)) {
+		log_notice("%s: audio format changed: restarting encoder",
+		    filename);
+		_pipeline_close_encoder(p, 1);
+	}
+
+	_pipeline_fade_prepare(p);
+
+	p->trim_lead = p->trim_level > 0.0f;
+	p->trim_eof = 0;
+	p->trim_start = p->trim_len = p->trim_silent = 0;
+	p->trim_lead_frames = 0;
+	p->skip_frames = p->end_frames = 0;
+	if (p->trim_level > 0.0f) {
+		p->trim_max = PIPELINE_TRIM_MAX * (size_t)p->fmt.rate;
+		if (p->bound_end > p->bound_start) {
+			/* Round outwards, the bounds are whole milliseconds: */
+			p->skip_frames = (unsigned long long)p->bound_start *
+			    p->fmt.rate / 1000;
+			p->end_frames = ((unsigned long long)p->bound_end + 1) *
+			    p->fmt.rate / 1000;
+			log_debug("%s: audio from %.1f to %.1f seconds",
+			    filename, (double)p->bound_start / 1000.0,
+			    (double)p->bound_end / 1000.0);
+		}
+		/* Held back silence, up to two blocks to pass on, and one more: */
+		samples = (p->trim_max + 3 * PIPELINE_FRAMES) * p->fmt.channels;
+		if (p->trim_size < samples) {
+			p->trim = xreallocarray(p->trim, samples,
+			    sizeof(*p->trim));
+			p->trim_size = samples;
+		}
+	}
+
+	if (!p->limit) {
+		limiter_destroy(&p->limiter);
+	} else if (NULL == p->limiter ||
+	    p->fmt.rate != p->lim_fmt.rate ||
+	    p->fmt.channels != p->lim_fmt.channels) {
+		limiter_destroy(&p->limiter);
+		p->limiter = limiter_create(p->fmt.rate, p->fmt.channels,
+		    PIPELINE_CEILING);
+		p->lim_fmt = p->fmt;
+	}
+	/* A crossfade mixes two tracks, whose sum may still be too loud: */
+	p->lim_bypass = p->limiter && 0 == p->xfade_frames &&
+	    0.0f <= p->peak && p->peak * p->gain <= PIPELINE_CEILING;
+
+	xfree(p->enc_cmd);
+	p->enc_cmd = encoder_cmd ? xstrdup(encoder_cmd) : NULL;
+	if (encoder_cmd && 0 > _pipeline_spawn(p, encoder_cmd)) {
+		pipeline_stop(p);
+		return (-1);
+	}
+
+	log_debug("%s: decoding with %s: %u Hz, %u channel(s)", filename,
+	    p->dec->name, p->fmt.rate, p->fmt.channels);
+	if (1.0f != p->gain)
+		log_debug("%s: normalizing loudness: %+.2f dB", filename,
+		    20.0 * log10(p->gain));
+	if (p->lim_bypass)
+		log_debug("%s: true peak below the ceiling: not limiting",
+		    filename);
+
+	return (0);
+}
+
+ssize_t
+pipeline_read(struct pipeline *p, void *buf, size_t size)
+{
+	if (p->tail_pos < p->tail_len && 0 < size) {
+		size_t	len = p->tail_len - p->tail_pos;
+
+		if (len > size)
+			len = size;
+		memcpy(buf, p->tail + p->tail_pos, len);
+		p->tail_pos += len;
+		if (p->tail_pos == p->tail_len)
+			p->tail_len = p->tail_pos = 0;
+		return ((ssize_t)len);
+	}
+	if (!p->running || 0 == size)
+		return (0);
+
+	/* Without an encoder, hand out the audio itself: */
+	if (0 > p->enc_out) {
+		size_t	len;
+
+		if (p->data_pos == p->data_len && 0 == _pipeline_decode(p))
+			return (0);
+		len = p->data_len - p->data_pos;
+		if (len > size)
+			len = size;
+		memcpy(buf, p->data + p->data_pos, len);
+		p->data_pos += len;
+		return ((ssize_t)len);
+	}
+
+	for (;;) {
+		struct pollfd	pfd[2];
+		nfds_t		nfds = 1;
+		ssize_t 	n;
+
+		/* Keep the encoder fed, and signal the end of the audio: */
+		if (0 <= p->enc_in && p->data_pos == p->data_len &&
+		    0 == _pipeline_decode(p))
+			_pipeline_close_fd(&p->enc_in);
+
+		pfd[0].fd = p->enc_out;
+		pfd[0].events = POLLIN;
+		pfd[0].revents = 0;
+		if (0 <= p->enc_in) {
+			pfd[1].fd = p->enc_in;
+			pfd[1].events = POLLOUT;
+			pfd[1].revents = 0;
+			nfds++;
+		}
+		if (0 > poll(pfd, nfds, -1)) {
+			if (EINTR == errno)
+				continue;
+			log_syserr(ERROR, errno, "poll");
+			return (-1);
+		}
+
+		if (pfd[0].revents) {
+			n = read(p->enc_out, buf, size);
+			if (0 > n) {
+				if (EINTR == errno || EAGAIN == errno)
+					continue;
+				log_syserr(ERROR, errno, p->filename);
+				return (-1);
+			}
+			/* The encoder is done when its output ends: */
+			return (n);
+		}
+
+		if (1 < nfds && pfd[1].revents) {
+			n = write(p->enc_in, p->data + p->data_pos,
+			    p->data_len - p->data_pos);
+			if (0 > n) {
+				if (EINTR == errno || EAGAIN == errno)
+					continue;
+				/* Let the encoder finish, whatever happened: */
+				log_syserr(WARNING, errno, "encoder");
+				_pipeline_close_fd(&p->enc_in);
+				continue;
+			}
+			p->data_pos += (size_t)n;
+		}
+	}
+}
+
+void
+pipeline_stop(struct pipeline *p)
+{
+	if (!p->running)
+		return;
+
+	if (p->dec_frames)
+		log_debug("%s: decoded %.1f seconds of audio in %.3f seconds",
+		    p->filename, (double)p->dec_frames / (double)p->fmt.rate,
+		    p->dec_seconds);
+	if (p->dec_handle) {
+		p->dec->close(p->dec_handle);
+		p->dec_handle = NULL;
+	}
+	_pipeline_fade_finish(p);
+
+	_pipeline_close_fd(&p->enc_in);
+	_pipeline_close_fd(&p->enc_out);
+	if (0 < p->enc_pid) {
+		int	status;
+
+		/* An encoder that is cut short may not notice right away: */
+		if (!p->dec_eof)
+			(void)kill(p->enc_pid, SIGTERM);
+		while (0 > waitpid(p->enc_pid, &status, 0) && EINTR == errno)
+			;
+		p->enc_pid = -1;
+	}
+
+	p->running = 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2026 Moritz Grimm <mgrimm@mrsserver.net>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include <sys/types.h>
+
+#include "cfg.h"
+#include "metrics.h"
+
+/*
+ * A pipeline decodes tracks in-process with a decoder plugin, and feeds the
+ * audio to the stream's encoder program, or to an encoder plugin that
+ * persists across tracks. Without an encoder, the audio itself is the
+ * output. With a crossfade, the end of each track is held back and mixed
+ * with the beginning of the next. Loudness normalization applies a gain to
+ * each track, and keeps the output below -1 dBTP with a limiter.
+ */
+typedef struct pipeline *	pipeline_t;
+
+pipeline_t
+	pipeline_create(metrics_t);
+void	pipeline_destroy(pipeline_t *);
+
+int	pipeline_set_encoder(pipeline_t, const char *);
+/*
+ * Both end the encoded stream, whose final output is read first after
+ * that. A restarted encoder starts a new stream with the next track, and
+ * draining is meant for the end of streaming, when the final output can
+ * still be read after pipeline_stop(). Draining then also plays out the
+ * audio that is held back for a crossfade or in the limiter.
+ */
+void	pipeline_restart_encoder(pipeline_t);
+void	pipeline_drain(pipeline_t);
+void	pipeline_set_crossfade(pipeline_t, unsigned int, enum cfg_stream_fade);
+void	pipeline_set_gain(pipeline_t, float, int);
+/*
+ * Sets the true peak of the next track before the gain, or a negative one
+ * if it is unknown. Tracks that the gain keeps below the ceiling are not
+ * limited, unless they are crossfaded.
+ */
+void	pipeline_set_peak(pipeline_t, float);
+/*
+ * Skips leading silence below the given level in dBFS, and ends tracks at
+ * their trailing silence. A level of 0 disables trimming.
+ */
+void	pipeline_set_silence(pipeline_t, int);
+/*
+ * Sets where the audio of the next track begins and ends, in milliseconds,
+ * as measured at or below the trimming level, or an end of 0 if that is
+ * unknown. Trimming skips what lies outside without scanning it, and stops
+ * decoding at the end.
+ */
+void	pipeline_set_bounds(pipeline_t, unsigned long, unsigned long);
+
+int	pipeline_start(pipeline_t, cfg_decoder_t, const char *, const char *);
+ssize_t pipeline_read(pipeline_t, void *, size_t);
+void	pipeline_stop(pipeline_t);
+
+#endif /* __PIPELINE_H__ */
@@ -352,6 +352,16 @@ playlist_get_position(struct playlist *pl)
 	return ((unsigned long)pl->index);
 }
 
+const char *
+playlist_peek(struct playlist *pl, unsigned long offset)
+{
+	if (pl->program || pl->index >= pl->num ||
+	    offset >= pl->num - pl->index)
+		return (NULL);
+
+	return ((const char *)pl->list[pl->index + offset]);
+}
+
 int
 playlist_goto_entry(struct playlist *pl, const char *entry)
 {
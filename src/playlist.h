@@ -75,6 +75,13 @@ unsigned long	playlist_get_num_items(playlist_t);
  */
 unsigned long	playlist_get_position(playlist_t);
 
+/*
+ * Look at the entry that playlist_get_next() would return after skipping
+ * offset entries, without changing the current position. Returns NULL past
+ * the end of the playlist.
+ */
+const char *	playlist_peek(playlist_t, unsigned long /* offset */);
+
 /*
  * Search for a given entry in the playlist and reposition to it. Returns 1 on
  * success and 0 on failure. A subsequent call to playlist_get_next() will
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2026 Moritz Grimm <mgrimm@mrsserver.net>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <sys/queue.h>
+
+#ifdef HAVE_DLOPEN
+# include <dlfcn.h>
+#endif /* HAVE_DLOPEN */
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif /* HAVE_PTHREAD */
+#include <string.h>
+
+#include "log.h"
+#include "plugin.h"
+#include "xalloc.h"
+
+/*
+ * Plugins stay loaded until plugin_exit(), so that the code and data they
+ * hand out remain valid across configuration reloads.
+ */
+struct plugin {
+	TAILQ_ENTRY(plugin)	 entry;
+	char			*path;
+	void			*handle;
+	const struct ezstream_decoder_plugin *
+				 decoder;
+	const struct ezstream_encoder_plugin *
+				 encoder;
+};
+TAILQ_HEAD(plugin_list, plugin);
+
+static struct plugin_list	plugins = TAILQ_HEAD_INITIALIZER(plugins);
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t		plugins_mtx = PTHREAD_MUTEX_INITIALIZER;
+# define PLUGIN_LOCK()		pthread_mutex_lock(&plugins_mtx)
+# define PLUGIN_UNLOCK()	pthread_mutex_unlock(&plugins_mtx)
+#else
+# define PLUGIN_LOCK()		do { } while (0)
+# define PLUGIN_UNLOCK()	do { } while (0)
+#endif /* HAVE_PTHREAD */
+
+static struct plugin *
+		_plugin_load(const char *);
+static struct plugin *
+		_plugin_load_locked(const char *);
+
+/*
+ * The analysis workers look up plugins as well; entries are never modified
+ * after insertion, so only the list itself needs the lock.
+ */
+static struct plugin *
+_plugin_load(const char *path)
+{
+	struct plugin	*p;
+
+	PLUGIN_LOCK();
+	p = _plugin_load_locked(path);
+	PLUGIN_UNLOCK();
+
+	return (p);
+}
+
+static struct plugin *
+_plugin_load_locked(const char *path)
+{
+	struct plugin	*p;
+
+	TAILQ_FOREACH(p, &plugins, entry) {
+		if (0 == strcmp(p->path, path))
+			return (p);
+	}
+
+#ifdef HAVE_DLOPEN
+	{
+		void	*handle;
+
+		handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+		if (NULL == handle) {
+			log_error("plugin: %s", dlerror());
+			return (NULL);
+		}
+		p = xcalloc(1UL, sizeof(*p));
+		p->path = xstrdup(path);
+		p->handle = handle;
+		p->decoder = (const struct ezstream_decoder_plugin *)
+		    dlsym(handle, EZSTREAM_DECODER_PLUGIN_SYMBOL);
+		p->encoder = (const struct ezstream_encoder_plugin *)
+		    dlsym(handle, EZSTREAM_ENCODER_PLUGIN_SYMBOL);
+		TAILQ_INSERT_TAIL(&plugins, p, entry);
+	}
+
+	return (p);
+#else /* HAVE_DLOPEN */
+	log_error("plugin: %s: not supported on this platform", path);
+	return (NULL);
+#endif /* HAVE_DLOPEN */
+}
+
+void
+plugin_exit(void)
+{
+	struct plugin	*p;
+
+	PLUGIN_LOCK();
+	while (NULL != (p = TAILQ_FIRST(&plugins))) {
+		TAILQ_REMOVE(&plugins, p, entry);
+#ifdef HAVE_DLOPEN
+		(void)dlclose(p->handle);
+#endif /* HAVE_DLOPEN */
+		xfree(p->path);
+		xfree(p);
+	}
+	PLUGIN_UNLOCK();
+}
+
+const struct ezstream_decoder_plugin *
+plugin_get_decoder(const char *path)
+{
+	struct plugin	*p;
+
+	if (NULL == path) {
+		log_error("plugin: no decoder plugin configured");
+		return (NULL);
+	}
+	if (NULL == (p = _plugin_load(path)))
+		return (NULL);
+	if (NULL == p->decoder) {
+		log_error("plugin: %s: not a decoder plugin", path);
+		return (NULL);
+	}
+	if (EZSTREAM_PLUGIN_ABI_VERSION != p->decoder->abi_version ||
+	    !p->decoder->open || !p->decoder->decode || !p->decoder->close) {
+		log_error("plugin: %s: incompatible decoder plugin (ABI version %u)",
+		    path, p->decoder->abi_version);
+		return (NULL);
+	}
+
+	return (p->decoder);
+}
+
+const struct ezstream_encoder_plugin *
+plugin_get_encoder(const char *path)
+{
+	struct plugin	*p;
+
+	if (NULL == path) {
+		log_error("plugin: no encoder plugin configured");
+		return (NULL);
+	}
+	if (NULL == (p = _plugin_load(path)))
+		return (NULL);
+	if (NULL == p->encoder) {
+		log_error("plugin: %s: not an encoder plugin", path);
+		return (NULL);
+	}
+	if (EZSTREAM_PLUGIN_ABI_VERSION != p->encoder->abi_version ||
+	    !p->encoder->open || !p->encoder->encode || !p->encoder->close) {
+		log_error("plugin: %s: incompatible encoder plugin (ABI version %u)",
+		    path, p->encoder->abi_version);
+		return (NULL);
+	}
+
+	return (p->encoder);
+}
@@ -0,0 +1,454 @@
+/*
+ * Copyright (c) 2026 Moritz Grimm <mgrimm@mrsserver.net>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "compat.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "sock.h"
+#include "xalloc.h"
+
+#define SOCK_MAX_CLIENTS	16
+#define SOCK_INBUF_SIZE 	4096
+#define SOCK_DEFAULT_HOST	"127.0.0.1"
+
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL		0
+#endif /* !MSG_NOSIGNAL */
+
+struct sock_client {
+	int	 fd;
+	int	 closing;
+	char	 in[SOCK_INBUF_SIZE];
+	size_t	 in_len;
+	char	*out;
+	size_t	 out_len;
+	size_t	 out_size;
+	size_t	 out_off;
+};
+
+struct sock_listener {
+	char			*address;
+	char			*unix_path;
+	char			*eor;
+	size_t			 eor_len;
+	int			 fd;
+	sock_handler_t		 handler;
+	void			*handler_arg;
+	struct sock_client	*clients[SOCK_MAX_CLIENTS];
+};
+
+static int	_sock_nonblock(int);
+static int	_sock_listen_unix(struct sock_listener *, const char *);
+static int	_sock_listen_inet(struct sock_listener *, const char *);
+static void	_sock_accept(struct sock_listener *);
+static void	_sock_client_free(struct sock_client **);
+static int	_sock_client_read(struct sock_listener *, struct sock_client *);
+static int	_sock_client_flush(struct sock_client *);
+
+static int
+_sock_nonblock(int fd)
+{
+	int	flags;
+
+	if (0 > (flags = fcntl(fd, F_GETFL, 0)) ||
+	    0 > fcntl(fd, F_SETFL, flags | O_NONBLOCK) ||
+	    0 > fcntl(fd, F_SETFD, FD_CLOEXEC))
+		return (-1);
+	return (0);
+}
+
+static int
+_sock_listen_unix(struct sock_listener *l, const char *path)
+{
+	struct sockaddr_un	sun;
+	struct stat		sb;
+	int			fd, ret;
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	if (sizeof(sun.sun_path) <=
+	    strlcpy(sun.sun_path, path, sizeof(sun.sun_path))) {
+		log_error("%s: socket path too long", path);
+		return (-1);
+	}
+
+	if (0 > (l->fd = socket(AF_UNIX, SOCK_STREAM, 0))) {
+		log_syserr(ERROR, errno, "socket");
+		return (-1);
+	}
+	/*
+	 * Remove a stale socket left behind by a previous instance, which
+	 * nobody accepts connections on anymore:
+	 */
+	if (0 == lstat(path, &sb)) {
+		if (!S_ISSOCK(sb.st_mode)) {
+			log_error("%s: exists and is not a socket", path);
+			return (-1);
+		}
+		if (0 > (fd = socket(AF_UNIX, SOCK_STREAM, 0))) {
+			log_syserr(ERROR, errno, "socket");
+			return (-1);
+		}
+		ret = connect(fd, (struct sockaddr *)&sun, sizeof(sun));
+		if (0 > ret)
+			ret = errno;
+		close(fd);
+		if (0 == ret) {
+			log_error("%s: control socket in use", path);
+			return (-1);
+		}
+		if (ECONNREFUSED != ret && ENOENT != ret) {
+			log_syserr(ERROR, ret, path);
+			return (-1);
+		}
+		(void)unlink(path);
+	}
+	if (0 > bind(l->fd, (struct sockaddr *)&sun, sizeof(sun))) {
+		log_syserr(ERROR, errno, path);
+		return (-1);
+	}
+	l->unix_path = xstrdup(path);
+
+	return (0);
+}
+
+static int
+_sock_listen_inet(struct sock_listener *l, const char *address)
+{
+	struct addrinfo  hints, *res, *ai;
+	const char	*p;
+	char		*host, *port;
+	int		 error, on = 1;
+
+	/*
+	 * Accepted forms are "port", "host:port" and "[v6-address]:port".
+	 * Without a host, only the loopback interface is used.
+	 */
+	if (NULL == (p = strrchr(address, ':'))) {
+		host = xstrdup(SOCK_DEFAULT_HOST);
+		port = xstrdup(address);
+	} else {
+		host = xstrdup(address);
+		host[p - address] = '\0';
+		port = xstrdup(p + 1);
+		if ('[' == host[0] && ']' == host[strlen(host) - 1]) {
+			host[strlen(host) - 1] = '\0';
+			memmove(host, host + 1, strlen(host));
+		}
+		if ('\0' == host[0]) {
+			xfree(host);
+			host = xstrdup(SOCK_DEFAULT_HOST);
+		}
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+	if (0 != (error = getaddrinfo(host, port, &hints, &res))) {
+		log_error("%s: %s", address, gai_strerror(error));
+		xfree(host);
+		xfree(port);
+		return (-1);
+	}
+	xfree(host);
+	xfree(port);
+
+	error = 0;
+	for (ai = res; ai; ai = ai->ai_next) {
+		if (0 > (l->fd = socket(ai->ai_family, ai->ai_socktype,
+		    ai->ai_protocol))) {
+			error = errno;
+			continue;
+		}
+		(void)setsockopt(l->fd, SOL_SOCKET, SO_REUSEADDR, &on,
+		    sizeof(on));
+		if (0 == bind(l->fd, ai->ai_addr, ai->ai_addrlen))
+			break;
+		error = errno;
+		close(l->fd);
+		l->fd = -1;
+	}
+	freeaddrinfo(res);
+	if (0 > l->fd) {
+		log_syserr(ERROR, error, address);
+		return (-1);
+	}
+
+	return (0);
+}
+
+static void
+_sock_accept(struct sock_listener *l)
+{
+	struct sock_client	*c;
+	unsigned int		 i;
+	int			 fd;
+
+	while (0 <= (fd = accept(l->fd, NULL, NULL))) {
+		for (i = 0; i < SOCK_MAX_CLIENTS; i++) {
+			if (NULL == l->clients[i])
+				break;
+		}
+		if (SOCK_MAX_CLIENTS <= i || 0 > _sock_nonblock(fd)) {
+			log_warning("%s: rejecting connection: %s",
+			    l->address, SOCK_MAX_CLIENTS <= i ?
+				"too many clients" : strerror(errno));
+			close(fd);
+			continue;
+		}
+		c = xcalloc(1UL, sizeof(*c));
+		c->fd = fd;
+		l->clients[i] = c;
+	}
+	if (EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno)
+		log_syserr(WARNING, errno, "accept");
+}
+
+static void
+_sock_client_free(struct sock_client **c_p)
+{
+	struct sock_client	*c = *c_p;
+
+	close(c->fd);
+	if (c->out)
+		xfree(c->out);
+	xfree(c);
+	*c_p = NULL;
+}
+
+static int
+_sock_client_read(struct sock_listener *l, struct sock_client *c)
+{
+	ssize_t  n;
+	char	*eor;
+
+	n = read(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len - 1);
+	if (0 > n)
+		return (EAGAIN == errno || EINTR == errno ? 0 : -1);
+	if (0 == n) {
+		/* Peer is done sending; answer what's left, then close. */
+		c->closing = 1;
+		return (0);
+	}
+	c->in_len += (size_t)n;
+	c->in[c->in_len] = '\0';
+
+	while (!c->closing && NULL != (eor = strstr(c->in, l->eor))) {
+		size_t	consumed;
+
+		*eor = '\0';
+		consumed = (size_t)(eor - c->in) + l->eor_len;
+		if (eor > c->in && '\r' == eor[-1])
+			eor[-1] = '\0';
+		if (SOCK_CLOSE == l->handler(c, c->in, l->handler_arg))
+			c->closing = 1;
+		memmove(c->in, c->in + consumed, c->in_len - consumed + 1);
+		c->in_len -= consumed;
+	}
+	if (c->in_len >= sizeof(c->in) - 1) {
+		log_warning("%s: request too long", l->address);
+		return (-1);
+	}
+
+	return (0);
+}
+
+static int
+_sock_client_flush(struct sock_client *c)
+{
+	ssize_t n;
+
+	while (c->out_off < c->out_len) {
+		n = send(c->fd, c->out + c->out_off, c->out_len - c->out_off,
+		    MSG_NOSIGNAL);
+		if (0 > n)
+			return (EAGAIN == errno || EINTR == errno ? 0 : -1);
+		c->out_off += (size_t)n;
+	}
+	c->out_off = c->out_len = 0;
+
+	return (0);
+}
+
+sock_listener_t
+sock_listen(const char *address, const char *eor, sock_handler_t handler,
+    void *handler_arg)
+{
+	struct sock_listener	*l;
+	int			 ret;
+
+	l = xcalloc(1UL, sizeof(*l));
+	l->address = xstrdup(address);
+	l->eor = xstrdup(eor);
+	l->eor_len = strlen(eor);
+	l->fd = -1;
+	l->handler = handler;
+	l->handler_arg = handler_arg;
+
+	if ('/' == address[0])
+		ret = _sock_listen_unix(l, address);
+	else
+		ret = _sock_listen_inet(l, address);
+	if (0 > ret ||
+	    0 > _sock_nonblock(l->fd) ||
+	    0 > listen(l->fd, SOCK_MAX_CLIENTS)) {
+		if (0 == ret)
+			log_syserr(ERROR, errno, address);
+		sock_close(&l);
+		return (NULL);
+	}
+
+	return (l);
+}
+
+void
+sock_close(struct sock_listener **l_p)
+{
+	struct sock_listener	*l = *l_p;
+	unsigned int		 i;
+
+	if (NULL == l)
+		return;
+
+	for (i = 0; i < SOCK_MAX_CLIENTS; i++) {
+		if (l->clients[i])
+			_sock_client_free(&l->clients[i]);
+	}
+	if (0 <= l->fd)
+		close(l->fd);
+	if (l->unix_path) {
+		(void)unlink(l->unix_path);
+		xfree(l->unix_path);
+	}
+	xfree(l->eor);
+	xfree(l->address);
+	xfree(l);
+	*l_p = NULL;
+}
+
+const char *
+sock_get_address(struct sock_listener *l)
+{
+	return (l->address);
+}
+
+void
+sock_poll(struct sock_listener *l)
+{
+	struct pollfd	 pfd[SOCK_MAX_CLIENTS + 1];
+	unsigned int	 idx[SOCK_MAX_CLIENTS + 1];
+	unsigned int	 i, n, nfds;
+
+	if (NULL == l)
+		return;
+
+	pfd[0].fd = l->fd;
+	pfd[0].events = POLLIN;
+	pfd[0].revents = 0;
+	for (i = 0, nfds = 1; i < SOCK_MAX_CLIENTS; i++) {
+		if (NULL == l->clients[i])
+			continue;
+		pfd[nfds].fd = l->clients[i]->fd;
+		pfd[nfds].events = l->clients[i]->out_len ? POLLOUT : POLLIN;
+		pfd[nfds].revents = 0;
+		idx[nfds] = i;
+		nfds++;
+	}
+	if (0 >= poll(pfd, nfds, 0))
+		return;
+
+	for (n = 1; n < nfds; n++) {
+		struct sock_client	*c = l->clients[idx[n]];
+		int			 error = 0;
+
+		if (0 == pfd[n].revents)
+			continue;
+		if (pfd[n].revents & POLLNVAL)
+			error = 1;
+		else if (pfd[n].revents & POLLOUT)
+			error = _sock_client_flush(c);
+		else if (pfd[n].revents & (POLLIN | POLLHUP | POLLERR))
+			error = _sock_client_read(l, c);
+		if (0 == error && 0 < c->out_len)
+			error = _sock_client_flush(c);
+
+		if (error || (c->closing && 0 == c->out_len))
+			_sock_client_free(&l->clients[idx[n]]);
+	}
+
+	if (pfd[0].revents & POLLIN)
+		_sock_accept(l);
+}
+
+void
+sock_client_write(struct sock_client *c, const char *data, size_t len)
+{
+	if (c->out_len + len > c->out_size) {
+		size_t	size = c->out_size ? c->out_size : BUFSIZ;
+
+		while (size < c->out_len + len)
+			size *= 2;
+		c->out = xreallocarray(c->out, size, sizeof(char));
+		c->out_size = size;
+	}
+	memcpy(c->out + c->out_len, data, len);
+	c->out_len += len;
+}
+
+void
+sock_client_printf(struct sock_client *c, const char *fmt, ...)
+{
+	va_list ap;
+	char	buf[BUFSIZ];
+	int	len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	if (0 > len)
+		return;
+	if ((size_t)len >= sizeof(buf)) {
+		char	*p = xmalloc((size_t)len + 1);
+
+		va_start(ap, fmt);
+		(void)vsnprintf(p, (size_t)len + 1, fmt, ap);
+		va_end(ap);
+		sock_client_write(c, p, (size_t)len);
+		xfree(p);
+		return;
+	}
+	sock_client_write(c, buf, (size_t)len);
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2026 Moritz Grimm <mgrimm@mrsserver.net>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SOCK_H__
+#define __SOCK_H__
+
+#include <stddef.h>
+
+#include "attributes.h"
+
+/*
+ * Minimal non-blocking, request/response style listening sockets. Nothing
+ * in here ever blocks: sock_poll() is meant to be called from the
+ * streaming loop, accepts pending connections, reads what is available
+ * and hands complete requests (terminated by the configured end-of-request
+ * marker) to a handler.
+ */
+
+#define SOCK_KEEP	0
+#define SOCK_CLOSE	1
+
+typedef struct sock_listener *	sock_listener_t;
+typedef struct sock_client *	sock_client_t;
+
+/* Returns SOCK_KEEP or SOCK_CLOSE */
+typedef int (*sock_handler_t)(sock_client_t, const char *, void *);
+
+sock_listener_t
+	sock_listen(const char *, const char *, sock_handler_t, void *);
+void	sock_close(sock_listener_t *);
+const char *
+	sock_get_address(sock_listener_t);
+
+void	sock_poll(sock_listener_t);
+
+void	sock_client_write(sock_client_t, const char *, size_t);
+void	sock_client_printf(sock_client_t, const char *, ...)
+    ATTRIBUTE_NONNULL(2)
+    ATTRIBUTE_FORMAT(printf, 2, 3);
+
+#endif /* __SOCK_H__ */
@@ -19,30 +19,281 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <shout/shout.h>
 
+#include "archive.h"
 #include "cfg.h"
 #include "log.h"
 #include "mdata.h"
+#include "metrics.h"
 #include "stream.h"
 #include "util.h"
 #include "xalloc.h"
 
+#define STREAM_FNV_BASIS	0xcbf29ce484222325ULL
+#define STREAM_FNV_PRIME	0x100000001b3ULL
+
+#define STREAM_OGG_HEADER	27
+#define STREAM_OGG_HEADER_MAX	(STREAM_OGG_HEADER + 255)
+#define STREAM_OGG_CONTINUED	0x01
+#define STREAM_OGG_BOS		0x02
+#define STREAM_OGG_NO_GRANULE	UINT64_MAX
+#define STREAM_OGG_IDENT	80
+#define STREAM_OGG_STREAMS	8
+
+/*
+ * The header packets of a logical stream in an Ogg chain, as many as its
+ * codec has, or only the first one for unknown codecs:
+ */
+struct stream_ogg_stream {
+	uint32_t	 serial;
+	unsigned long	 headers;
+	unsigned long	 packets;
+};
+
+/*
+ * Position in an Ogg stream, tracked across the data passing through
+ * stream_send() without copying it. Only page headers and the beginning of
+ * each BOS page are kept, to identify the codec and its sample rate, except
+ * for the header pages of the current chain, which are kept as the stream
+ * header.
+ */
+struct stream_ogg {
+	int		 enabled;
+	int		 synced;
+	size_t		 hdr_len;
+	size_t		 hdr_size;
+	size_t		 body_len;
+	size_t		 body_pos;
+	unsigned char	 page[STREAM_OGG_HEADER_MAX];
+	unsigned int	 flags;
+	uint64_t	 granule;
+	uint32_t	 serial;
+	unsigned char	 ident[STREAM_OGG_IDENT];
+	size_t		 ident_len;
+	/* The first audio stream of the current chain: */
+	int		 in_bos;
+	int		 have_track;
+	uint32_t	 track_serial;
+	unsigned long	 rate;
+	uint64_t	 preskip;
+	uint64_t	 pos;
+	uint64_t	 bytes;
+	uint64_t	 mark_pos;
+	uint64_t	 mark_bytes;
+	int		 capture;
+	int		 have_header;
+	struct stream_ogg_stream
+			 streams[STREAM_OGG_STREAMS];
+	size_t		 num_streams;
+};
+
+#define STREAM_MP3_INFO 	192
+
+#define STREAM_HEADER_MAX	(1024 * 1024)
+#define STREAM_RESUME_MAX	(4 * 1024 * 1024)
+
+/*
+ * Position in an MP3 stream, tracked frame by frame across the data passing
+ * through stream_send(). Tags are skipped, and the beginning of the first
+ * frame of a track is kept to look for a Xing, Info or VBRI header.
+ */
+struct stream_mp3 {
+	int		 enabled;
+	int		 synced;
+	/*
+	 * Sync is only assumed once a frame header follows a frame with
+	 * the same version, layer and sample rate. Until then, the samples
+	 * of the first frame are pending.
+	 */
+	int		 candidate;
+	unsigned int	 fixed;
+	int		 pending;
+	unsigned char	 hdr[10];
+	size_t		 hdr_len;
+	size_t		 skip;
+	size_t		 frame_len;
+	size_t		 frame_pos;
+	unsigned long	 frame_rate;
+	unsigned int	 frame_samples;
+	size_t		 info_off;
+	int		 probe;
+	unsigned char	 info[STREAM_MP3_INFO];
+	size_t		 info_len;
+	unsigned long	 rate;
+	uint64_t	 samples;
+	uint64_t	 bytes;
+	uint64_t	 mark_samples;
+	uint64_t	 mark_bytes;
+	int		 have_length;
+	uint64_t	 length;
+};
+
+#define STREAM_EBML_ID_EBML	0x1a45dfa3UL
+#define STREAM_EBML_ID_SEGMENT	0x18538067UL
+#define STREAM_EBML_ID_INFO	0x1549a966UL
+#define STREAM_EBML_ID_TRACKS	0x1654ae6bUL
+#define STREAM_EBML_ID_CLUSTER	0x1f43b675UL
+
+/*
+ * Element structure of a WebM or Matroska stream, followed across the data
+ * passing through stream_send(). Only the Segment and Cluster master
+ * elements are descended into, and all other element bodies are skipped.
+ * The EBML header, Segment header, Segment Information and Tracks, which a
+ * new connection needs ahead of any Cluster, are kept as the stream header.
+ */
+struct stream_ebml {
+	int		 enabled;
+	int		 synced;
+	unsigned char	 hdr[12];
+	size_t		 hdr_len;
+	uint64_t	 body_left;
+	int		 capture;
+	int		 have_header;
+};
+
+/* Bit rates in kbit/s, by MPEG version and layer: */
+static const unsigned short stream_mp3_bitrates[5][15] = {
+	{ 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+	{ 0, 32, 48, 56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 384 },
+	{ 0, 32, 40, 48,  56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320 },
+	{ 0, 32, 48, 56,  64,  80,  96, 112, 128, 144, 160, 176, 192, 224, 256 },
+	{ 0,  8, 16, 24,  32,  40,  48,  56,  64,  80,  96, 112, 128, 144, 160 }
+};
+
+/* Sample rates by MPEG version 2.5, (reserved,) 2 and 1: */
+static const unsigned short stream_mp3_rates[4][3] = {
+	{ 11025, 12000,  8000 },
+	{     0,     0,     0 },
+	{ 22050, 24000, 16000 },
+	{ 44100, 48000, 32000 }
+};
+
 struct stream {
-	char	*name;
-	shout_t *shout;
+	char			*name;
+	shout_t 		*shout;
+	metrics_t		 metrics;
+	/*
+	 * Metadata updates reuse the same libshout metadata objects and
+	 * formatting buffer, so that a refresh needs no allocations once the
+	 * buffer is large enough:
+	 */
+	shout_metadata_t	*md_song;
+	shout_metadata_t	*md_tags;
+	char			*md_buf;
+	size_t			 md_buf_size;
+	/*
+	 * Resolved configuration handles, valid for as long as the
+	 * configuration generation does not change:
+	 */
+	unsigned int		 cfg_gen;
+	cfg_stream_t		 cfg_stream;
+	cfg_server_t		 cfg_server;
+	cfg_intake_t		 cfg_intake;
+	/*
+	 * Signatures of the settings in effect, to tell what a configuration
+	 * reload changed:
+	 */
+	uint64_t		 sig_connection;
+	uint64_t		 sig_intake;
+	struct stream_ogg	 ogg;
+	struct stream_mp3	 mp3;
+	struct stream_ebml	 ebml;
+	/*
+	 * The stream header of the current media stream, and the state of
+	 * resuming it on a new connection at a point where it can be
+	 * picked up:
+	 */
+	char			*header;
+	size_t			 header_len;
+	size_t			 header_size;
+	int			 header_overflow;
+	int			 resume;
+	size_t			 resume_at;
+	int			 resume_header;
+	unsigned char		 resume_hdr[STREAM_OGG_HEADER_MAX];
+	size_t			 resume_hdr_len;
+	size_t			 resume_dropped;
+	/*
+	 * The local archive, and the first point in the data that is being
+	 * sent at which a new archive file may begin. The point is only
+	 * good for a new file with the stream header if the header did not
+	 * start over afterwards.
+	 */
+	archive_t		 archive;
+	int			 cut;
+	size_t			 cut_at;
+	int			 cut_header;
+	unsigned int		 cut_gen;
+	unsigned int		 header_gen;
+	/*
+	 * How long the stream was paused since libshout began to pace the
+	 * connection with its first data, which it would otherwise try to
+	 * catch up on, and when the current pause began:
+	 */
+	int			 paced;
+	long			 paused_ms;
+	struct timespec 	 pause_start;
+	int			 pausing;
 };
 
 static int	_stream_cfg_server(struct stream *, cfg_server_t);
 static int	_stream_cfg_tls(struct stream *, cfg_server_t);
 static int	_stream_cfg_stream(struct stream *, cfg_stream_t);
 static void	_stream_reset(struct stream *);
+static int	_stream_lookup(struct stream *, cfg_stream_t *, cfg_server_t *);
+static int	_stream_check_intake(struct stream *);
+static void	_stream_cfg_refresh(struct stream *);
+static uint64_t _stream_hash(uint64_t, const char *);
+static uint64_t _stream_sig_connection(cfg_stream_t, cfg_server_t);
+static uint64_t _stream_sig_intake(cfg_intake_t);
+static shout_metadata_t *
+		_stream_new_metadata(void);
+static const char *
+		_stream_format_metadata(struct stream *, mdata_t);
+static int	_stream_send_metadata(struct stream *, shout_metadata_t *);
+static void	_stream_ogg_enable(struct stream *, int);
+static void	_stream_ogg_parse(struct stream *, const unsigned char *,
+		    size_t);
+static void	_stream_ogg_header(struct stream_ogg *, unsigned char);
+static void	_stream_ogg_capture(struct stream *, size_t);
+static int	_stream_ogg_packets(struct stream_ogg *);
+static void	_stream_ogg_page(struct stream_ogg *);
+static int	_stream_ogg_ident(struct stream_ogg *);
+static void	_stream_ogg_headers(struct stream_ogg *);
+static void	_stream_mp3_enable(struct stream *, int);
+static void	_stream_mp3_parse(struct stream *, const unsigned char *,
+		    size_t);
+static int	_stream_mp3_header(struct stream_mp3 *, unsigned char);
+static int	_stream_mp3_decode(struct stream_mp3 *);
+static void	_stream_mp3_frame(struct stream_mp3 *);
+static void	_stream_mp3_count(struct stream_mp3 *);
+static int	_stream_mp3_info(struct stream_mp3 *);
+static void	_stream_ebml_enable(struct stream *, int);
+static void	_stream_ebml_parse(struct stream *, const unsigned char *,
+		    size_t);
+static int	_stream_ebml_header(struct stream_ebml *, unsigned char);
+static void	_stream_ebml_element(struct stream *, size_t);
+static size_t	_stream_ebml_vint_len(unsigned char);
+static int	_stream_header_add(struct stream *, const void *, size_t);
+static void	_stream_header_reset(struct stream *);
+static void	_stream_resume_at(struct stream *, size_t, const unsigned char *,
+		    size_t, int);
+static void	_stream_cut(struct stream *, size_t, size_t, int);
+static void	_stream_archive(struct stream *, const char *, size_t);
+static int	_stream_send(struct stream *, const char *, size_t);
+static unsigned long
+		_stream_le32(const unsigned char *);
+static unsigned long
+		_stream_be32(const unsigned char *);
 
 static int
 _stream_cfg_server(struct stream *s, cfg_server_t cfg_server)
@@ -257,6 +508,13 @@ _stream_cfg_stream(struct stream *s, cfg_stream_t cfg_stream)
 		    s->name, cfg_stream_get_format_str(cfg_stream));
 		return (-1);
 	}
+	_stream_ogg_enable(s,
+	    CFG_STREAM_OGG == cfg_stream_get_format(cfg_stream));
+	_stream_mp3_enable(s,
+	    CFG_STREAM_MP3 == cfg_stream_get_format(cfg_stream));
+	_stream_ebml_enable(s,
+	    CFG_STREAM_WEBM == cfg_stream_get_format(cfg_stream) ||
+	    CFG_STREAM_MATROSKA == cfg_stream_get_format(cfg_stream));
 	if (SHOUTERR_SUCCESS !=
 	    shout_set_public(s->shout, (unsigned int)cfg_stream_get_public(cfg_stream))) {
 		log_error("stream: %s: public: %s",
@@ -361,6 +619,9 @@ stream_create(const char *name)
 		log_syserr(ALERT, ENOMEM, "shout_new");
 		exit(1);
 	}
+	s->metrics = metrics_create(name);
+	s->md_song = _stream_new_metadata();
+	s->md_tags = _stream_new_metadata();
 
 	return (s);
 }
@@ -371,68 +632,220 @@ stream_destroy(struct stream **s_p)
 	struct stream	*s = *s_p;
 
 	shout_free(s->shout);
+	shout_metadata_free(s->md_song);
+	shout_metadata_free(s->md_tags);
+	metrics_destroy(&s->metrics);
+	xfree(s->md_buf);
+	xfree(s->header);
 	xfree(s->name);
 	xfree(s);
 	*s_p = NULL;
 }
 
-int
-stream_configure(struct stream *s)
+static int
+_stream_lookup(struct stream *s, cfg_stream_t *cfg_stream_p,
+    cfg_server_t *cfg_server_p)
 {
-	cfg_stream_list_t	 streams;
-	cfg_server_list_t	 servers;
-	cfg_stream_t		 cfg_stream;
-	cfg_server_t		 cfg_server;
-	cfg_intake_t		 cfg_intake;
-	const char		*server;
+	const char	*server;
 
-	streams = cfg_get_streams();
-	cfg_stream = cfg_stream_list_find(streams, s->name);
-	if (!cfg_stream) {
+	*cfg_stream_p = stream_get_cfg_stream(s);
+	if (!*cfg_stream_p) {
 		log_error("stream: %s: no configuration", s->name);
 		return (-1);
 	}
-	servers = cfg_get_servers();
-	server = cfg_stream_get_server(cfg_stream);
-	if (!server)
-		server = CFG_DEFAULT;
-	cfg_server = cfg_server_list_find(servers, server);
-	if (!cfg_server) {
+	_stream_cfg_refresh(s);
+	if (!s->cfg_server) {
+		server = cfg_stream_get_server(*cfg_stream_p);
+		if (!server)
+			server = CFG_DEFAULT;
+		s->cfg_server = cfg_server_list_find(cfg_get_servers(),
+		    server);
+	}
+	*cfg_server_p = s->cfg_server;
+	if (!*cfg_server_p) {
 		log_error("stream: %s: no configuration: %s",
-		    s->name, cfg_stream_get_server(cfg_stream));
+		    s->name, cfg_stream_get_server(*cfg_stream_p));
 		return (-1);
 	}
 
-	if (0 != _stream_cfg_server(s, cfg_server) ||
-	    0 != _stream_cfg_tls(s, cfg_server) ||
-	    0 != _stream_cfg_stream(s, cfg_stream)) {
-		_stream_reset(s);
-		return (-1);
-	}
+	return (0);
+}
+
+static int
+_stream_check_intake(struct stream *s)
+{
+	cfg_intake_t	cfg_intake;
 
 	cfg_intake = stream_get_cfg_intake(s);
 	if (0 > cfg_intake_validate(cfg_intake, NULL)) {
 		log_error("stream: %s: referencing unconfigured intake (%s)",
 		    s->name, cfg_intake_get_name(cfg_intake));
+		return (-1);
+	}
+
+	return (0);
+}
+
+static void
+_stream_cfg_refresh(struct stream *s)
+{
+	if (s->cfg_gen == cfg_get_generation())
+		return;
+	s->cfg_gen = cfg_get_generation();
+	s->cfg_stream = NULL;
+	s->cfg_server = NULL;
+	s->cfg_intake = NULL;
+}
+
+static uint64_t
+_stream_hash(uint64_t h, const char *str)
+{
+	const unsigned char	*p;
+
+	/* Each field is terminated, and unset ones differ from empty ones: */
+	if (!str) {
+		h ^= 0x100;
+		return (h * STREAM_FNV_PRIME);
+	}
+	for (p = (const unsigned char *)str; *p; p++) {
+		h ^= *p;
+		h *= STREAM_FNV_PRIME;
+	}
+
+	return (h * STREAM_FNV_PRIME);
+}
+
+static uint64_t
+_stream_sig_connection(cfg_stream_t cfg_stream, cfg_server_t cfg_server)
+{
+	uint64_t	h = STREAM_FNV_BASIS;
+	char		port[16];
+
+	(void)snprintf(port, sizeof(port), "%u",
+	    cfg_server_get_port(cfg_server));
+	h = _stream_hash(h, cfg_server_get_protocol_str(cfg_server));
+	h = _stream_hash(h, cfg_server_get_hostname(cfg_server));
+	h = _stream_hash(h, port);
+	h = _stream_hash(h, cfg_server_get_user(cfg_server));
+	h = _stream_hash(h, cfg_server_get_password(cfg_server));
+	h = _stream_hash(h, cfg_server_get_tls_str(cfg_server));
+	h = _stream_hash(h, cfg_server_get_tls_cipher_suite(cfg_server));
+	h = _stream_hash(h, cfg_server_get_ca_dir(cfg_server));
+	h = _stream_hash(h, cfg_server_get_ca_file(cfg_server));
+	h = _stream_hash(h, cfg_server_get_client_cert(cfg_server));
+	h = _stream_hash(h, cfg_stream_get_mountpoint(cfg_stream));
+	h = _stream_hash(h, cfg_stream_get_format_str(cfg_stream));
+	h = _stream_hash(h, cfg_stream_get_public(cfg_stream) ? "1" : "0");
+	h = _stream_hash(h, cfg_stream_get_stream_name(cfg_stream));
+	h = _stream_hash(h, cfg_stream_get_stream_url(cfg_stream));
+	h = _stream_hash(h, cfg_stream_get_stream_genre(cfg_stream));
+	h = _stream_hash(h, cfg_stream_get_stream_description(cfg_stream));
+	h = _stream_hash(h, cfg_stream_get_stream_quality(cfg_stream));
+	h = _stream_hash(h, cfg_stream_get_stream_bitrate(cfg_stream));
+	h = _stream_hash(h, cfg_stream_get_stream_samplerate(cfg_stream));
+	h = _stream_hash(h, cfg_stream_get_stream_channels(cfg_stream));
+
+	return (h);
+}
+
+static uint64_t
+_stream_sig_intake(cfg_intake_t cfg_intake)
+{
+	uint64_t	h = STREAM_FNV_BASIS;
+
+	h = _stream_hash(h, cfg_intake_get_type_str(cfg_intake));
+	h = _stream_hash(h, cfg_intake_get_filename(cfg_intake));
+
+	return (h);
+}
+
+int
+stream_configure(struct stream *s)
+{
+	cfg_stream_t	cfg_stream;
+	cfg_server_t	cfg_server;
+
+	if (0 > _stream_lookup(s, &cfg_stream, &cfg_server))
+		return (-1);
+
+	if (0 != _stream_cfg_server(s, cfg_server) ||
+	    0 != _stream_cfg_tls(s, cfg_server) ||
+	    0 != _stream_cfg_stream(s, cfg_stream) ||
+	    0 != _stream_check_intake(s)) {
 		_stream_reset(s);
 		return (-1);
 	}
+	s->sig_connection = _stream_sig_connection(cfg_stream, cfg_server);
+	s->sig_intake = _stream_sig_intake(stream_get_cfg_intake(s));
 
 	return (0);
 }
 
 int
-stream_set_metadata(struct stream *s, mdata_t md, char **md_str)
+stream_check(struct stream *s)
 {
-	shout_metadata_t	*shout_md = NULL;
-	int			 ret;
+	cfg_stream_t	 cfg_stream;
+	cfg_server_t	 cfg_server;
 
-	if (cfg_get_metadata_no_updates())
-		return (0);
+	shout_t 	*shout;
+	int		 ret;
 
-	if (md == NULL)
+	if (0 > _stream_lookup(s, &cfg_stream, &cfg_server) ||
+	    0 > _stream_check_intake(s))
+		return (-1);
+
+	/*
+	 * Try the settings on a scratch libshout handle, so that they can be
+	 * rejected without disturbing the connection:
+	 */
+	shout = s->shout;
+	s->shout = shout_new();
+	if (NULL == s->shout) {
+		log_syserr(ALERT, ENOMEM, "shout_new");
+		exit(1);
+	}
+	ret = 0;
+	if (0 != _stream_cfg_server(s, cfg_server) ||
+	    0 != _stream_cfg_tls(s, cfg_server) ||
+	    0 != _stream_cfg_stream(s, cfg_stream))
+		ret = -1;
+	shout_free(s->shout);
+	s->shout = shout;
+
+	return (ret);
+}
+
+int
+stream_reload(struct stream *s, unsigned int *changes_p)
+{
+	cfg_stream_t	cfg_stream;
+	cfg_server_t	cfg_server;
+	uint64_t	sig_intake;
+
+	*changes_p = 0;
+	if (0 > _stream_lookup(s, &cfg_stream, &cfg_server))
 		return (-1);
 
+	sig_intake = _stream_sig_intake(stream_get_cfg_intake(s));
+	if (s->sig_intake != sig_intake)
+		*changes_p |= STREAM_CHANGED_INTAKE;
+	s->sig_intake = sig_intake;
+	if (s->sig_connection == _stream_sig_connection(cfg_stream, cfg_server))
+		return (0);
+
+	/* Start over with a fresh handle, to not keep any old settings: */
+	*changes_p |= STREAM_CHANGED_CONNECTION;
+	stream_disconnect(s);
+	_stream_reset(s);
+
+	return (stream_configure(s));
+}
+
+static shout_metadata_t *
+_stream_new_metadata(void)
+{
+	shout_metadata_t	*shout_md;
+
 	if ((shout_md = shout_metadata_new()) == NULL) {
 		log_syserr(ALERT, ENOMEM, "shout_metadata_new");
 		exit(1);
@@ -450,19 +863,937 @@ stream_set_metadata(struct stream *s, mdata_t md, char **md_str)
 		exit(1);
 	}
 
+	return (shout_md);
+}
+
+static const char *
+_stream_format_metadata(struct stream *s, mdata_t md)
+{
+	util_template_t  tmpl = cfg_get_metadata_format_template();
+	int		 len;
+
+	len = mdata_strformat_template(md, s->md_buf, s->md_buf_size, tmpl);
+	if (0 > len)
+		return (NULL);
+	if ((size_t)len >= s->md_buf_size) {
+		if (0 == s->md_buf_size)
+			s->md_buf_size = BUFSIZ;
+		while ((size_t)len >= s->md_buf_size)
+			s->md_buf_size *= 2;
+		s->md_buf = xreallocarray(s->md_buf, s->md_buf_size,
+		    sizeof(char));
+		(void)mdata_strformat_template(md, s->md_buf, s->md_buf_size,
+		    tmpl);
+	}
+
+	return (s->md_buf);
+}
+
+static int
+_stream_send_metadata(struct stream *s, shout_metadata_t *shout_md)
+{
+	struct timespec start, now;
+	int		ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = shout_set_metadata(s->shout, shout_md);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (ret != SHOUTERR_SUCCESS)
+		log_warning("shout_set_metadata: %s", shout_get_error(s->shout));
+	else {
+		metrics_count(s->metrics, METRICS_METADATA_UPDATES, 1);
+		log_event(INFO, "metadata_update",
+		    (double)(now.tv_sec - start.tv_sec) +
+		    (double)(now.tv_nsec - start.tv_nsec) / 1000000000.0,
+		    "stream metadata: updated");
+	}
+	metrics_observe_since(s->metrics, METRICS_METADATA_LATENCY, &start);
+
+	return (ret);
+}
+
+static void
+_stream_ogg_enable(struct stream *s, int enable)
+{
+	if (enable && !s->ogg.enabled) {
+		memset(&s->ogg, 0, sizeof(s->ogg));
+		s->ogg.hdr_size = STREAM_OGG_HEADER;
+		s->header_len = 0;
+	}
+	s->ogg.enabled = enable;
+}
+
+static void
+_stream_ogg_parse(struct stream *s, const unsigned char *p, size_t len)
+{
+	struct stream_ogg	*o = &s->ogg;
+	const unsigned char	*q;
+	size_t			 i, n;
+
+	i = 0;
+	while (i < len) {
+		if (o->hdr_len < o->hdr_size) {
+			if ((o->hdr_len < 4 && p[i] != "OggS"[o->hdr_len]) ||
+			    (4 == o->hdr_len && p[i] != 0)) {
+				if (o->synced)
+					log_warning("stream: %s: lost Ogg page sync",
+					    s->name);
+				o->synced = 0;
+				if (o->hdr_len) {
+					/* Look at this byte again as a start: */
+					o->hdr_len = 0;
+					continue;
+				}
+				q = memchr(p + i + 1, 'O', len - i - 1);
+				n = q ? (size_t)(q - p) - i : len - i;
+				o->bytes += n;
+				i += n;
+				continue;
+			}
+			_stream_ogg_header(o, p[i]);
+			n = 1;
+			if (o->hdr_len == o->hdr_size)
+				_stream_ogg_capture(s, i + n);
+		} else {
+			n = o->body_len - o->body_pos;
+			if (n > len - i)
+				n = len - i;
+			if (o->flags & STREAM_OGG_BOS &&
+			    o->ident_len < sizeof(o->ident)) {
+				size_t	id_n = sizeof(o->ident) - o->ident_len;
+
+				if (id_n > n)
+					id_n = n;
+				memcpy(o->ident + o->ident_len, p + i, id_n);
+				o->ident_len += id_n;
+			}
+			if (o->capture && 0 > _stream_header_add(s, p + i, n))
+				o->capture = 0;
+			o->body_pos += n;
+		}
+		o->bytes += n;
+		i += n;
+		if (o->hdr_len == o->hdr_size && o->body_pos == o->body_len)
+			_stream_ogg_page(o);
+	}
+}
+
+static void
+_stream_ogg_header(struct stream_ogg *o, unsigned char c)
+{
+	if (0 == o->hdr_len) {
+		o->flags = 0;
+		o->granule = 0;
+		o->serial = 0;
+		o->body_len = o->body_pos = 0;
+		o->ident_len = 0;
+	} else if (3 == o->hdr_len)
+		o->synced = 1;
+	else if (5 == o->hdr_len)
+		o->flags = c;
+	else if (6 <= o->hdr_len && 13 >= o->hdr_len)
+		o->granule |= (uint64_t)c << (8 * (o->hdr_len - 6));
+	else if (14 <= o->hdr_len && 17 >= o->hdr_len)
+		o->serial |= (uint32_t)c << (8 * (o->hdr_len - 14));
+	else if (26 == o->hdr_len)
+		o->hdr_size += c;
+	else if (STREAM_OGG_HEADER <= o->hdr_len)
+		o->body_len += c;
+	o->page[o->hdr_len++] = c;
+}
+
+/*
+ * Keeps the header pages of a chain, which end with the first page that
+ * holds no part of a header packet, and picks up the stream again at this
+ * page on a new connection.
+ */
+static void
+_stream_ogg_capture(struct stream *s, size_t end)
+{
+	struct stream_ogg	*o = &s->ogg;
+	int			 new_chain, data;
+
+	new_chain = o->flags & STREAM_OGG_BOS && !o->in_bos;
+	if (new_chain)
+		o->num_streams = 0;
+	data = _stream_ogg_packets(o);
+
+	/* A packet that began before is of no use on a new connection: */
+	if (s->resume && !(o->flags & STREAM_OGG_CONTINUED))
+		_stream_resume_at(s, end, o->page, o->hdr_size,
+		    !new_chain && 0 < s->header_len);
+	if (new_chain) {
+		_stream_header_reset(s);
+		o->have_header = 0;
+		o->capture = 1;
+	} else if (data && o->capture) {
+		o->capture = 0;
+		o->have_header = !s->header_overflow && 0 < s->header_len;
+	}
+	/* A new archive file may begin with a chain or a data page: */
+	if (new_chain)
+		_stream_cut(s, end, o->hdr_size, 0);
+	else if (data && o->have_header &&
+	    !(o->flags & STREAM_OGG_CONTINUED))
+		_stream_cut(s, end, o->hdr_size, 1);
+	if (o->capture && 0 > _stream_header_add(s, o->page, o->hdr_size))
+		o->capture = 0;
+}
+
+/*
+ * Counts the packets that end on the page towards the header packets of
+ * its logical stream, unless they are complete already. Returns 1 if the
+ * page holds no part of a header packet, and 0 otherwise.
+ */
+static int
+_stream_ogg_packets(struct stream_ogg *o)
+{
+	struct stream_ogg_stream	*st = NULL;
+	size_t				 i;
+
+	for (i = 0; i < o->num_streams; i++) {
+		if (o->streams[i].serial == o->serial) {
+			st = &o->streams[i];
+			break;
+		}
+	}
+	if (NULL == st && o->flags & STREAM_OGG_BOS &&
+	    o->num_streams < STREAM_OGG_STREAMS) {
+		st = &o->streams[o->num_streams++];
+		st->serial = o->serial;
+		/* Until the codec is known from the first packet: */
+		st->headers = 1;
+		st->packets = 0;
+	}
+	if (NULL == st)
+		return (!(o->flags & STREAM_OGG_BOS));
+	if (!(o->flags & STREAM_OGG_BOS) && st->packets >= st->headers)
+		return (1);
+
+	/* A lacing value below 255 ends a packet: */
+	for (i = STREAM_OGG_HEADER; i < o->hdr_size; i++) {
+		if (255 > o->page[i])
+			st->packets++;
+	}
+
+	return (0);
+}
+
+static void
+_stream_ogg_page(struct stream_ogg *o)
+{
+	if (o->flags & STREAM_OGG_BOS) {
+		_stream_ogg_headers(o);
+		/* The first BOS page after data pages starts a new chain: */
+		if (!o->in_bos) {
+			o->in_bos = 1;
+			o->have_track = 0;
+			o->bytes = o->hdr_size + o->body_len;
+			o->mark_bytes = 0;
+		}
+		if (!o->have_track && 0 == _stream_ogg_ident(o)) {
+			o->have_track = 1;
+			o->track_serial = o->serial;
+			o->pos = o->mark_pos = 0;
+		}
+	} else {
+		o->in_bos = 0;
+		if (o->have_track && o->serial == o->track_serial &&
+		    STREAM_OGG_NO_GRANULE != o->granule)
+			o->pos = o->granule;
+	}
+	o->hdr_len = 0;
+	o->hdr_size = STREAM_OGG_HEADER;
+}
+
+static int
+_stream_ogg_ident(struct stream_ogg *o)
+{
+	const unsigned char	*id = o->ident;
+
+	o->rate = 0;
+	o->preskip = 0;
+	if (16 <= o->ident_len && 0 == memcmp(id, "\001vorbis", 7)) {
+		o->rate = _stream_le32(id + 12);
+	} else if (12 <= o->ident_len && 0 == memcmp(id, "OpusHead", 8)) {
+		/* Opus granule positions always count 48 kHz samples: */
+		o->rate = 48000;
+		o->preskip = (uint64_t)id[10] | (uint64_t)id[11] << 8;
+	} else if (30 <= o->ident_len && 0 == memcmp(id, "\177FLAC", 5)) {
+		o->rate = (unsigned long)id[27] << 12 |
+		    (unsigned long)id[28] << 4 | (unsigned long)id[29] >> 4;
+	} else if (40 <= o->ident_len && 0 == memcmp(id, "Speex   ", 8)) {
+		o->rate = _stream_le32(id + 36);
+	}
+
+	return (o->rate ? 0 : -1);
+}
+
+/* Learns the number of header packets of a logical stream from its first: */
+static void
+_stream_ogg_headers(struct stream_ogg *o)
+{
+	const unsigned char	*id = o->ident;
+	unsigned long		 headers = 0;
+	size_t			 i;
+
+	if (7 <= o->ident_len && (0 == memcmp(id, "\001vorbis", 7) ||
+	    0 == memcmp(id, "\200theora", 7))) {
+		headers = 3;
+	} else if (8 <= o->ident_len && 0 == memcmp(id, "OpusHead", 8)) {
+		headers = 2;
+	} else if (9 <= o->ident_len && 0 == memcmp(id, "\177FLAC", 5)) {
+		/* Zero header packets after the first means unknown: */
+		headers = (unsigned long)id[7] << 8 | id[8];
+		if (headers)
+			headers++;
+	} else if (72 <= o->ident_len && 0 == memcmp(id, "Speex   ", 8)) {
+		headers = 2 + _stream_le32(id + 68);
+	}
+	if (0 == headers)
+		return;
+
+	for (i = 0; i < o->num_streams; i++) {
+		if (o->streams[i].serial == o->serial) {
+			o->streams[i].headers = headers;
+			break;
+		}
+	}
+}
+
+static void
+_stream_mp3_enable(struct stream *s, int enable)
+{
+	if (enable && !s->mp3.enabled) {
+		memset(&s->mp3, 0, sizeof(s->mp3));
+		s->mp3.probe = 1;
+	}
+	s->mp3.enabled = enable;
+}
+
+static void
+_stream_mp3_parse(struct stream *s, const unsigned char *p, size_t len)
+{
+	struct stream_mp3	*o = &s->mp3;
+	const unsigned char	*data = p;
+	size_t			 n;
+	int			 ret;
+
+	while (len) {
+		if (o->skip) {
+			n = o->skip < len ? o->skip : len;
+			o->skip -= n;
+		} else if (o->frame_pos < o->frame_len) {
+			n = o->frame_len - o->frame_pos;
+			if (n > len)
+				n = len;
+			if (o->probe && o->info_len &&
+			    o->info_len < sizeof(o->info)) {
+				size_t	info_n = sizeof(o->info) - o->info_len;
+
+				if (info_n > n)
+					info_n = n;
+				memcpy(o->info + o->info_len, p, info_n);
+				o->info_len += info_n;
+			}
+			o->frame_pos += n;
+			o->bytes += n;
+			if (o->frame_pos == o->frame_len)
+				_stream_mp3_frame(o);
+		} else {
+			ret = _stream_mp3_header(o, *p);
+			if (ret) {
+				if (o->synced)
+					log_warning("stream: %s: lost MP3 frame sync",
+					    s->name);
+				o->synced = 0;
+			}
+			if (0 <= ret) {
+				n = 1;
+				/* A new archive file may begin with any frame: */
+				if (0 == o->hdr_len &&
+				    o->frame_pos < o->frame_len)
+					_stream_cut(s, (size_t)(p - data) + n,
+					    o->frame_pos, 0);
+			} else {
+				for (n = 1; n < len; n++) {
+					if (0xff == p[n] || 'I' == p[n] ||
+					    'T' == p[n])
+						break;
+				}
+			}
+		}
+		p += n;
+		len -= n;
+	}
+}
+
+/*
+ * Takes the next byte of a frame header or tag. Returns 0 if the byte is
+ * part of one, and -1 if it is not. When a header turns out to be invalid,
+ * the bytes after its start are looked at again, and 1 is returned if the
+ * byte is part of a header or tag that begins among them.
+ */
+static int
+_stream_mp3_header(struct stream_mp3 *o, unsigned char c)
+{
+	unsigned char	buf[sizeof(o->hdr)];
+	size_t		len, i, rest;
+	unsigned int	fixed;
+
+	o->hdr[o->hdr_len++] = c;
+
+	switch (o->hdr[0]) {
+	case 0xff:
+		if (2 == o->hdr_len && 0xe0 != (c & 0xe0))
+			break;
+		if (4 > o->hdr_len)
+			return (0);
+		if (0 > _stream_mp3_decode(o))
+			break;
+		if (o->probe) {
+			memcpy(o->info, o->hdr, 4);
+			o->info_len = 4;
+		}
+		o->frame_pos = 4;
+		o->bytes += 4;
+		o->hdr_len = 0;
+		fixed = (unsigned int)(o->hdr[1] & 0xfe) << 8 |
+		    (o->hdr[2] & 0x0c);
+		if (!o->candidate || fixed != o->fixed)
+			o->synced = 0;
+		else if (!o->synced) {
+			o->synced = 1;
+			if (o->pending)
+				_stream_mp3_count(o);
+		}
+		o->candidate = 1;
+		o->fixed = fixed;
+		o->pending = 0;
+		return (0);
+	case 'I':
+		if ((2 == o->hdr_len && 'D' != c) ||
+		    (3 == o->hdr_len && '3' != c) ||
+		    (7 <= o->hdr_len && c & 0x80))
+			break;
+		if (10 > o->hdr_len)
+			return (0);
+		/* ID3v2 tag sizes are syncsafe integers, plus a footer: */
+		o->skip = (size_t)o->hdr[6] << 21 | (size_t)o->hdr[7] << 14 |
+		    (size_t)o->hdr[8] << 7 | (size_t)o->hdr[9];
+		if (o->hdr[5] & 0x10)
+			o->skip += 10;
+		o->hdr_len = 0;
+		o->probe = 1;
+		return (0);
+	case 'T':
+		if ((2 == o->hdr_len && 'A' != c) ||
+		    (3 == o->hdr_len && 'G' != c))
+			break;
+		if (3 > o->hdr_len)
+			return (0);
+		/* ID3v1 tags are 128 bytes long: */
+		o->skip = 128 - 3;
+		o->hdr_len = 0;
+		return (0);
+	default:
+		break;
+	}
+
+	/* A header may still begin in the bytes after the first one: */
+	o->candidate = 0;
+	o->pending = 0;
+	len = o->hdr_len - 1;
+	memcpy(buf, o->hdr + 1, len);
+	o->hdr_len = 0;
+	for (i = 0; i < len; i++) {
+		if (0 == o->hdr_len && 0xff != buf[i] && 'I' != buf[i] &&
+		    'T' != buf[i])
+			continue;
+		if (0 > _stream_mp3_header(o, buf[i]) || 0 < o->hdr_len)
+			continue;
+		/* A header ended early, and the rest is its body: */
+		rest = len - i - 1;
+		if (o->skip) {
+			o->skip -= rest < o->skip ? rest : o->skip;
+		} else if (o->frame_pos < o->frame_len && rest) {
+			if (o->probe && o->info_len + rest <= sizeof(o->info)) {
+				memcpy(o->info + o->info_len, buf + i + 1,
+				    rest);
+				o->info_len += rest;
+			}
+			o->frame_pos += rest;
+			o->bytes += rest;
+		}
+		return (1);
+	}
+
+	return (o->hdr_len ? 1 : -1);
+}
+
+static int
+_stream_mp3_decode(struct stream_mp3 *o)
+{
+	unsigned int	version = (o->hdr[1] >> 3) & 0x03;
+	unsigned int	layer = (o->hdr[1] >> 1) & 0x03;
+	unsigned int	br_idx = o->hdr[2] >> 4;
+	unsigned int	sr_idx = (o->hdr[2] >> 2) & 0x03;
+	unsigned int	padding = (o->hdr[2] >> 1) & 0x01;
+	int		mono = 0x03 == o->hdr[3] >> 6;
+	unsigned long	bitrate, rate;
+
+	if (1 == version || 0 == layer || 0 == br_idx || 15 == br_idx ||
+	    3 == sr_idx)
+		return (-1);
+
+	if (3 == version)
+		bitrate = stream_mp3_bitrates[3 - layer][br_idx];
+	else
+		bitrate = stream_mp3_bitrates[3 == layer ? 3 : 4][br_idx];
+	bitrate *= 1000;
+	rate = stream_mp3_rates[version][sr_idx];
+
+	switch (layer) {
+	case 3:
+		o->frame_len = (12 * bitrate / rate + padding) * 4;
+		o->frame_samples = 384;
+		break;
+	case 2:
+		o->frame_len = 144 * bitrate / rate + padding;
+		o->frame_samples = 1152;
+		break;
+	default:
+		o->frame_len = (3 == version ? 144 : 72) * bitrate / rate +
+		    padding;
+		o->frame_samples = 3 == version ? 1152 : 576;
+		break;
+	}
+	o->frame_rate = rate;
+	/* A Xing header follows the side information, and the CRC: */
+	if (3 == version)
+		o->info_off = mono ? 4 + 17 : 4 + 32;
+	else
+		o->info_off = mono ? 4 + 9 : 4 + 17;
+	if (0 == (o->hdr[1] & 0x01))
+		o->info_off += 2;
+
+	return (0);
+}
+
+static void
+_stream_mp3_frame(struct stream_mp3 *o)
+{
+	if (o->probe && o->info_len) {
+		o->probe = 0;
+		/* The info frame of a track is not part of its audio: */
+		if (0 == _stream_mp3_info(o)) {
+			o->bytes -= o->frame_len;
+			return;
+		}
+	}
+	if (!o->synced) {
+		o->pending = 1;
+		return;
+	}
+	_stream_mp3_count(o);
+}
+
+static void
+_stream_mp3_count(struct stream_mp3 *o)
+{
+	if (o->frame_rate != o->rate) {
+		o->rate = o->frame_rate;
+		o->samples = o->mark_samples = 0;
+		o->bytes = o->frame_len;
+		o->mark_bytes = 0;
+	}
+	o->samples += o->frame_samples;
+}
+
+static int
+_stream_mp3_info(struct stream_mp3 *o)
+{
+	const unsigned char	*x = o->info + o->info_off;
+	const unsigned char	*end = o->info + o->info_len;
+	unsigned long		 flags, frames = 0, delay = 0, padding = 0;
+
+	if (x + 8 <= end &&
+	    (0 == memcmp(x, "Xing", 4) || 0 == memcmp(x, "Info", 4))) {
+		flags = _stream_be32(x + 4);
+		x += 8;
+		if (flags & 0x01 && x + 4 <= end) {
+			frames = _stream_be32(x);
+			x += 4;
+		}
+		if (flags & 0x02)
+			x += 4;
+		if (flags & 0x04)
+			x += 100;
+		if (flags & 0x08)
+			x += 4;
+		/* The LAME tag has the encoder delay and padding: */
+		if (x + 24 <= end && (0 == memcmp(x, "LAME", 4) ||
+		    0 == memcmp(x, "Lavc", 4) || 0 == memcmp(x, "Lavf", 4))) {
+			delay = (unsigned long)x[21] << 4 | x[22] >> 4;
+			padding = (unsigned long)(x[22] & 0x0f) << 8 | x[23];
+		}
+	} else if (4 + 32 + 18 <= o->info_len &&
+	    0 == memcmp(o->info + 4 + 32, "VBRI", 4)) {
+		frames = _stream_be32(o->info + 4 + 32 + 14);
+	} else
+		return (-1);
+
+	o->have_length = 0 < frames;
+	o->length = (uint64_t)frames * o->frame_samples;
+	if (o->length > delay + padding)
+		o->length -= delay + padding;
+
+	return (0);
+}
+
+static void
+_stream_ebml_enable(struct stream *s, int enable)
+{
+	if (enable && !s->ebml.enabled) {
+		memset(&s->ebml, 0, sizeof(s->ebml));
+		s->header_len = 0;
+	}
+	s->ebml.enabled = enable;
+}
+
+static void
+_stream_ebml_parse(struct stream *s, const unsigned char *p, size_t len)
+{
+	struct stream_ebml	*o = &s->ebml;
+	size_t			 i, n;
+	int			 ret;
+
+	i = 0;
+	while (i < len) {
+		if (o->body_left) {
+			n = len - i;
+			if (o->body_left < n)
+				n = (size_t)o->body_left;
+			if (o->capture && 0 > _stream_header_add(s, p + i, n))
+				o->capture = 0;
+			o->body_left -= n;
+			i += n;
+			continue;
+		}
+		ret = _stream_ebml_header(o, p[i]);
+		if (0 > ret) {
+			if (o->synced)
+				log_warning("stream: %s: lost EBML element sync",
+				    s->name);
+			o->synced = 0;
+			if (o->hdr_len) {
+				/* Look at this byte again as a start: */
+				o->hdr_len = 0;
+				continue;
+			}
+			/* Only the EBML header and Clusters are recognized: */
+			for (i++; i < len; i++) {
+				if (0x1a == p[i] || 0x1f == p[i])
+					break;
+			}
+			continue;
+		}
+		i++;
+		if (0 < ret)
+			_stream_ebml_element(s, i);
+	}
+}
+
+static int
+_stream_ebml_header(struct stream_ebml *o, unsigned char c)
+{
+	size_t		 id_len, size_len, i;
+	unsigned long	 id;
+
+	if (0 == o->hdr_len &&
+	    (0x10 > c || (!o->synced && 0x1a != c && 0x1f != c)))
+		return (-1);
+	o->hdr[o->hdr_len++] = c;
+
+	id_len = _stream_ebml_vint_len(o->hdr[0]);
+	if (o->hdr_len == id_len && !o->synced) {
+		for (id = 0, i = 0; i < id_len; i++)
+			id = id << 8 | o->hdr[i];
+		if (STREAM_EBML_ID_EBML != id && STREAM_EBML_ID_CLUSTER != id) {
+			o->hdr_len--;
+			return (-1);
+		}
+	}
+	if (o->hdr_len <= id_len)
+		return (0);
+	size_len = _stream_ebml_vint_len(o->hdr[id_len]);
+	if (0 == size_len) {
+		o->hdr_len--;
+		return (-1);
+	}
+
+	return (o->hdr_len == id_len + size_len ? 1 : 0);
+}
+
+static void
+_stream_ebml_element(struct stream *s, size_t end)
+{
+	struct stream_ebml	*o = &s->ebml;
+	size_t			 id_len, size_len, i;
+	unsigned long		 id;
+	uint64_t		 size;
+	int			 unknown;
+
+	id_len = _stream_ebml_vint_len(o->hdr[0]);
+	size_len = _stream_ebml_vint_len(o->hdr[id_len]);
+	for (id = 0, i = 0; i < id_len; i++)
+		id = id << 8 | o->hdr[i];
+	/* The size marker bit is not part of the value: */
+	size = o->hdr[id_len] & (0xff >> size_len);
+	unknown = size == (uint64_t)(0xff >> size_len);
+	for (i = id_len + 1; i < id_len + size_len; i++) {
+		size = size << 8 | o->hdr[i];
+		if (0xff != o->hdr[i])
+			unknown = 0;
+	}
+	o->synced = 1;
+	o->capture = 0;
+	o->body_left = 0;
+
+	switch (id) {
+	case STREAM_EBML_ID_EBML:
+		/* A new stream, which comes with its own header: */
+		_stream_header_reset(s);
+		o->have_header = 0;
+		if (s->resume)
+			_stream_resume_at(s, end, o->hdr, o->hdr_len, 0);
+		_stream_cut(s, end, o->hdr_len, 0);
+		o->capture = 0 == _stream_header_add(s, o->hdr, o->hdr_len);
+		o->body_left = size;
+		break;
+	case STREAM_EBML_ID_SEGMENT:
+		/*
+		 * Descend into the Segment. It continues indefinitely as
+		 * far as a new connection is concerned:
+		 */
+		if (!o->have_header) {
+			o->hdr[id_len] = (unsigned char)(0xff >> (size_len - 1));
+			for (i = id_len + 1; i < id_len + size_len; i++)
+				o->hdr[i] = 0xff;
+			(void)_stream_header_add(s, o->hdr, o->hdr_len);
+		}
+		unknown = 0;
+		break;
+	case STREAM_EBML_ID_CLUSTER:
+		/* Descend into the Cluster, which completes the header: */
+		if (!o->have_header)
+			o->have_header = !s->header_overflow &&
+			    0 < s->header_len;
+		if (s->resume)
+			_stream_resume_at(s, end, o->hdr, o->hdr_len,
+			    o->have_header);
+		if (o->have_header)
+			_stream_cut(s, end, o->hdr_len, 1);
+		unknown = 0;
+		break;
+	case STREAM_EBML_ID_INFO:
+	case STREAM_EBML_ID_TRACKS:
+		if (!o->have_header)
+			o->capture = 0 == _stream_header_add(s, o->hdr,
+			    o->hdr_len);
+		o->body_left = size;
+		break;
+	default:
+		o->body_left = size;
+		break;
+	}
+	o->hdr_len = 0;
+	if (unknown) {
+		/* Only master elements of interest may have an unknown size: */
+		o->synced = 0;
+		o->capture = 0;
+		o->body_left = 0;
+	}
+}
+
+static size_t
+_stream_ebml_vint_len(unsigned char c)
+{
+	size_t	len;
+
+	for (len = 1; len <= 8; len++) {
+		if (c & (0x80 >> (len - 1)))
+			return (len);
+	}
+
+	return (0);
+}
+
+static int
+_stream_header_add(struct stream *s, const void *data, size_t len)
+{
+	size_t	size;
+
+	if (s->header_overflow)
+		return (-1);
+	if (s->header_len + len > STREAM_HEADER_MAX) {
+		log_warning("stream: %s: stream header too large, not keeping it",
+		    s->name);
+		s->header_overflow = 1;
+		s->header_len = 0;
+		return (-1);
+	}
+	if (s->header_len + len > s->header_size) {
+		size = s->header_size ? s->header_size : 4096;
+		while (s->header_len + len > size)
+			size *= 2;
+		s->header = xreallocarray(s->header, size, 1UL);
+		s->header_size = size;
+	}
+	memcpy(s->header + s->header_len, data, len);
+	s->header_len += len;
+
+	return (0);
+}
+
+static void
+_stream_header_reset(struct stream *s)
+{
+	s->header_len = 0;
+	s->header_overflow = 0;
+	s->header_gen++;
+}
+
+/*
+ * Ends dropping data on a new connection at the given offset in the data
+ * that is being sent, after the element header that begins there, and
+ * decides whether the stream header has to be sent first.
+ */
+static void
+_stream_resume_at(struct stream *s, size_t offset, const unsigned char *hdr,
+    size_t hdr_len, int send_header)
+{
+	s->resume = 0;
+	s->resume_at = offset;
+	memcpy(s->resume_hdr, hdr, hdr_len);
+	s->resume_hdr_len = hdr_len;
+	s->resume_header = send_header;
+}
+
+/*
+ * Notes the start of the element header that ends at the given offset in
+ * the data that is being sent as a point to begin a new archive file at,
+ * unless the element header began in previous data.
+ */
+static void
+_stream_cut(struct stream *s, size_t end, size_t hdr_len, int header)
+{
+	if (NULL == s->archive || s->cut || end < hdr_len)
+		return;
+	s->cut = 1;
+	s->cut_at = end - hdr_len;
+	s->cut_header = header;
+	s->cut_gen = s->header_gen;
+}
+
+static void
+_stream_archive(struct stream *s, const char *data, size_t len)
+{
+	struct archive_stats	stats;
+	size_t			i;
+
+	if (!s->ogg.enabled && !s->mp3.enabled && !s->ebml.enabled) {
+		/* Without a parser, any point will do: */
+		archive_cut(s->archive, NULL, 0);
+		archive_write(s->archive, data, len);
+	} else if (s->cut && s->cut_gen == s->header_gen) {
+		archive_write(s->archive, data, s->cut_at);
+		if (s->cut_header)
+			archive_cut(s->archive, s->header, s->header_len);
+		else
+			archive_cut(s->archive, NULL, 0);
+		archive_write(s->archive, data + s->cut_at, len - s->cut_at);
+	} else
+		archive_write(s->archive, data, len);
+	s->cut = 0;
+
+	archive_poll(s->archive, &stats);
+	metrics_count(s->metrics, METRICS_ARCHIVE_BYTES, stats.written);
+	metrics_count(s->metrics, METRICS_ARCHIVE_DROPPED, stats.dropped);
+	for (i = 0; i < stats.lag_num; i++)
+		metrics_observe(s->metrics, METRICS_ARCHIVE_LAG, stats.lag[i]);
+}
+
+static int
+_stream_send(struct stream *s, const char *data, size_t len)
+{
+	struct timespec start;
+	int		ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = shout_send(s->shout, (const unsigned char *)data, len);
+	metrics_observe_since(s->metrics, METRICS_SEND_LATENCY, &start);
+	if (SHOUTERR_SUCCESS == ret) {
+		s->paced = 1;
+		metrics_count(s->metrics, METRICS_BYTES_SENT, len);
+		metrics_count(s->metrics, METRICS_CHUNKS_SENT, 1);
+		return (0);
+	}
+	metrics_count(s->metrics, METRICS_SEND_ERRORS, 1);
+
+	log_warning("stream: %s: send: %s: error %d: %s", s->name,
+	    shout_get_host(s->shout), shout_get_errno(s->shout),
+	    shout_get_error(s->shout));
+
+	stream_disconnect(s);
+
+	return (-1);
+}
+
+static unsigned long
+_stream_le32(const unsigned char *p)
+{
+	return ((unsigned long)p[0] | (unsigned long)p[1] << 8 |
+	    (unsigned long)p[2] << 16 | (unsigned long)p[3] << 24);
+}
+
+static unsigned long
+_stream_be32(const unsigned char *p)
+{
+	return ((unsigned long)p[0] << 24 | (unsigned long)p[1] << 16 |
+	    (unsigned long)p[2] << 8 | (unsigned long)p[3]);
+}
+
+int
+stream_set_metadata(struct stream *s, mdata_t md, const char **md_str)
+{
+	shout_metadata_t	*shout_md;
+	unsigned long		 allocs;
+	int			 ret;
+
+	if (cfg_get_metadata_no_updates())
+		return (0);
+
+	if (md == NULL)
+		return (-1);
+
+	allocs = xalloc_get_allocs();
+
 	if (cfg_get_metadata_format_str()) {
-		char	buf[BUFSIZ];
+		const char	*song;
 
-		mdata_strformat(md, buf, sizeof(buf),
-		    cfg_get_metadata_format_str());
+		if (NULL == (song = _stream_format_metadata(s, md)))
+			return (-1);
+		shout_md = s->md_song;
 		if (SHOUTERR_SUCCESS !=
-		    shout_metadata_add(shout_md, "song", buf)) {
+		    shout_metadata_add(shout_md, "song", song)) {
 			log_syserr(ALERT, ENOMEM, "shout_metadata_add");
 			exit(1);
 		}
-		log_info("stream metadata: formatted: %s", buf);
+		log_info("stream metadata: formatted: %s", song);
 	} else {
 		if (mdata_get_artist(md) && mdata_get_title(md)) {
+			shout_md = s->md_tags;
 			if (SHOUTERR_SUCCESS != shout_metadata_add(shout_md,
 				"artist", mdata_get_artist(md)) ||
 			    SHOUTERR_SUCCESS != shout_metadata_add(shout_md,
@@ -475,6 +1806,7 @@ stream_set_metadata(struct stream *s, mdata_t md, char **md_str)
 			    mdata_get_artist(md),
 			    mdata_get_title(md));
 		} else if (mdata_get_songinfo(md)) {
+			shout_md = s->md_song;
 			if (SHOUTERR_SUCCESS != shout_metadata_add(shout_md,
 			        "song", mdata_get_songinfo(md))) {
 				log_syserr(ALERT, ENOMEM,
@@ -484,6 +1816,7 @@ stream_set_metadata(struct stream *s, mdata_t md, char **md_str)
 			log_info("stream metadata: songinfo: %s",
 			    mdata_get_songinfo(md));
 		} else {
+			shout_md = s->md_song;
 			if (SHOUTERR_SUCCESS != shout_metadata_add(shout_md,
 			        "song", mdata_get_name(md))) {
 				log_syserr(ALERT, ENOMEM,
@@ -495,21 +1828,40 @@ stream_set_metadata(struct stream *s, mdata_t md, char **md_str)
 		}
 	}
 
-	if ((ret = shout_set_metadata(s->shout, shout_md)) != SHOUTERR_SUCCESS)
-		log_warning("shout_set_metadata: %s", shout_get_error(s->shout));
+	metrics_count(s->metrics, METRICS_METADATA_ALLOCS,
+	    xalloc_get_allocs() - allocs);
 
-	shout_metadata_free(shout_md);
+	ret = _stream_send_metadata(s, shout_md);
 
-	if (ret == SHOUTERR_SUCCESS) {
-		if (md_str != NULL && *md_str == NULL)
-			*md_str = mdata_get_songinfo(md) ?
-			    xstrdup(mdata_get_songinfo(md)) :
-			    xstrdup(mdata_get_name(md));
-	}
+	if (ret == SHOUTERR_SUCCESS && md_str != NULL)
+		*md_str = mdata_get_songinfo(md) ?
+		    mdata_get_songinfo(md) : mdata_get_name(md);
 
 	return (ret == SHOUTERR_SUCCESS ? 0 : -1);
 }
 
+int
+stream_set_metadata_str(struct stream *s, const char *song)
+{
+	if (cfg_get_metadata_no_updates())
+		return (0);
+
+	if (SHOUTERR_SUCCESS != shout_metadata_add(s->md_song, "song", song)) {
+		log_syserr(ALERT, ENOMEM, "shout_metadata_add");
+		exit(1);
+	}
+	log_info("stream metadata: song: %s", song);
+
+	return (SHOUTERR_SUCCESS == _stream_send_metadata(s, s->md_song) ?
+	    0 : -1);
+}
+
+const char *
+stream_get_name(struct stream *s)
+{
+	return (s->name);
+}
+
 int
 stream_get_connected(struct stream *s)
 {
@@ -519,7 +1871,11 @@ stream_get_connected(struct stream *s)
 cfg_stream_t
 stream_get_cfg_stream(struct stream *s)
 {
-	return (cfg_stream_list_find(cfg_get_streams(), s->name));
+	_stream_cfg_refresh(s);
+	if (!s->cfg_stream)
+		s->cfg_stream = cfg_stream_list_find(cfg_get_streams(),
+		    s->name);
+	return (s->cfg_stream);
 }
 
 cfg_intake_t
@@ -528,11 +1884,21 @@ stream_get_cfg_intake(struct stream *s)
 	cfg_stream_t	 cfg_stream;
 	const char	*intake;
 
+	_stream_cfg_refresh(s);
+	if (s->cfg_intake)
+		return (s->cfg_intake);
 	cfg_stream = cfg_stream_list_get(cfg_get_streams(), s->name);
 	intake = cfg_stream_get_intake(cfg_stream);
 	if (!intake)
 		intake = CFG_DEFAULT;
-	return (cfg_intake_list_get(cfg_get_intakes(), intake));
+	s->cfg_intake = cfg_intake_list_get(cfg_get_intakes(), intake);
+	return (s->cfg_intake);
+}
+
+metrics_t
+stream_get_metrics(struct stream *s)
+{
+	return (s->metrics);
 }
 
 cfg_server_t
@@ -541,18 +1907,35 @@ stream_get_cfg_server(struct stream *s)
 	cfg_stream_t	 cfg_stream;
 	const char	*server;
 
+	_stream_cfg_refresh(s);
+	if (s->cfg_server)
+		return (s->cfg_server);
 	cfg_stream = cfg_stream_list_get(cfg_get_streams(), s->name);
 	server = cfg_stream_get_server(cfg_stream);
 	if (!server)
 		server = CFG_DEFAULT;
-	return (cfg_server_list_get(cfg_get_servers(), server));
+	s->cfg_server = cfg_server_list_get(cfg_get_servers(), server);
+	return (s->cfg_server);
 }
 
 int
 stream_connect(struct stream *s)
 {
-	if (shout_open(s->shout) == SHOUTERR_SUCCESS)
+	if (shout_open(s->shout) == SHOUTERR_SUCCESS) {
+		metrics_set_connected(s->metrics, 1);
+		/*
+		 * An Ogg stream is picked up again at the next page, and a
+		 * WebM or Matroska stream at the next EBML header or Cluster,
+		 * after the stream header unless a new stream begins there:
+		 */
+		s->resume = s->ogg.enabled || s->ebml.enabled;
+		s->resume_dropped = 0;
+		s->paced = 0;
+		s->paused_ms = 0;
+		if (s->pausing)
+			clock_gettime(CLOCK_MONOTONIC, &s->pause_start);
 		return (0);
+	}
 
 	log_warning("stream: %s: connect: [%s]:%d: error %d: %s", s->name,
 	    shout_get_host(s->shout), shout_get_port(s->shout),
@@ -564,6 +1947,7 @@ stream_connect(struct stream *s)
 void
 stream_disconnect(struct stream *s)
 {
+	metrics_set_connected(s->metrics, 0);
 	if (!stream_get_connected(s))
 		return;
 	shout_close(s->shout);
@@ -572,21 +1956,202 @@ stream_disconnect(struct stream *s)
 void
 stream_sync(struct stream *s)
 {
-	shout_sync(s->shout);
+	struct timespec start;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (0 == s->paused_ms || !s->paced || !stream_get_connected(s))
+		shout_sync(s->shout);
+	else {
+		long	delay;
+
+		/* Pacing continues as if the pauses never happened: */
+		delay = shout_delay(s->shout) + s->paused_ms;
+		if (0 < delay) {
+			struct timespec ts;
+
+			ts.tv_sec = delay / 1000;
+			ts.tv_nsec = (delay % 1000) * 1000000L;
+			(void)nanosleep(&ts, NULL);
+		}
+	}
+	metrics_observe_since(s->metrics, METRICS_SYNC_WAIT, &start);
+}
+
+void
+stream_pause(struct stream *s)
+{
+	if (s->pausing)
+		return;
+	s->pausing = 1;
+	clock_gettime(CLOCK_MONOTONIC, &s->pause_start);
+}
+
+void
+stream_resume(struct stream *s)
+{
+	struct timespec now;
+
+	if (!s->pausing)
+		return;
+	s->pausing = 0;
+	/* Without pacing yet, there is nothing to catch up on: */
+	if (!s->paced)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	s->paused_ms += (now.tv_sec - s->pause_start.tv_sec) * 1000 +
+	    (now.tv_nsec - s->pause_start.tv_nsec) / 1000000;
 }
 
 int
 stream_send(struct stream *s, const char *data, size_t len)
 {
-	if (shout_send(s->shout, (const unsigned char *)data, len)
-	    == SHOUTERR_SUCCESS)
+	int	resuming = s->resume;
+
+	/*
+	 * The position follows the data handed over, whether or not it
+	 * reaches the server, as the source has moved on either way:
+	 */
+	if (s->ogg.enabled)
+		_stream_ogg_parse(s, (const unsigned char *)data, len);
+	else if (s->mp3.enabled)
+		_stream_mp3_parse(s, (const unsigned char *)data, len);
+	else if (s->ebml.enabled)
+		_stream_ebml_parse(s, (const unsigned char *)data, len);
+	if (s->archive)
+		_stream_archive(s, data, len);
+
+	if (!resuming)
+		return (_stream_send(s, data, len));
+
+	if (s->resume) {
+		s->resume_dropped += len;
+		if (s->resume_dropped <= STREAM_RESUME_MAX)
+			return (0);
+		log_warning("stream: %s: no point to resume the stream at, sending as is",
+		    s->name);
+		s->resume = 0;
+		return (_stream_send(s, data, len));
+	}
+	/* The element header may have begun in previous data: */
+	s->resume_dropped = s->resume_dropped + s->resume_at -
+	    s->resume_hdr_len;
+	if (s->resume_dropped)
+		log_info("stream: %s: resuming after %zu bytes%s", s->name,
+		    s->resume_dropped,
+		    s->resume_header ? ", with stream header" : "");
+	if ((s->resume_header &&
+		0 > _stream_send(s, s->header, s->header_len)) ||
+	    0 > _stream_send(s, (const char *)s->resume_hdr,
+		s->resume_hdr_len))
+		return (-1);
+	if (s->resume_at < len)
+		return (_stream_send(s, data + s->resume_at,
+		    len - s->resume_at));
+
+	return (0);
+}
+
+size_t
+stream_get_boundary(struct stream *s)
+{
+	struct stream_ogg	*o = &s->ogg;
+	struct stream_mp3	*m = &s->mp3;
+	struct stream_ebml	*e = &s->ebml;
+	size_t			 id_len;
+
+	if (m->enabled) {
+		if (m->skip)
+			return (m->skip);
+		if (m->frame_pos < m->frame_len)
+			return (m->frame_len - m->frame_pos);
+		if (0 == m->hdr_len)
+			return (0);
+		if (0xff == m->hdr[0])
+			return (4 - m->hdr_len);
+		return (('I' == m->hdr[0] ? 10 : 3) - m->hdr_len);
+	}
+	if (e->enabled) {
+		if (e->body_left)
+			return (e->body_left > SIZE_MAX ?
+			    SIZE_MAX : (size_t)e->body_left);
+		if (0 == e->hdr_len)
+			return (0);
+		id_len = _stream_ebml_vint_len(e->hdr[0]);
+		if (e->hdr_len <= id_len)
+			return (id_len + 1 - e->hdr_len);
+		return (id_len + _stream_ebml_vint_len(e->hdr[id_len]) -
+		    e->hdr_len);
+	}
+	if (!o->enabled || !o->synced || 0 == o->hdr_len)
 		return (0);
+	if (o->hdr_len < o->hdr_size)
+		return (o->hdr_size - o->hdr_len);
+	return (o->body_len - o->body_pos);
+}
 
-	log_warning("stream: %s: send: %s: error %d: %s", s->name,
-	    shout_get_host(s->shout), shout_get_errno(s->shout),
-	    shout_get_error(s->shout));
+void
+stream_mark(struct stream *s)
+{
+	s->ogg.mark_pos = s->ogg.pos;
+	s->ogg.mark_bytes = s->ogg.bytes;
+	s->mp3.mark_samples = s->mp3.samples;
+	s->mp3.mark_bytes = s->mp3.bytes;
+	s->mp3.have_length = 0;
+	s->mp3.probe = 1;
+	s->mp3.info_len = 0;
+}
 
-	stream_disconnect(s);
+int
+stream_get_position(struct stream *s, double *secs, double *kbps)
+{
+	struct stream_ogg	*o = &s->ogg;
+	struct stream_mp3	*m = &s->mp3;
+	uint64_t		 start, end, bytes;
 
-	return (-1);
+	if (m->enabled && m->rate) {
+		*secs = (double)(m->samples - m->mark_samples) /
+		    (double)m->rate;
+		bytes = m->bytes - m->mark_bytes;
+	} else if (o->enabled && o->have_track) {
+		start = o->mark_pos > o->preskip ? o->mark_pos : o->preskip;
+		end = o->pos > start ? o->pos : start;
+		*secs = (double)(end - start) / (double)o->rate;
+		bytes = o->bytes - o->mark_bytes;
+	} else
+		return (-1);
+
+	if (kbps)
+		*kbps = 0.0 < *secs ?
+		    (double)bytes * 8.0 / *secs / 1000.0 : 0.0;
+
+	return (0);
+}
+
+int
+stream_get_length(struct stream *s, double *secs)
+{
+	struct stream_mp3	*m = &s->mp3;
+
+	if (!m->enabled || !m->have_length || !m->frame_rate)
+		return (-1);
+	*secs = (double)m->length / (double)m->frame_rate;
+
+	return (0);
+}
+
+const char *
+stream_get_header(struct stream *s, size_t *len)
+{
+	if (!(s->ogg.enabled && s->ogg.have_header) &&
+	    !(s->ebml.enabled && s->ebml.have_header))
+		return (NULL);
+	*len = s->header_len;
+	return (s->header);
+}
+
+void
+stream_set_archive(struct stream *s, archive_t archive)
+{
+	s->archive = archive;
+	s->cut = 0;
 }
@@ -19,8 +19,13 @@
 
 #include <shout/shout.h>
 
+#include "archive.h"
 #include "cfg.h"
 #include "mdata.h"
+#include "metrics.h"
+
+#define STREAM_CHANGED_CONNECTION	0x01
+#define STREAM_CHANGED_INTAKE		0x02
 
 typedef struct stream * stream_t;
 
@@ -31,8 +36,16 @@ stream_t
 	stream_create(const char *);
 void	stream_destroy(stream_t *);
 int	stream_configure(stream_t);
+int	stream_check(stream_t);
+/*
+ * Applies a reloaded configuration, and reports what changed since the last
+ * stream_configure() or stream_reload(). The stream is disconnected if its
+ * server or stream settings changed.
+ */
+int	stream_reload(stream_t, unsigned int *);
 
-int	stream_set_metadata(stream_t, mdata_t, char **);
+int	stream_set_metadata(stream_t, mdata_t, const char **);
+int	stream_set_metadata_str(stream_t, const char *);
 
 const char *
 	stream_get_name(stream_t);
@@ -43,10 +56,47 @@ cfg_intake_t
 	stream_get_cfg_intake(stream_t);
 cfg_server_t
 	stream_get_cfg_server(stream_t);
+metrics_t
+	stream_get_metrics(stream_t);
 
 int	stream_connect(stream_t);
 void	stream_disconnect(stream_t);
 void	stream_sync(stream_t);
 int	stream_send(stream_t, const char *, size_t);
+/*
+ * Stops the clock that paces the stream while no data is being sent, so
+ * that sending picks up again at the regular rate afterwards, rather than
+ * catching up on the time spent paused.
+ */
+void	stream_pause(stream_t);
+void	stream_resume(stream_t);
+
+/*
+ * Ogg, MP3, WebM and Matroska streams are followed page by page, frame by
+ * frame, or element by element, as they are sent. The boundary is the
+ * number of bytes left until the end of the current page, frame or element,
+ * which is 0 in between them and for other formats.
+ * The position is the media time and bitrate since the last stream_mark(),
+ * or since the start of the current Ogg chain. The length of a track is
+ * known for MP3 files with a Xing, Info or VBRI header.
+ */
+size_t	stream_get_boundary(stream_t);
+void	stream_mark(stream_t);
+int	stream_get_position(stream_t, double *, double *);
+int	stream_get_length(stream_t, double *);
+/*
+ * The header pages of the current Ogg chain, or the EBML header, Segment
+ * Information and Tracks of a WebM or Matroska stream, which are sent ahead
+ * of the next page or Cluster on a new connection.
+ */
+const char *
+	stream_get_header(stream_t, size_t *);
+
+/*
+ * Adds everything that is sent from now on to an archive. New archive
+ * files begin at the same points at which a new connection picks up the
+ * stream, or with any MP3 frame.
+ */
+void	stream_set_archive(stream_t, archive_t);
 
 #endif /* __STREAM_H__ */
@@ -29,6 +29,7 @@
 #include <locale.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 
 #ifdef HAVE_ICONV
@@ -39,98 +40,279 @@
 #include "util.h"
 #include "xalloc.h"
 
-#ifndef BUFSIZ
-# define BUFSIZ 1024
-#endif
+struct util_template_token {
+	size_t		 id;	/* Placeholder index, or TEMPLATE_LITERAL */
+	const char	*str;	/* Literal text */
+	size_t		 len;
+};
+
+#define TEMPLATE_LITERAL	((size_t)-1)
+
+struct util_template {
+	char				*source;
+	struct util_template_token	*tokens;
+	size_t				 num_tokens;
+	size_t				 literal_len;
+};
+
+enum util_conv {
+	UTIL_CONV_TO_UTF8 = 0,
+	UTIL_CONV_FROM_UTF8,
+	UTIL_CONV_MAX
+};
+
+/* Resolved on first use, and again after util_reset_codeset(): */
+static char		 util_codeset[64];
+static int		 util_codeset_utf8;
+#ifdef HAVE_ICONV
+static iconv_t		 util_cd[UTIL_CONV_MAX] = {
+	(iconv_t)-1, (iconv_t)-1
+};
+#endif /* HAVE_ICONV */
 
 static char		*pidfile_path;
 static FILE		*pidfile_file;
 static pid_t		 pidfile_pid;
 static unsigned int	 pidfile_numlocks;
 
-static char *	_util_iconvert(const char *, const char *, const char *);
+static const char *
+		_util_codeset(void);
+static size_t	_util_utf8_len(const unsigned char *);
+static int	_util_utf8_check(const char *);
+static char *	_util_utf8_sanitize(xarena_t, const char *);
+static char *	_util_strdup(xarena_t, const char *);
+static char *	_util_grow(xarena_t, char *, size_t, size_t);
+static char *	_util_iconvert(xarena_t, const char *, enum util_conv);
+#ifdef HAVE_ICONV
+static iconv_t	_util_iconv_open(enum util_conv);
+#endif /* HAVE_ICONV */
+static void	_util_template_add(struct util_template *, size_t,
+		    const char *, size_t);
+static void	_util_shellquote(const char *, char *, size_t);
 static void	_util_cleanup_pidfile(void);
 
-static char *
-_util_iconvert(const char *in_str, const char *from, const char *to)
+static const char *
+_util_codeset(void)
 {
-#ifdef HAVE_ICONV
-	iconv_t 		 cd;
-	ICONV_CONST char	*input, *ip;
-	size_t			 input_len;
-	char			*output;
-	size_t			 output_size;
-	char			 buf[BUFSIZ], *bp;
-	size_t			 bufavail;
-	size_t			 out_pos;
-	char			*tocode;
+	if ('\0' == util_codeset[0]) {
+		const char	*codeset;
+
+		setlocale(LC_CTYPE, "");
+		codeset = nl_langinfo((nl_item)CODESET);
+		(void)strlcpy(util_codeset, codeset && codeset[0] ?
+		    codeset : "US-ASCII", sizeof(util_codeset));
+		setlocale(LC_CTYPE, "C");
+		util_codeset_utf8 = 0 == strcasecmp(util_codeset, "UTF-8") ||
+		    0 == strcasecmp(util_codeset, "UTF8");
+	}
 
-	if (NULL == in_str)
-		return (xstrdup(""));
+	return (util_codeset);
+}
 
-	tocode = xstrdup(to);
-	if ((cd = iconv_open(tocode, from)) == (iconv_t)-1 &&
-	    (cd = iconv_open("", from)) == (iconv_t)-1 &&
-	    (cd = iconv_open(tocode, "")) == (iconv_t)-1) {
-		xfree(tocode);
-		log_syserr(ERROR, errno, "iconv_open");
-		return (xstrdup(in_str));
+/*
+ * Returns the length of the valid UTF-8 sequence at the given position, or
+ * 0 if there is none. Overlong forms, surrogates, and code points past
+ * U+10FFFF are not valid.
+ */
+static size_t
+_util_utf8_len(const unsigned char *p)
+{
+	size_t	n, i;
+
+	if (0x80 > p[0])
+		return (1);
+	if (0xc2 <= p[0] && 0xdf >= p[0])
+		n = 1;
+	else if (0xe0 <= p[0] && 0xef >= p[0])
+		n = 2;
+	else if (0xf0 <= p[0] && 0xf4 >= p[0])
+		n = 3;
+	else
+		return (0);
+	for (i = 1; i <= n; i++) {
+		if (0x80 != (p[i] & 0xc0))
+			return (0);
 	}
+	if ((0xe0 == p[0] && 0xa0 > p[1]) ||
+	    (0xed == p[0] && 0xa0 <= p[1]) ||
+	    (0xf0 == p[0] && 0x90 > p[1]) ||
+	    (0xf4 == p[0] && 0x90 <= p[1]))
+		return (0);
 
-	ip = input = (ICONV_CONST char *)in_str;
-	input_len = strlen(input);
-	output_size = 1;
-	output = xcalloc(output_size, sizeof(char));
-	out_pos = 0;
-	output[out_pos] = '\0';
-	while (input_len > 0) {
-		char	*op;
-		size_t	 count;
-
-		buf[0] = '\0';
-		bp = buf;
-		bufavail = sizeof(buf) - 1;
-
-		if (iconv(cd, &ip, &input_len, &bp, &bufavail) == (size_t)-1 &&
-		    errno != E2BIG) {
-			*bp++ = '?';
-			ip++;
-			input_len--;
-			bufavail--;
-		}
-		*bp = '\0';
+	return (n + 1);
+}
 
-		count = sizeof(buf) - bufavail - 1;
+/*
+ * Returns 1 for plain ASCII input, 2 for other valid UTF-8, and 0 for
+ * anything else.
+ */
+static int
+_util_utf8_check(const char *str)
+{
+	const unsigned char	*p = (const unsigned char *)str;
+	int			 ret = 1;
 
-		output_size += count;
-		op = output = xreallocarray(output, output_size, sizeof(char));
-		op += out_pos;
-		memcpy(op, buf, count);
-		out_pos += count;
-		op += count;
-		*op = '\0';
+	while (*p) {
+		size_t	n;
+
+		if (0 == (n = _util_utf8_len(p)))
+			return (0);
+		if (1 < n)
+			ret = 2;
+		p += n;
 	}
 
-	if (iconv_close(cd) == -1) {
-		log_syserr(ERROR, errno, "iconv_close");
-		xfree(output);
-		xfree(tocode);
-		return (xstrdup(in_str));
+	return (ret);
+}
+
+/*
+ * Replaces what is not valid UTF-8, which iconv(3) implementations do not
+ * reliably do when converting from UTF-8 to UTF-8:
+ */
+static char *
+_util_utf8_sanitize(xarena_t a, const char *str)
+{
+	const unsigned char	*p = (const unsigned char *)str;
+	char			*out, *op;
+	size_t			 n;
+
+	op = out = _util_grow(a, NULL, 0, strlen(str) + 1);
+	while (*p) {
+		if (0 == (n = _util_utf8_len(p))) {
+			*op++ = '?';
+			p++;
+			continue;
+		}
+		memcpy(op, p, n);
+		op += n;
+		p += n;
 	}
+	*op = '\0';
 
-	xfree(tocode);
-	return (output);
-#else
-	(void)from;
-	(void)to;
+	return (out);
+}
+
+/* Copies and buffers come from the arena, if one is given: */
+static char *
+_util_strdup(xarena_t a, const char *str)
+{
+	return (a ? xarena_strdup(a, str) : xstrdup(str));
+}
+
+static char *
+_util_grow(xarena_t a, char *old, size_t old_size, size_t size)
+{
+	char	*p;
+
+	if (NULL == a)
+		return (xreallocarray(old, size, sizeof(char)));
+	p = xarena_alloc(a, size);
+	if (old)
+		memcpy(p, old, old_size);
+
+	return (p);
+}
+
+static char *
+_util_iconvert(xarena_t a, const char *in_str, enum util_conv conv)
+{
+	int	check;
 
 	if (NULL == in_str)
-		return (xstrdup(""));
+		return (_util_strdup(a, ""));
+
+	/*
+	 * Plain ASCII is the same in UTF-8 and in every locale codeset that
+	 * matters, and valid UTF-8 needs no conversion in UTF-8 locales:
+	 */
+	check = _util_utf8_check(in_str);
+	if (1 == check)
+		return (_util_strdup(a, in_str));
+	(void)_util_codeset();
+	if (2 == check && util_codeset_utf8)
+		return (_util_strdup(a, in_str));
+	if (util_codeset_utf8)
+		return (_util_utf8_sanitize(a, in_str));
 
-	return (xstrdup(in_str));
+#ifdef HAVE_ICONV
+	{
+		iconv_t 		 cd;
+		ICONV_CONST char	*ip;
+		size_t			 input_len;
+		char			*output, *op;
+		size_t			 output_size, out_avail;
+
+		if (NULL == (cd = _util_iconv_open(conv)))
+			return (_util_strdup(a, in_str));
+		/* Reset the conversion state of the cached descriptor: */
+		(void)iconv(cd, NULL, NULL, NULL, NULL);
+
+		ip = (ICONV_CONST char *)in_str;
+		input_len = strlen(in_str);
+		/* Enough for any conversion between UTF-8 and 8 bit codesets: */
+		output_size = input_len * 4 + 1;
+		op = output = _util_grow(a, NULL, 0, output_size);
+		out_avail = output_size - 1;
+		while (input_len > 0) {
+			if (iconv(cd, &ip, &input_len, &op, &out_avail) !=
+			    (size_t)-1)
+				continue;
+			if (E2BIG == errno || 0 == out_avail) {
+				size_t	out_pos = (size_t)(op - output);
+
+				output = _util_grow(a, output, output_size,
+				    output_size * 2);
+				out_avail += output_size;
+				output_size *= 2;
+				op = output + out_pos;
+				continue;
+			}
+			/* Replace what cannot be converted: */
+			*op++ = '?';
+			out_avail--;
+			ip++;
+			input_len--;
+		}
+		*op = '\0';
+
+		return (output);
+	}
+#else
+	(void)conv;
+
+	return (_util_strdup(a, in_str));
 #endif /* HAVE_ICONV */
 }
 
+#ifdef HAVE_ICONV
+static iconv_t
+_util_iconv_open(enum util_conv conv)
+{
+	const char	*from, *to;
+	iconv_t 	 cd;
+
+	if ((iconv_t)-1 != util_cd[conv])
+		return (util_cd[conv]);
+
+	if (UTIL_CONV_TO_UTF8 == conv) {
+		from = _util_codeset();
+		to = "UTF-8";
+	} else {
+		from = "UTF-8";
+		to = _util_codeset();
+	}
+	if ((cd = iconv_open(to, from)) == (iconv_t)-1 &&
+	    (cd = iconv_open("", from)) == (iconv_t)-1 &&
+	    (cd = iconv_open(to, "")) == (iconv_t)-1) {
+		log_syserr(ERROR, errno, "iconv_open");
+		return (NULL);
+	}
+	util_cd[conv] = cd;
+
+	return (cd);
+}
+#endif /* HAVE_ICONV */
+
 static void
 _util_cleanup_pidfile(void)
 {
@@ -250,65 +432,86 @@ util_strrcasecmp(const char *s, const char *sub)
 char *
 util_char2utf8(const char *in_str)
 {
-	char	*codeset;
-
-	setlocale(LC_CTYPE, "");
-	codeset = nl_langinfo((nl_item)CODESET);
-	setlocale(LC_CTYPE, "C");
+	return (_util_iconvert(NULL, in_str, UTIL_CONV_TO_UTF8));
+}
 
-	return (_util_iconvert(in_str, codeset, "UTF-8"));
+char *
+util_char2utf8_arena(xarena_t a, const char *in_str)
+{
+	return (_util_iconvert(a, in_str, UTIL_CONV_TO_UTF8));
 }
 
 char *
 util_utf82char(const char *in_str)
 {
-	char	*codeset;
+	return (_util_iconvert(NULL, in_str, UTIL_CONV_FROM_UTF8));
+}
 
-	setlocale(LC_CTYPE, "");
-	codeset = nl_langinfo((nl_item)CODESET);
-	setlocale(LC_CTYPE, "C");
+char *
+util_utf82char_arena(xarena_t a, const char *in_str)
+{
+	return (_util_iconvert(a, in_str, UTIL_CONV_FROM_UTF8));
+}
 
-	return (_util_iconvert(in_str, "UTF-8", codeset));
+void
+util_reset_codeset(void)
+{
+#ifdef HAVE_ICONV
+	unsigned int	i;
+
+	for (i = 0; i < UTIL_CONV_MAX; i++) {
+		if ((iconv_t)-1 == util_cd[i])
+			continue;
+		if (-1 == iconv_close(util_cd[i]))
+			log_syserr(ERROR, errno, "iconv_close");
+		util_cd[i] = (iconv_t)-1;
+	}
+#endif /* HAVE_ICONV */
+	util_codeset[0] = '\0';
+	util_codeset_utf8 = 0;
 }
 
 char *
 util_expand_words(const char *in, struct util_dict dicts[])
 {
-	size_t	 i;
-	char	*out;
-	size_t	 out_size = strlen(in) + 1;
+	const struct util_dict	*d;
+	const char		*in_p;
+	char			*out, *out_p;
+	size_t			 out_size;
+	int			 pass;
 
 	/* empty input string? */
-	if (1 == out_size)
+	if ('\0' == in[0])
 		return (NULL);
 
-	out = xstrdup(in);
-	i = out_size - 1;
-	while (i--) {
-		struct util_dict *d = dicts;
-
-		while (d && d->from) {
-			if (0 == strncmp(&out[i], d->from, strlen(d->from))) {
-				char	*buf, *tmp;
-				size_t	 buf_len;
-
-				buf_len = strlen(&out[i]) + strlen(d->to)
-				    - strlen(d->from);
-				buf = xcalloc(buf_len + 1, sizeof(*buf));
-				snprintf(buf, buf_len + 1, "%s%s",
-				    d->to, &out[i + strlen(d->from)]);
-
-				out_size += buf_len;
-				tmp = xcalloc(out_size, sizeof(*tmp));
-				snprintf(tmp, i + 1, "%s", out);
-				snprintf(tmp + i, out_size - i, "%s", buf);
-				free(buf);
-				free(out);
-				out = tmp;
-
-				break;
+	/* Determine the output size first, then fill it in: */
+	out = out_p = NULL;
+	out_size = 1;
+	for (pass = 0; pass < 2; pass++) {
+		if (1 == pass)
+			out = out_p = xcalloc(out_size, sizeof(*out));
+		for (in_p = in; *in_p; ) {
+			for (d = dicts; d && d->from; d++) {
+				if (*in_p == d->from[0] &&
+				    0 == strncmp(in_p, d->from, strlen(d->from)))
+					break;
+			}
+			if (d && d->from) {
+				size_t	to_len = strlen(d->to);
+
+				if (1 == pass) {
+					memcpy(out_p, d->to, to_len);
+					out_p += to_len;
+				} else
+					out_size += to_len;
+				in_p += strlen(d->from);
+			} else {
+				if (1 == pass)
+					*out_p++ = *in_p;
+				else
+					out_size++;
+				in_p++;
 			}
-			d++;
 		}
 	}
 
@@ -317,19 +520,16 @@ util_expand_words(const char *in, struct util_dict dicts[])
 
 #define SHELLQUOTE_OUTLEN_MAX	8191UL
 
-char *
-util_shellquote(const char *in, size_t outlen_max)
+/*
+ * Writes at most out_len characters of quoted input, plus the terminating
+ * NUL, to out.
+ */
+static void
+_util_shellquote(const char *in, char *out, size_t out_len)
 {
-	char		*out, *out_p;
-	size_t		 out_len;
+	char		*out_p;
 	const char	*in_p;
 
-	if (!outlen_max || outlen_max > SHELLQUOTE_OUTLEN_MAX)
-		outlen_max = SHELLQUOTE_OUTLEN_MAX;
-	out_len = outlen_max;
-
-	out = xcalloc(out_len + 1, sizeof(char));
-
 	out_p = out;
 	in_p = in;
 
@@ -357,6 +557,195 @@ util_shellquote(const char *in, size_t outlen_max)
 		out_len--;
 	}
 	*out_p++ = '\'';
+	*out_p = '\0';
+}
+
+char *
+util_shellquote(const char *in, size_t outlen_max)
+{
+	char	*out;
+
+	if (!outlen_max || outlen_max > SHELLQUOTE_OUTLEN_MAX)
+		outlen_max = SHELLQUOTE_OUTLEN_MAX;
+
+	out = xcalloc(outlen_max + 1, sizeof(char));
+	_util_shellquote(in, out, outlen_max);
+
+	return (out);
+}
+
+char *
+util_shellquote_arena(xarena_t a, const char *in, size_t outlen_max)
+{
+	const char	*in_p;
+	char		*out;
+	size_t		 out_len;
+
+	if (!outlen_max || outlen_max > SHELLQUOTE_OUTLEN_MAX)
+		outlen_max = SHELLQUOTE_OUTLEN_MAX;
+
+	/* Only reserve what the quoted string needs: */
+	out_len = strlen("''") + strlen(in);
+	for (in_p = in; NULL != (in_p = strchr(in_p, '\'')); in_p++)
+		out_len += strlen("'\\''") - 1;
+	if (out_len > outlen_max)
+		out_len = outlen_max;
+
+	out = xarena_alloc(a, out_len + 1);
+	_util_shellquote(in, out, out_len);
+
+	return (out);
+}
+
+char *
+util_jsonquote(const char *in)
+{
+	char		*out, *out_p;
+	size_t		 out_len;
+	const char	*in_p;
+
+	out_len = strlen("\"\"") + 1;
+	for (in_p = in; *in_p; in_p++) {
+		if ('"' == *in_p || '\\' == *in_p)
+			out_len += 2;
+		else if (0x20 > (unsigned char)*in_p)
+			out_len += strlen("\\u0000");
+		else
+			out_len++;
+	}
+
+	out = xcalloc(out_len, sizeof(char));
+	out_p = out;
+
+	*out_p++ = '"';
+	for (in_p = in; *in_p; in_p++) {
+		if ('"' == *in_p || '\\' == *in_p) {
+			*out_p++ = '\\';
+			*out_p++ = *in_p;
+		} else if (0x20 > (unsigned char)*in_p) {
+			(void)snprintf(out_p, out_len - (size_t)(out_p - out),
+			    "\\u%04x", (unsigned int)(unsigned char)*in_p);
+			out_p += strlen("\\u0000");
+		} else
+			*out_p++ = *in_p;
+	}
+	*out_p = '"';
+
+	return (out);
+}
+
+static void
+_util_template_add(struct util_template *t, size_t id, const char *str,
+    size_t len)
+{
+	struct util_template_token	*tok;
+
+	if (TEMPLATE_LITERAL == id && 0 == len)
+		return;
+	t->tokens = xreallocarray(t->tokens, t->num_tokens + 1,
+	    sizeof(*t->tokens));
+	tok = &t->tokens[t->num_tokens++];
+	tok->id = id;
+	tok->str = str;
+	tok->len = len;
+	if (TEMPLATE_LITERAL == id)
+		t->literal_len += len;
+}
+
+struct util_template *
+util_template_compile(const char *in, const char *const placeholders[])
+{
+	struct util_template	*t;
+	const char		*p, *lit;
+	size_t			 i;
+
+	t = xcalloc(1UL, sizeof(*t));
+	t->source = xstrdup(in);
+
+	/* Tokens point into the private copy of the source string: */
+	for (p = lit = t->source; *p; ) {
+		for (i = 0; placeholders[i]; i++) {
+			if (*p == placeholders[i][0] &&
+			    0 == strncmp(p, placeholders[i],
+				strlen(placeholders[i])))
+				break;
+		}
+		if (NULL == placeholders[i]) {
+			p++;
+			continue;
+		}
+		_util_template_add(t, TEMPLATE_LITERAL, lit, (size_t)(p - lit));
+		_util_template_add(t, i, NULL, 0);
+		p += strlen(placeholders[i]);
+		lit = p;
+	}
+	_util_template_add(t, TEMPLATE_LITERAL, lit, (size_t)(p - lit));
+
+	return (t);
+}
+
+void
+util_template_destroy(struct util_template **t_p)
+{
+	struct util_template	*t = *t_p;
+
+	if (NULL == t)
+		return;
+	xfree(t->tokens);
+	xfree(t->source);
+	xfree(t);
+	*t_p = NULL;
+}
+
+const char *
+util_template_get_source(struct util_template *t)
+{
+	return (t->source);
+}
+
+size_t
+util_template_render(struct util_template *t, const char *const values[],
+    char *buf, size_t bufsize)
+{
+	size_t	i, len, out_len = 0;
+
+	for (i = 0; i < t->num_tokens; i++) {
+		const struct util_template_token	*tok = &t->tokens[i];
+		const char				*str;
+
+		if (TEMPLATE_LITERAL == tok->id) {
+			str = tok->str;
+			len = tok->len;
+		} else {
+			str = values[tok->id] ? values[tok->id] : "";
+			len = strlen(str);
+		}
+		if (out_len < bufsize) {
+			size_t	n = bufsize - out_len - 1;
+
+			memcpy(buf + out_len, str, len < n ? len : n);
+		}
+		out_len += len;
+	}
+	if (bufsize)
+		buf[out_len < bufsize ? out_len : bufsize - 1] = '\0';
+
+	return (out_len);
+}
+
+char *
+util_template_expand(struct util_template *t, const char *const values[])
+{
+	char	*out;
+	size_t	 i, out_size = t->literal_len + 1;
+
+	for (i = 0; i < t->num_tokens; i++) {
+		if (TEMPLATE_LITERAL != t->tokens[i].id &&
+		    values[t->tokens[i].id])
+			out_size += strlen(values[t->tokens[i].id]);
+	}
+	out = xmalloc(out_size);
+	(void)util_template_render(t, values, out, out_size);
 
 	return (out);
 }
@@ -16,6 +16,8 @@
 #ifndef __UTIL_H__
 #define __UTIL_H__
 
+#include "xalloc.h"
+
 #ifndef UTIL_DEFAULT_PROGNAME
 # define UTIL_DEFAULT_PROGNAME  "ezstream"
 #endif /* !UTIL_DEFAULT_PROGNAME */
@@ -25,6 +27,14 @@ struct util_dict {
 	const char	*to;
 };
 
+/*
+ * Compiled form of a string with placeholders, which can be expanded in a
+ * single pass. Placeholders are identified by their index in the array of
+ * names that the template was compiled with, and the same index is used
+ * to look up their values when rendering.
+ */
+typedef struct util_template *	util_template_t;
+
 const char *
 	util_get_progname(const char *);
 int	util_write_pid_file(const char *);
@@ -32,7 +42,21 @@ int	util_strrcmp(const char *, const char *);
 int	util_strrcasecmp(const char *, const char *);
 char *	util_char2utf8(const char *);
 char *	util_utf82char(const char *);
+char *	util_char2utf8_arena(xarena_t, const char *);
+char *	util_utf82char_arena(xarena_t, const char *);
+void	util_reset_codeset(void);
 char *	util_expand_words(const char *, struct util_dict[]);
 char *	util_shellquote(const char *, size_t);
+char *	util_shellquote_arena(xarena_t, const char *, size_t);
+char *	util_jsonquote(const char *);
+
+util_template_t
+	util_template_compile(const char *, const char *const []);
+void	util_template_destroy(util_template_t *);
+const char *
+	util_template_get_source(util_template_t);
+size_t	util_template_render(util_template_t, const char *const [], char *,
+	    size_t);
+char *	util_template_expand(util_template_t, const char *const []);
 
 #endif /* __UTIL_H__ */
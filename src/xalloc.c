@@ -20,12 +20,311 @@
 
 #include "compat.h"
 
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif /* HAVE_PTHREAD */
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "log.h"
 #include "xalloc.h"
 
+/* Default arena chunk size, and the alignment of arena allocations: */
+#define XARENA_CHUNK_SIZE	4096UL
+#define XARENA_ALIGN		16UL
+#define XARENA_ROUNDUP(n)	(((n) + XARENA_ALIGN - 1) & ~(XARENA_ALIGN - 1))
+
+struct xarena_chunk {
+	struct xarena_chunk	*next;
+	size_t			 size;
+	size_t			 used;
+};
+#define XARENA_CHUNK_HDR	XARENA_ROUNDUP(sizeof(struct xarena_chunk))
+
+struct xarena {
+	struct xarena_chunk	*chunks;
+	size_t			 chunk_size;
+	struct xarena_stats	 stats;
+};
+
+/*
+ * Allocations are counted per thread where possible, so that benchmarks
+ * of one thread are not thrown off by others.
+ */
+#if defined(HAVE_THREAD_LOCAL)
+static __thread unsigned long	xalloc_allocs;
+# define XALLOC_COUNT()		xalloc_allocs++
+# define XALLOC_ALLOCS()	xalloc_allocs
+#elif defined(HAVE_ATOMIC_BUILTINS)
+static unsigned long	xalloc_allocs;
+# define XALLOC_COUNT()		\
+	(void)__atomic_fetch_add(&xalloc_allocs, 1UL, __ATOMIC_RELAXED)
+# define XALLOC_ALLOCS()	__atomic_load_n(&xalloc_allocs, __ATOMIC_RELAXED)
+#else
+static unsigned long	xalloc_allocs;
+# define XALLOC_COUNT()		xalloc_allocs++
+# define XALLOC_ALLOCS()	xalloc_allocs
+#endif
+
+/*
+ * Allocation profiling: counts per call site, and a table of the live
+ * allocations made while profiling is on, to attribute frees and
+ * reallocations to their sites. Both use open addressing with linear
+ * probing, and are allocated with plain malloc() so as not to profile
+ * themselves.
+ */
+#define XALLOC_PROF_SITES	1024U
+#define XALLOC_PROF_PTRS_MIN	1024U
+
+struct xalloc_prof_ptr {
+	const void	*ptr;
+	size_t		 size;
+	unsigned int	 site;
+};
+
+static int			 xalloc_prof_on;
+static struct xalloc_site	*xalloc_prof_sites;
+static unsigned int		 xalloc_prof_nsites;
+static struct xalloc_prof_ptr	*xalloc_prof_ptrs;
+static size_t			 xalloc_prof_ptrs_size;
+static size_t			 xalloc_prof_nptrs;
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t		 xalloc_prof_mtx = PTHREAD_MUTEX_INITIALIZER;
+# define XALLOC_PROF_LOCK()	pthread_mutex_lock(&xalloc_prof_mtx)
+# define XALLOC_PROF_UNLOCK()	pthread_mutex_unlock(&xalloc_prof_mtx)
+#else
+# define XALLOC_PROF_LOCK()	do { } while (0)
+# define XALLOC_PROF_UNLOCK()	do { } while (0)
+#endif /* HAVE_PTHREAD */
+/*
+ * Profiling is toggled under the lock, but checked without it first, so
+ * that allocations stay cheap while it is off. The tables are only touched
+ * after checking again under the lock.
+ */
+#ifdef HAVE_ATOMIC_BUILTINS
+# define XALLOC_PROF_ON()	__atomic_load_n(&xalloc_prof_on, __ATOMIC_ACQUIRE)
+# define XALLOC_PROF_SET_ON(on) \
+	__atomic_store_n(&xalloc_prof_on, on, __ATOMIC_RELEASE)
+#else
+# define XALLOC_PROF_ON()	xalloc_prof_on
+# define XALLOC_PROF_SET_ON(on) xalloc_prof_on = (on)
+#endif /* HAVE_ATOMIC_BUILTINS */
+
+static struct xarena_chunk *
+		_xarena_chunk_new(struct xarena *, size_t, const char *,
+		    unsigned int);
+static void	_xarena_free_chunks(struct xarena *);
+static size_t	_xalloc_prof_hash(const void *);
+static unsigned int
+		_xalloc_prof_site(const char *, unsigned int);
+static void	_xalloc_prof_grow(void);
+static void	_xalloc_prof_alloc(const void *, size_t, const char *,
+		    unsigned int);
+static void	_xalloc_prof_free(const void *);
+static void	_xalloc_prof_clear(void);
+static int	_xalloc_prof_cmp(const void *, const void *);
+
+static size_t
+_xalloc_prof_hash(const void *ptr)
+{
+	uintptr_t	h = (uintptr_t)ptr >> 4;
+
+	h ^= h >> 16;
+	h *= 0x45d9f3bU;
+	h ^= h >> 16;
+
+	return ((size_t)h);
+}
+
+static unsigned int
+_xalloc_prof_site(const char *file, unsigned int line)
+{
+	unsigned int	i, n;
+
+	/* __FILE__ is the same string for all call sites in a file: */
+	i = (unsigned int)((_xalloc_prof_hash(file) ^ line * 0x9e3779b1U) %
+	    XALLOC_PROF_SITES);
+	for (n = 0; n < XALLOC_PROF_SITES; n++) {
+		struct xalloc_site	*s = &xalloc_prof_sites[i];
+
+		if (NULL == s->file) {
+			s->file = file;
+			s->line = line;
+			xalloc_prof_nsites++;
+			return (i);
+		}
+		if (s->line == line &&
+		    (s->file == file || 0 == strcmp(s->file, file)))
+			return (i);
+		i = (i + 1) % XALLOC_PROF_SITES;
+	}
+
+	/* Table is full; account to the site that is already there: */
+	return (i);
+}
+
+static void
+_xalloc_prof_grow(void)
+{
+	struct xalloc_prof_ptr	*old = xalloc_prof_ptrs;
+	size_t			 old_size = xalloc_prof_ptrs_size;
+	size_t			 i;
+
+	xalloc_prof_ptrs_size = old_size ? old_size * 2 : XALLOC_PROF_PTRS_MIN;
+	xalloc_prof_ptrs = calloc(xalloc_prof_ptrs_size,
+	    sizeof(*xalloc_prof_ptrs));
+	if (NULL == xalloc_prof_ptrs) {
+		log_alert("xalloc profile: cannot allocate %zu entries",
+		    xalloc_prof_ptrs_size);
+		exit(1);
+	}
+	for (i = 0; i < old_size; i++) {
+		size_t	j;
+
+		if (NULL == old[i].ptr)
+			continue;
+		j = _xalloc_prof_hash(old[i].ptr) & (xalloc_prof_ptrs_size - 1);
+		while (NULL != xalloc_prof_ptrs[j].ptr)
+			j = (j + 1) & (xalloc_prof_ptrs_size - 1);
+		xalloc_prof_ptrs[j] = old[i];
+	}
+	free(old);
+}
+
+static void
+_xalloc_prof_alloc(const void *ptr, size_t size, const char *file,
+    unsigned int line)
+{
+	struct xalloc_site	*s;
+	unsigned int		 site;
+	size_t			 i;
+
+	XALLOC_PROF_LOCK();
+	if (!XALLOC_PROF_ON()) {
+		XALLOC_PROF_UNLOCK();
+		return;
+	}
+	site = _xalloc_prof_site(file, line);
+	s = &xalloc_prof_sites[site];
+	s->allocs++;
+	s->bytes += size;
+	s->live++;
+	s->live_bytes += size;
+
+	/* Keep the table at most half full: */
+	if (2 * (xalloc_prof_nptrs + 1) > xalloc_prof_ptrs_size)
+		_xalloc_prof_grow();
+	i = _xalloc_prof_hash(ptr) & (xalloc_prof_ptrs_size - 1);
+	while (NULL != xalloc_prof_ptrs[i].ptr)
+		i = (i + 1) & (xalloc_prof_ptrs_size - 1);
+	xalloc_prof_ptrs[i].ptr = ptr;
+	xalloc_prof_ptrs[i].size = size;
+	xalloc_prof_ptrs[i].site = site;
+	xalloc_prof_nptrs++;
+	XALLOC_PROF_UNLOCK();
+}
+
+static void
+_xalloc_prof_free(const void *ptr)
+{
+	struct xalloc_site	*s;
+	size_t			 i, j, mask;
+
+	XALLOC_PROF_LOCK();
+	if (!XALLOC_PROF_ON() || NULL == ptr || 0 == xalloc_prof_nptrs) {
+		XALLOC_PROF_UNLOCK();
+		return;
+	}
+	mask = xalloc_prof_ptrs_size - 1;
+	for (i = _xalloc_prof_hash(ptr) & mask;
+	    NULL != xalloc_prof_ptrs[i].ptr; i = (i + 1) & mask) {
+		if (xalloc_prof_ptrs[i].ptr == ptr)
+			break;
+	}
+	if (NULL == xalloc_prof_ptrs[i].ptr) {
+		/* Allocated before profiling was turned on */
+		XALLOC_PROF_UNLOCK();
+		return;
+	}
+
+	s = &xalloc_prof_sites[xalloc_prof_ptrs[i].site];
+	s->live--;
+	s->live_bytes -= xalloc_prof_ptrs[i].size;
+	xalloc_prof_nptrs--;
+
+	/* Close the gap, so that no probe sequence is interrupted: */
+	xalloc_prof_ptrs[i].ptr = NULL;
+	for (j = (i + 1) & mask; NULL != xalloc_prof_ptrs[j].ptr;
+	    j = (j + 1) & mask) {
+		size_t	k = _xalloc_prof_hash(xalloc_prof_ptrs[j].ptr) & mask;
+
+		if ((j > i && (k <= i || k > j)) ||
+		    (j < i && (k <= i && k > j))) {
+			xalloc_prof_ptrs[i] = xalloc_prof_ptrs[j];
+			xalloc_prof_ptrs[j].ptr = NULL;
+			i = j;
+		}
+	}
+	XALLOC_PROF_UNLOCK();
+}
+
+static void
+_xalloc_prof_clear(void)
+{
+	free(xalloc_prof_sites);
+	xalloc_prof_sites = NULL;
+	xalloc_prof_nsites = 0;
+	free(xalloc_prof_ptrs);
+	xalloc_prof_ptrs = NULL;
+	xalloc_prof_ptrs_size = 0;
+	xalloc_prof_nptrs = 0;
+}
+
+static int
+_xalloc_prof_cmp(const void *a, const void *b)
+{
+	const struct xalloc_site	*sa = a, *sb = b;
+
+	if (sa->live_bytes != sb->live_bytes)
+		return (sa->live_bytes < sb->live_bytes ? 1 : -1);
+	if (sa->bytes != sb->bytes)
+		return (sa->bytes < sb->bytes ? 1 : -1);
+	return (0);
+}
+
+static struct xarena_chunk *
+_xarena_chunk_new(struct xarena *a, size_t size, const char *file,
+    unsigned int line)
+{
+	struct xarena_chunk	*c;
+
+	if (size > SIZE_MAX - XARENA_CHUNK_HDR) {
+		log_alert("%s[%u]: cannot allocate %zu bytes",
+		    file, line, size);
+		exit(1);
+	}
+	c = xmalloc_c(XARENA_CHUNK_HDR + size, file, line);
+	c->next = NULL;
+	c->size = size;
+	c->used = 0;
+	a->stats.capacity += size;
+
+	return (c);
+}
+
+static void
+_xarena_free_chunks(struct xarena *a)
+{
+	struct xarena_chunk	*c;
+
+	while (NULL != (c = a->chunks)) {
+		a->chunks = c->next;
+		xfree(c);
+	}
+	a->stats.capacity = 0;
+}
+
 void *
 xmalloc_c(size_t size, const char *file, unsigned int line)
 {
@@ -36,6 +335,9 @@ xmalloc_c(size_t size, const char *file, unsigned int line)
 		    file, line, size);
 		exit(1);
 	}
+	XALLOC_COUNT();
+	if (XALLOC_PROF_ON())
+		_xalloc_prof_alloc(ret, size, file, line);
 
 	return (ret);
 }
@@ -50,6 +352,9 @@ xcalloc_c(size_t nmemb, size_t size, const char *file, unsigned int line)
 		    file, line, nmemb, size);
 		exit(1);
 	}
+	XALLOC_COUNT();
+	if (XALLOC_PROF_ON())
+		_xalloc_prof_alloc(ret, nmemb * size, file, line);
 
 	return (ret);
 }
@@ -58,13 +363,20 @@ void *
 xreallocarray_c(void *ptr, size_t nmemb, size_t size, const char *file,
     unsigned int line)
 {
-	void	*ret = reallocarray(ptr, nmemb, size);
+	void	*ret;
 
+	/* Failure is fatal, so the old allocation can be forgotten first: */
+	if (XALLOC_PROF_ON())
+		_xalloc_prof_free(ptr);
+	ret = reallocarray(ptr, nmemb, size);
 	if (NULL == ret) {
 		log_alert("%s[%u]: cannot allocate %zu * %zu bytes",
 		    file, line, nmemb, size);
 		exit(1);
 	}
+	XALLOC_COUNT();
+	if (XALLOC_PROF_ON())
+		_xalloc_prof_alloc(ret, nmemb * size, file, line);
 
 	return (ret);
 }
@@ -79,6 +391,9 @@ xstrdup_c(const char *str, const char *file, unsigned int line)
 		    file, line, strlen(str) + 1);
 		exit(1);
 	}
+	XALLOC_COUNT();
+	if (XALLOC_PROF_ON())
+		_xalloc_prof_alloc(ret, strlen(ret) + 1, file, line);
 
 	return (ret);
 }
@@ -88,5 +403,210 @@ xfree_c(void *ptr, const char *file, unsigned int line)
 {
 	(void)file;
 	(void)line;
+	if (XALLOC_PROF_ON())
+		_xalloc_prof_free(ptr);
 	free(ptr);
 }
+
+unsigned long
+xalloc_get_allocs(void)
+{
+	return (XALLOC_ALLOCS());
+}
+
+void
+xalloc_profile_set(int on)
+{
+	XALLOC_PROF_LOCK();
+	if (on && !XALLOC_PROF_ON()) {
+		xalloc_prof_sites = calloc(XALLOC_PROF_SITES,
+		    sizeof(*xalloc_prof_sites));
+		if (NULL == xalloc_prof_sites) {
+			log_alert("xalloc profile: cannot allocate %u sites",
+			    XALLOC_PROF_SITES);
+			exit(1);
+		}
+	} else if (!on && XALLOC_PROF_ON())
+		_xalloc_prof_clear();
+	XALLOC_PROF_SET_ON(on ? 1 : 0);
+	XALLOC_PROF_UNLOCK();
+}
+
+int
+xalloc_profile_get(void)
+{
+	return (XALLOC_PROF_ON());
+}
+
+size_t
+xalloc_profile_get_sites(struct xalloc_site *sites, size_t nsites,
+    struct xalloc_site *total)
+{
+	struct xalloc_site	*all;
+	size_t			 i, n = 0;
+
+	if (total)
+		memset(total, 0, sizeof(*total));
+
+	XALLOC_PROF_LOCK();
+	if (!XALLOC_PROF_ON() || 0 == xalloc_prof_nsites) {
+		XALLOC_PROF_UNLOCK();
+		return (0);
+	}
+	all = malloc(xalloc_prof_nsites * sizeof(*all));
+	if (NULL == all) {
+		XALLOC_PROF_UNLOCK();
+		return (0);
+	}
+	for (i = 0; i < XALLOC_PROF_SITES; i++) {
+		if (NULL == xalloc_prof_sites[i].file)
+			continue;
+		all[n++] = xalloc_prof_sites[i];
+		if (total) {
+			total->allocs += xalloc_prof_sites[i].allocs;
+			total->bytes += xalloc_prof_sites[i].bytes;
+			total->live += xalloc_prof_sites[i].live;
+			total->live_bytes += xalloc_prof_sites[i].live_bytes;
+		}
+	}
+	XALLOC_PROF_UNLOCK();
+
+	qsort(all, n, sizeof(*all), _xalloc_prof_cmp);
+	if (nsites > n)
+		nsites = n;
+	memcpy(sites, all, nsites * sizeof(*sites));
+	free(all);
+
+	return (nsites);
+}
+
+void
+xalloc_profile_dump(size_t max_sites)
+{
+	struct xalloc_site	*sites, total;
+	size_t			 i, n;
+
+	if (!XALLOC_PROF_ON()) {
+		log_notice("allocation profile: not enabled");
+		return;
+	}
+	if (NULL == (sites = calloc(max_sites, sizeof(*sites))))
+		return;
+	n = xalloc_profile_get_sites(sites, max_sites, &total);
+	log_notice("allocation profile: %lu allocations (%llu bytes), "
+	    "%lu live (%llu bytes)", total.allocs, total.bytes, total.live,
+	    total.live_bytes);
+	for (i = 0; i < n; i++) {
+		log_notice("allocation profile: %s:%u: %lu allocations "
+		    "(%llu bytes), %lu live (%llu bytes)",
+		    sites[i].file, sites[i].line, sites[i].allocs,
+		    sites[i].bytes, sites[i].live, sites[i].live_bytes);
+	}
+	free(sites);
+}
+
+struct xarena *
+xarena_create(size_t chunk_size)
+{
+	struct xarena	*a;
+
+	a = xcalloc(1UL, sizeof(*a));
+	a->chunk_size = chunk_size ?
+	    XARENA_ROUNDUP(chunk_size) : XARENA_CHUNK_SIZE;
+
+	return (a);
+}
+
+void
+xarena_destroy(struct xarena **a_p)
+{
+	struct xarena	*a = *a_p;
+
+	if (NULL == a)
+		return;
+	_xarena_free_chunks(a);
+	xfree(a);
+	*a_p = NULL;
+}
+
+void
+xarena_reset(struct xarena *a)
+{
+	a->stats.bytes = 0;
+	a->stats.allocs = 0;
+	a->stats.resets++;
+
+	if (NULL == a->chunks)
+		return;
+	if (NULL == a->chunks->next) {
+		a->chunks->used = 0;
+		return;
+	}
+
+	/*
+	 * More than one chunk was needed since the last reset. Replace them
+	 * with a single chunk of their combined size, so that the next round
+	 * fits into it without further allocations:
+	 */
+	a->chunk_size = a->stats.capacity;
+	_xarena_free_chunks(a);
+	a->chunks = _xarena_chunk_new(a, a->chunk_size, __FILE__, __LINE__);
+}
+
+void *
+xarena_alloc_c(struct xarena *a, size_t size, const char *file,
+    unsigned int line)
+{
+	struct xarena_chunk	*c = a->chunks;
+	void			*ret;
+
+	if (size > SIZE_MAX - XARENA_ALIGN) {
+		log_alert("%s[%u]: cannot allocate %zu bytes",
+		    file, line, size);
+		exit(1);
+	}
+	size = size ? XARENA_ROUNDUP(size) : XARENA_ALIGN;
+
+	if (NULL == c || c->size - c->used < size) {
+		if (size > a->chunk_size && NULL != c) {
+			/* Keep using the current chunk for smaller requests: */
+			c = _xarena_chunk_new(a, size, file, line);
+			c->next = a->chunks->next;
+			a->chunks->next = c;
+		} else {
+			c = _xarena_chunk_new(a, size > a->chunk_size ?
+			    size : a->chunk_size, file, line);
+			c->next = a->chunks;
+			a->chunks = c;
+		}
+	}
+
+	ret = (char *)c + XARENA_CHUNK_HDR + c->used;
+	c->used += size;
+
+	a->stats.bytes += size;
+	a->stats.allocs++;
+	if (a->stats.bytes > a->stats.peak)
+		a->stats.peak = a->stats.bytes;
+
+	return (ret);
+}
+
+char *
+xarena_strdup_c(struct xarena *a, const char *str, const char *file,
+    unsigned int line)
+{
+	size_t	 len = strlen(str) + 1;
+	char	*ret;
+
+	ret = xarena_alloc_c(a, len, file, line);
+	memcpy(ret, str, len);
+
+	return (ret);
+}
+
+const struct xarena_stats *
+xarena_get_stats(struct xarena *a)
+{
+	return (&a->stats);
+}
@@ -25,10 +25,64 @@
 #define xstrdup(str)		xstrdup_c(str, __FILE__, __LINE__)
 #define xfree(p)		xfree_c(p, __FILE__, __LINE__)
 
+#define xarena_alloc(a, s)	xarena_alloc_c(a, s, __FILE__, __LINE__)
+#define xarena_strdup(a, str)	xarena_strdup_c(a, str, __FILE__, __LINE__)
+
 void *	xmalloc_c(size_t, const char *, unsigned int);
 void *	xcalloc_c(size_t, size_t, const char *, unsigned int);
 void *	xreallocarray_c(void *, size_t, size_t, const char *, unsigned int);
 char *	xstrdup_c(const char *, const char *, unsigned int);
 void	xfree_c(void *, const char *, unsigned int);
 
+/*
+ * Number of allocations made so far, for benchmarks. Where the compiler
+ * supports it, only those of the calling thread are counted.
+ */
+unsigned long
+	xalloc_get_allocs(void);
+
+/*
+ * Allocation profiling by call site. While it is on, every allocation is
+ * counted towards the file and line it was made from, and so is freeing
+ * it again. Sites are reported in order of their live bytes.
+ */
+struct xalloc_site {
+	const char		*file;
+	unsigned int		 line;
+	unsigned long		 allocs;
+	unsigned long long	 bytes;
+	unsigned long		 live;
+	unsigned long long	 live_bytes;
+};
+
+void	xalloc_profile_set(int);
+int	xalloc_profile_get(void);
+size_t	xalloc_profile_get_sites(struct xalloc_site *, size_t,
+	    struct xalloc_site *);
+void	xalloc_profile_dump(size_t);
+
+/*
+ * Arenas hand out memory for short-lived objects from larger chunks, which
+ * are all released at once by xarena_reset() or xarena_destroy(). Memory
+ * from an arena must not be passed to xfree() or xreallocarray().
+ */
+typedef struct xarena * xarena_t;
+
+struct xarena_stats {
+	size_t		bytes;		/* handed out since the last reset */
+	unsigned long	allocs; 	/* made since the last reset */
+	size_t		capacity;	/* currently held in chunks */
+	size_t		peak;		/* most bytes handed out between resets */
+	unsigned long	resets;
+};
+
+xarena_t
+	xarena_create(size_t);
+void	xarena_destroy(xarena_t *);
+void	xarena_reset(xarena_t);
+void *	xarena_alloc_c(xarena_t, size_t, const char *, unsigned int);
+char *	xarena_strdup_c(xarena_t, const char *, const char *, unsigned int);
+const struct xarena_stats *
+	xarena_get_stats(xarena_t);
+
 #endif /* __XALLOC_H__ */
@@ -0,0 +1,264 @@
+#include <check.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "analysis.h"
+#include "cfg.h"
+#include "log.h"
+#include "mdata.h"
+#include "plugin.h"
+
+#define PLUGIN_RAW	BUILDDIR "/.libs/plugin_raw.so"
+#define NULL_RAW	SRCDIR "/null.raw"
+#define TONE_RAW	BUILDDIR "/check_analysis.raw"
+#define CACHE_FILE	BUILDDIR "/check_analysis.cache"
+#define RATE		44100
+#define AMPLITUDE	0.1
+
+Suite * analysis_suite(void);
+void	setup_checked(void);
+void	teardown_checked(void);
+
+static void	_write_tone(void);
+static void	_wait_lookup(const char *, struct analysis_result *);
+
+/* 1 s of silence, 3 s of a 1 kHz sine at -20 dBFS and 0.5 s of silence */
+static void
+_write_tone(void)
+{
+	FILE	*fp;
+	size_t	 i;
+
+	fp = fopen(TONE_RAW, "wb");
+	ck_assert_ptr_ne(fp, NULL);
+	for (i = 0; i < RATE * 9 / 2; i++) {
+		int	s = 0;
+
+		if (i >= RATE && i < RATE * 4)
+			s = (int)lrint(AMPLITUDE * 32768.0 *
+			    sin(2.0 * M_PI * 1000.0 * (double)(i - RATE) /
+			    RATE));
+		s &= 0xffff;
+		ck_assert_int_ne(fputc(s & 0xff, fp), EOF);
+		ck_assert_int_ne(fputc(s >> 8, fp), EOF);
+		ck_assert_int_ne(fputc(s & 0xff, fp), EOF);
+		ck_assert_int_ne(fputc(s >> 8, fp), EOF);
+	}
+	ck_assert_int_eq(fclose(fp), 0);
+}
+
+static void
+_wait_lookup(const char *file, struct analysis_result *res)
+{
+	struct timespec ts;
+	unsigned int	i;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = 10 * 1000000L;
+	for (i = 0; i < 1000 && 0 > analysis_lookup(file, res); i++)
+		nanosleep(&ts, NULL);
+	ck_assert_int_eq(analysis_lookup(file, res), 0);
+}
+
+START_TEST(test_analysis_file)
+{
+	struct analysis_result	res;
+
+	ck_assert_int_eq(analysis_file(PLUGIN_RAW,
+	    BUILDDIR "/nonexistent.raw", &res), -1);
+	ck_assert_int_eq(analysis_file(BUILDDIR "/nonexistent.so",
+	    TONE_RAW, &res), -1);
+
+	ck_assert_int_eq(analysis_file(PLUGIN_RAW, TONE_RAW, &res), 0);
+	/* The gating blocks that overlap the edges of the tone count, too: */
+	ck_assert(res.loudness > -20.6f);
+	ck_assert(res.loudness < -20.2f);
+	ck_assert(fabsf(res.true_peak - AMPLITUDE) < 0.001f);
+	ck_assert_uint_eq(res.duration, 4500);
+	ck_assert_uint_eq(res.audio_start, 1000);
+	ck_assert_uint_eq(res.audio_end, 4000);
+
+	ck_assert_int_eq(analysis_file(PLUGIN_RAW, NULL_RAW, &res), 0);
+	ck_assert(isinf(res.loudness) && res.loudness < 0.0f);
+	ck_assert(res.true_peak == 0.0f);
+	ck_assert_uint_eq(res.duration, 1000);
+	ck_assert_uint_eq(res.audio_start, 0);
+	ck_assert_uint_eq(res.audio_end, 1000);
+}
+END_TEST
+
+START_TEST(test_analysis_cache)
+{
+	struct analysis_result	res;
+	FILE			*fp;
+	char			 buf[BUFSIZ];
+	unsigned int		 lines;
+
+	(void)remove(CACHE_FILE);
+	ck_assert_int_eq(analysis_init(CACHE_FILE, 2), 0);
+	ck_assert_int_eq(analysis_lookup(TONE_RAW, &res), -1);
+	ck_assert_int_eq(analysis_queue(BUILDDIR "/nonexistent.raw",
+	    PLUGIN_RAW), -1);
+	ck_assert_int_eq(analysis_queue(TONE_RAW, NULL), -1);
+	ck_assert_int_eq(analysis_queue(TONE_RAW, PLUGIN_RAW), 0);
+	ck_assert_int_eq(analysis_queue(TONE_RAW, PLUGIN_RAW), 0);
+	ck_assert_int_eq(analysis_queue(NULL_RAW, PLUGIN_RAW), 0);
+	_wait_lookup(TONE_RAW, &res);
+	ck_assert_uint_eq(res.audio_start, 1000);
+	_wait_lookup(NULL_RAW, &res);
+	ck_assert(isinf(res.loudness));
+	analysis_exit();
+	ck_assert_int_eq(analysis_lookup(TONE_RAW, &res), -1);
+
+	/* Results persist, and are available without workers: */
+	ck_assert_int_eq(analysis_init(CACHE_FILE, 0), 0);
+	ck_assert_int_eq(analysis_queue(NULL_RAW, PLUGIN_RAW), 0);
+	ck_assert_int_eq(analysis_lookup(TONE_RAW, &res), 0);
+	ck_assert(res.loudness > -20.6f);
+	ck_assert(res.loudness < -20.2f);
+	ck_assert(fabsf(res.true_peak - AMPLITUDE) < 0.001f);
+	ck_assert_uint_eq(res.duration, 4500);
+	ck_assert_uint_eq(res.audio_end, 4000);
+	ck_assert_int_eq(analysis_lookup(NULL_RAW, &res), 0);
+	ck_assert(isinf(res.loudness) && res.loudness < 0.0f);
+	analysis_exit();
+
+	/* Damaged lines are dropped when the cache is compacted: */
+	fp = fopen(CACHE_FILE, "a");
+	ck_assert_ptr_ne(fp, NULL);
+	fputs("garbage\n", fp);
+	ck_assert_int_eq(fclose(fp), 0);
+	ck_assert_int_eq(analysis_init(CACHE_FILE, 0), 0);
+	ck_assert_int_eq(analysis_lookup(TONE_RAW, &res), 0);
+	analysis_exit();
+	fp = fopen(CACHE_FILE, "r");
+	ck_assert_ptr_ne(fp, NULL);
+	for (lines = 0; NULL != fgets(buf, (int)sizeof(buf), fp); lines++)
+		;
+	ck_assert_int_eq(fclose(fp), 0);
+	ck_assert_uint_eq(lines, 3);
+
+	/* Unknown formats are replaced: */
+	fp = fopen(CACHE_FILE, "w");
+	ck_assert_ptr_ne(fp, NULL);
+	fputs("something else\n", fp);
+	ck_assert_int_eq(fclose(fp), 0);
+	ck_assert_int_eq(analysis_init(CACHE_FILE, 0), 0);
+	ck_assert_int_eq(analysis_lookup(TONE_RAW, &res), -1);
+	analysis_exit();
+
+	ck_assert_int_eq(analysis_init(BUILDDIR "/nonexistent/cache", 0),
+	    -1);
+}
+END_TEST
+
+START_TEST(test_analysis_apply)
+{
+	struct analysis_result	 res;
+	mdata_t 		 md;
+	float			 gain, peak;
+	unsigned long		 start, end;
+
+	(void)remove(CACHE_FILE);
+	ck_assert_int_eq(analysis_init(CACHE_FILE, 1), 0);
+	ck_assert_int_eq(analysis_queue(TONE_RAW, PLUGIN_RAW), 0);
+	_wait_lookup(TONE_RAW, &res);
+
+	md = mdata_create();
+	ck_assert_int_eq(mdata_parse_file(md, TONE_RAW), 0);
+	ck_assert_int_eq(mdata_get_true_peak(md, &peak), -1);
+	ck_assert_int_eq(mdata_get_audio_bounds(md, &start, &end), -1);
+	analysis_apply(md, TONE_RAW);
+	ck_assert_int_eq(mdata_get_track_gain(md, &gain), 0);
+	ck_assert(fabsf(gain - (-18.0f - res.loudness)) < 0.001f);
+	ck_assert_int_eq(mdata_get_album_gain(md, &gain), -1);
+	ck_assert_int_eq(mdata_get_true_peak(md, &peak), 0);
+	ck_assert(peak == res.true_peak);
+	ck_assert_int_eq(mdata_get_audio_bounds(md, &start, &end), 0);
+	ck_assert_uint_eq(start, 1000);
+	ck_assert_uint_eq(end, 4000);
+
+	/* Gain from tags takes precedence: */
+	ck_assert_int_eq(mdata_parse_file(md, TONE_RAW), 0);
+	ck_assert_int_eq(mdata_get_track_gain(md, &gain), -1);
+	mdata_set_track_gain(md, -3.0f);
+	analysis_apply(md, TONE_RAW);
+	ck_assert_int_eq(mdata_get_track_gain(md, &gain), 0);
+	ck_assert(gain == -3.0f);
+	ck_assert_int_eq(mdata_get_audio_bounds(md, &start, &end), 0);
+
+	/* Files without results are left alone: */
+	ck_assert_int_eq(mdata_parse_file(md, NULL_RAW), 0);
+	analysis_apply(md, NULL_RAW);
+	ck_assert_int_eq(mdata_get_track_gain(md, &gain), -1);
+	ck_assert_int_eq(mdata_get_true_peak(md, &peak), -1);
+
+	/* Metadata from elsewhere, such as a metadata program: */
+	analysis_apply(md, TONE_RAW);
+	ck_assert_int_eq(mdata_get_true_peak(md, &peak), 0);
+	ck_assert(peak == res.true_peak);
+	mdata_destroy(&md);
+
+	analysis_exit();
+}
+END_TEST
+
+Suite *
+analysis_suite(void)
+{
+	Suite	*s;
+	TCase	*tc_analysis;
+
+	s = suite_create("Analysis");
+
+	tc_analysis = tcase_create("Analysis");
+	tcase_add_checked_fixture(tc_analysis, setup_checked,
+	    teardown_checked);
+	tcase_add_test(tc_analysis, test_analysis_file);
+	tcase_add_test(tc_analysis, test_analysis_cache);
+	tcase_add_test(tc_analysis, test_analysis_apply);
+	suite_add_tcase(s, tc_analysis);
+
+	return (s);
+}
+
+void
+setup_checked(void)
+{
+	if (0 < cfg_init() ||
+	    0 < cfg_set_program_name("check_analysis", NULL) ||
+	    0 < log_init(cfg_get_program_name()))
+		ck_abort_msg("setup_checked failed");
+
+	_write_tone();
+}
+
+void
+teardown_checked(void)
+{
+	analysis_exit();
+	plugin_exit();
+	log_exit();
+	cfg_exit();
+}
+
+int
+main(void)
+{
+	int	 num_failed;
+	Suite	*s;
+	SRunner *sr;
+
+	s = analysis_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_NORMAL);
+	num_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	if (num_failed)
+		return (1);
+	return (0);
+}
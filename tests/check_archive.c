@@ -0,0 +1,262 @@
+#include <sys/stat.h>
+
+#include <check.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "archive.h"
+#include "cfg.h"
+#include "log.h"
+
+#define ARCHIVE_DIR	BUILDDIR "/check_archive.d"
+
+Suite * archive_suite(void);
+void	setup_checked(void);
+void	teardown_checked(void);
+
+static unsigned int
+		_count_files(const char *, const char *, size_t);
+static void	_clean_dir(const char *);
+static void	_wait_poll(archive_t, unsigned long, struct archive_stats *);
+
+/* Counts the files in the directory that hold exactly the given data */
+static unsigned int
+_count_files(const char *dir, const char *data, size_t len)
+{
+	char		 path[PATH_MAX], buf[8192];
+	DIR		*d;
+	struct dirent	*de;
+	FILE		*fp;
+	size_t		 n;
+	unsigned int	 count = 0;
+
+	d = opendir(dir);
+	ck_assert_ptr_ne(d, NULL);
+	while (NULL != (de = readdir(d))) {
+		if ('.' == de->d_name[0])
+			continue;
+		ck_assert_int_lt(snprintf(path, sizeof(path), "%s/%s", dir,
+		    de->d_name), (int)sizeof(path));
+		fp = fopen(path, "rb");
+		ck_assert_ptr_ne(fp, NULL);
+		n = fread(buf, 1, sizeof(buf), fp);
+		fclose(fp);
+		if (n == len && 0 == memcmp(buf, data, len))
+			count++;
+	}
+	closedir(d);
+
+	return (count);
+}
+
+static void
+_clean_dir(const char *dir)
+{
+	char		 path[PATH_MAX];
+	DIR		*d;
+	struct dirent	*de;
+
+	if (NULL == (d = opendir(dir)))
+		return;
+	while (NULL != (de = readdir(d))) {
+		if ('.' == de->d_name[0])
+			continue;
+		(void)snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+		(void)unlink(path);
+	}
+	closedir(d);
+}
+
+/* The writer waits for up to a second before it writes small amounts */
+static void
+_wait_poll(archive_t a, unsigned long written, struct archive_stats *total)
+{
+	struct archive_stats	stats;
+	struct timespec 	ts;
+	unsigned int		i;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = 10 * 1000000L;
+	memset(total, 0, sizeof(*total));
+	for (i = 0; i < 500; i++) {
+		archive_poll(a, &stats);
+		total->written += stats.written;
+		total->dropped += stats.dropped;
+		total->lag_num += stats.lag_num;
+		if (total->written >= written)
+			break;
+		nanosleep(&ts, NULL);
+	}
+	ck_assert_uint_eq(total->written, written);
+}
+
+START_TEST(test_archive_create)
+{
+	archive_t	a;
+
+	ck_assert_ptr_eq(archive_create(BUILDDIR "/nonexistent", "test",
+	    "bin", 0, 0, 4096), NULL);
+	ck_assert_ptr_eq(archive_create(SRCDIR "/playlist.txt", "test",
+	    "bin", 0, 0, 4096), NULL);
+
+	a = archive_create(ARCHIVE_DIR, "test", "bin", 3600, 0, 4096);
+	ck_assert_ptr_ne(a, NULL);
+	archive_destroy(&a);
+	ck_assert_ptr_eq(a, NULL);
+	archive_destroy(&a);
+}
+END_TEST
+
+START_TEST(test_archive_rotate)
+{
+	archive_t		a;
+	struct archive_stats	stats;
+	char			first[121], second[11], data[60];
+
+	/* A new file is due after 100 bytes: */
+	a = archive_create(ARCHIVE_DIR, "check/test", "bin", 0, 100, 4096);
+	ck_assert_ptr_ne(a, NULL);
+
+	/* Nothing is archived before the first point to begin a file at: */
+	archive_write(a, "xx", 2);
+	archive_cut(a, "H", 1);
+	memset(data, 'a', sizeof(data));
+	archive_write(a, data, sizeof(data));
+	archive_cut(a, "H", 1);
+	archive_write(a, data, sizeof(data));
+	archive_cut(a, "H", 1);
+	memset(data, 'b', sizeof(data));
+	archive_write(a, data, 10);
+
+	_wait_poll(a, 1 + 120 + 1 + 10, &stats);
+	ck_assert_uint_eq(stats.dropped, 0);
+	ck_assert_uint_ne(stats.lag_num, 0);
+	archive_destroy(&a);
+
+	first[0] = 'H';
+	memset(first + 1, 'a', 120);
+	second[0] = 'H';
+	memset(second + 1, 'b', 10);
+	ck_assert_uint_eq(_count_files(ARCHIVE_DIR, first, sizeof(first)), 1);
+	ck_assert_uint_eq(_count_files(ARCHIVE_DIR, second, sizeof(second)),
+	    1);
+}
+END_TEST
+
+START_TEST(test_archive_drop)
+{
+	archive_t		a;
+	struct archive_stats	stats;
+	char			data[100];
+
+	a = archive_create(ARCHIVE_DIR, "test", "bin", 0, 0, 64);
+	ck_assert_ptr_ne(a, NULL);
+
+	/* What does not fit into the buffer is dropped: */
+	memset(data, 'a', sizeof(data));
+	archive_cut(a, NULL, 0);
+	archive_write(a, data, sizeof(data));
+	archive_write(a, data, 50);
+	_wait_poll(a, 50, &stats);
+	ck_assert_uint_eq(stats.dropped, 100);
+	archive_destroy(&a);
+
+	ck_assert_uint_eq(_count_files(ARCHIVE_DIR, data, 50), 1);
+}
+END_TEST
+
+START_TEST(test_archive_batch)
+{
+	archive_t		a;
+	struct archive_stats	stats;
+	char			data[1 + 160 * 37];
+	size_t			i;
+
+	data[0] = 'H';
+	for (i = 1; i < sizeof(data); i++)
+		data[i] = (char)('a' + i % 26);
+
+	/* Many small writes go out together, also around the buffer end: */
+	a = archive_create(ARCHIVE_DIR, "test", "bin", 0, 0, 4096);
+	ck_assert_ptr_ne(a, NULL);
+	archive_cut(a, data, 1);
+	for (i = 0; i < 100; i++)
+		archive_write(a, data + 1 + i * 37, 37);
+	_wait_poll(a, 1 + 100 * 37, &stats);
+	for (i = 100; i < 160; i++)
+		archive_write(a, data + 1 + i * 37, 37);
+	_wait_poll(a, 60 * 37, &stats);
+	ck_assert_uint_eq(stats.dropped, 0);
+	/* Each write still counts towards how long data waits: */
+	ck_assert_uint_eq(stats.lag_num, 60);
+	archive_destroy(&a);
+
+	ck_assert_uint_eq(_count_files(ARCHIVE_DIR, data, sizeof(data)), 1);
+}
+END_TEST
+
+Suite *
+archive_suite(void)
+{
+	Suite	*s;
+	TCase	*tc_archive;
+
+	s = suite_create("Archive");
+
+	tc_archive = tcase_create("Archive");
+	tcase_add_checked_fixture(tc_archive, setup_checked,
+	    teardown_checked);
+	tcase_add_test(tc_archive, test_archive_create);
+	tcase_add_test(tc_archive, test_archive_rotate);
+	tcase_add_test(tc_archive, test_archive_drop);
+	tcase_add_test(tc_archive, test_archive_batch);
+	suite_add_tcase(s, tc_archive);
+
+	return (s);
+}
+
+void
+setup_checked(void)
+{
+	if (0 < cfg_init() ||
+	    0 < cfg_set_program_name("check_archive", NULL) ||
+	    0 < log_init(cfg_get_program_name()))
+		ck_abort_msg("setup_checked failed");
+
+	if (0 > mkdir(ARCHIVE_DIR, 0755) && EEXIST != errno)
+		ck_abort_msg("setup_checked failed");
+	_clean_dir(ARCHIVE_DIR);
+}
+
+void
+teardown_checked(void)
+{
+	_clean_dir(ARCHIVE_DIR);
+	(void)rmdir(ARCHIVE_DIR);
+	log_exit();
+	cfg_exit();
+}
+
+int
+main(void)
+{
+	int	 num_failed;
+	Suite	*s;
+	SRunner *sr;
+
+	s = archive_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_NORMAL);
+	num_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	if (num_failed)
+		return (1);
+	return (0);
+}
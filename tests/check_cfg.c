@@ -73,6 +73,38 @@ START_TEST(test_program_rtstatus_output)
 }
 END_TEST
 
+START_TEST(test_program_rtstatus_interval)
+{
+	const char	*errstr;
+
+	ck_assert_uint_eq(cfg_get_program_rtstatus_interval(),
+	    CFG_RTSTATUS_INTERVAL_DEFAULT);
+	TEST_EMPTYSTR(cfg_set_program_rtstatus_interval);
+
+	errstr = NULL;
+	ck_assert_int_eq(cfg_set_program_rtstatus_interval("1", &errstr), -1);
+	ck_assert_str_eq(errstr, "too small");
+	errstr = NULL;
+	ck_assert_int_eq(cfg_set_program_rtstatus_interval("60001", &errstr),
+	    -1);
+	ck_assert_str_eq(errstr, "too large");
+	errstr = NULL;
+	ck_assert_int_eq(cfg_set_program_rtstatus_interval("1s", &errstr), -1);
+	ck_assert_ptr_ne(errstr, NULL);
+
+	ck_assert_int_eq(cfg_set_program_rtstatus_interval("250", NULL), 0);
+	ck_assert_uint_eq(cfg_get_program_rtstatus_interval(), 250);
+}
+END_TEST
+
+START_TEST(test_program_rtstatus_json)
+{
+	ck_assert_int_eq(cfg_get_program_rtstatus_json(), 0);
+	ck_assert_int_eq(cfg_set_program_rtstatus_json(-1, NULL), 0);
+	ck_assert_int_ne(cfg_get_program_rtstatus_json(), 0);
+}
+END_TEST
+
 START_TEST(test_program_verbosity)
 {
 	ck_assert_int_eq(cfg_set_program_verbosity(2000, NULL), 0);
@@ -153,6 +185,185 @@ START_TEST(test_metadata_no_updates)
 }
 END_TEST
 
+START_TEST(test_metrics_listen)
+{
+	ck_assert_ptr_eq(cfg_get_metrics_listen(), NULL);
+	TEST_STRLCPY(cfg_set_metrics_listen, cfg_get_metrics_listen,
+	    PATH_MAX);
+}
+END_TEST
+
+START_TEST(test_control_socket)
+{
+	const char	*errstr;
+	char		 longpath[PATH_MAX + 1];
+
+	ck_assert_ptr_eq(cfg_get_control_socket(), NULL);
+	TEST_EMPTYSTR(cfg_set_control_socket);
+
+	errstr = NULL;
+	ck_assert_int_eq(cfg_set_control_socket("ezstream.sock", &errstr),
+	    -1);
+	ck_assert_str_eq(errstr, "not an absolute path");
+	ck_assert_ptr_eq(cfg_get_control_socket(), NULL);
+
+	memset(longpath, 'x', sizeof(longpath));
+	longpath[0] = '/';
+	longpath[sizeof(longpath) - 1] = '\0';
+	errstr = NULL;
+	ck_assert_int_eq(cfg_set_control_socket(longpath, &errstr), -1);
+	ck_assert_str_eq(errstr, "too long");
+
+	ck_assert_int_eq(cfg_set_control_socket("/tmp/ezstream.sock", NULL),
+	    0);
+	ck_assert_str_eq(cfg_get_control_socket(), "/tmp/ezstream.sock");
+}
+END_TEST
+
+START_TEST(test_analysis_cache)
+{
+	ck_assert_ptr_eq(cfg_get_analysis_cache(), NULL);
+	TEST_STRLCPY(cfg_set_analysis_cache, cfg_get_analysis_cache,
+	    PATH_MAX);
+}
+END_TEST
+
+START_TEST(test_analysis_workers)
+{
+	const char	*errstr;
+
+	ck_assert_uint_eq(cfg_get_analysis_workers(),
+	    CFG_ANALYSIS_WORKERS_DEFAULT);
+	TEST_EMPTYSTR(cfg_set_analysis_workers);
+
+	errstr = NULL;
+	ck_assert_int_eq(cfg_set_analysis_workers("0", &errstr), -1);
+	ck_assert_ptr_ne(errstr, NULL);
+	errstr = NULL;
+	ck_assert_int_eq(cfg_set_analysis_workers("17", &errstr), -1);
+	ck_assert_ptr_ne(errstr, NULL);
+
+	ck_assert_int_eq(cfg_set_analysis_workers("4", NULL), 0);
+	ck_assert_uint_eq(cfg_get_analysis_workers(), 4);
+}
+END_TEST
+
+START_TEST(test_archive_directory)
+{
+	ck_assert_ptr_eq(cfg_get_archive_directory(), NULL);
+	TEST_STRLCPY(cfg_set_archive_directory, cfg_get_archive_directory,
+	    PATH_MAX);
+}
+END_TEST
+
+START_TEST(test_archive_rotate_time)
+{
+	const char	*errstr;
+
+	ck_assert_uint_eq(cfg_get_archive_rotate_time(),
+	    CFG_ARCHIVE_ROTATE_TIME_DEFAULT);
+	TEST_EMPTYSTR(cfg_set_archive_rotate_time);
+
+	errstr = NULL;
+	ck_assert_int_eq(cfg_set_archive_rotate_time("-1", &errstr), -1);
+	ck_assert_ptr_ne(errstr, NULL);
+	errstr = NULL;
+	ck_assert_int_eq(cfg_set_archive_rotate_time("604801", &errstr), -1);
+	ck_assert_ptr_ne(errstr, NULL);
+
+	ck_assert_int_eq(cfg_set_archive_rotate_time("0", NULL), 0);
+	ck_assert_uint_eq(cfg_get_archive_rotate_time(), 0);
+	ck_assert_int_eq(cfg_set_archive_rotate_time("600", NULL), 0);
+	ck_assert_uint_eq(cfg_get_archive_rotate_time(), 600);
+}
+END_TEST
+
+START_TEST(test_archive_rotate_size)
+{
+	const char	*errstr;
+
+	ck_assert_uint_eq(cfg_get_archive_rotate_size(), 0);
+	TEST_EMPTYSTR(cfg_set_archive_rotate_size);
+
+	errstr = NULL;
+	ck_assert_int_eq(cfg_set_archive_rotate_size("1048577", &errstr), -1);
+	ck_assert_ptr_ne(errstr, NULL);
+
+	ck_assert_int_eq(cfg_set_archive_rotate_size("100", NULL), 0);
+	ck_assert_uint_eq(cfg_get_archive_rotate_size(), 100);
+}
+END_TEST
+
+START_TEST(test_archive_buffer_size)
+{
+	const char	*errstr;
+
+	ck_assert_uint_eq(cfg_get_archive_buffer_size(),
+	    CFG_ARCHIVE_BUFFER_SIZE_DEFAULT);
+	TEST_EMPTYSTR(cfg_set_archive_buffer_size);
+
+	errstr = NULL;
+	ck_assert_int_eq(cfg_set_archive_buffer_size("0", &errstr), -1);
+	ck_assert_ptr_ne(errstr, NULL);
+	errstr = NULL;
+	ck_assert_int_eq(cfg_set_archive_buffer_size("1025", &errstr), -1);
+	ck_assert_ptr_ne(errstr, NULL);
+
+	ck_assert_int_eq(cfg_set_archive_buffer_size("64", NULL), 0);
+	ck_assert_uint_eq(cfg_get_archive_buffer_size(), 64);
+}
+END_TEST
+
+START_TEST(test_logging_target)
+{
+	const char	*errstr;
+
+	ck_assert_ptr_eq(cfg_get_logging_target(), NULL);
+	TEST_EMPTYSTR(cfg_set_logging_target);
+
+	errstr = NULL;
+	ck_assert_int_eq(cfg_set_logging_target("ezstream.log", &errstr), -1);
+	ck_assert_str_eq(errstr, "invalid");
+
+	ck_assert_int_eq(cfg_set_logging_target("syslog", NULL), 0);
+	ck_assert_str_eq(cfg_get_logging_target(), "syslog");
+	ck_assert_int_eq(cfg_set_logging_target("stderr", NULL), 0);
+	ck_assert_str_eq(cfg_get_logging_target(), "stderr");
+	ck_assert_int_eq(cfg_set_logging_target("/tmp/ezstream.log", NULL), 0);
+	ck_assert_str_eq(cfg_get_logging_target(), "/tmp/ezstream.log");
+}
+END_TEST
+
+START_TEST(test_logging_async)
+{
+	TEST_BOOLEAN(cfg_set_logging_async, cfg_get_logging_async);
+}
+END_TEST
+
+START_TEST(test_logging_rate_limit)
+{
+	TEST_UINTNUM(cfg_set_logging_rate_limit, cfg_get_logging_rate_limit);
+}
+END_TEST
+
+START_TEST(test_logging_format)
+{
+	const char	*errstr;
+
+	ck_assert_int_eq(cfg_get_logging_format(), CFG_LOG_FORMAT_TEXT);
+	TEST_EMPTYSTR(cfg_set_logging_format);
+
+	errstr = NULL;
+	ck_assert_int_eq(cfg_set_logging_format("xml", &errstr), -1);
+	ck_assert_str_eq(errstr, "invalid");
+
+	ck_assert_int_eq(cfg_set_logging_format("JSON", NULL), 0);
+	ck_assert_int_eq(cfg_get_logging_format(), CFG_LOG_FORMAT_JSON);
+	ck_assert_int_eq(cfg_set_logging_format("text", NULL), 0);
+	ck_assert_int_eq(cfg_get_logging_format(), CFG_LOG_FORMAT_TEXT);
+}
+END_TEST
+
 Suite *
 cfg_suite(void)
 {
@@ -160,6 +371,11 @@ cfg_suite(void)
 	TCase	*tc_core;
 	TCase	*tc_program;
 	TCase	*tc_metadata;
+	TCase	*tc_metrics;
+	TCase	*tc_control;
+	TCase	*tc_analysis;
+	TCase	*tc_archive;
+	TCase	*tc_logging;
 
 	s = suite_create("Config");
 
@@ -178,6 +394,8 @@ cfg_suite(void)
 	tcase_add_test(tc_program, test_program_pid_file);
 	tcase_add_test(tc_program, test_program_quiet_stderr);
 	tcase_add_test(tc_program, test_program_rtstatus_output);
+	tcase_add_test(tc_program, test_program_rtstatus_interval);
+	tcase_add_test(tc_program, test_program_rtstatus_json);
 	tcase_add_test(tc_program, test_program_verbosity);
 	suite_add_tcase(s, tc_program);
 
@@ -191,6 +409,43 @@ cfg_suite(void)
 	tcase_add_test(tc_metadata, test_metadata_no_updates);
 	suite_add_tcase(s, tc_metadata);
 
+	tc_metrics = tcase_create("Metrics");
+	tcase_add_checked_fixture(tc_metrics, setup_checked,
+	    teardown_checked);
+	tcase_add_test(tc_metrics, test_metrics_listen);
+	suite_add_tcase(s, tc_metrics);
+
+	tc_control = tcase_create("Control");
+	tcase_add_checked_fixture(tc_control, setup_checked,
+	    teardown_checked);
+	tcase_add_test(tc_control, test_control_socket);
+	suite_add_tcase(s, tc_control);
+
+	tc_analysis = tcase_create("Analysis");
+	tcase_add_checked_fixture(tc_analysis, setup_checked,
+	    teardown_checked);
+	tcase_add_test(tc_analysis, test_analysis_cache);
+	tcase_add_test(tc_analysis, test_analysis_workers);
+	suite_add_tcase(s, tc_analysis);
+
+	tc_archive = tcase_create("Archive");
+	tcase_add_checked_fixture(tc_archive, setup_checked,
+	    teardown_checked);
+	tcase_add_test(tc_archive, test_archive_directory);
+	tcase_add_test(tc_archive, test_archive_rotate_time);
+	tcase_add_test(tc_archive, test_archive_rotate_size);
+	tcase_add_test(tc_archive, test_archive_buffer_size);
+	suite_add_tcase(s, tc_archive);
+
+	tc_logging = tcase_create("Logging");
+	tcase_add_checked_fixture(tc_logging, setup_checked,
+	    teardown_checked);
+	tcase_add_test(tc_logging, test_logging_target);
+	tcase_add_test(tc_logging, test_logging_async);
+	tcase_add_test(tc_logging, test_logging_rate_limit);
+	tcase_add_test(tc_logging, test_logging_format);
+	suite_add_tcase(s, tc_logging);
+
 	return (s);
 }
 
@@ -53,6 +53,19 @@ START_TEST(test_decoder_list_get)
 }
 END_TEST
 
+START_TEST(test_decoder_list_find)
+{
+	cfg_decoder_t	dec = cfg_decoder_list_get(decoders, "foo");
+	unsigned int	gen = cfg_get_generation();
+
+	ck_assert_ptr_eq(cfg_decoder_list_find(decoders, "FOO"), dec);
+	ck_assert_int_eq(cfg_decoder_set_name(dec, decoders, "bar", NULL), 0);
+	ck_assert_uint_ne(cfg_get_generation(), gen);
+	ck_assert_ptr_eq(cfg_decoder_list_find(decoders, "foo"), NULL);
+	ck_assert_ptr_eq(cfg_decoder_list_find(decoders, "BAR"), dec);
+}
+END_TEST
+
 START_TEST(test_decoder_set_name)
 {
 	TEST_XSTRDUP_T(cfg_decoder_t, cfg_decoder_list_get, decoders,
@@ -67,6 +80,13 @@ START_TEST(test_decoder_set_program)
 }
 END_TEST
 
+START_TEST(test_decoder_set_plugin)
+{
+	TEST_XSTRDUP_T(cfg_decoder_t, cfg_decoder_list_get, decoders,
+	    cfg_decoder_set_plugin, cfg_decoder_get_plugin);
+}
+END_TEST
+
 START_TEST(test_decoder_add_match)
 {
 	cfg_decoder_t	 dec = cfg_decoder_list_get(decoders, "test_decoder_add_match");
@@ -90,6 +110,17 @@ START_TEST(test_decoder_add_match)
 	    0);
 	ck_assert_ptr_eq(cfg_decoder_list_findext(decoders, ".test"), dec);
 	ck_assert_ptr_eq(cfg_decoder_list_findext(decoders, ".test2"), dec2);
+	ck_assert_ptr_eq(cfg_decoder_list_findext(decoders, ".TeSt2"), dec2);
+
+	/* Removing a decoder drops its name and extensions from the index: */
+	ck_assert_ptr_eq(cfg_decoder_list_find(decoders,
+	    "TEST_DECODER_ADD_MATCH_2"), dec2);
+	cfg_decoder_list_remove(decoders, &dec2);
+	ck_assert_ptr_eq(dec2, NULL);
+	ck_assert_ptr_eq(cfg_decoder_list_find(decoders,
+	    "test_decoder_add_match_2"), NULL);
+	ck_assert_ptr_eq(cfg_decoder_list_findext(decoders, ".test2"), NULL);
+	ck_assert_ptr_eq(cfg_decoder_list_findext(decoders, ".test"), dec);
 }
 END_TEST
 
@@ -156,6 +187,19 @@ START_TEST(test_decoder_validate)
 	ck_assert_int_eq(cfg_decoder_set_program(dec, decoders,
 	    PLACEHOLDER_TRACK, NULL), 0);
 	ck_assert_int_eq(cfg_decoder_validate(dec, &errstr), 0);
+
+	ck_assert_int_eq(cfg_decoder_set_plugin(dec, decoders, "test.so",
+	    NULL), 0);
+	errstr = NULL;
+	ck_assert_int_ne(cfg_decoder_validate(dec, &errstr), 0);
+	ck_assert_str_eq(errstr, "program and plugin are mutually exclusive");
+
+	dec = cfg_decoder_list_get(decoders, "test_decoder_validate_plugin");
+	ck_assert_int_eq(cfg_decoder_set_plugin(dec, decoders, "test.so",
+	    NULL), 0);
+	ck_assert_int_eq(cfg_decoder_add_match(dec, decoders, ".test2", NULL),
+	    0);
+	ck_assert_int_eq(cfg_decoder_validate(dec, &errstr), 0);
 }
 END_TEST
 
@@ -171,8 +215,10 @@ cfg_suite(void)
 	tcase_add_checked_fixture(tc_decoder, setup_checked,
 	    teardown_checked);
 	tcase_add_test(tc_decoder, test_decoder_list_get);
+	tcase_add_test(tc_decoder, test_decoder_list_find);
 	tcase_add_test(tc_decoder, test_decoder_set_name);
 	tcase_add_test(tc_decoder, test_decoder_set_program);
+	tcase_add_test(tc_decoder, test_decoder_set_plugin);
 	tcase_add_test(tc_decoder, test_decoder_add_match);
 	tcase_add_test(tc_decoder, test_decoder_validate);
 	suite_add_tcase(s, tc_decoder);
@@ -57,6 +57,13 @@ START_TEST(test_encoder_set_program)
 }
 END_TEST
 
+START_TEST(test_encoder_set_plugin)
+{
+	TEST_XSTRDUP_T(cfg_encoder_t, cfg_encoder_list_get, encoders,
+	    cfg_encoder_set_plugin, cfg_encoder_get_plugin);
+}
+END_TEST
+
 START_TEST(test_encoder_set_format_str)
 {
 	cfg_encoder_t	 enc = cfg_encoder_list_get(encoders, "test_encoder_set_format_str");
@@ -146,6 +153,17 @@ START_TEST(test_encoder_validate)
 	ck_assert_int_ne(cfg_encoder_validate(enc, &errstr), 0);
 	ck_assert_str_eq(errstr,
 	    "duplicate placeholder " PLACEHOLDER_TITLE);
+
+	ck_assert_int_eq(cfg_encoder_set_plugin(enc, encoders, "test.so",
+	    NULL), 0);
+	errstr = NULL;
+	ck_assert_int_ne(cfg_encoder_validate(enc, &errstr), 0);
+	ck_assert_str_eq(errstr, "program and plugin are mutually exclusive");
+
+	ck_assert_int_eq(cfg_encoder_set_format(enc2, CFG_STREAM_OGG), 0);
+	ck_assert_int_eq(cfg_encoder_set_plugin(enc2, encoders, "test.so",
+	    NULL), 0);
+	ck_assert_int_eq(cfg_encoder_validate(enc2, NULL), 0);
 }
 END_TEST
 
@@ -163,6 +181,7 @@ cfg_suite(void)
 	tcase_add_test(tc_encoder, test_encoder_list_get);
 	tcase_add_test(tc_encoder, test_encoder_set_name);
 	tcase_add_test(tc_encoder, test_encoder_set_program);
+	tcase_add_test(tc_encoder, test_encoder_set_plugin);
 	tcase_add_test(tc_encoder, test_encoder_set_format_str);
 	tcase_add_test(tc_encoder, test_encoder_validate);
 	suite_add_tcase(s, tc_encoder);
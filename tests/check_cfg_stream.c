@@ -73,6 +73,42 @@ START_TEST(test_stream_fmt2str)
 }
 END_TEST
 
+START_TEST(test_stream_str2fade)
+{
+	enum cfg_stream_fade	fade;
+
+	ck_assert_int_eq(cfg_stream_str2fade(CFG_SFADE_LINEAR, &fade), 0);
+	ck_assert_int_eq(fade, CFG_STREAM_FADE_LINEAR);
+	ck_assert_int_eq(cfg_stream_str2fade("EQUAL-power", &fade), 0);
+	ck_assert_int_eq(fade, CFG_STREAM_FADE_EQUAL_POWER);
+	ck_assert_int_eq(cfg_stream_str2fade("<something else>", &fade), -1);
+	ck_assert_str_eq(cfg_stream_fade2str(CFG_STREAM_FADE_LINEAR),
+	    CFG_SFADE_LINEAR);
+	ck_assert_str_eq(cfg_stream_fade2str(CFG_STREAM_FADE_EQUAL_POWER),
+	    CFG_SFADE_EQUAL_POWER);
+}
+END_TEST
+
+START_TEST(test_stream_str2norm)
+{
+	enum cfg_stream_norm	norm;
+
+	ck_assert_int_eq(cfg_stream_str2norm(CFG_SNORM_NONE, &norm), 0);
+	ck_assert_int_eq(norm, CFG_STREAM_NORM_NONE);
+	ck_assert_int_eq(cfg_stream_str2norm("Track", &norm), 0);
+	ck_assert_int_eq(norm, CFG_STREAM_NORM_TRACK);
+	ck_assert_int_eq(cfg_stream_str2norm(CFG_SNORM_ALBUM, &norm), 0);
+	ck_assert_int_eq(norm, CFG_STREAM_NORM_ALBUM);
+	ck_assert_int_eq(cfg_stream_str2norm("<something else>", &norm), -1);
+	ck_assert_str_eq(cfg_stream_norm2str(CFG_STREAM_NORM_NONE),
+	    CFG_SNORM_NONE);
+	ck_assert_str_eq(cfg_stream_norm2str(CFG_STREAM_NORM_TRACK),
+	    CFG_SNORM_TRACK);
+	ck_assert_str_eq(cfg_stream_norm2str(CFG_STREAM_NORM_ALBUM),
+	    CFG_SNORM_ALBUM);
+}
+END_TEST
+
 START_TEST(test_stream_name)
 {
 }
@@ -200,6 +236,88 @@ START_TEST(test_stream_stream_channels)
 }
 END_TEST
 
+START_TEST(test_stream_crossfade)
+{
+	cfg_stream_t	 str = cfg_stream_list_get(streams, "test_stream_crossfade");
+	const char	*errstr2;
+
+	TEST_EMPTYSTR_T(cfg_stream_t, cfg_stream_list_get, streams,
+	    cfg_stream_set_crossfade);
+
+	ck_assert_uint_eq(cfg_stream_get_crossfade(str), 0);
+	errstr2 = NULL;
+	ck_assert_int_eq(cfg_stream_set_crossfade(str, streams, "-1",
+	    &errstr2), -1);
+	ck_assert_ptr_ne(errstr2, NULL);
+	ck_assert_int_eq(cfg_stream_set_crossfade(str, streams, "30001",
+	    NULL), -1);
+	ck_assert_int_eq(cfg_stream_set_crossfade(str, streams, "3000",
+	    NULL), 0);
+	ck_assert_uint_eq(cfg_stream_get_crossfade(str), 3000);
+}
+END_TEST
+
+START_TEST(test_stream_crossfade_curve)
+{
+	cfg_stream_t	 str = cfg_stream_list_get(streams, "test_stream_crossfade_curve");
+	const char	*errstr2;
+
+	TEST_EMPTYSTR_T(cfg_stream_t, cfg_stream_list_get, streams,
+	    cfg_stream_set_crossfade_curve);
+
+	ck_assert_int_eq(cfg_stream_get_crossfade_curve(str),
+	    CFG_STREAM_FADE_EQUAL_POWER);
+	ck_assert_int_eq(cfg_stream_set_crossfade_curve(str, streams,
+	    "<something else>", &errstr2), -1);
+	ck_assert_str_eq(errstr2, "unsupported crossfade curve");
+	ck_assert_int_eq(cfg_stream_set_crossfade_curve(str, streams,
+	    CFG_SFADE_LINEAR, NULL), 0);
+	ck_assert_int_eq(cfg_stream_get_crossfade_curve(str),
+	    CFG_STREAM_FADE_LINEAR);
+}
+END_TEST
+
+START_TEST(test_stream_normalization)
+{
+	cfg_stream_t	 str = cfg_stream_list_get(streams, "test_stream_normalization");
+	const char	*errstr2;
+
+	TEST_EMPTYSTR_T(cfg_stream_t, cfg_stream_list_get, streams,
+	    cfg_stream_set_normalization);
+
+	ck_assert_int_eq(cfg_stream_get_normalization(str),
+	    CFG_STREAM_NORM_NONE);
+	ck_assert_int_eq(cfg_stream_set_normalization(str, streams,
+	    "<something else>", &errstr2), -1);
+	ck_assert_str_eq(errstr2, "unsupported normalization");
+	ck_assert_int_eq(cfg_stream_set_normalization(str, streams,
+	    CFG_SNORM_ALBUM, NULL), 0);
+	ck_assert_int_eq(cfg_stream_get_normalization(str),
+	    CFG_STREAM_NORM_ALBUM);
+}
+END_TEST
+
+START_TEST(test_stream_silence_threshold)
+{
+	cfg_stream_t	 str = cfg_stream_list_get(streams, "test_stream_silence_threshold");
+	const char	*errstr2;
+
+	TEST_EMPTYSTR_T(cfg_stream_t, cfg_stream_list_get, streams,
+	    cfg_stream_set_silence_threshold);
+
+	ck_assert_int_eq(cfg_stream_get_silence_threshold(str), 0);
+	errstr2 = NULL;
+	ck_assert_int_eq(cfg_stream_set_silence_threshold(str, streams, "0",
+	    &errstr2), -1);
+	ck_assert_ptr_ne(errstr2, NULL);
+	ck_assert_int_eq(cfg_stream_set_silence_threshold(str, streams,
+	    "-121", NULL), -1);
+	ck_assert_int_eq(cfg_stream_set_silence_threshold(str, streams,
+	    "-60", NULL), 0);
+	ck_assert_int_eq(cfg_stream_get_silence_threshold(str), -60);
+}
+END_TEST
+
 START_TEST(test_stream_validate)
 {
 	cfg_stream_t	 str = cfg_stream_list_get(streams, "test_stream_validate");
@@ -229,6 +347,8 @@ cfg_suite(void)
 	tcase_add_test(tc_stream, test_stream_list_get);
 	tcase_add_test(tc_stream, test_stream_str2fmt);
 	tcase_add_test(tc_stream, test_stream_fmt2str);
+	tcase_add_test(tc_stream, test_stream_str2fade);
+	tcase_add_test(tc_stream, test_stream_str2norm);
 	tcase_add_test(tc_stream, test_stream_name);
 	tcase_add_test(tc_stream, test_stream_mountpoint);
 	tcase_add_test(tc_stream, test_stream_intake);
@@ -244,6 +364,10 @@ cfg_suite(void)
 	tcase_add_test(tc_stream, test_stream_stream_bitrate);
 	tcase_add_test(tc_stream, test_stream_stream_samplerate);
 	tcase_add_test(tc_stream, test_stream_stream_channels);
+	tcase_add_test(tc_stream, test_stream_crossfade);
+	tcase_add_test(tc_stream, test_stream_crossfade_curve);
+	tcase_add_test(tc_stream, test_stream_normalization);
+	tcase_add_test(tc_stream, test_stream_silence_threshold);
 	tcase_add_test(tc_stream, test_stream_validate);
 	suite_add_tcase(s, tc_stream);
 
@@ -77,6 +77,39 @@ START_TEST(test_rtstatus_output)
 }
 END_TEST
 
+START_TEST(test_rtstatus_interval)
+{
+	char	*argv[] = { "check_cmdline", "-i", "250", NULL };
+	char	*argv2[] = { "check_cmdline", "-i", "0", NULL };
+	int	 argc = (int)(sizeof(argv) / sizeof(argv[0])) - 1;
+	int	 ret;
+
+	ck_assert_uint_eq(cfg_get_program_rtstatus_interval(),
+	    CFG_RTSTATUS_INTERVAL_DEFAULT);
+	ck_assert_int_ne(cmdline_parse(argc, argv, &ret), 0);
+	ck_assert_int_eq(ret, 2);
+	ck_assert_uint_eq(cfg_get_program_rtstatus_interval(), 250);
+	ck_assert_int_ne(cmdline_parse(argc, argv2, &ret), 0);
+	ck_assert_int_eq(ret, 2);
+	ck_assert_uint_eq(cfg_get_program_rtstatus_interval(), 250);
+}
+END_TEST
+
+START_TEST(test_rtstatus_json)
+{
+	char	*argv[] = { "check_cmdline", "-j", NULL };
+	int	 argc = (int)(sizeof(argv) / sizeof(argv[0])) - 1;
+	int	 ret;
+
+	ck_assert_int_eq(cfg_get_program_rtstatus_json(), 0);
+	ck_assert_int_ne(cmdline_parse(argc, argv, &ret), 0);
+	ck_assert_int_eq(ret, 2);
+	ck_assert_int_ne(cfg_get_program_rtstatus_json(), 0);
+	ck_assert_int_ne(cfg_get_program_rtstatus_output(), 0);
+	ck_assert_int_ne(cfg_get_program_quiet_stderr(), 0);
+}
+END_TEST
+
 START_TEST(test_shuffle)
 {
 	char	*argv[] =
@@ -152,6 +185,8 @@ cmdline_suite(void)
 	tcase_add_test(tc_cmdline, test_pidfile);
 	tcase_add_test(tc_cmdline, test_quiet_stderr);
 	tcase_add_test(tc_cmdline, test_rtstatus_output);
+	tcase_add_test(tc_cmdline, test_rtstatus_interval);
+	tcase_add_test(tc_cmdline, test_rtstatus_json);
 	tcase_add_test(tc_cmdline, test_shuffle);
 	tcase_add_test(tc_cmdline, test_version);
 	tcase_add_test(tc_cmdline, test_verbose);
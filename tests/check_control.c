@@ -0,0 +1,194 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <check.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "control.h"
+#include "log.h"
+
+Suite * control_suite(void);
+void	setup_checked(void);
+void	teardown_checked(void);
+
+static int	num_echo;
+
+static int	_echo(const char *, char *, size_t);
+static int	_fail(const char *, char *, size_t);
+
+static const struct control_command	commands[] = {
+	{ "echo", "<text>", "echo the argument", _echo },
+	{ "fail", NULL, "always fail", _fail },
+	{ NULL, NULL, NULL, NULL }
+};
+
+static int
+_echo(const char *arg, char *reply, size_t reply_size)
+{
+	num_echo++;
+	snprintf(reply, reply_size, "%s", arg);
+	return (0);
+}
+
+static int
+_fail(const char *arg, char *reply, size_t reply_size)
+{
+	(void)arg;
+	(void)reply;
+	(void)reply_size;
+	return (-1);
+}
+
+START_TEST(test_control_dispatch)
+{
+	char	reply[256];
+
+	ck_assert_int_eq(control_init(NULL, commands), 0);
+	control_poll();
+
+	ck_assert_int_eq(control_dispatch("help", reply, sizeof(reply)), 0);
+	ck_assert_str_eq(reply, "OK commands: help, echo <text>, fail");
+
+	ck_assert_int_eq(control_dispatch("  echo   foo bar ", reply,
+	    sizeof(reply)), 0);
+	ck_assert_str_eq(reply, "OK foo bar ");
+	ck_assert_int_eq(num_echo, 1);
+
+	ck_assert_int_eq(control_dispatch("echo", reply, sizeof(reply)), -1);
+	ck_assert_str_eq(reply, "ERR echo: missing argument <text>");
+	ck_assert_int_eq(control_dispatch("fail now", reply, sizeof(reply)),
+	    -1);
+	ck_assert_str_eq(reply, "ERR fail: unexpected argument");
+	ck_assert_int_eq(control_dispatch("fail", reply, sizeof(reply)), -1);
+	ck_assert_str_eq(reply, "ERR");
+	ck_assert_int_eq(control_dispatch("echoo x", reply, sizeof(reply)),
+	    -1);
+	ck_assert_str_eq(reply, "ERR unknown command: echoo (try: help)");
+	ck_assert_int_eq(control_dispatch("quit", reply, sizeof(reply)), 0);
+	ck_assert_str_eq(reply, "OK bye");
+	ck_assert_int_eq(num_echo, 1);
+
+	control_exit();
+}
+END_TEST
+
+START_TEST(test_control_socket)
+{
+	struct sockaddr_un	 sun;
+	const char		 req[] = "echo hello\n\nbogus\r\nquit\n";
+	char			 buf[BUFSIZ];
+	char			 path[PATH_MAX];
+	size_t			 len = 0;
+	ssize_t 		 n;
+	FILE			*fp;
+	int			 fd, i;
+
+	ck_assert_ptr_ne(getcwd(buf, sizeof(buf)), NULL);
+	snprintf(path, sizeof(path), "%s/check_control.sock", buf);
+
+	ck_assert_int_eq(control_init("/nonexistent/check_control.sock",
+	    commands), -1);
+
+	/* Only a stale socket is replaced, not any other file: */
+	fp = fopen(path, "w");
+	ck_assert_ptr_ne(fp, NULL);
+	fclose(fp);
+	ck_assert_int_eq(control_init(path, commands), -1);
+	control_exit();
+	ck_assert_int_eq(access(path, F_OK), 0);
+	ck_assert_int_eq(unlink(path), 0);
+
+	/* ... and a socket that is still in use is not taken over: */
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strncpy(sun.sun_path, path, sizeof(sun.sun_path) - 1);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	ck_assert_int_ge(fd, 0);
+	ck_assert_int_eq(bind(fd, (struct sockaddr *)&sun, sizeof(sun)), 0);
+	ck_assert_int_eq(listen(fd, 1), 0);
+	ck_assert_int_eq(control_init(path, commands), -1);
+	control_exit();
+	ck_assert_int_eq(access(path, F_OK), 0);
+	close(fd);
+
+	ck_assert_int_eq(control_init(path, commands), 0);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	ck_assert_int_ge(fd, 0);
+	ck_assert_int_eq(connect(fd, (struct sockaddr *)&sun, sizeof(sun)), 0);
+	ck_assert_int_eq(write(fd, req, strlen(req)), (ssize_t)strlen(req));
+
+	for (i = 0; i < 100; i++) {
+		control_poll();
+		n = recv(fd, buf + len, sizeof(buf) - len - 1, MSG_DONTWAIT);
+		if (0 == n)
+			break;
+		if (0 < n)
+			len += (size_t)n;
+		usleep(10000);
+	}
+	buf[len] = '\0';
+	close(fd);
+
+	ck_assert_str_eq(buf,
+	    "OK hello\n"
+	    "ERR unknown command: bogus (try: help)\n"
+	    "OK bye\n");
+
+	control_exit();
+	ck_assert_int_ne(access(path, F_OK), 0);
+}
+END_TEST
+
+Suite *
+control_suite(void)
+{
+	Suite	*s;
+	TCase	*tc_control;
+
+	s = suite_create("Control");
+
+	tc_control = tcase_create("Control");
+	tcase_add_checked_fixture(tc_control, setup_checked, teardown_checked);
+	tcase_add_test(tc_control, test_control_dispatch);
+	tcase_add_test(tc_control, test_control_socket);
+	suite_add_tcase(s, tc_control);
+
+	return (s);
+}
+
+void
+setup_checked(void)
+{
+	if (0 < log_init(NULL))
+		ck_abort_msg("setup_checked failed");
+}
+
+void
+teardown_checked(void)
+{
+	log_exit();
+}
+
+int
+main(void)
+{
+	int	 num_failed;
+	Suite	*s;
+	SRunner *sr;
+
+	s = control_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_NORMAL);
+	num_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	if (num_failed)
+		return (1);
+	return (0);
+}
@@ -0,0 +1,194 @@
+#include <check.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "limiter.h"
+#include "pcm.h"
+
+#define RATE		44100
+#define CHANNELS	2
+#define CEILING 	0.5f
+#define BLOCK		1000
+
+Suite * limiter_suite(void);
+
+static float	_tone(size_t, float);
+static void	_process(limiter_t, const float *, float *, size_t);
+
+/* A stereo 1 kHz sine, with the right channel inverted */
+static float
+_tone(size_t sample, float amplitude)
+{
+	float	v = amplitude *
+		    sinf(2.0f * (float)M_PI * 1000.0f * (float)(sample / 2) /
+		    RATE);
+
+	return (sample % 2 ? -v : v);
+}
+
+/* Processes in uneven blocks, to cross block boundaries at odd offsets: */
+static void
+_process(limiter_t l, const float *in, float *out, size_t frames)
+{
+	size_t	i, n;
+
+	for (i = 0; i < frames * CHANNELS; i++)
+		out[i] = in[i];
+	for (i = 0; i < frames; i += n) {
+		n = i % 3 ? BLOCK : BLOCK / 7;
+		if (n > frames - i)
+			n = frames - i;
+		limiter_process(l, out + i * CHANNELS, n);
+	}
+}
+
+START_TEST(test_limiter_quiet)
+{
+	limiter_t	 l;
+	float		*in, *out;
+	size_t		 d, i;
+
+	l = limiter_create(RATE, CHANNELS, CEILING);
+	d = limiter_get_delay(l);
+	ck_assert_uint_gt(d, 2);
+	in = calloc(RATE * CHANNELS, sizeof(*in));
+	out = calloc(RATE * CHANNELS, sizeof(*out));
+	ck_assert_ptr_ne(in, NULL);
+	ck_assert_ptr_ne(out, NULL);
+	for (i = 0; i < RATE * CHANNELS; i++)
+		in[i] = _tone(i, CEILING / 2.0f);
+
+	/* Delayed, but otherwise untouched: */
+	_process(l, in, out, RATE);
+	for (i = 0; i < d * CHANNELS; i++)
+		ck_assert(out[i] == 0.0f);
+	for (; i < RATE * CHANNELS; i++)
+		ck_assert(out[i] == in[i - d * CHANNELS]);
+
+	limiter_destroy(&l);
+	ck_assert_ptr_eq(l, NULL);
+	free(in);
+	free(out);
+}
+END_TEST
+
+START_TEST(test_limiter_loud)
+{
+	limiter_t	 l;
+	float		*in, *out;
+	size_t		 d, i;
+	float		 peak;
+
+	ck_assert_ptr_ne(pcm_init(), NULL);
+	l = limiter_create(RATE, CHANNELS, CEILING);
+	d = limiter_get_delay(l);
+	in = calloc(2 * RATE * CHANNELS, sizeof(*in));
+	out = calloc(2 * RATE * CHANNELS, sizeof(*out));
+	ck_assert_ptr_ne(in, NULL);
+	ck_assert_ptr_ne(out, NULL);
+	/* Half a second of loud audio, then quiet audio: */
+	for (i = 0; i < RATE * CHANNELS; i++)
+		in[i] = _tone(i, i < RATE ? 4.0f * CEILING : CEILING / 2.0f);
+	for (; i < 2 * RATE * CHANNELS; i++)
+		in[i] = _tone(i, CEILING / 2.0f);
+
+	_process(l, in, out, 2 * RATE);
+
+	/* Below the ceiling, between samples too: */
+	for (i = 2 * CHANNELS; i < 2 * RATE * CHANNELS; i++) {
+		float	mid;
+
+		ck_assert(fabsf(out[i]) <= CEILING * 1.0001f);
+		if (i + CHANNELS >= 2 * RATE * CHANNELS)
+			continue;
+		mid = (9.0f * (out[i - CHANNELS] + out[i]) -
+		    out[i - 2 * CHANNELS] - out[i + CHANNELS]) / 16.0f;
+		ck_assert(fabsf(mid) <= CEILING * 1.01f);
+	}
+	/* ... but not much lower, once the limiter has settled: */
+	peak = pcm_peak(out + RATE / 4 * CHANNELS, RATE / 4 * CHANNELS);
+	ck_assert(peak > CEILING * 0.9f);
+
+	/* The gain is released again eventually: */
+	for (i = 7 * RATE / 4 * CHANNELS; i < 2 * RATE * CHANNELS; i++)
+		ck_assert(out[i] == in[i - d * CHANNELS]);
+
+	limiter_destroy(&l);
+	free(in);
+	free(out);
+}
+END_TEST
+
+START_TEST(test_limiter_bypass)
+{
+	limiter_t	 l;
+	float		*in, *out;
+	size_t		 d, i;
+
+	l = limiter_create(RATE, CHANNELS, CEILING);
+	d = limiter_get_delay(l);
+	in = calloc(2 * RATE * CHANNELS, sizeof(*in));
+	out = calloc(2 * RATE * CHANNELS, sizeof(*out));
+	ck_assert_ptr_ne(in, NULL);
+	ck_assert_ptr_ne(out, NULL);
+	for (i = 0; i < RATE; i++)
+		in[i] = _tone(i, 4.0f * CEILING);
+	for (; i < 2 * RATE * CHANNELS; i++)
+		in[i] = _tone(i, CEILING / 2.0f);
+
+	/* Loud audio, then quiet audio that is known to be quiet: */
+	_process(l, in, out, RATE / 2);
+	for (i = RATE; i < 2 * RATE * CHANNELS; i++)
+		out[i] = in[i];
+	for (i = RATE / 2; i < 2 * RATE; i += BLOCK)
+		limiter_bypass(l, out + i * CHANNELS,
+		    i + BLOCK > 2 * RATE ? 2 * RATE - i : BLOCK);
+
+	/* What is left of the loud audio is still limited: */
+	for (i = 0; i < 2 * RATE * CHANNELS; i++)
+		ck_assert(fabsf(out[i]) <= CEILING * 1.0001f);
+	/* ... and the gain is released as before: */
+	for (i = 7 * RATE / 4 * CHANNELS; i < 2 * RATE * CHANNELS; i++)
+		ck_assert(out[i] == in[i - d * CHANNELS]);
+
+	limiter_destroy(&l);
+	free(in);
+	free(out);
+}
+END_TEST
+
+Suite *
+limiter_suite(void)
+{
+	Suite	*s;
+	TCase	*tc_limiter;
+
+	s = suite_create("Limiter");
+
+	tc_limiter = tcase_create("Limiter");
+	tcase_add_test(tc_limiter, test_limiter_quiet);
+	tcase_add_test(tc_limiter, test_limiter_loud);
+	tcase_add_test(tc_limiter, test_limiter_bypass);
+	suite_add_tcase(s, tc_limiter);
+
+	return (s);
+}
+
+int
+main(void)
+{
+	int	 num_failed;
+	Suite	*s;
+	SRunner *sr;
+
+	s = limiter_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_NORMAL);
+	num_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	if (num_failed)
+		return (1);
+	return (0);
+}
@@ -1,5 +1,16 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* HAVE_CONFIG_H */
+
 #include <check.h>
 #include <errno.h>
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif /* HAVE_PTHREAD */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "log.h"
 
@@ -7,6 +18,35 @@ Suite * log_suite(void);
 void	setup_checked(void);
 void	teardown_checked(void);
 
+#ifdef HAVE_PTHREAD
+# define LOG_THREADS	4
+
+static pthread_mutex_t	log_thread_mtx = PTHREAD_MUTEX_INITIALIZER;
+static int		log_thread_stop;
+
+static void *	_log_thread(void *);
+
+/* Logs until told to stop, and counts the messages in the argument */
+static void *
+_log_thread(void *arg)
+{
+	unsigned long	*count = arg;
+	int		 stop;
+
+	for (;;) {
+		pthread_mutex_lock(&log_thread_mtx);
+		stop = log_thread_stop;
+		pthread_mutex_unlock(&log_thread_mtx);
+		if (stop)
+			break;
+		(void)log_warning("from a thread: %lu", *count);
+		(*count)++;
+	}
+
+	return (NULL);
+}
+#endif /* HAVE_PTHREAD */
+
 START_TEST(test_log)
 {
 	unsigned int	verbosity;
@@ -43,6 +83,179 @@ START_TEST(test_log)
 }
 END_TEST
 
+static unsigned int
+_count_lines(const char *path, const char *needle)
+{
+	FILE		*fp;
+	char		 buf[BUFSIZ];
+	unsigned int	 n = 0;
+
+	fp = fopen(path, "r");
+	ck_assert_ptr_ne(fp, NULL);
+	while (fgets(buf, sizeof(buf), fp))
+		if (strstr(buf, needle))
+			n++;
+	fclose(fp);
+
+	return (n);
+}
+
+START_TEST(test_log_target)
+{
+	char		path[] = "check_log.XXXXXX";
+	int		fd, i;
+
+	fd = mkstemp(path);
+	ck_assert_int_ge(fd, 0);
+	close(fd);
+
+	ck_assert_int_eq(log_set_target(LOG_TARGET_FILE, NULL), -1);
+	ck_assert_int_eq(log_set_target(LOG_TARGET_FILE,
+	    "/nonexistent/check_log"), -1);
+	ck_assert_int_eq(log_set_target(LOG_TARGET_FILE, path), 0);
+
+	ck_assert_int_ne(log_error("sync %d", 1), 0);
+	ck_assert_uint_eq(_count_lines(path, "check_log["), 1);
+	ck_assert_uint_eq(_count_lines(path, "]: sync 1"), 1);
+
+	if (0 == log_set_async(1)) {
+		for (i = 0; i < 100; i++)
+			ck_assert_int_ne(log_warning("async %d", i), 0);
+		/* Disabling asynchronous mode flushes all pending records: */
+		ck_assert_int_eq(log_set_async(0), 0);
+		ck_assert_uint_eq(_count_lines(path, "]: async "), 100);
+		ck_assert_uint_eq(log_get_dropped(), 0);
+	}
+
+	log_set_ratelimit(3);
+	for (i = 0; i < 10; i++)
+		(void)log_error("limited");
+	ck_assert_int_ne(log_alert("alerts are never limited"), 0);
+	ck_assert_uint_eq(_count_lines(path, "]: limited\n"), 3);
+	ck_assert_uint_eq(log_get_suppressed(), 7);
+	ck_assert_int_ne(log_error("other message"), 0);
+	/* Messages are told apart by their text, not their format: */
+	for (i = 0; i < 10; i++)
+		ck_assert_int_ne(log_error("limited %d", i), 0);
+	for (i = 0; i < 5; i++) {
+		(void)log_syserr(ERROR, ENOENT, "first");
+		(void)log_syserr(ERROR, EACCES, "second");
+	}
+	ck_assert_uint_eq(_count_lines(path, "]: limited "), 10);
+	ck_assert_uint_eq(_count_lines(path, "]: first: "), 3);
+	ck_assert_uint_eq(_count_lines(path, "]: second: "), 3);
+	ck_assert_uint_eq(log_get_suppressed(), 7 + 2 + 2);
+	log_set_ratelimit(0);
+
+	ck_assert_int_eq(log_set_target(LOG_TARGET_STDERR, NULL), 0);
+	ck_assert_int_ne(log_error("stderr"), 0);
+	ck_assert_int_eq(log_set_target(LOG_TARGET_SYSLOG, NULL), 0);
+
+	ck_assert_int_eq(unlink(path), 0);
+}
+END_TEST
+
+START_TEST(test_log_json)
+{
+	char		path[] = "check_log.XXXXXX";
+	char		long_msg[4096];
+	int		fd;
+
+	fd = mkstemp(path);
+	ck_assert_int_ge(fd, 0);
+	close(fd);
+	ck_assert_int_eq(log_set_target(LOG_TARGET_FILE, path), 0);
+	log_set_verbosity(1);
+	log_set_format(LOG_FORMAT_JSON);
+
+	ck_assert_int_ne(log_error("plain \"quoted\"\tmessage"), 0);
+	ck_assert_uint_eq(_count_lines(path, "{\"time\":\""), 1);
+	ck_assert_uint_eq(_count_lines(path,
+	    "\"level\":\"error\",\"message\":\"plain \\\"quoted\\\"\\u0009message\"}\n"),
+	    1);
+
+	log_set_context(LOG_CTX_STREAM, "default");
+	log_set_context(LOG_CTX_MOUNTPOINT, "/stream.ogg");
+	ck_assert_int_ne(log_event(NOTICE, "reconnected", 1.5,
+	    "reconnect: %s: success", "localhost"), 0);
+	ck_assert_uint_eq(_count_lines(path,
+	    "\"level\":\"notice\",\"event\":\"reconnected\","
+	    "\"stream\":\"default\",\"mountpoint\":\"/stream.ogg\","
+	    "\"duration\":1.500000,"
+	    "\"message\":\"reconnect: localhost: success\"}\n"), 1);
+	log_set_context(LOG_CTX_MOUNTPOINT, NULL);
+	ck_assert_int_ne(log_event(WARNING, "connection_lost", -1.0, "lost"),
+	    0);
+	ck_assert_uint_eq(_count_lines(path,
+	    "\"event\":\"connection_lost\",\"stream\":\"default\","
+	    "\"message\":\"lost\"}\n"), 1);
+
+	/* Overlong messages are truncated, but remain well-formed: */
+	memset(long_msg, 'x', sizeof(long_msg) - 1);
+	long_msg[sizeof(long_msg) - 1] = '\0';
+	ck_assert_int_ne(log_warning("%s", long_msg), 0);
+	ck_assert_uint_eq(_count_lines(path, "xxx\"}\n"), 1);
+
+	log_set_format(LOG_FORMAT_TEXT);
+	ck_assert_int_ne(log_event(NOTICE, "skip", -1.0, "text again"), 0);
+	ck_assert_uint_eq(_count_lines(path, "]: text again\n"), 1);
+
+	ck_assert_int_eq(unlink(path), 0);
+}
+END_TEST
+
+#ifdef HAVE_PTHREAD
+START_TEST(test_log_threads)
+{
+	char		path[2][32] = { "check_log.XXXXXX", "check_log.XXXXXX" };
+	pthread_t	threads[LOG_THREADS];
+	unsigned long	counts[LOG_THREADS], dropped, total = 0;
+	unsigned int	i;
+	int		fd;
+
+	for (i = 0; i < 2; i++) {
+		fd = mkstemp(path[i]);
+		ck_assert_int_ge(fd, 0);
+		close(fd);
+	}
+	ck_assert_int_eq(log_set_target(LOG_TARGET_FILE, path[0]), 0);
+	dropped = log_get_dropped();
+
+	/* Logging goes on while the target and mode change underneath: */
+	log_thread_stop = 0;
+	for (i = 0; i < LOG_THREADS; i++) {
+		counts[i] = 0;
+		ck_assert_int_eq(pthread_create(&threads[i], NULL,
+		    _log_thread, &counts[i]), 0);
+	}
+	for (i = 0; i < 200; i++) {
+		ck_assert_int_eq(log_set_target(LOG_TARGET_FILE,
+		    path[i % 2]), 0);
+		(void)log_set_async(i % 3);
+		log_set_format(i % 5 ? LOG_FORMAT_TEXT : LOG_FORMAT_JSON);
+		log_set_context(LOG_CTX_TRACK, i % 2 ? "track" : NULL);
+	}
+	pthread_mutex_lock(&log_thread_mtx);
+	log_thread_stop = 1;
+	pthread_mutex_unlock(&log_thread_mtx);
+	for (i = 0; i < LOG_THREADS; i++) {
+		pthread_join(threads[i], NULL);
+		total += counts[i];
+	}
+	ck_assert_int_eq(log_set_async(0), 0);
+
+	/* Messages are either written to one of the files, or dropped: */
+	ck_assert_uint_eq(_count_lines(path[0], "from a thread: ") +
+	    _count_lines(path[1], "from a thread: ") +
+	    (log_get_dropped() - dropped), total);
+
+	ck_assert_int_eq(log_set_target(LOG_TARGET_SYSLOG, NULL), 0);
+	for (i = 0; i < 2; i++)
+		ck_assert_int_eq(unlink(path[i]), 0);
+}
+END_TEST
+#endif /* HAVE_PTHREAD */
+
 Suite *
 log_suite(void)
 {
@@ -54,6 +267,11 @@ log_suite(void)
 	tc_log = tcase_create("Log");
 	tcase_add_checked_fixture(tc_log, setup_checked, teardown_checked);
 	tcase_add_test(tc_log, test_log);
+	tcase_add_test(tc_log, test_log_target);
+	tcase_add_test(tc_log, test_log_json);
+#ifdef HAVE_PTHREAD
+	tcase_add_test(tc_log, test_log_threads);
+#endif /* HAVE_PTHREAD */
 	suite_add_tcase(s, tc_log);
 
 	return (s);
@@ -1,3 +1,7 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* HAVE_CONFIG_H */
+
 #include <check.h>
 
 #include <stdio.h>
@@ -105,6 +109,37 @@ START_TEST(test_mdata_parse_file)
 }
 END_TEST
 
+START_TEST(test_mdata_gain)
+{
+	float	gain;
+
+	ck_assert_int_eq(mdata_parse_file(md, SRCDIR "/test16-nometa.ogg"), 0);
+	ck_assert_int_ne(mdata_get_track_gain(md, &gain), 0);
+	ck_assert_int_ne(mdata_get_album_gain(md, &gain), 0);
+	mdata_set_track_gain(md, -3.0f);
+	ck_assert_int_eq(mdata_get_track_gain(md, &gain), 0);
+	ck_assert(gain == -3.0f);
+
+#ifdef HAVE_TAGLIB_PROPERTY_GET
+	ck_assert_int_eq(mdata_parse_file(md, SRCDIR "/test20-replaygain.ogg"), 0);
+	ck_assert_str_eq(mdata_get_title(md), "ReplayGain");
+	ck_assert_int_eq(mdata_get_track_gain(md, &gain), 0);
+	ck_assert(gain == -6.5f);
+	ck_assert_int_eq(mdata_get_album_gain(md, &gain), 0);
+	ck_assert(gain == 1.25f);
+
+	/* R128 gains are relative to -23 LUFS: */
+	ck_assert_int_eq(mdata_parse_file(md, SRCDIR "/test21-r128.ogg"), 0);
+	ck_assert_int_eq(mdata_get_track_gain(md, &gain), 0);
+	ck_assert(gain == -5.0f);
+	ck_assert_int_ne(mdata_get_album_gain(md, &gain), 0);
+#endif /* HAVE_TAGLIB_PROPERTY_GET */
+
+	ck_assert_int_eq(mdata_parse_file(md, SRCDIR "/test16-nometa.ogg"), 0);
+	ck_assert_int_ne(mdata_get_track_gain(md, &gain), 0);
+}
+END_TEST
+
 START_TEST(test_mdata_run_program)
 {
 	ck_assert_int_ne(mdata_run_program(md, SRCDIR "/nonexistent"), 0);
@@ -182,6 +217,30 @@ START_TEST(test_mdata_strformat)
 }
 END_TEST
 
+START_TEST(test_mdata_arena)
+{
+	xarena_t	arena;
+	mdata_t 	amd;
+
+	arena = xarena_create(0);
+	amd = mdata_create_arena(arena);
+	mdata_set_normalize_strings(amd, 1);
+	ck_assert_int_eq(mdata_parse_file(amd, SRCDIR "/test02-whitespace.ogg"), 0);
+	ck_assert_str_eq(mdata_get_name(amd), "test02-whitespace");
+	ck_assert_str_eq(mdata_get_artist(amd), "test artist");
+	ck_assert_str_eq(mdata_get_songinfo(amd),
+	    "test artist - test title - test album");
+	ck_assert_int_eq(mdata_refresh(amd), 0);
+	ck_assert_str_eq(mdata_get_title(amd), "test title");
+	ck_assert_int_eq(mdata_run_program(amd, SRCDIR "/test-meta01.sh"), 0);
+	ck_assert_str_eq(mdata_get_songinfo(amd), "songinfo");
+	ck_assert_uint_gt(xarena_get_stats(arena)->allocs, 0);
+	mdata_destroy(&amd);
+	ck_assert_ptr_eq(amd, NULL);
+	xarena_destroy(&arena);
+}
+END_TEST
+
 Suite *
 mdata_suite(void)
 {
@@ -194,8 +253,10 @@ mdata_suite(void)
 	tcase_add_checked_fixture(tc_mdata, setup_checked, teardown_checked);
 	tcase_add_test(tc_mdata, test_mdata_md);
 	tcase_add_test(tc_mdata, test_mdata_parse_file);
+	tcase_add_test(tc_mdata, test_mdata_gain);
 	tcase_add_test(tc_mdata, test_mdata_run_program);
 	tcase_add_test(tc_mdata, test_mdata_strformat);
+	tcase_add_test(tc_mdata, test_mdata_arena);
 	suite_add_tcase(s, tc_mdata);
 
 	return (s);
@@ -0,0 +1,181 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <check.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "metrics.h"
+#include "xalloc.h"
+
+Suite * metrics_suite(void);
+void	setup_checked(void);
+void	teardown_checked(void);
+
+START_TEST(test_metrics)
+{
+	metrics_t	 m;
+	struct timespec  ts;
+	char		*out;
+	size_t		 len;
+
+	m = metrics_create("check\"metrics");
+	ck_assert_ptr_ne(m, NULL);
+
+	metrics_count(m, METRICS_BYTES_SENT, 4096);
+	metrics_count(m, METRICS_BYTES_SENT, 4096);
+	metrics_count(m, METRICS_CHUNKS_SENT, 2);
+	ck_assert_uint_eq(metrics_get_counter(m, METRICS_BYTES_SENT), 8192);
+	ck_assert_uint_eq(metrics_get_counter(m, METRICS_CHUNKS_SENT), 2);
+	ck_assert_uint_eq(metrics_get_counter(m, METRICS_RECONNECTS), 0);
+
+	metrics_observe(m, METRICS_SEND_LATENCY, 0.002);
+	metrics_observe(m, METRICS_SEND_LATENCY, 20.0);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	metrics_observe_since(m, METRICS_SYNC_WAIT, &ts);
+	metrics_set_connected(m, 1);
+
+	out = metrics_render(&len);
+	ck_assert_ptr_ne(out, NULL);
+	ck_assert_uint_eq(strlen(out), len);
+	ck_assert_ptr_ne(strstr(out,
+	    "# TYPE ezstream_sent_bytes_total counter\n"), NULL);
+	ck_assert_ptr_ne(strstr(out,
+	    "ezstream_sent_bytes_total{stream=\"check\\\"metrics\"} 8192\n"),
+	    NULL);
+	ck_assert_ptr_ne(strstr(out,
+	    "ezstream_connected{stream=\"check\\\"metrics\"} 1\n"), NULL);
+	ck_assert_ptr_ne(strstr(out,
+	    "ezstream_send_latency_seconds_bucket{stream=\"check\\\"metrics\",le=\"0.001\"} 0\n"),
+	    NULL);
+	ck_assert_ptr_ne(strstr(out,
+	    "ezstream_send_latency_seconds_bucket{stream=\"check\\\"metrics\",le=\"0.0025\"} 1\n"),
+	    NULL);
+	ck_assert_ptr_ne(strstr(out,
+	    "ezstream_send_latency_seconds_bucket{stream=\"check\\\"metrics\",le=\"+Inf\"} 2\n"),
+	    NULL);
+	ck_assert_ptr_ne(strstr(out,
+	    "ezstream_send_latency_seconds_count{stream=\"check\\\"metrics\"} 2\n"),
+	    NULL);
+	ck_assert_ptr_ne(strstr(out,
+	    "ezstream_sync_wait_seconds_count{stream=\"check\\\"metrics\"} 1\n"),
+	    NULL);
+	xfree(out);
+
+	metrics_destroy(&m);
+	ck_assert_ptr_eq(m, NULL);
+	out = metrics_render(NULL);
+	ck_assert_ptr_eq(strstr(out, "check\\\"metrics"), NULL);
+	xfree(out);
+}
+END_TEST
+
+START_TEST(test_metrics_listen)
+{
+	metrics_t		 m;
+	struct sockaddr_un	 sun;
+	const char		 req[] = "GET /metrics HTTP/1.0\r\n\r\n";
+	char			 buf[BUFSIZ * 4];
+	size_t			 len = 0;
+	ssize_t 		 n;
+	char			 path[PATH_MAX];
+	int			 fd, i;
+
+	ck_assert_ptr_ne(getcwd(buf, sizeof(buf)), NULL);
+	snprintf(path, sizeof(path), "%s/check_metrics.sock", buf);
+
+	ck_assert_int_eq(metrics_init(NULL), 0);
+	metrics_poll();
+	metrics_exit();
+	ck_assert_int_eq(metrics_init("/nonexistent/check_metrics.sock"), -1);
+	ck_assert_int_eq(metrics_init("localhost:bogus"), -1);
+
+	ck_assert_int_eq(metrics_init(path), 0);
+	m = metrics_create("check-metrics");
+	metrics_count(m, METRICS_TRACK_CHANGES, 3);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	ck_assert_int_ge(fd, 0);
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strncpy(sun.sun_path, path, sizeof(sun.sun_path) - 1);
+	ck_assert_int_eq(connect(fd, (struct sockaddr *)&sun, sizeof(sun)), 0);
+	ck_assert_int_eq(write(fd, req, strlen(req)), (ssize_t)strlen(req));
+
+	for (i = 0; i < 100; i++) {
+		metrics_poll();
+		n = recv(fd, buf + len, sizeof(buf) - len - 1, MSG_DONTWAIT);
+		if (0 == n)
+			break;
+		if (0 < n)
+			len += (size_t)n;
+		usleep(10000);
+	}
+	buf[len] = '\0';
+	close(fd);
+
+	ck_assert_int_eq(strncmp(buf, "HTTP/1.0 200 OK\r\n",
+	    strlen("HTTP/1.0 200 OK\r\n")), 0);
+	ck_assert_ptr_ne(strstr(buf,
+	    "ezstream_track_changes_total{stream=\"check-metrics\"} 3\n"),
+	    NULL);
+
+	metrics_destroy(&m);
+	metrics_exit();
+	ck_assert_int_ne(access(path, F_OK), 0);
+}
+END_TEST
+
+Suite *
+metrics_suite(void)
+{
+	Suite	*s;
+	TCase	*tc_metrics;
+
+	s = suite_create("Metrics");
+
+	tc_metrics = tcase_create("Metrics");
+	tcase_add_checked_fixture(tc_metrics, setup_checked, teardown_checked);
+	tcase_add_test(tc_metrics, test_metrics);
+	tcase_add_test(tc_metrics, test_metrics_listen);
+	suite_add_tcase(s, tc_metrics);
+
+	return (s);
+}
+
+void
+setup_checked(void)
+{
+	if (0 < log_init(NULL))
+		ck_abort_msg("setup_checked failed");
+}
+
+void
+teardown_checked(void)
+{
+	log_exit();
+}
+
+int
+main(void)
+{
+	int	 num_failed;
+	Suite	*s;
+	SRunner *sr;
+
+	s = metrics_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_NORMAL);
+	num_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	if (num_failed)
+		return (1);
+	return (0);
+}
@@ -0,0 +1,157 @@
+#include <check.h>
+#include <math.h>
+#include <string.h>
+
+#include "pcm.h"
+
+#define PCM_SAMPLES	37
+
+Suite * pcm_suite(void);
+
+static const char	*impls[] = { "avx2", "sse2", "scalar" };
+
+START_TEST(test_pcm_s16le)
+{
+	const float	in[] = { 0.0f, 0.5f, -0.5f, 1.0f, -1.0f, 2.0f, -2.0f,
+			    1.0f / 65536.0f, -1.0f / 65536.0f };
+	unsigned char	out[sizeof(in) / sizeof(in[0]) * PCM_S16_SIZE];
+	float		back[sizeof(in) / sizeof(in[0])];
+
+	pcm_float_to_s16le(in, out, sizeof(in) / sizeof(in[0]));
+	ck_assert_uint_eq(out[0] | out[1] << 8, 0x0000);
+	ck_assert_uint_eq(out[2] | out[3] << 8, 0x4000);
+	ck_assert_uint_eq(out[4] | out[5] << 8, 0xc000);
+	/* Clipped: */
+	ck_assert_uint_eq(out[6] | out[7] << 8, 0x7fff);
+	ck_assert_uint_eq(out[8] | out[9] << 8, 0x8000);
+	ck_assert_uint_eq(out[10] | out[11] << 8, 0x7fff);
+	ck_assert_uint_eq(out[12] | out[13] << 8, 0x8000);
+	/* Rounded half away from zero: */
+	ck_assert_uint_eq(out[14] | out[15] << 8, 0x0001);
+	ck_assert_uint_eq(out[16] | out[17] << 8, 0xffff);
+
+	pcm_s16le_to_float(out, back, sizeof(in) / sizeof(in[0]));
+	ck_assert(back[1] == 0.5f);
+	ck_assert(back[2] == -0.5f);
+	ck_assert(back[4] == -1.0f);
+	ck_assert(back[7] == 1.0f / 32768.0f);
+}
+END_TEST
+
+START_TEST(test_pcm_mix)
+{
+	float	a[PCM_SAMPLES], b[PCM_SAMPLES], ga[PCM_SAMPLES],
+		gb[PCM_SAMPLES], ref[PCM_SAMPLES], dst[PCM_SAMPLES];
+	size_t	i, j;
+
+	ck_assert_ptr_ne(pcm_init(), NULL);
+	ck_assert_int_ne(pcm_select("<something else>"), 0);
+	ck_assert_int_eq(pcm_select("scalar"), 0);
+
+	for (i = 0; i < PCM_SAMPLES; i++) {
+		a[i] = sinf((float)i);
+		b[i] = cosf((float)i * 0.5f);
+		ga[i] = (float)i / PCM_SAMPLES;
+		gb[i] = 1.0f - ga[i];
+		ref[i] = a[i] * ga[i] + b[i] * gb[i];
+	}
+
+	/* Every supported implementation, including their scalar tails: */
+	for (j = 0; j < sizeof(impls) / sizeof(impls[0]); j++) {
+		size_t	n;
+
+		if (0 != pcm_select(impls[j]))
+			continue;
+		for (n = 0; n <= PCM_SAMPLES; n += 9) {
+			memcpy(dst, a, sizeof(dst));
+			pcm_mix(dst, ga, b, gb, n);
+			for (i = 0; i < n; i++)
+				ck_assert(fabsf(dst[i] - ref[i]) < 1e-6f);
+			for (; i < PCM_SAMPLES; i++)
+				ck_assert(dst[i] == a[i]);
+
+			memcpy(dst, a, sizeof(dst));
+			pcm_scale(dst, ga, n);
+			for (i = 0; i < n; i++)
+				ck_assert(fabsf(dst[i] - a[i] * ga[i]) < 1e-6f);
+			for (; i < PCM_SAMPLES; i++)
+				ck_assert(dst[i] == a[i]);
+		}
+	}
+}
+END_TEST
+
+START_TEST(test_pcm_gain)
+{
+	float	a[PCM_SAMPLES], dst[PCM_SAMPLES];
+	size_t	i, j;
+
+	for (i = 0; i < PCM_SAMPLES; i++)
+		a[i] = sinf((float)i) * 0.5f;
+
+	for (j = 0; j < sizeof(impls) / sizeof(impls[0]); j++) {
+		size_t	n;
+
+		if (0 != pcm_select(impls[j]))
+			continue;
+		for (n = 0; n <= PCM_SAMPLES; n += 9) {
+			float	peak = 0.0f;
+
+			memcpy(dst, a, sizeof(dst));
+			pcm_gain(dst, 0.25f, n);
+			for (i = 0; i < n; i++)
+				ck_assert(dst[i] == a[i] * 0.25f);
+			for (; i < PCM_SAMPLES; i++)
+				ck_assert(dst[i] == a[i]);
+
+			for (i = 0; i < n; i++) {
+				if (fabsf(a[i]) > peak)
+					peak = fabsf(a[i]);
+			}
+			ck_assert(pcm_peak(a, n) == peak);
+		}
+		/* Negative peaks count, in the scalar tail too: */
+		memcpy(dst, a, sizeof(dst));
+		dst[3] = -0.75f;
+		ck_assert(pcm_peak(dst, PCM_SAMPLES) == 0.75f);
+		dst[PCM_SAMPLES - 1] = -0.875f;
+		ck_assert(pcm_peak(dst, PCM_SAMPLES) == 0.875f);
+	}
+}
+END_TEST
+
+Suite *
+pcm_suite(void)
+{
+	Suite	*s;
+	TCase	*tc_pcm;
+
+	s = suite_create("PCM");
+
+	tc_pcm = tcase_create("PCM");
+	tcase_add_test(tc_pcm, test_pcm_s16le);
+	tcase_add_test(tc_pcm, test_pcm_mix);
+	tcase_add_test(tc_pcm, test_pcm_gain);
+	suite_add_tcase(s, tc_pcm);
+
+	return (s);
+}
+
+int
+main(void)
+{
+	int	 num_failed;
+	Suite	*s;
+	SRunner *sr;
+
+	s = pcm_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_NORMAL);
+	num_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	if (num_failed)
+		return (1);
+	return (0);
+}
@@ -0,0 +1,470 @@
+#include <check.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "cfg.h"
+#include "log.h"
+#include "metrics.h"
+#include "pipeline.h"
+#include "plugin.h"
+
+#define PLUGIN_RAW	BUILDDIR "/.libs/plugin_raw.so"
+#define NULL_RAW	SRCDIR "/null.raw"
+#define NULL_RAW_SIZE	176400
+#define RAW_HEADER_SIZE 4
+#define RAW_TRAILER_SIZE 4
+#define TONE_RAW	BUILDDIR "/check_pipeline.raw"
+#define TONE_FRAMES	22050
+#define TONE_SAMPLE	0x4000
+#define XFADE_FRAMES	4410
+/* The limiter's ceiling of -1 dBTP, as a 16-bit sample */
+#define CEILING_SAMPLE	29205
+/* Leading, inner and trailing silence, with the inner one not trimmed */
+#define BURST_FRAMES	4410
+#define SILENCE_LEAD	44100
+#define SILENCE_GAP	(44100 * 6)
+#define SILENCE_TRAIL	(44100 * 2)
+
+Suite * pipeline_suite(void);
+void	setup_checked(void);
+void	teardown_checked(void);
+
+static void	_write_tone(void);
+static void	_write_frames(FILE *, int, size_t);
+static size_t	_read_all(pipeline_t);
+static size_t	_read_samples(pipeline_t, short *, size_t);
+
+cfg_decoder_list_t	decoders;
+metrics_t		metrics;
+
+/* Half a second of a constant signal: */
+static void
+_write_tone(void)
+{
+	FILE	*fp;
+	size_t	 i;
+
+	fp = fopen(TONE_RAW, "wb");
+	ck_assert_ptr_ne(fp, NULL);
+	for (i = 0; i < TONE_FRAMES * 2; i++) {
+		ck_assert_int_ne(fputc(TONE_SAMPLE & 0xff, fp), EOF);
+		ck_assert_int_ne(fputc(TONE_SAMPLE >> 8, fp), EOF);
+	}
+	ck_assert_int_eq(fclose(fp), 0);
+}
+
+static void
+_write_frames(FILE *fp, int sample, size_t frames)
+{
+	size_t	i;
+
+	for (i = 0; i < frames * 2; i++) {
+		ck_assert_int_ne(fputc(sample & 0xff, fp), EOF);
+		ck_assert_int_ne(fputc((sample >> 8) & 0xff, fp), EOF);
+	}
+}
+
+static size_t
+_read_all(pipeline_t p)
+{
+	char	buf[4096];
+	size_t	total = 0;
+	ssize_t n;
+
+	while (0 < (n = pipeline_read(p, buf, sizeof(buf))))
+		total += (size_t)n;
+	ck_assert_int_eq(n, 0);
+
+	return (total);
+}
+
+static size_t
+_read_samples(pipeline_t p, short *samples, size_t max)
+{
+	unsigned char	buf[4096];
+	size_t		n = 0, i;
+	ssize_t 	len;
+
+	while (0 < (len = pipeline_read(p, buf, sizeof(buf)))) {
+		ck_assert_int_eq(len % 2, 0);
+		for (i = 0; i < (size_t)len && n < max; i += 2)
+			samples[n++] = (short)(buf[i] | buf[i + 1] << 8);
+	}
+	ck_assert_int_eq(len, 0);
+
+	return (n);
+}
+
+START_TEST(test_plugin)
+{
+	const struct ezstream_decoder_plugin	*dp;
+
+	ck_assert_ptr_eq(plugin_get_decoder(NULL), NULL);
+	ck_assert_ptr_eq(plugin_get_decoder(BUILDDIR "/nonexistent.so"),
+	    NULL);
+
+	dp = plugin_get_decoder(PLUGIN_RAW);
+	ck_assert_ptr_ne(dp, NULL);
+	ck_assert_str_eq(dp->name, "raw");
+	ck_assert_ptr_eq(plugin_get_decoder(PLUGIN_RAW), dp);
+
+	ck_assert_ptr_eq(plugin_get_encoder(NULL), NULL);
+	ck_assert_ptr_ne(plugin_get_encoder(PLUGIN_RAW), NULL);
+}
+END_TEST
+
+START_TEST(test_pipeline)
+{
+	pipeline_t	p;
+	cfg_decoder_t	dec;
+	char		buf[4096];
+
+	p = pipeline_create(metrics);
+	ck_assert_ptr_ne(p, NULL);
+	ck_assert_int_eq(pipeline_read(p, buf, sizeof(buf)), 0);
+
+	dec = cfg_decoder_list_get(decoders, "raw");
+	ck_assert_int_ne(pipeline_start(p, dec, NULL_RAW, NULL), 0);
+	ck_assert_int_eq(cfg_decoder_set_plugin(dec, decoders,
+	    BUILDDIR "/nonexistent.so", NULL), 0);
+	ck_assert_int_ne(pipeline_start(p, dec, NULL_RAW, NULL), 0);
+	ck_assert_int_eq(cfg_decoder_set_plugin(dec, decoders, PLUGIN_RAW,
+	    NULL), 0);
+	ck_assert_int_ne(pipeline_start(p, dec, SRCDIR "/nonexistent.raw",
+	    NULL), 0);
+
+	/* Without an encoder, the audio itself comes out: */
+	ck_assert_int_eq(pipeline_start(p, dec, NULL_RAW, NULL), 0);
+	ck_assert_uint_eq(_read_all(p), NULL_RAW_SIZE);
+	pipeline_stop(p);
+
+	ck_assert_int_eq(pipeline_start(p, dec, NULL_RAW, "cat"), 0);
+	ck_assert_uint_eq(_read_all(p), NULL_RAW_SIZE);
+	pipeline_stop(p);
+
+	/* An encoder that stops reading early: */
+	ck_assert_int_eq(pipeline_start(p, dec, NULL_RAW, "head -c 1000"), 0);
+	ck_assert_uint_eq(_read_all(p), 1000);
+	pipeline_stop(p);
+
+	/* Stopping in the middle of a track: */
+	ck_assert_int_eq(pipeline_start(p, dec, NULL_RAW, "cat"), 0);
+	ck_assert_int_gt(pipeline_read(p, buf, sizeof(buf)), 0);
+	ck_assert_int_eq(pipeline_start(p, dec, NULL_RAW, NULL), 0);
+	ck_assert_int_gt(pipeline_read(p, buf, sizeof(buf)), 0);
+
+	pipeline_destroy(&p);
+	ck_assert_ptr_eq(p, NULL);
+	pipeline_destroy(&p);
+}
+END_TEST
+
+START_TEST(test_pipeline_encoder)
+{
+	pipeline_t	p;
+	cfg_decoder_t	dec;
+
+	p = pipeline_create(metrics);
+	dec = cfg_decoder_list_get(decoders, "raw");
+	ck_assert_int_eq(cfg_decoder_set_plugin(dec, decoders, PLUGIN_RAW,
+	    NULL), 0);
+
+	ck_assert_int_ne(pipeline_set_encoder(p, BUILDDIR "/nonexistent.so"),
+	    0);
+	ck_assert_int_eq(pipeline_set_encoder(p, PLUGIN_RAW), 0);
+
+	/* Only the first track starts a new encoded stream: */
+	ck_assert_int_eq(pipeline_start(p, dec, NULL_RAW, NULL), 0);
+	ck_assert_uint_eq(_read_all(p), RAW_HEADER_SIZE + NULL_RAW_SIZE);
+	pipeline_stop(p);
+	ck_assert_int_eq(pipeline_start(p, dec, NULL_RAW, NULL), 0);
+	ck_assert_uint_eq(_read_all(p), NULL_RAW_SIZE);
+	pipeline_stop(p);
+
+	/* The old stream ends before the new one starts: */
+	pipeline_restart_encoder(p);
+	ck_assert_int_eq(pipeline_start(p, dec, NULL_RAW, NULL), 0);
+	ck_assert_uint_eq(_read_all(p),
+	    RAW_TRAILER_SIZE + RAW_HEADER_SIZE + NULL_RAW_SIZE);
+	pipeline_stop(p);
+
+	/* Draining at the end leaves the final output to be read: */
+	pipeline_drain(p);
+	ck_assert_uint_eq(_read_all(p), RAW_TRAILER_SIZE);
+	pipeline_drain(p);
+	ck_assert_uint_eq(_read_all(p), 0);
+
+	/* Without the encoder plugin, the audio itself comes out again: */
+	ck_assert_int_eq(pipeline_start(p, dec, NULL_RAW, NULL), 0);
+	ck_assert_uint_eq(_read_all(p), RAW_HEADER_SIZE + NULL_RAW_SIZE);
+	pipeline_stop(p);
+	ck_assert_int_eq(pipeline_set_encoder(p, NULL), 0);
+	ck_assert_int_eq(pipeline_start(p, dec, NULL_RAW, NULL), 0);
+	ck_assert_uint_eq(_read_all(p), RAW_TRAILER_SIZE + NULL_RAW_SIZE);
+
+	pipeline_destroy(&p);
+}
+END_TEST
+
+START_TEST(test_pipeline_crossfade)
+{
+	pipeline_t	 p;
+	cfg_decoder_t	 dec;
+	short		*samples;
+	size_t		 i, n;
+
+	/* A tone, followed by silence: */
+	_write_tone();
+	samples = calloc(NULL_RAW_SIZE / 2, sizeof(*samples));
+	ck_assert_ptr_ne(samples, NULL);
+
+	p = pipeline_create(metrics);
+	dec = cfg_decoder_list_get(decoders, "raw");
+	ck_assert_int_eq(cfg_decoder_set_plugin(dec, decoders, PLUGIN_RAW,
+	    NULL), 0);
+	pipeline_set_crossfade(p, 100, CFG_STREAM_FADE_LINEAR);
+
+	/* The end of the first track is held back ... */
+	ck_assert_int_eq(pipeline_start(p, dec, TONE_RAW, NULL), 0);
+	n = _read_samples(p, samples, NULL_RAW_SIZE / 2);
+	ck_assert_uint_eq(n, (TONE_FRAMES - XFADE_FRAMES) * 2);
+	for (i = 0; i < n; i++)
+		ck_assert_int_eq(samples[i], TONE_SAMPLE);
+	pipeline_stop(p);
+
+	/* ... and overlaps with the beginning of the next: */
+	ck_assert_int_eq(pipeline_start(p, dec, NULL_RAW, "cat"), 0);
+	n = _read_samples(p, samples, NULL_RAW_SIZE / 2);
+	ck_assert_uint_eq(n, NULL_RAW_SIZE / 2 - XFADE_FRAMES * 2);
+	ck_assert_int_lt(samples[0], TONE_SAMPLE);
+	ck_assert_int_gt(samples[0], TONE_SAMPLE - 10);
+	for (i = 2; i < XFADE_FRAMES * 2; i++)
+		ck_assert_int_le(samples[i], samples[i - 2]);
+	ck_assert_int_gt(samples[XFADE_FRAMES * 2 - 1], 0);
+	for (i = XFADE_FRAMES * 2; i < n; i++)
+		ck_assert_int_eq(samples[i], 0);
+	pipeline_stop(p);
+
+	/* The end of the last track is played out when draining: */
+	pipeline_drain(p);
+	ck_assert_uint_eq(_read_all(p), XFADE_FRAMES * 4);
+	pipeline_drain(p);
+	ck_assert_uint_eq(_read_all(p), 0);
+
+	/* Without a crossfade, the held back audio is dropped: */
+	pipeline_set_crossfade(p, 0, CFG_STREAM_FADE_LINEAR);
+	ck_assert_int_eq(pipeline_start(p, dec, TONE_RAW, NULL), 0);
+	ck_assert_uint_eq(_read_all(p), TONE_FRAMES * 4);
+
+	pipeline_destroy(&p);
+	free(samples);
+	(void)unlink(TONE_RAW);
+}
+END_TEST
+
+START_TEST(test_pipeline_gain)
+{
+	pipeline_t	 p;
+	cfg_decoder_t	 dec;
+	short		*samples;
+	size_t		 i, n;
+
+	_write_tone();
+	samples = calloc(TONE_FRAMES * 2, sizeof(*samples));
+	ck_assert_ptr_ne(samples, NULL);
+
+	p = pipeline_create(metrics);
+	dec = cfg_decoder_list_get(decoders, "raw");
+	ck_assert_int_eq(cfg_decoder_set_plugin(dec, decoders, PLUGIN_RAW,
+	    NULL), 0);
+
+	/* Half the amplitude: */
+	pipeline_set_gain(p, -6.0206f, 0);
+	ck_assert_int_eq(pipeline_start(p, dec, TONE_RAW, NULL), 0);
+	n = _read_samples(p, samples, TONE_FRAMES * 2);
+	ck_assert_uint_eq(n, TONE_FRAMES * 2);
+	for (i = 0; i < n; i++)
+		ck_assert_int_eq(samples[i], TONE_SAMPLE / 2);
+	pipeline_stop(p);
+
+	/* Twice the amplitude, limited after a short delay: */
+	pipeline_set_gain(p, 6.0206f, 1);
+	ck_assert_int_eq(pipeline_start(p, dec, TONE_RAW, NULL), 0);
+	n = _read_samples(p, samples, TONE_FRAMES * 2);
+	ck_assert_uint_eq(n, TONE_FRAMES * 2);
+	ck_assert_int_eq(samples[0], 0);
+	for (i = 0; i < n; i++)
+		ck_assert_int_le(samples[i], CEILING_SAMPLE);
+	for (i = n / 2; i < n; i++)
+		ck_assert_int_ge(samples[i], CEILING_SAMPLE - 1);
+	pipeline_stop(p);
+
+	/* ... which is played out when draining: */
+	pipeline_drain(p);
+	n = _read_samples(p, samples, TONE_FRAMES * 2);
+	ck_assert_uint_gt(n, 0);
+	ck_assert_uint_lt(n, 1000);
+	for (i = 0; i < n; i++) {
+		ck_assert_int_le(samples[i], CEILING_SAMPLE);
+		ck_assert_int_gt(samples[i], TONE_SAMPLE);
+	}
+
+	/* The limiter is gone without normalization: */
+	pipeline_set_gain(p, 0.0f, 0);
+	ck_assert_int_eq(pipeline_start(p, dec, TONE_RAW, NULL), 0);
+	n = _read_samples(p, samples, TONE_FRAMES * 2);
+	ck_assert_uint_eq(n, TONE_FRAMES * 2);
+	ck_assert_int_eq(samples[0], TONE_SAMPLE);
+	pipeline_stop(p);
+
+	/* A true peak that stays below the ceiling spares the limiting: */
+	pipeline_set_gain(p, 6.0206f, 1);
+	pipeline_set_peak(p, 0.25f);
+	ck_assert_int_eq(pipeline_start(p, dec, TONE_RAW, NULL), 0);
+	n = _read_samples(p, samples, TONE_FRAMES * 2);
+	ck_assert_uint_eq(n, TONE_FRAMES * 2);
+	ck_assert_int_eq(samples[0], 0);
+	ck_assert_int_eq(samples[n - 1], 32767);
+
+	pipeline_destroy(&p);
+	free(samples);
+	(void)unlink(TONE_RAW);
+}
+END_TEST
+
+START_TEST(test_pipeline_silence)
+{
+	pipeline_t	 p;
+	cfg_decoder_t	 dec;
+	FILE		*fp;
+	short		*samples;
+	size_t		 i, n;
+
+	/*
+	 * Noise at about -70 dBFS around two short bursts of audio, with
+	 * a gap of silence between them that is too long to be trimmed:
+	 */
+	fp = fopen(TONE_RAW, "wb");
+	ck_assert_ptr_ne(fp, NULL);
+	_write_frames(fp, 10, SILENCE_LEAD);
+	_write_frames(fp, TONE_SAMPLE, BURST_FRAMES);
+	_write_frames(fp, 0, SILENCE_GAP);
+	_write_frames(fp, -TONE_SAMPLE, BURST_FRAMES);
+	_write_frames(fp, -10, SILENCE_TRAIL);
+	ck_assert_int_eq(fclose(fp), 0);
+
+	n = (SILENCE_LEAD + 2 * BURST_FRAMES + SILENCE_GAP + SILENCE_TRAIL) * 2;
+	samples = calloc(n, sizeof(*samples));
+	ck_assert_ptr_ne(samples, NULL);
+
+	p = pipeline_create(metrics);
+	dec = cfg_decoder_list_get(decoders, "raw");
+	ck_assert_int_eq(cfg_decoder_set_plugin(dec, decoders, PLUGIN_RAW,
+	    NULL), 0);
+
+	pipeline_set_silence(p, -60);
+	ck_assert_int_eq(pipeline_start(p, dec, TONE_RAW, NULL), 0);
+	n = _read_samples(p, samples, n);
+	ck_assert_uint_eq(n, (2 * BURST_FRAMES + SILENCE_GAP) * 2);
+	for (i = 0; i < BURST_FRAMES * 2; i++)
+		ck_assert_int_eq(samples[i], TONE_SAMPLE);
+	for (; i < (BURST_FRAMES + SILENCE_GAP) * 2; i++)
+		ck_assert_int_eq(samples[i], 0);
+	for (; i < n; i++)
+		ck_assert_int_eq(samples[i], -TONE_SAMPLE);
+	pipeline_stop(p);
+
+	/* Known bounds are trusted, rather than scanned for: */
+	pipeline_set_bounds(p, 1050, 7150);
+	ck_assert_int_eq(pipeline_start(p, dec, TONE_RAW, NULL), 0);
+	n = (SILENCE_LEAD + 2 * BURST_FRAMES + SILENCE_GAP + SILENCE_TRAIL) * 2;
+	n = _read_samples(p, samples, n);
+	ck_assert_uint_eq(n, (7151 * 441 / 10 - 1050 * 441 / 10) * 2);
+	ck_assert_int_eq(samples[0], TONE_SAMPLE);
+	ck_assert_int_eq(samples[n - 1], -TONE_SAMPLE);
+	pipeline_stop(p);
+	pipeline_set_bounds(p, 0, 0);
+
+	/* Below the noise, nothing is trimmed: */
+	pipeline_set_silence(p, -80);
+	ck_assert_int_eq(pipeline_start(p, dec, TONE_RAW, NULL), 0);
+	ck_assert_uint_eq(_read_all(p), (SILENCE_LEAD + 2 * BURST_FRAMES +
+	    SILENCE_GAP + SILENCE_TRAIL) * 2 * 2);
+	pipeline_stop(p);
+
+	pipeline_set_silence(p, 0);
+	ck_assert_int_eq(pipeline_start(p, dec, TONE_RAW, NULL), 0);
+	ck_assert_uint_eq(_read_all(p), (SILENCE_LEAD + 2 * BURST_FRAMES +
+	    SILENCE_GAP + SILENCE_TRAIL) * 2 * 2);
+
+	pipeline_destroy(&p);
+	free(samples);
+	(void)unlink(TONE_RAW);
+}
+END_TEST
+
+Suite *
+pipeline_suite(void)
+{
+	Suite	*s;
+	TCase	*tc_pipeline;
+
+	s = suite_create("Pipeline");
+
+	tc_pipeline = tcase_create("Pipeline");
+	tcase_add_checked_fixture(tc_pipeline, setup_checked,
+	    teardown_checked);
+	tcase_add_test(tc_pipeline, test_plugin);
+	tcase_add_test(tc_pipeline, test_pipeline);
+	tcase_add_test(tc_pipeline, test_pipeline_encoder);
+	tcase_add_test(tc_pipeline, test_pipeline_crossfade);
+	tcase_add_test(tc_pipeline, test_pipeline_gain);
+	tcase_add_test(tc_pipeline, test_pipeline_silence);
+	suite_add_tcase(s, tc_pipeline);
+
+	return (s);
+}
+
+void
+setup_checked(void)
+{
+	if (0 < cfg_init() ||
+	    0 < cfg_set_program_name("check_pipeline", NULL) ||
+	    0 < log_init(cfg_get_program_name()))
+		ck_abort_msg("setup_checked failed");
+
+	(void)signal(SIGPIPE, SIG_IGN);
+	decoders = cfg_decoder_list_create();
+	metrics = metrics_create("check_pipeline");
+}
+
+void
+teardown_checked(void)
+{
+	metrics_destroy(&metrics);
+	cfg_decoder_list_destroy(&decoders);
+	plugin_exit();
+	log_exit();
+	cfg_exit();
+}
+
+int
+main(void)
+{
+	int	 num_failed;
+	Suite	*s;
+	SRunner *sr;
+
+	s = pipeline_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_NORMAL);
+	num_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	if (num_failed)
+		return (1);
+	return (0);
+}
@@ -19,6 +19,9 @@ START_TEST(test_playlist_file)
 	ck_assert_str_eq(playlist_get_next(p), "1.ogg");
 	playlist_skip_next(p);
 	ck_assert_uint_eq(playlist_get_position(p), 2);
+	ck_assert_str_eq(playlist_peek(p, 0), "3.ogg");
+	ck_assert_str_eq(playlist_peek(p, 2), "5.ogg");
+	ck_assert_ptr_eq(playlist_peek(p, 3), NULL);
 	ck_assert_str_eq(playlist_get_next(p), "3.ogg");
 	ck_assert_int_eq(playlist_goto_entry(p, "2.ogg"), 1);
 	ck_assert_str_eq(playlist_get_next(p), "2.ogg");
@@ -68,6 +71,7 @@ START_TEST(test_playlist_program)
 	    "Great_Artist_-_Great_Song.ogg");
 	ck_assert_uint_eq(playlist_get_num_items(p), 0);
 	ck_assert_uint_eq(playlist_get_position(p), 0);
+	ck_assert_ptr_eq(playlist_peek(p, 0), NULL);
 	ck_assert_int_eq(playlist_goto_entry(p,
 	    "Great_Artist_-_Great_Song.ogg"), 0);
 	ck_assert_int_eq(playlist_reread(&p), 0);
@@ -1,3 +1,13 @@
+#include <sys/stat.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
 #include <check.h>
 
 #include "cfg.h"
@@ -6,22 +16,141 @@
 #include "stream.h"
 #include "xalloc.h"
 
+#define ARCHIVE_DIR	BUILDDIR "/check_stream.d"
+
 Suite * stream_suite(void);
 void	setup_checked(void);
 void	teardown_checked(void);
 
 cfg_intake_list_t	intakes;
 
+static void	_send_file(stream_t, const char *, size_t);
+static void	_check_header(stream_t, const char *, size_t);
+static unsigned int
+		_count_files(const char *, const char *, size_t);
+static void	_clean_dir(const char *);
+static stream_t _create(const char *, const char *);
+
+static void
+_send_file(stream_t s, const char *path, size_t chunk)
+{
+	char	 buf[4096];
+	size_t	 n;
+	FILE	*fp;
+
+	fp = fopen(path, "rb");
+	ck_assert_ptr_ne(fp, NULL);
+	while (0 < (n = fread(buf, 1, chunk, fp)))
+		stream_send(s, buf, n);
+	fclose(fp);
+}
+
+/* The kept stream header is the beginning of the file: */
+static void
+_check_header(stream_t s, const char *path, size_t expected_len)
+{
+	char		 buf[8192];
+	const char	*header;
+	size_t		 header_len;
+	FILE		*fp;
+
+	header = stream_get_header(s, &header_len);
+	ck_assert_ptr_ne(header, NULL);
+	ck_assert_uint_eq(header_len, expected_len);
+	fp = fopen(path, "rb");
+	ck_assert_ptr_ne(fp, NULL);
+	ck_assert_uint_eq(fread(buf, 1, header_len, fp), header_len);
+	fclose(fp);
+	ck_assert_int_eq(memcmp(header, buf, header_len), 0);
+}
+
+/* Counts the files in the directory that hold exactly the given data */
+static unsigned int
+_count_files(const char *dir, const char *data, size_t len)
+{
+	char		 path[PATH_MAX], buf[8192];
+	DIR		*d;
+	struct dirent	*de;
+	FILE		*fp;
+	size_t		 n;
+	unsigned int	 count = 0;
+
+	d = opendir(dir);
+	ck_assert_ptr_ne(d, NULL);
+	while (NULL != (de = readdir(d))) {
+		if ('.' == de->d_name[0])
+			continue;
+		ck_assert_int_lt(snprintf(path, sizeof(path), "%s/%s", dir,
+		    de->d_name), (int)sizeof(path));
+		fp = fopen(path, "rb");
+		ck_assert_ptr_ne(fp, NULL);
+		n = fread(buf, 1, sizeof(buf), fp);
+		fclose(fp);
+		if (n == len && 0 == memcmp(buf, data, len))
+			count++;
+	}
+	closedir(d);
+
+	return (count);
+}
+
+static void
+_clean_dir(const char *dir)
+{
+	char		 path[PATH_MAX];
+	DIR		*d;
+	struct dirent	*de;
+
+	if (NULL == (d = opendir(dir)))
+		return;
+	while (NULL != (de = readdir(d))) {
+		if ('.' == de->d_name[0])
+			continue;
+		(void)snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+		(void)unlink(path);
+	}
+	closedir(d);
+}
+
+/* A stream that is configured completely, with the given format: */
+static stream_t
+_create(const char *format, const char *mountpoint)
+{
+	stream_t		 s;
+	cfg_server_t		 srv_cfg;
+	cfg_stream_t		 str_cfg;
+	cfg_intake_t		 int_cfg;
+	cfg_server_list_t	 servers = cfg_get_servers();
+	cfg_stream_list_t	 streams = cfg_get_streams();
+
+	s = stream_create("test-format");
+	srv_cfg = stream_get_cfg_server(s);
+	str_cfg = stream_get_cfg_stream(s);
+	int_cfg = stream_get_cfg_intake(s);
+	ck_assert_int_eq(cfg_server_set_hostname(srv_cfg, servers, "localhost", NULL), 0);
+	ck_assert_int_eq(cfg_server_set_password(srv_cfg, servers, "test", NULL), 0);
+	ck_assert_int_eq(cfg_stream_set_mountpoint(str_cfg, streams, mountpoint, NULL), 0);
+	ck_assert_int_eq(cfg_stream_set_format(str_cfg, streams, format, NULL), 0);
+	ck_assert_int_eq(cfg_intake_set_filename(int_cfg, intakes, "stream_test", NULL), 0);
+	ck_assert_int_eq(stream_configure(s), 0);
+
+	return (s);
+}
+
 START_TEST(test_stream)
 {
 	stream_t		 s;
 	mdata_t 		 m;
-	char			*m_str;
+	const char		*m_str;
+	unsigned long long	 allocs;
+	unsigned int		 changes;
+	metrics_t		 m_metrics;
 	cfg_server_t		 srv_cfg;
 	cfg_stream_t		 str_cfg;
 	cfg_intake_t		 int_cfg;
 	cfg_server_list_t	 servers = cfg_get_servers();
 	cfg_stream_list_t	 streams = cfg_get_streams();
+	struct timespec 	 ts, start, end;
 
 	s = stream_create("test-stream");
 	ck_assert_ptr_ne(s, NULL);
@@ -31,6 +160,19 @@ START_TEST(test_stream)
 	stream_sync(s);
 	ck_assert_int_ne(stream_send(s, NULL, 0), 0);
 
+	/* Without a connection, there is no pacing to catch up on: */
+	ts.tv_sec = 0;
+	ts.tv_nsec = 50 * 1000000L;
+	stream_pause(s);
+	nanosleep(&ts, NULL);
+	stream_resume(s);
+	stream_resume(s);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	stream_sync(s);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ck_assert_int_lt((end.tv_sec - start.tv_sec) * 1000 +
+	    (end.tv_nsec - start.tv_nsec) / 1000000, 40);
+
 	srv_cfg = stream_get_cfg_server(s);
 	ck_assert_ptr_ne(srv_cfg, NULL);
 	str_cfg = stream_get_cfg_stream(s);
@@ -92,28 +234,313 @@ START_TEST(test_stream)
 	 */
 	m_str = NULL;
 	stream_set_metadata(s, m, &m_str);
-	xfree(m_str);
 	m_str = NULL;
 	ck_assert_int_eq(mdata_parse_file(m, SRCDIR "/test15-title.ogg"), 0);
 	stream_set_metadata(s, m, &m_str);
-	xfree(m_str);
 	m_str = NULL;
 	ck_assert_int_eq(mdata_parse_file(m, SRCDIR "/test16-nometa.ogg"), 0);
 	stream_set_metadata(s, m, &m_str);
-	xfree(m_str);
 	m_str = NULL;
 	cfg_set_metadata_format_str("test", NULL);
 	ck_assert_int_eq(mdata_parse_file(m, SRCDIR "/test01-artist+album+title.ogg"), 0);
 	stream_set_metadata(s, m, &m_str);
-	xfree(m_str);
 	m_str = NULL;
 
+	/* Repeated updates reuse the per-stream buffers: */
+	cfg_set_metadata_format_str("@a@ - @t@", NULL);
+	stream_set_metadata(s, m, NULL);
+	m_metrics = stream_get_metrics(s);
+	allocs = metrics_get_counter(m_metrics, METRICS_METADATA_ALLOCS);
+	stream_set_metadata(s, m, NULL);
+	stream_set_metadata(s, m, NULL);
+	ck_assert_uint_eq(metrics_get_counter(m_metrics,
+	    METRICS_METADATA_ALLOCS), allocs);
+
 	mdata_destroy(&m);
 
+	/* Reloads report what changed since the stream was configured: */
+	ck_assert_int_eq(stream_configure(s), 0);
+	ck_assert_int_eq(stream_reload(s, &changes), 0);
+	ck_assert_uint_eq(changes, 0);
+	ck_assert_int_eq(cfg_intake_set_filename(int_cfg, intakes,
+	    "stream_test2", NULL), 0);
+	ck_assert_int_eq(stream_reload(s, &changes), 0);
+	ck_assert_uint_eq(changes, STREAM_CHANGED_INTAKE);
+	ck_assert_int_eq(cfg_server_set_hostname(srv_cfg, servers,
+	    "localhost2", NULL), 0);
+	ck_assert_int_eq(stream_check(s), 0);
+	ck_assert_int_eq(stream_reload(s, &changes), 0);
+	ck_assert_uint_eq(changes, STREAM_CHANGED_CONNECTION);
+	ck_assert_int_eq(stream_reload(s, &changes), 0);
+	ck_assert_uint_eq(changes, 0);
+
+	/* Cached configuration handles follow configuration changes: */
+	ck_assert_ptr_eq(stream_get_cfg_server(s), srv_cfg);
+	ck_assert_int_eq(cfg_stream_set_server(str_cfg, streams, "other",
+	    NULL), 0);
+	ck_assert_ptr_ne(stream_get_cfg_server(s), srv_cfg);
+	ck_assert_ptr_eq(stream_get_cfg_server(s),
+	    cfg_server_list_find(servers, "other"));
+	ck_assert_int_eq(cfg_stream_set_name(str_cfg, streams, "renamed",
+	    NULL), 0);
+	ck_assert_ptr_eq(stream_get_cfg_stream(s), NULL);
+	ck_assert_int_eq(cfg_stream_set_name(str_cfg, streams, "test-stream",
+	    NULL), 0);
+	ck_assert_ptr_eq(stream_get_cfg_stream(s), str_cfg);
+
 	stream_destroy(&s);
 }
 END_TEST
 
+START_TEST(test_stream_ogg)
+{
+	stream_t		 s;
+	double			 secs, kbps;
+	char			 page[64];
+	size_t			 size;
+	FILE			*fp;
+
+	s = _create("ogg", "/test.ogg");
+
+	ck_assert_uint_eq(stream_get_boundary(s), 0);
+	ck_assert_int_ne(stream_get_position(s, &secs, &kbps), 0);
+
+	/* The first page has a 28 byte header and a 30 byte body: */
+	fp = fopen(SRCDIR "/test01-artist+album+title.ogg", "rb");
+	ck_assert_ptr_ne(fp, NULL);
+	ck_assert_uint_eq(fread(page, 1, 20, fp), 20);
+	stream_send(s, page, 20);
+	ck_assert_uint_eq(stream_get_boundary(s), 7);
+	ck_assert_uint_eq(fread(page, 1, 10, fp), 10);
+	stream_send(s, page, 10);
+	ck_assert_uint_eq(stream_get_boundary(s), 28);
+	ck_assert_uint_eq(fread(page, 1, 28, fp), 28);
+	stream_send(s, page, 28);
+	ck_assert_uint_eq(stream_get_boundary(s), 0);
+	fclose(fp);
+	ck_assert_int_eq(stream_get_position(s, &secs, &kbps), 0);
+	ck_assert(0.0 == secs);
+	ck_assert_ptr_eq(stream_get_header(s, &size), NULL);
+
+	/* One second of Vorbis audio, in pieces that cross page boundaries: */
+	stream_destroy(&s);
+	s = stream_create("test-format");
+	ck_assert_int_eq(stream_configure(s), 0);
+	_send_file(s, SRCDIR "/test01-artist+album+title.ogg", 1000);
+	ck_assert_uint_eq(stream_get_boundary(s), 0);
+	ck_assert_int_eq(stream_get_position(s, &secs, &kbps), 0);
+	ck_assert(1.0 == secs);
+	ck_assert(32.824 - 0.001 < kbps && 32.824 + 0.001 > kbps);
+	_check_header(s, SRCDIR "/test01-artist+album+title.ogg", 58 + 3928);
+	stream_mark(s);
+	ck_assert_int_eq(stream_get_position(s, &secs, &kbps), 0);
+	ck_assert(0.0 == secs);
+
+	/* Junk in between is skipped, and a new chain starts over: */
+	stream_send(s, "junk", 4);
+	_send_file(s, SRCDIR "/test16-nometa.ogg", 777);
+	ck_assert_uint_eq(stream_get_boundary(s), 0);
+	ck_assert_int_eq(stream_get_position(s, &secs, &kbps), 0);
+	ck_assert(1.0 == secs);
+	ck_assert(32.328 - 0.001 < kbps && 32.328 + 0.001 > kbps);
+	_check_header(s, SRCDIR "/test16-nometa.ogg", 58 + 3866);
+
+	/* Other formats are not followed: */
+	ck_assert_int_eq(cfg_stream_set_format(stream_get_cfg_stream(s),
+	    cfg_get_streams(), "mp3", NULL), 0);
+	stream_configure(s);
+	ck_assert_int_ne(stream_get_position(s, &secs, &kbps), 0);
+
+	stream_destroy(&s);
+}
+END_TEST
+
+/* MPEG-1 Layer III, 128 kbit/s, 44.1 kHz, stereo: */
+#define MP3_FRAME_LEN	417
+#define MP3_FRAMES	100
+
+START_TEST(test_stream_mp3)
+{
+	stream_t		 s;
+	double			 secs, kbps;
+	unsigned char		*buf, *p;
+	size_t			 size, i;
+
+	s = _create("mp3", "/test.mp3");
+
+	/*
+	 * An ID3v2 tag, an Info frame with a LAME tag of 576 samples delay
+	 * and 1000 samples padding, silent frames, and an ID3v1 tag:
+	 */
+	size = 20 + MP3_FRAME_LEN * (1 + MP3_FRAMES) + 128;
+	buf = xcalloc(size, 1UL);
+	memcpy(buf, "ID3\004\000\000\000\000\000\012", 10);
+	p = buf + 20;
+	for (i = 0; i < 1 + MP3_FRAMES; i++)
+		memcpy(p + i * MP3_FRAME_LEN, "\377\373\220\000", 4);
+	memcpy(p + 36, "Info\000\000\000\001\000\000\000\144", 12);
+	memcpy(p + 48, "LAME3.100", 9);
+	memcpy(p + 48 + 21, "\044\003\350", 3);
+	memcpy(buf + size - 128, "TAG", 3);
+
+	ck_assert_int_ne(stream_get_position(s, &secs, &kbps), 0);
+	ck_assert_int_ne(stream_get_length(s, &secs), 0);
+	stream_send(s, (char *)buf, 15);
+	ck_assert_uint_eq(stream_get_boundary(s), 5);
+	stream_send(s, (char *)buf + 15, 5);
+	ck_assert_uint_eq(stream_get_boundary(s), 0);
+	stream_send(s, (char *)buf + 20, 2);
+	ck_assert_uint_eq(stream_get_boundary(s), 2);
+	stream_send(s, (char *)buf + 22, 8);
+	ck_assert_uint_eq(stream_get_boundary(s), MP3_FRAME_LEN - 10);
+	for (i = 30; i < size; i += 1000)
+		stream_send(s, (char *)buf + i, size - i < 1000 ? size - i : 1000);
+	ck_assert_uint_eq(stream_get_boundary(s), 0);
+
+	ck_assert_int_eq(stream_get_position(s, &secs, &kbps), 0);
+	ck_assert(MP3_FRAMES * 1152.0 / 44100.0 == secs);
+	ck_assert(127.70 < kbps && 127.71 > kbps);
+	ck_assert_int_eq(stream_get_length(s, &secs), 0);
+	ck_assert((MP3_FRAMES * 1152.0 - 1576.0) / 44100.0 == secs);
+
+	/* A new track starts without a length, until its Info frame: */
+	stream_mark(s);
+	ck_assert_int_ne(stream_get_length(s, &secs), 0);
+	ck_assert_int_eq(stream_get_position(s, &secs, &kbps), 0);
+	ck_assert(0.0 == secs);
+	stream_send(s, "junk", 4);
+	stream_send(s, (char *)buf + 20 + MP3_FRAME_LEN,
+	    MP3_FRAME_LEN * MP3_FRAMES);
+	ck_assert_int_ne(stream_get_length(s, &secs), 0);
+	ck_assert_int_eq(stream_get_position(s, &secs, &kbps), 0);
+	ck_assert(MP3_FRAMES * 1152.0 / 44100.0 == secs);
+
+	/* A header that turns out to be invalid may hide the real one: */
+	stream_mark(s);
+	stream_send(s, "\377", 1);
+	stream_send(s, (char *)buf + 20 + MP3_FRAME_LEN,
+	    MP3_FRAME_LEN * MP3_FRAMES);
+	ck_assert_int_eq(stream_get_position(s, &secs, &kbps), 0);
+	ck_assert(MP3_FRAMES * 1152.0 / 44100.0 == secs);
+	stream_mark(s);
+	stream_send(s, "ID3\004\000\000\000", 7);
+	stream_send(s, (char *)buf + 20 + MP3_FRAME_LEN,
+	    MP3_FRAME_LEN * MP3_FRAMES);
+	ck_assert_int_eq(stream_get_position(s, &secs, &kbps), 0);
+	ck_assert(MP3_FRAMES * 1152.0 / 44100.0 == secs);
+
+	/* A lone header that the next one does not match is not audio: */
+	stream_mark(s);
+	p = xcalloc((size_t)MP3_FRAME_LEN, 1UL);
+	memcpy(p, "\377\375\200\000", 4);
+	stream_send(s, (char *)p, MP3_FRAME_LEN);
+	xfree(p);
+	stream_send(s, (char *)buf + 20 + MP3_FRAME_LEN,
+	    MP3_FRAME_LEN * MP3_FRAMES);
+	ck_assert_int_eq(stream_get_position(s, &secs, &kbps), 0);
+	ck_assert(MP3_FRAMES * 1152.0 / 44100.0 == secs);
+
+	xfree(buf);
+	stream_destroy(&s);
+}
+END_TEST
+
+START_TEST(test_stream_webm)
+{
+	stream_t		 s;
+	const char		*header;
+	size_t			 header_len;
+	/*
+	 * EBML header, Segment of known size, SeekHead, Info, Tracks, and
+	 * a Cluster of unknown size with a Timecode and two SimpleBlocks:
+	 */
+	const char		 webm[] =
+	    "\x1a\x45\xdf\xa3\x84\x42\x86\x81\x01"
+	    "\x18\x53\x80\x67\x01\x00\x00\x00\x00\x00\x10\x00"
+	    "\x11\x4d\x9b\x74\x82\xec\x80"
+	    "\x15\x49\xa9\x66\x83" "inf"
+	    "\x16\x54\xae\x6b\x84" "trks"
+	    "\x1f\x43\xb6\x75\x01\xff\xff\xff\xff\xff\xff\xff"
+	    "\xe7\x81\x00"
+	    "\xa3\x88\x81\x00\x00\x80" "abcd"
+	    "\xa3\x88\x81\x00\x28\x00" "efgh";
+	/* The Segment continues indefinitely for a new connection: */
+	const char		 expected[] =
+	    "\x1a\x45\xdf\xa3\x84\x42\x86\x81\x01"
+	    "\x18\x53\x80\x67\x01\xff\xff\xff\xff\xff\xff\xff"
+	    "\x15\x49\xa9\x66\x83" "inf"
+	    "\x16\x54\xae\x6b\x84" "trks";
+	const size_t		 header_end = 9 + 12 + 7 + 8 + 9;
+
+	s = _create("webm", "/test.webm");
+
+	/* The header is complete with the first Cluster: */
+	stream_send(s, webm, 3);
+	ck_assert_uint_eq(stream_get_boundary(s), 2);
+	stream_send(s, webm + 3, 3);
+	ck_assert_uint_eq(stream_get_boundary(s), 3);
+	stream_send(s, webm + 6, header_end - 6);
+	ck_assert_uint_eq(stream_get_boundary(s), 0);
+	ck_assert_ptr_eq(stream_get_header(s, &header_len), NULL);
+	stream_send(s, webm + header_end, 12 + 3 + 5);
+	ck_assert_uint_eq(stream_get_boundary(s), 5);
+	header = stream_get_header(s, &header_len);
+	ck_assert_ptr_ne(header, NULL);
+	ck_assert_uint_eq(header_len, sizeof(expected) - 1);
+	ck_assert_int_eq(memcmp(header, expected, header_len), 0);
+	stream_send(s, webm + header_end + 20, sizeof(webm) - 1 - header_end - 20);
+	ck_assert_uint_eq(stream_get_boundary(s), 0);
+
+	/* A new EBML header starts a new stream header: */
+	stream_send(s, webm, 10);
+	ck_assert_ptr_eq(stream_get_header(s, &header_len), NULL);
+	stream_send(s, webm + 10, sizeof(webm) - 1 - 10);
+	header = stream_get_header(s, &header_len);
+	ck_assert_ptr_ne(header, NULL);
+	ck_assert_uint_eq(header_len, sizeof(expected) - 1);
+	ck_assert_int_eq(memcmp(header, expected, header_len), 0);
+
+	stream_destroy(&s);
+}
+END_TEST
+
+START_TEST(test_stream_archive)
+{
+	stream_t		 s;
+	archive_t		 a;
+	char			 ogg[8192];
+	size_t			 ogg_len;
+	FILE			*fp;
+
+	fp = fopen(SRCDIR "/test01-artist+album+title.ogg", "rb");
+	ck_assert_ptr_ne(fp, NULL);
+	ogg_len = fread(ogg, 1, sizeof(ogg), fp);
+	fclose(fp);
+	ck_assert_uint_eq(ogg_len, 4103);
+	ck_assert(0 == mkdir(ARCHIVE_DIR, 0755) || EEXIST == errno);
+	_clean_dir(ARCHIVE_DIR);
+
+	s = _create("ogg", "/test.ogg");
+
+	/*
+	 * A new file is due after 2000 bytes. It begins with the next chain,
+	 * or with the first data page, behind the header pages:
+	 */
+	a = archive_create(ARCHIVE_DIR, "test", "ogg", 0, 2000, 65536);
+	ck_assert_ptr_ne(a, NULL);
+	stream_set_archive(s, a);
+	_send_file(s, SRCDIR "/test01-artist+album+title.ogg", 777);
+	_send_file(s, SRCDIR "/test01-artist+album+title.ogg", 777);
+	stream_destroy(&s);
+	archive_destroy(&a);
+
+	ck_assert_uint_eq(_count_files(ARCHIVE_DIR, ogg, 58 + 3928), 2);
+	ck_assert_uint_eq(_count_files(ARCHIVE_DIR, ogg, ogg_len), 2);
+	_clean_dir(ARCHIVE_DIR);
+	(void)rmdir(ARCHIVE_DIR);
+}
+END_TEST
+
 Suite *
 stream_suite(void)
 {
@@ -125,6 +552,10 @@ stream_suite(void)
 	tc_stream = tcase_create("Stream");
 	tcase_add_checked_fixture(tc_stream, setup_checked, teardown_checked);
 	tcase_add_test(tc_stream, test_stream);
+	tcase_add_test(tc_stream, test_stream_ogg);
+	tcase_add_test(tc_stream, test_stream_mp3);
+	tcase_add_test(tc_stream, test_stream_webm);
+	tcase_add_test(tc_stream, test_stream_archive);
 	suite_add_tcase(s, tc_stream);
 
 	return (s);
@@ -0,0 +1,408 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <check.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <shout/shout.h>
+
+#include "cfg.h"
+#include "log.h"
+#include "stream.h"
+#include "xalloc.h"
+
+/* As STREAM_RESUME_MAX in stream.c: */
+#define RESUME_MAX	(4 * 1024 * 1024)
+#define CHUNK		65536
+
+Suite * stream_resume_suite(void);
+void	setup_checked(void);
+void	teardown_checked(void);
+
+cfg_intake_list_t	intakes;
+
+/*
+ * The connection to the server is replaced with one that keeps what is sent
+ * over it:
+ */
+static int		shim_connected;
+static unsigned char	shim_sent[CHUNK];
+static size_t		shim_sent_len;
+static size_t		shim_total;
+
+static stream_t _create(const char *, const char *);
+static void	_reconnect(stream_t);
+static void	_check_sent(const char *, size_t);
+static long	_pause_sync(stream_t);
+static size_t	_ogg_page(char *, unsigned char, uint64_t, const char *,
+		    size_t, const char *);
+
+int
+shout_open(shout_t *shout)
+{
+	(void)shout;
+	shim_connected = 1;
+	return (SHOUTERR_SUCCESS);
+}
+
+int
+shout_close(shout_t *shout)
+{
+	(void)shout;
+	shim_connected = 0;
+	return (SHOUTERR_SUCCESS);
+}
+
+int
+shout_get_connected(shout_t *shout)
+{
+	(void)shout;
+	return (shim_connected ? SHOUTERR_CONNECTED : SHOUTERR_UNCONNECTED);
+}
+
+int
+shout_send(shout_t *shout, const unsigned char *data, size_t len)
+{
+	size_t	n;
+
+	(void)shout;
+	if (!shim_connected)
+		return (SHOUTERR_UNCONNECTED);
+	n = sizeof(shim_sent) - shim_sent_len;
+	if (n > len)
+		n = len;
+	memcpy(shim_sent + shim_sent_len, data, n);
+	shim_sent_len += n;
+	shim_total += len;
+	return (SHOUTERR_SUCCESS);
+}
+
+static stream_t
+_create(const char *format, const char *mountpoint)
+{
+	stream_t		 s;
+	cfg_server_t		 srv_cfg;
+	cfg_stream_t		 str_cfg;
+	cfg_intake_t		 int_cfg;
+	cfg_server_list_t	 servers = cfg_get_servers();
+	cfg_stream_list_t	 streams = cfg_get_streams();
+
+	s = stream_create("test-resume");
+	srv_cfg = stream_get_cfg_server(s);
+	str_cfg = stream_get_cfg_stream(s);
+	int_cfg = stream_get_cfg_intake(s);
+	ck_assert_int_eq(cfg_server_set_hostname(srv_cfg, servers, "localhost", NULL), 0);
+	ck_assert_int_eq(cfg_server_set_password(srv_cfg, servers, "test", NULL), 0);
+	ck_assert_int_eq(cfg_stream_set_mountpoint(str_cfg, streams, mountpoint, NULL), 0);
+	ck_assert_int_eq(cfg_stream_set_format(str_cfg, streams, format, NULL), 0);
+	ck_assert_int_eq(cfg_intake_set_filename(int_cfg, intakes, "stream_test", NULL), 0);
+	ck_assert_int_eq(stream_configure(s), 0);
+
+	return (s);
+}
+
+/* Drops the connection, and starts over with a new one: */
+static void
+_reconnect(stream_t s)
+{
+	stream_disconnect(s);
+	ck_assert_int_eq(stream_get_connected(s), 0);
+	shim_sent_len = shim_total = 0;
+	ck_assert_int_eq(stream_connect(s), 0);
+	ck_assert_int_eq(stream_get_connected(s), 1);
+}
+
+static void
+_check_sent(const char *data, size_t len)
+{
+	ck_assert_uint_eq(shim_total, len);
+	ck_assert_uint_eq(shim_sent_len, len);
+	ck_assert_int_eq(memcmp(shim_sent, data, len), 0);
+}
+
+/*
+ * Puts together an Ogg page of logical stream 1, with the given lacing
+ * values and a body to match:
+ */
+static size_t
+_ogg_page(char *buf, unsigned char flags, uint64_t granule,
+    const char *lacing, size_t nsegs, const char *body)
+{
+	size_t	body_len, i;
+
+	memset(buf, 0, 27);
+	memcpy(buf, "OggS", 4);
+	buf[5] = (char)flags;
+	for (i = 0; i < 8; i++)
+		buf[6 + i] = (char)(granule >> (8 * i));
+	buf[14] = 1;
+	buf[26] = (char)nsegs;
+	memcpy(buf + 27, lacing, nsegs);
+	for (body_len = 0, i = 0; i < nsegs; i++)
+		body_len += (unsigned char)lacing[i];
+	memcpy(buf + 27 + nsegs, body, body_len);
+
+	return (27 + nsegs + body_len);
+}
+
+/* Pauses for 50 ms, and returns how long syncing takes after that: */
+static long
+_pause_sync(stream_t s)
+{
+	struct timespec ts, start, end;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = 50 * 1000000L;
+	stream_pause(s);
+	nanosleep(&ts, NULL);
+	stream_resume(s);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	stream_sync(s);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return ((end.tv_sec - start.tv_sec) * 1000 +
+	    (end.tv_nsec - start.tv_nsec) / 1000000);
+}
+
+START_TEST(test_stream_resume_ogg)
+{
+	stream_t	 s;
+	char		 ogg[4096], sent[4096], body[512], ident[30];
+	size_t		 len, header_len, data_at, next_at, last_at;
+	const char	*header;
+
+	/*
+	 * A Vorbis chain with a setup header across two pages, and a first
+	 * audio packet across two pages, where the first page does not end
+	 * a packet and so has no granule position:
+	 */
+	memset(body, 'x', sizeof(body));
+	memset(ident, 0, sizeof(ident));
+	memcpy(ident, "\001vorbis", 7);
+	memcpy(ident + 12, "\104\254\000\000", 4);
+	len = _ogg_page(ogg, 0x02, 0, "\036", 1, ident);
+	len += _ogg_page(ogg + len, 0, 0, "\024\377", 2, body);
+	len += _ogg_page(ogg + len, 0x01, 0, "\012", 1, body);
+	header_len = len;
+	len += _ogg_page(ogg + len, 0, UINT64_MAX, "\377\377", 2, body);
+	data_at = len;
+	len += _ogg_page(ogg + len, 0x01, 1024, "\005\020", 2, body);
+	next_at = len;
+	len += _ogg_page(ogg + len, 0, 2048, "\100", 1, body);
+	last_at = len;
+	len += _ogg_page(ogg + len, 0x04, 4096, "\100", 1, body);
+
+	s = _create("ogg", "/test.ogg");
+
+	/* A stream that begins with the connection is sent as is: */
+	ck_assert_int_eq(stream_connect(s), 0);
+	stream_send(s, ogg, 20);
+	stream_send(s, ogg + 20, data_at + 30 - 20);
+	stream_send(s, ogg + data_at + 30, len - data_at - 30);
+	_check_sent(ogg, len);
+	header = stream_get_header(s, &len);
+	ck_assert_ptr_ne(header, NULL);
+	ck_assert_uint_eq(len, header_len);
+	ck_assert_int_eq(memcmp(header, ogg, header_len), 0);
+	len = last_at + 27 + 1 + 64;
+
+	/*
+	 * In the middle of a page, the next page that does not continue a
+	 * packet follows the header pages, even with its page header split
+	 * across sends:
+	 */
+	stream_send(s, ogg + header_len, 40);
+	_reconnect(s);
+	stream_send(s, ogg + header_len + 40, next_at - header_len - 40);
+	stream_send(s, ogg + next_at, 10);
+	ck_assert_uint_eq(shim_total, 0);
+	stream_send(s, ogg + next_at + 10, len - next_at - 10);
+	memcpy(sent, ogg, header_len);
+	memcpy(sent + header_len, ogg + next_at, len - next_at);
+	_check_sent(sent, header_len + len - next_at);
+
+	/* A new chain comes without the previous header pages: */
+	stream_send(s, ogg + data_at, 3);
+	_reconnect(s);
+	stream_send(s, ogg + data_at + 3, next_at - data_at - 3);
+	ck_assert_uint_eq(shim_total, 0);
+	stream_send(s, ogg, 10);
+	stream_send(s, ogg + 10, len - 10);
+	_check_sent(ogg, len);
+
+	stream_destroy(&s);
+}
+END_TEST
+
+START_TEST(test_stream_resume_webm)
+{
+	stream_t	 s;
+	char		 sent[256];
+	size_t		 i;
+	/*
+	 * EBML header, Segment of known size, SeekHead, Info, Tracks, and
+	 * a Cluster of unknown size with a Timecode and two SimpleBlocks:
+	 */
+	const char	 webm[] =
+	    "\x1a\x45\xdf\xa3\x84\x42\x86\x81\x01"
+	    "\x18\x53\x80\x67\x01\x00\x00\x00\x00\x00\x10\x00"
+	    "\x11\x4d\x9b\x74\x82\xec\x80"
+	    "\x15\x49\xa9\x66\x83" "inf"
+	    "\x16\x54\xae\x6b\x84" "trks"
+	    "\x1f\x43\xb6\x75\x01\xff\xff\xff\xff\xff\xff\xff"
+	    "\xe7\x81\x00"
+	    "\xa3\x88\x81\x00\x00\x80" "abcd"
+	    "\xa3\x88\x81\x00\x28\x00" "efgh";
+	/* The stream header that a new connection gets first: */
+	const char	 header[] =
+	    "\x1a\x45\xdf\xa3\x84\x42\x86\x81\x01"
+	    "\x18\x53\x80\x67\x01\xff\xff\xff\xff\xff\xff\xff"
+	    "\x15\x49\xa9\x66\x83" "inf"
+	    "\x16\x54\xae\x6b\x84" "trks";
+	const size_t	 cluster_at = 9 + 12 + 7 + 8 + 9;
+	const size_t	 block_at = cluster_at + 12 + 3;
+	const char	 block[] = "\xa3\x88\x81\x00\x50\x00" "ijkl";
+	char		*big;
+
+	s = _create("webm", "/test.webm");
+
+	/* A stream that begins with the connection is sent as is: */
+	ck_assert_int_eq(stream_connect(s), 0);
+	for (i = 0; i < sizeof(webm) - 1; i += 3)
+		stream_send(s, webm + i, sizeof(webm) - 1 - i < 3 ?
+		    sizeof(webm) - 1 - i : 3);
+	_check_sent(webm, sizeof(webm) - 1);
+
+	/*
+	 * In the middle of a Cluster, the next Cluster follows the stream
+	 * header, even with its element header split across sends:
+	 */
+	_reconnect(s);
+	stream_send(s, block, sizeof(block) - 1);
+	ck_assert_uint_eq(shim_total, 0);
+	stream_send(s, webm + cluster_at, 2);
+	stream_send(s, webm + cluster_at + 2, 8);
+	ck_assert_uint_eq(shim_total, 0);
+	stream_send(s, webm + cluster_at + 10, sizeof(webm) - 1 - cluster_at -
+	    10);
+	memcpy(sent, header, sizeof(header) - 1);
+	memcpy(sent + sizeof(header) - 1, webm + cluster_at,
+	    sizeof(webm) - 1 - cluster_at);
+	_check_sent(sent, sizeof(header) - 1 + sizeof(webm) - 1 - cluster_at);
+
+	/* Also in the middle of a SimpleBlock: */
+	stream_send(s, block, 3);
+	_reconnect(s);
+	stream_send(s, block + 3, sizeof(block) - 1 - 3);
+	stream_send(s, webm + cluster_at, sizeof(webm) - 1 - cluster_at);
+	_check_sent(sent, sizeof(header) - 1 + sizeof(webm) - 1 - cluster_at);
+
+	/* A new EBML header comes without the previous stream header: */
+	_reconnect(s);
+	stream_send(s, webm + block_at, sizeof(webm) - 1 - block_at);
+	stream_send(s, webm, 3);
+	stream_send(s, webm + 3, sizeof(webm) - 1 - 3);
+	_check_sent(webm, sizeof(webm) - 1);
+
+	/*
+	 * With no Cluster for too long, the stream is sent as is from
+	 * then on:
+	 */
+	_reconnect(s);
+	stream_send(s, "\xa3\x01\x00\x00\x00\x00\x50\x00\x10", 9);
+	big = xcalloc((size_t)CHUNK, 1UL);
+	for (i = 0; (i + 1) * CHUNK < RESUME_MAX; i++) {
+		memset(big, (int)('a' + i % 26), CHUNK);
+		stream_send(s, big, CHUNK);
+	}
+	ck_assert_uint_eq(shim_total, 0);
+	memset(big, 'z', CHUNK);
+	stream_send(s, big, CHUNK);
+	_check_sent(big, CHUNK);
+	xfree(big);
+
+	stream_destroy(&s);
+}
+END_TEST
+
+START_TEST(test_stream_pause)
+{
+	stream_t	s;
+
+	s = _create("mp3", "/test.mp3");
+
+	/* Pacing only catches up on pauses once it began: */
+	ck_assert_int_lt(_pause_sync(s), 40);
+	ck_assert_int_eq(stream_connect(s), 0);
+	ck_assert_int_lt(_pause_sync(s), 40);
+	ck_assert_int_eq(stream_send(s, "data", 4), 0);
+	ck_assert_int_ge(_pause_sync(s), 40);
+
+	/* ... and starts over with a new connection: */
+	_reconnect(s);
+	ck_assert_int_lt(_pause_sync(s), 40);
+	stream_disconnect(s);
+	ck_assert_int_lt(_pause_sync(s), 40);
+
+	stream_destroy(&s);
+}
+END_TEST
+
+Suite *
+stream_resume_suite(void)
+{
+	Suite	*s;
+	TCase	*tc_resume;
+
+	s = suite_create("Stream Resume");
+
+	tc_resume = tcase_create("Resume");
+	tcase_add_checked_fixture(tc_resume, setup_checked, teardown_checked);
+	tcase_add_test(tc_resume, test_stream_resume_ogg);
+	tcase_add_test(tc_resume, test_stream_resume_webm);
+	tcase_add_test(tc_resume, test_stream_pause);
+	suite_add_tcase(s, tc_resume);
+
+	return (s);
+}
+
+void
+setup_checked(void)
+{
+	if (0 < cfg_init() ||
+	    0 < cfg_set_program_name("check_stream_resume", NULL) ||
+	    0 < log_init(cfg_get_program_name()) ||
+	    0 < stream_init())
+		ck_abort_msg("setup_checked failed");
+	shim_connected = 0;
+	shim_sent_len = shim_total = 0;
+}
+
+void
+teardown_checked(void)
+{
+	stream_exit();
+	cfg_exit();
+}
+
+int
+main(void)
+{
+	int	 num_failed;
+	Suite	*s;
+	SRunner	*sr;
+
+	s = stream_resume_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_NORMAL);
+	num_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	if (num_failed)
+		return (1);
+	return (0);
+}
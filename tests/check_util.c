@@ -1,6 +1,8 @@
 #include <sys/file.h>
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <check.h>
@@ -67,18 +69,98 @@ START_TEST(test_util_utf8sanity)
 	str = util_utf82char(test_str);
 	ck_assert_str_eq(str, test_str);
 	xfree(str);
+
+	str = util_utf82char(NULL);
+	ck_assert_str_eq(str, "");
+	xfree(str);
+
+	/* Conversions keep working with freshly resolved settings: */
+	str = util_utf82char("\xe6\x9d\xb1\xe4\xba\xac");
+	ck_assert_ptr_ne(str, NULL);
+	xfree(str);
+	util_reset_codeset();
+	util_reset_codeset();
+	str = util_char2utf8(test_str);
+	ck_assert_str_eq(str, test_str);
+	xfree(str);
+
+	/* Invalid input is never passed through as-is: */
+	str = util_char2utf8("invalid \xff\xfe");
+	ck_assert_ptr_eq(strstr(str, "\xff\xfe"), NULL);
+	xfree(str);
+	util_reset_codeset();
+
+	/* Nor are overlong forms, surrogates, or code points past U+10FFFF: */
+	setenv("LC_ALL", "C.UTF-8", 1);
+	util_reset_codeset();
+	str = util_char2utf8("\xe0\x80\xaf \xed\xa0\x80 \xf4\x90\x80\x80");
+	ck_assert_ptr_eq(strstr(str, "\xe0\x80\xaf"), NULL);
+	ck_assert_ptr_eq(strstr(str, "\xed\xa0\x80"), NULL);
+	ck_assert_ptr_eq(strstr(str, "\xf4\x90\x80\x80"), NULL);
+	xfree(str);
+	str = util_char2utf8("\xed\x9f\xbf \xf4\x8f\xbf\xbf");
+	ck_assert_ptr_ne(str, NULL);
+	xfree(str);
+	unsetenv("LC_ALL");
+	util_reset_codeset();
 }
 END_TEST
 
 START_TEST(test_util_expand_words)
 {
+	struct util_dict	 dicts[] = {
+		{ "@a@", "artist" },
+		{ "@t@", "@a@" },
+		{ NULL, NULL }
+	};
+	char			*str;
+
 	ck_assert_ptr_eq(util_expand_words("", NULL), NULL);
+
+	str = util_expand_words("no placeholders", NULL);
+	ck_assert_str_eq(str, "no placeholders");
+	xfree(str);
+
+	/* Replacements are not expanded again: */
+	str = util_expand_words("@a@ - @t@@@a@", dicts);
+	ck_assert_str_eq(str, "artist - @a@@artist");
+	xfree(str);
+}
+END_TEST
+
+START_TEST(test_util_template)
+{
+	static const char *const placeholders[] = { "@a@", "@t@", NULL };
+	const char		*values[] = { "artist", NULL };
+	util_template_t 	 t;
+	char			 buf[8];
+	char			*str;
+
+	t = util_template_compile("<@a@|@t@|@x@>", placeholders);
+	ck_assert_str_eq(util_template_get_source(t), "<@a@|@t@|@x@>");
+	ck_assert_uint_eq(util_template_render(t, values, NULL, 0), 13);
+	str = util_template_expand(t, values);
+	ck_assert_str_eq(str, "<artist||@x@>");
+	xfree(str);
+	ck_assert_uint_eq(util_template_render(t, values, buf, sizeof(buf)),
+	    13);
+	ck_assert_str_eq(buf, "<artist");
+	util_template_destroy(&t);
+	ck_assert_ptr_eq(t, NULL);
+	util_template_destroy(&t);
+
+	t = util_template_compile("", placeholders);
+	str = util_template_expand(t, values);
+	ck_assert_str_eq(str, "");
+	xfree(str);
+	util_template_destroy(&t);
 }
 END_TEST
 
 START_TEST(test_util_shellquote)
 {
-	char	*str;
+	char		*str;
+	xarena_t	 arena;
 
 	str = util_shellquote("testing 1 2 3", 0);
 	ck_assert_str_eq(str, "'testing 1 2 3'");
@@ -111,6 +193,46 @@ START_TEST(test_util_shellquote)
 	str = util_shellquote("`echo TEST`", 1000000);
 	ck_assert_str_eq(str, "'`echo TEST`'");
 	xfree(str);
+
+	arena = xarena_create(0);
+	ck_assert_str_eq(util_shellquote_arena(arena, "testing 1 2 3", 0),
+	    "'testing 1 2 3'");
+	ck_assert_str_eq(util_shellquote_arena(arena, "testing 1 2 3", 9),
+	    "'testing'");
+	ck_assert_str_eq(util_shellquote_arena(arena, "testing'1 2 3", 11),
+	    "'testing'");
+	ck_assert_str_eq(util_shellquote_arena(arena, "''''", 0),
+	    "''\\'''\\'''\\'''\\'''");
+	ck_assert_str_eq(util_shellquote_arena(arena, "", 0), "''");
+	ck_assert_str_eq(util_utf82char_arena(arena, "foo'bar"), "foo'bar");
+	ck_assert_str_eq(util_char2utf8_arena(arena, NULL), "");
+	xarena_destroy(&arena);
+}
+END_TEST
+
+START_TEST(test_util_jsonquote)
+{
+	char	*str;
+
+	str = util_jsonquote("");
+	ck_assert_str_eq(str, "\"\"");
+	xfree(str);
+
+	str = util_jsonquote("testing 1 2 3");
+	ck_assert_str_eq(str, "\"testing 1 2 3\"");
+	xfree(str);
+
+	str = util_jsonquote("foo\"bar\\baz");
+	ck_assert_str_eq(str, "\"foo\\\"bar\\\\baz\"");
+	xfree(str);
+
+	str = util_jsonquote("tab\there\nnewline\x01");
+	ck_assert_str_eq(str, "\"tab\\u0009here\\u000anewline\\u0001\"");
+	xfree(str);
+
+	str = util_jsonquote("\xc3\xa4\xc3\xb6\xc3\xbc");
+	ck_assert_str_eq(str, "\"\xc3\xa4\xc3\xb6\xc3\xbc\"");
+	xfree(str);
 }
 END_TEST
 
@@ -128,7 +250,9 @@ util_suite(void)
 	tcase_add_test(tc_util, test_util_strrcmp);
 	tcase_add_test(tc_util, test_util_utf8sanity);
 	tcase_add_test(tc_util, test_util_expand_words);
+	tcase_add_test(tc_util, test_util_template);
 	tcase_add_test(tc_util, test_util_shellquote);
+	tcase_add_test(tc_util, test_util_jsonquote);
 	suite_add_tcase(s, tc_util);
 
 	return (s);
@@ -1,8 +1,48 @@
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* HAVE_CONFIG_H */
+
 #include <check.h>
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif /* HAVE_PTHREAD */
+#include <string.h>
 
 #include "xalloc.h"
 
 Suite * xalloc_suite(void);
+#if defined(HAVE_PTHREAD) && defined(HAVE_THREAD_LOCAL)
+static void *	_allocs_thread(void *);
+
+static void *
+_allocs_thread(void *arg)
+{
+	unsigned long	*allocs = arg;
+	unsigned long	 n = xalloc_get_allocs();
+	int		 i;
+
+	for (i = 0; i < 10; i++)
+		xfree(xmalloc(1UL));
+	*allocs = xalloc_get_allocs() - n;
+
+	return (NULL);
+}
+#endif /* HAVE_PTHREAD && HAVE_THREAD_LOCAL */
+#ifdef HAVE_PTHREAD
+static void *	_profile_thread(void *);
+
+static void *
+_profile_thread(void *arg)
+{
+	int	i;
+
+	(void)arg;
+	for (i = 0; i < 100000; i++)
+		xfree(xreallocarray(xmalloc(16UL), 2UL, 16UL));
+
+	return (NULL);
+}
+#endif /* HAVE_PTHREAD */
 
 START_TEST(test_malloc)
 {
@@ -69,6 +109,147 @@ START_TEST(test_strdup)
 }
 END_TEST
 
+START_TEST(test_allocs)
+{
+	unsigned long	 n = xalloc_get_allocs();
+	char		*s;
+
+	s = xstrdup("test");
+	s = xreallocarray(s, 2UL, 5UL);
+	xfree(s);
+	s = xmalloc(1UL);
+	xfree(s);
+	ck_assert_uint_eq(xalloc_get_allocs() - n, 3);
+}
+END_TEST
+
+#if defined(HAVE_PTHREAD) && defined(HAVE_THREAD_LOCAL)
+START_TEST(test_allocs_threads)
+{
+	unsigned long	n = xalloc_get_allocs(), allocs = 0;
+	pthread_t	t;
+
+	/* Other threads do not count: */
+	ck_assert_int_eq(pthread_create(&t, NULL, _allocs_thread, &allocs),
+	    0);
+	ck_assert_int_eq(pthread_join(t, NULL), 0);
+	ck_assert_uint_eq(allocs, 10);
+	ck_assert_uint_eq(xalloc_get_allocs() - n, 0);
+}
+END_TEST
+#endif /* HAVE_PTHREAD && HAVE_THREAD_LOCAL */
+
+START_TEST(test_arena)
+{
+	xarena_t			 a;
+	const struct xarena_stats	*st;
+	unsigned long			 n;
+	char				*s, *big;
+	void				*p;
+
+	a = xarena_create(64UL);
+	st = xarena_get_stats(a);
+	ck_assert_uint_eq(st->capacity, 0);
+
+	s = xarena_strdup(a, "test");
+	ck_assert_str_eq(s, "test");
+	p = xarena_alloc(a, 1UL);
+	ck_assert_uint_eq((unsigned long)p % 16, 0);
+	p = xarena_alloc(a, 0UL);
+	ck_assert_ptr_ne(p, NULL);
+	big = xarena_alloc(a, 1000UL);
+	memset(big, 'x', 1000UL);
+	/* The oversized chunk does not replace the current one: */
+	p = xarena_alloc(a, 16UL);
+	ck_assert_ptr_eq(p, s + 48);
+	ck_assert_str_eq(s, "test");
+	ck_assert_uint_eq(st->allocs, 5);
+	ck_assert_uint_eq(st->bytes, 16 + 16 + 16 + 1008 + 16);
+	ck_assert_uint_eq(st->capacity, 64 + 1008);
+
+	/* Chunks are merged on reset, so the same round needs no more: */
+	xarena_reset(a);
+	ck_assert_uint_eq(st->resets, 1);
+	ck_assert_uint_eq(st->allocs, 0);
+	ck_assert_uint_eq(st->capacity, 64 + 1008);
+	ck_assert_uint_eq(st->peak, 16 + 16 + 16 + 1008 + 16);
+	n = xalloc_get_allocs();
+	(void)xarena_strdup(a, "test");
+	(void)xarena_alloc(a, 1000UL);
+	(void)xarena_alloc(a, 16UL);
+	ck_assert_uint_eq(xalloc_get_allocs() - n, 0);
+
+	xarena_destroy(&a);
+	ck_assert_ptr_eq(a, NULL);
+	xarena_destroy(&a);
+}
+END_TEST
+
+START_TEST(test_profile)
+{
+	struct xalloc_site	 sites[4], total;
+	void			*ptrs[3000];
+	char			*s;
+	unsigned int		 line, i;
+
+	ck_assert_uint_eq(xalloc_profile_get_sites(sites, 4, &total), 0);
+	s = xstrdup("allocated before");
+	xalloc_profile_set(1);
+	ck_assert_int_eq(xalloc_profile_get(), 1);
+
+	line = __LINE__ + 2;
+	for (i = 0; i < 3000; i++)
+		ptrs[i] = xmalloc(16UL);
+	for (i = 0; i < 3000; i += 2)
+		xfree(ptrs[i]);
+	xfree(s);
+	s = xstrdup("test");
+	s = xreallocarray(s, 1UL, 100000UL);
+
+	ck_assert_uint_eq(xalloc_profile_get_sites(sites, 4, &total), 3);
+	ck_assert_uint_eq(total.allocs, 3002);
+	ck_assert_uint_eq(total.live, 1501);
+	ck_assert_uint_eq(total.live_bytes, 1500 * 16 + 100000);
+	ck_assert_uint_eq(sites[0].live_bytes, 100000);
+	ck_assert_uint_eq(sites[1].line, line);
+	ck_assert_uint_eq(sites[1].allocs, 3000);
+	ck_assert_uint_eq(sites[1].live, 1500);
+	ck_assert_uint_eq(sites[1].bytes, 3000 * 16);
+	ck_assert_uint_eq(sites[2].live, 0);
+	ck_assert_uint_eq(sites[2].bytes, strlen("test") + 1);
+
+	for (i = 1; i < 3000; i += 2)
+		xfree(ptrs[i]);
+	xfree(s);
+	ck_assert_uint_eq(xalloc_profile_get_sites(sites, 1, &total), 1);
+	ck_assert_uint_eq(total.live, 0);
+	ck_assert_uint_eq(total.live_bytes, 0);
+	xalloc_profile_dump(10);
+
+	xalloc_profile_set(0);
+	ck_assert_int_eq(xalloc_profile_get(), 0);
+	ck_assert_uint_eq(xalloc_profile_get_sites(sites, 4, NULL), 0);
+}
+END_TEST
+
+#ifdef HAVE_PTHREAD
+START_TEST(test_profile_threads)
+{
+	struct xalloc_site	sites[4];
+	pthread_t		t;
+	int			i;
+
+	/* Toggled while another thread allocates: */
+	ck_assert_int_eq(pthread_create(&t, NULL, _profile_thread, NULL), 0);
+	for (i = 0; i < 1000; i++)
+		xalloc_profile_set(i % 2 == 0);
+	ck_assert_int_eq(pthread_join(t, NULL), 0);
+	ck_assert_int_eq(xalloc_profile_get(), 0);
+	ck_assert_uint_eq(xalloc_profile_get_sites(sites, 4, NULL), 0);
+}
+END_TEST
+#endif /* HAVE_PTHREAD */
+
 Suite *
 xalloc_suite(void)
 {
@@ -82,6 +263,15 @@ xalloc_suite(void)
 	tcase_add_test(tc_xalloc, test_calloc);
 	tcase_add_test(tc_xalloc, test_reallocarray);
 	tcase_add_test(tc_xalloc, test_strdup);
+	tcase_add_test(tc_xalloc, test_allocs);
+#if defined(HAVE_PTHREAD) && defined(HAVE_THREAD_LOCAL)
+	tcase_add_test(tc_xalloc, test_allocs_threads);
+#endif /* HAVE_PTHREAD && HAVE_THREAD_LOCAL */
+	tcase_add_test(tc_xalloc, test_arena);
+	tcase_add_test(tc_xalloc, test_profile);
+#ifdef HAVE_PTHREAD
+	tcase_add_test(tc_xalloc, test_profile_threads);
+#endif /* HAVE_PTHREAD */
 	suite_add_tcase(s, tc_xalloc);
 
 	return (s);
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2026 Moritz Grimm <mgrimm@mrsserver.net>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/*
+ * plugin_raw: decoder and encoder plugin for raw 16-bit signed
+ * little-endian stereo audio at 44.1 kHz, for testing the plugin interface.
+ * The encoder starts each stream with a RAW_HEADER, and ends it with a
+ * RAW_TRAILER when drained.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ezstream_plugin.h"
+
+#define RAW_HEADER	"RAW\n"
+#define RAW_TRAILER	"END\n"
+#define RAW_FRAMES	4096
+
+struct raw_encoder {
+	int		header;
+	int		trailer;
+	unsigned char	buf[sizeof(RAW_HEADER) + RAW_FRAMES * 4];
+};
+
+extern const struct ezstream_decoder_plugin	ezstream_decoder_plugin;
+extern const struct ezstream_encoder_plugin	ezstream_encoder_plugin;
+
+static void *	_raw_open(const char *, struct ezstream_pcm_format *);
+static long	_raw_decode(void *, float *, size_t);
+static void	_raw_close(void *);
+static void *	_raw_enc_open(const struct ezstream_pcm_format *);
+static long	_raw_enc_encode(void *, const float *, size_t,
+		    const unsigned char **);
+static long	_raw_enc_drain(void *, const unsigned char **);
+static void	_raw_enc_close(void *);
+
+const struct ezstream_decoder_plugin	ezstream_decoder_plugin = {
+	EZSTREAM_PLUGIN_ABI_VERSION,
+	"raw",
+	_raw_open,
+	_raw_decode,
+	_raw_close
+};
+
+const struct ezstream_encoder_plugin	ezstream_encoder_plugin = {
+	EZSTREAM_PLUGIN_ABI_VERSION,
+	"raw",
+	_raw_enc_open,
+	_raw_enc_encode,
+	_raw_enc_drain,
+	_raw_enc_close
+};
+
+static void *
+_raw_open(const char *path, struct ezstream_pcm_format *fmt)
+{
+	FILE	*fp;
+
+	if (NULL == (fp = fopen(path, "rb")))
+		return (NULL);
+	fmt->rate = 44100;
+	fmt->channels = 2;
+
+	return (fp);
+}
+
+static long
+_raw_decode(void *handle, float *pcm, size_t frames)
+{
+	unsigned char	 buf[4096];
+	size_t		 n, i;
+
+	if (frames > sizeof(buf) / 4)
+		frames = sizeof(buf) / 4;
+	n = fread(buf, 4, frames, (FILE *)handle);
+	for (i = 0; i < n * 2; i++) {
+		int	s = buf[2 * i] | (buf[2 * i + 1] << 8);
+
+		if (s >= 0x8000)
+			s -= 0x10000;
+		pcm[i] = (float)s / 32768.0f;
+	}
+
+	return ((long)n);
+}
+
+static void
+_raw_close(void *handle)
+{
+	fclose((FILE *)handle);
+}
+
+static void *
+_raw_enc_open(const struct ezstream_pcm_format *fmt)
+{
+	struct raw_encoder	*e;
+
+	if (2 != fmt->channels)
+		return (NULL);
+	if (NULL == (e = calloc(1, sizeof(*e))))
+		return (NULL);
+	e->header = 1;
+	e->trailer = 1;
+
+	return (e);
+}
+
+static long
+_raw_enc_encode(void *handle, const float *pcm, size_t frames,
+    const unsigned char **out)
+{
+	struct raw_encoder	*e = handle;
+	size_t			 len = 0, i;
+
+	if (e->header) {
+		memcpy(e->buf, RAW_HEADER, strlen(RAW_HEADER));
+		len = strlen(RAW_HEADER);
+		e->header = 0;
+	}
+	if (frames > RAW_FRAMES)
+		return (-1);
+	for (i = 0; i < frames * 2; i++) {
+		float	f = pcm[i] * 32768.0f;
+		long	s = (long)(f < 0.0f ? f - 0.5f : f + 0.5f);
+
+		if (s > 32767)
+			s = 32767;
+		if (s < -32768)
+			s = -32768;
+		e->buf[len++] = (unsigned char)(s & 0xff);
+		e->buf[len++] = (unsigned char)((s >> 8) & 0xff);
+	}
+	*out = e->buf;
+
+	return ((long)len);
+}
+
+static long
+_raw_enc_drain(void *handle, const unsigned char **out)
+{
+	struct raw_encoder	*e = handle;
+
+	if (!e->trailer)
+		return (0);
+	memcpy(e->buf, RAW_TRAILER, strlen(RAW_TRAILER));
+	e->trailer = 0;
+	*out = e->buf;
+
+	return ((long)strlen(RAW_TRAILER));
+}
+
+static void
+_raw_enc_close(void *handle)
+{
+	free(handle);
+}